@@ -0,0 +1,42 @@
+#include <stdatomic.h>
+#include "alloc_count.h"
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static atomic_size_t allocs;
+static atomic_size_t frees;
+static atomic_size_t bytes;
+
+void *malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&bytes, size, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&bytes, n * size, memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&bytes, size, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    if (ptr != NULL) {
+        atomic_fetch_add_explicit(&frees, 1, memory_order_relaxed);
+    }
+    __libc_free(ptr);
+}
+
+void alloc_count_get(alloc_count_t *out) {
+    out->allocs = atomic_load(&allocs);
+    out->frees = atomic_load(&frees);
+    out->bytes = atomic_load(&bytes);
+}
@@ -0,0 +1,17 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <stddef.h>
+
+// Counts heap calls made by the process (glibc only), so benchmarks can
+// report allocations per operation.
+
+typedef struct {
+    size_t allocs;              // malloc, calloc and realloc calls
+    size_t frees;
+    size_t bytes;               // Bytes requested
+} alloc_count_t;
+
+void alloc_count_get(alloc_count_t *out);
+
+#endif // ALLOC_COUNT_H
@@ -0,0 +1,418 @@
+// Benchmarks of the firmware hot paths, run against the host build.
+//
+//   cmake -S host -B build-host && cmake --build build-host
+//   build-host/bench [--min-time ms] [--filter substring] [--label name] > bench.json
+//   tools/bench_compare.py baseline.json bench.json
+//
+// Each case runs until it has taken --min-time (default 200 ms), doubling the
+// iteration count. Results go to stdout as one JSON document; a table goes to
+// stderr.
+//
+// Built with CONFIG_DLOG_DEFERRED, so DLOGI here records into the dlog ring.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "alloc_count.h"
+#include "fixtures.h"
+#include "bthome_observer.h"
+#include "dlog.h"
+#include "esp_http_server.h"
+#include "http_server.h"
+#include "mqtt_payload.h"
+#include "sensors.h"
+#include "settings_json.h"
+#include "settings_page.h"
+#include "settings_schema.h"
+#include "weight_filter.h"
+#include "sim/sim.h"
+#include "station_host.h"
+
+// Three sensors each; they register on their first packet, after the 500
+// sensors of the registry cases, and SENSORS_MAX_COUNT is 512
+#define BLE_DEVICES 4
+
+// Iterations between drain() calls, few enough that the records of a batch
+// fit in the dlog ring
+#define DRAIN_BATCH 32
+
+static const char *TAG = "bench";
+
+typedef struct {
+    const char *name;
+    int param;                  // Sensor count for the registry cases, else 0
+    void (*setup)(int param);
+    void (*run)(void);
+    void (*drain)(void);        // Untimed, every DRAIN_BATCH iterations, if set
+} bench_case_t;
+
+typedef struct {
+    size_t bytes;
+} sink_t;
+
+static httpd_handle_t server;
+static settings_t settings;
+static settings_page_t page;
+static char scratch[1024];
+static char form_body[8192];
+static char form_copy[sizeof(form_body)];
+static char json_body[8192];
+static char json_copy[sizeof(json_body)];
+static size_t json_len;
+static settings_update_t update;
+static char payload[1024];
+static int next_sensor;
+static size_t next_device;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static esp_err_t sink_write(void *arg, const char *data, size_t len) {
+    ((sink_t *)arg)->bytes += len;
+    return ESP_OK;
+}
+
+// Same output as metrics_handler for the sensor section, which is the part
+// that grows with the sensor count
+static esp_err_t metrics_handler(httpd_req_t *req) {
+    char buf[2048];
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    http_chunk_writer_t w;
+    http_chunk_writer_init(&w, req, buf, sizeof(buf));
+    sensors_write_metrics(&w, settings.hostname);
+    return http_chunk_writer_finish(&w);
+}
+
+// Registers weight-style sensors until there are count of them, each with a
+// value so every exporter writes it
+static void sensors_setup(int count) {
+    char name[SENSOR_DISPLAY_NAME_MAX_LEN];
+    char device[SENSOR_DEVICE_NAME_MAX_LEN];
+    while (sensors_get_count() < count) {
+        int n = sensors_get_count();
+        snprintf(name, sizeof(name), "Room %d Temperature", n);
+        snprintf(device, sizeof(device), "Room %d", n);
+        int id = sensors_register(name, "°C", "temperature", device, "A4:C1:38:00:00:00");
+        if (id < 0) {
+            fprintf(stderr, "sensor registry full at %d\n", n);
+            exit(1);
+        }
+        sensors_update(id, 20.0f + (float)(n % 100) / 10.0f, true);
+    }
+}
+
+static void run_metrics(void) {
+    httpd_host_request(server, HTTP_GET, "/metrics", NULL, NULL);
+}
+
+static void run_sensors_data(void) {
+    httpd_host_request(server, HTTP_GET, "/sensors/data", NULL, NULL);
+}
+
+// One reading into the registry, cycling through every sensor
+static void run_sensors_update(void) {
+    int id = next_sensor++ % sensors_get_count();
+    sensors_update(id, 20.0f + (float)(next_sensor % 100) / 10.0f, true);
+}
+
+static void run_mqtt_payload(void) {
+    int id = next_sensor++ % sensors_get_count();
+    sensor_state_t state;
+    sensors_get_state(id, &state);
+    mqtt_payload_sensor(payload, sizeof(payload), settings.hostname, sensors_get_info(id), &state);
+}
+
+static void run_bthome_packet(void) {
+    sim_ble_deliver(next_device++ % BLE_DEVICES);
+}
+
+// The per-advertisement line of bthome_frame_callback, as ESP_LOGI would
+// format it before writing it out
+static void run_log_esp_format(void) {
+    static const uint8_t addr[6] = { 0xA4, 0xC1, 0x38, 0x01, 0x00, 0x01 };
+    char mac[18];
+    snprintf(payload, sizeof(payload), "I (%" PRIu32 ") %s: BTHome packet from %s (RSSI: %d dBm)\n",
+             esp_log_timestamp(), TAG, dlog_mac_str(addr, mac), -67);
+}
+
+// The same line through DLOGI: the cost on the hot path
+static void run_log_dlog_record(void) {
+    static const uint8_t addr[6] = { 0xA4, 0xC1, 0x38, 0x01, 0x00, 0x01 };
+    DLOGI(TAG, "BTHome packet from %s (RSSI: %d dBm)", DLOG_MAC(addr), -67);
+}
+
+static void run_weight_median(void) {
+    static const int32_t raw[CONFIG_WEIGHT_SAMPLE_TIMES] = {
+        150012, 149987, 150003, 150110, 149950, 150021, 149998, 150007, 149890, 150015,
+    };
+    int32_t samples[CONFIG_WEIGHT_SAMPLE_TIMES];
+    memcpy(samples, raw, sizeof(samples));
+    volatile int32_t median = weight_filter_median(samples, CONFIG_WEIGHT_SAMPLE_TIMES);
+    (void)median;
+}
+
+static void run_settings_render(void) {
+    sink_t sink = { 0 };
+    settings_page_render(&page, sink_write, &sink, scratch, sizeof(scratch));
+}
+
+static void run_settings_form(void) {
+    // Parsing decodes in place
+    strcpy(form_copy, form_body);
+    settings_update_init(&update);
+    settings_update_parse_form(&update, form_copy);
+    settings_update_changes(&update, &settings);
+}
+
+static void run_settings_json(void) {
+    memcpy(json_copy, json_body, json_len + 1);
+    settings_update_init(&update);
+    settings_update_parse_json(&update, json_copy, json_len);
+    settings_update_changes(&update, &settings);
+}
+
+// Appends key=value to the form body, percent-encoding the value
+static void form_add(size_t *len, const char *key, const char *value) {
+    *len += snprintf(form_body + *len, sizeof(form_body) - *len, "%s%s=", *len ? "&" : "", key);
+    for (const unsigned char *p = (const unsigned char *)value; *p != '\0' && *len + 4 < sizeof(form_body); p++) {
+        if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') ||
+            *p == '-' || *p == '.' || *p == '_') {
+            form_body[(*len)++] = (char)*p;
+        } else {
+            *len += snprintf(form_body + *len, sizeof(form_body) - *len, "%%%02X", *p);
+        }
+    }
+    form_body[*len] = '\0';
+}
+
+// The body the settings form posts for the fixture settings
+static void build_form_body(void) {
+    size_t len = 0;
+    char buf[32], key[48];
+    for (size_t i = 0; i < SETTING_FIELD_COUNT; i++) {
+        const char *value = setting_format(&settings, &settings_schema[i], buf, sizeof(buf));
+        form_add(&len, settings_schema[i].key, value != NULL ? value : "");
+    }
+    snprintf(buf, sizeof(buf), "%zu", settings.selected_bthome_object_ids_count);
+    form_add(&len, "bthome_objects_count", buf);
+    for (size_t i = 0; i < settings.selected_bthome_object_ids_count; i++) {
+        snprintf(key, sizeof(key), "bthome_objects[%zu]", i);
+        snprintf(buf, sizeof(buf), "%u", settings.selected_bthome_object_ids[i]);
+        form_add(&len, key, buf);
+    }
+    snprintf(buf, sizeof(buf), "%zu", settings.mac_filters_count);
+    form_add(&len, "mac_filter_count", buf);
+    for (size_t i = 0; i < settings.mac_filters_count; i++) {
+        const mac_filter_t *f = &settings.mac_filters[i];
+        snprintf(key, sizeof(key), "mac_filter[%zu][mac]", i);
+        snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", f->mac_addr[0], f->mac_addr[1],
+                 f->mac_addr[2], f->mac_addr[3], f->mac_addr[4], f->mac_addr[5]);
+        form_add(&len, key, buf);
+        snprintf(key, sizeof(key), "mac_filter[%zu][name]", i);
+        form_add(&len, key, f->name);
+        if (f->enabled) {
+            snprintf(key, sizeof(key), "mac_filter[%zu][enabled]", i);
+            form_add(&len, key, "on");
+        }
+        // Bindkeys share the row of the filter with the same MAC
+        for (size_t k = 0; k < settings.bthome_bindkeys_count; k++) {
+            if (memcmp(settings.bthome_bindkeys[k].mac_addr, f->mac_addr, 6) != 0) {
+                continue;
+            }
+            char hex[2 * BTHOME_BINDKEY_LEN + 1];
+            for (int j = 0; j < BTHOME_BINDKEY_LEN; j++) {
+                snprintf(&hex[2 * j], 3, "%02x", settings.bthome_bindkeys[k].key[j]);
+            }
+            snprintf(key, sizeof(key), "mac_filter[%zu][key]", i);
+            form_add(&len, key, hex);
+        }
+    }
+    snprintf(buf, sizeof(buf), "%zu", settings.ds18b20_names_count);
+    form_add(&len, "ds18b20_name_count", buf);
+    for (size_t i = 0; i < settings.ds18b20_names_count; i++) {
+        snprintf(key, sizeof(key), "ds18b20_name[%zu][address]", i);
+        snprintf(buf, sizeof(buf), "%016llX", (unsigned long long)settings.ds18b20_names[i].address);
+        form_add(&len, key, buf);
+        snprintf(key, sizeof(key), "ds18b20_name[%zu][name]", i);
+        form_add(&len, key, settings.ds18b20_names[i].name);
+    }
+}
+
+static esp_err_t json_sink(void *arg, const char *data, size_t len) {
+    if (json_len + len >= sizeof(json_body)) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(json_body + json_len, data, len);
+    json_len += len;
+    json_body[json_len] = '\0';
+    return ESP_OK;
+}
+
+static void settings_setup(int param) {
+    settings_update_init(&update);
+    strcpy(form_copy, form_body);
+    settings_update_parse_form(&update, form_copy);
+    if (update.error != NULL) {
+        fprintf(stderr, "form body rejected at %s\n", update.error);
+        exit(1);
+    }
+    settings_update_init(&update);
+    memcpy(json_copy, json_body, json_len + 1);
+    if (!settings_update_parse_json(&update, json_copy, json_len) || update.error != NULL) {
+        fprintf(stderr, "JSON body rejected at %s\n", update.error ? update.error : "(syntax)");
+        exit(1);
+    }
+}
+
+static void no_setup(int param) {
+}
+
+static const bench_case_t cases[] = {
+    { "metrics_render", 10, sensors_setup, run_metrics, NULL },
+    { "sensors_data_json", 10, sensors_setup, run_sensors_data, NULL },
+    { "metrics_render", 60, sensors_setup, run_metrics, NULL },
+    { "sensors_data_json", 60, sensors_setup, run_sensors_data, NULL },
+    { "metrics_render", 500, sensors_setup, run_metrics, NULL },
+    { "sensors_data_json", 500, sensors_setup, run_sensors_data, NULL },
+    { "sensors_update", 500, sensors_setup, run_sensors_update, NULL },
+    { "mqtt_sensor_payload", 0, no_setup, run_mqtt_payload, NULL },
+    { "weight_median", 0, no_setup, run_weight_median, NULL },
+    { "settings_render", 0, no_setup, run_settings_render, NULL },
+    { "settings_parse_form", 0, settings_setup, run_settings_form, NULL },
+    { "settings_parse_json", 0, settings_setup, run_settings_json, NULL },
+    { "bthome_packet", 0, no_setup, run_bthome_packet, NULL },
+    { "log_esp_format", 0, no_setup, run_log_esp_format, NULL },
+    { "log_dlog_record", 0, no_setup, run_log_dlog_record, dlog_flush },
+};
+
+static void setup_station(void) {
+    // The sensor pipeline: registry, HTTP handlers and the BTHome observer,
+    // fed by simulated devices that only send when asked
+    static mac_filter_t filters[BLE_DEVICES];
+    static sim_ble_device_t ble[BLE_DEVICES];
+    static uint8_t object_ids[] = { 0x01, 0x02, 0x03 };
+    static settings_t station = {
+        .hostname = "station-bench",
+        .selected_bthome_object_ids = object_ids,
+        .selected_bthome_object_ids_count = sizeof(object_ids),
+        .mac_filters = filters,
+        .mac_filters_count = BLE_DEVICES,
+    };
+    for (int i = 0; i < BLE_DEVICES; i++) {
+        uint8_t addr[6] = { 0xA4, 0xC1, 0x38, 0x01, 0x00, (uint8_t)i };
+        memcpy(filters[i].mac_addr, addr, 6);
+        snprintf(filters[i].name, sizeof(filters[i].name), "Bench %d", i);
+        filters[i].enabled = true;
+        memcpy(ble[i].addr, addr, 6);
+        ble[i].name = "ATC_BENCH";
+        ble[i].repeats = 1;
+        ble[i].celsius = 20.0f;
+        ble[i].humidity = 50.0f;
+        ble[i].battery = 90;
+    }
+    sim_ble_configure(ble, BLE_DEVICES);
+
+    station_host_init(&station);
+    if (dlog_init() != ESP_OK) {
+        exit(1);
+    }
+    server = httpd_host_start();
+    httpd_uri_t metrics_uri = { .uri = "/metrics", .method = HTTP_GET, .handler = metrics_handler };
+    httpd_register_uri_handler(server, &metrics_uri);
+    sensors_init(&station, server);
+    bthome_observer_init(&station, server);
+
+    // The settings page and parsers use the fully configured fixture
+    fixture_settings(&settings);
+    fixture_settings_page(&page, &settings);
+    build_form_body();
+    settings_json_write(&settings, json_sink, NULL);
+}
+
+int main(int argc, char **argv) {
+    long min_time_ms = 200;
+    const char *filter = NULL;
+    const char *label = "";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time_ms = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+            label = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--min-time ms] [--filter substring] [--label name]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    setup_station();
+
+    printf("{\"label\":\"%s\",\"results\":[", label);
+    bool first = true;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const bench_case_t *bc = &cases[c];
+        char name[64];
+        if (bc->param != 0) {
+            snprintf(name, sizeof(name), "%s/%d", bc->name, bc->param);
+        } else {
+            snprintf(name, sizeof(name), "%s", bc->name);
+        }
+        if (filter != NULL && strstr(name, filter) == NULL) {
+            continue;
+        }
+
+        bc->setup(bc->param);
+        bc->run();              // Warm up caches and one-time registrations
+
+        long iterations = 1;
+        uint64_t elapsed;
+        alloc_count_t before, after;
+        while (true) {
+            alloc_count_get(&before);
+            elapsed = 0;
+            for (long done = 0; done < iterations; ) {
+                long batch = iterations - done;
+                if (bc->drain != NULL && batch > DRAIN_BATCH) {
+                    batch = DRAIN_BATCH;
+                }
+                uint64_t start = now_ns();
+                for (long i = 0; i < batch; i++) {
+                    bc->run();
+                }
+                elapsed += now_ns() - start;
+                done += batch;
+                if (bc->drain != NULL) {
+                    bc->drain();
+                }
+            }
+            alloc_count_get(&after);
+            if (elapsed >= (uint64_t)min_time_ms * 1000000u || iterations >= (1L << 30)) {
+                break;
+            }
+            iterations *= 2;
+        }
+
+        double us_per_op = (double)elapsed / 1000.0 / iterations;
+        double allocs_per_op = (double)(after.allocs - before.allocs) / iterations;
+        double bytes_per_op = (double)(after.bytes - before.bytes) / iterations;
+        printf("%s\n  {\"name\":\"%s\",\"iterations\":%ld,\"us_per_op\":%.4f,"
+               "\"allocs_per_op\":%.3f,\"alloc_bytes_per_op\":%.1f}",
+               first ? "" : ",", name, iterations, us_per_op, allocs_per_op, bytes_per_op);
+        fprintf(stderr, "%-24s %10ld iters %12.3f us/op %8.2f allocs/op %10.1f B/op\n",
+                name, iterations, us_per_op, allocs_per_op, bytes_per_op);
+        first = false;
+    }
+    printf("\n]}\n");
+    dlog_stats_t dlog;
+    dlog_get_stats(&dlog);
+    fprintf(stderr, "%d sensors registered, %llu BTHome packets, %lu dlog records (%lu dropped)\n",
+            sensors_get_count(), (unsigned long long)sim_ble_adverts(),
+            (unsigned long)dlog.records, (unsigned long)dlog.dropped);
+    return 0;
+}
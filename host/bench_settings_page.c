@@ -0,0 +1,92 @@
+// Render time and heap use of the settings page (main/www/settings.html)
+//
+//   cmake -S host -B build-host && cmake --build build-host
+//   build-host/bench_settings_page [iterations] [--dump page.html]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "alloc_count.h"
+#include "fixtures.h"
+#include "settings_page.h"
+
+typedef struct {
+    FILE *dump;
+    size_t bytes;
+    size_t chunks;
+} sink_t;
+
+static esp_err_t sink_write(void *arg, const char *data, size_t len) {
+    sink_t *sink = (sink_t *)arg;
+    sink->bytes += len;
+    sink->chunks++;
+    if (sink->dump != NULL) {
+        fwrite(data, 1, len, sink->dump);
+    }
+    return ESP_OK;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    long iterations = 20000;
+    const char *dump_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dump_path = argv[++i];
+        } else {
+            iterations = strtol(argv[i], NULL, 10);
+        }
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations] [--dump page.html]\n", argv[0]);
+        return 2;
+    }
+
+    settings_t settings;
+    settings_page_t page;
+    char scratch[1024];
+    fixture_settings(&settings);
+    fixture_settings_page(&page, &settings);
+
+    sink_t sink = { 0 };
+    if (dump_path != NULL) {
+        sink.dump = fopen(dump_path, "w");
+        if (sink.dump == NULL) {
+            perror(dump_path);
+            return 1;
+        }
+    }
+    if (settings_page_render(&page, sink_write, &sink, scratch, sizeof(scratch)) != ESP_OK) {
+        fprintf(stderr, "render failed\n");
+        return 1;
+    }
+    if (sink.dump != NULL) {
+        fclose(sink.dump);
+        sink.dump = NULL;
+    }
+    size_t page_bytes = sink.bytes;
+    size_t page_chunks = sink.chunks;
+
+    alloc_count_t before, after;
+    alloc_count_get(&before);
+    uint64_t start = now_ns();
+    for (long i = 0; i < iterations; i++) {
+        settings_page_render(&page, sink_write, &sink, scratch, sizeof(scratch));
+    }
+    uint64_t elapsed = now_ns() - start;
+    alloc_count_get(&after);
+
+    printf("settings_page_render: %ld iterations, %.0f ns/op, %.2f allocs/op, %.1f alloc bytes/op, "
+           "%zu bytes/page, %zu chunks/page\n",
+           iterations, (double)elapsed / iterations,
+           (double)(after.allocs - before.allocs) / iterations,
+           (double)(after.bytes - before.bytes) / iterations,
+           page_bytes, page_chunks);
+    return 0;
+}
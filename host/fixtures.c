@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+#include "fixtures.h"
+
+// A fully configured station: every list near what the page is used with
+static mac_filter_t mac_filters[16];
+static bthome_bindkey_t bindkeys[8];
+static ds18b20_name_t ds18b20_names[8];
+static uint8_t object_ids[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x0C, 0x12, 0x2E, 0x3A, 0x40, 0x45, 0x57 };
+const uint64_t fixture_ds18b20_detected[FIXTURE_DS18B20_DETECTED] = {
+    0x28FF641E8416043AULL, 0x28FF641E84160441ULL, 0x28FF641E84160448ULL,
+    0x28FF641E8416044FULL, 0x28FF641E84160456ULL,
+};
+
+void fixture_settings(settings_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->hostname = "station-kitchen";
+    s->update_url = "https://updates.example.com/station/firmware.bin";
+    s->timezone = "EST5EDT,M3.2.0,M11.1.0";
+    s->wifi_ssid = "Bob's <Home> & Garden";
+    s->syslog_server = "syslog.example.com";
+    s->syslog_port = 6514;
+    s->syslog_transport = SYSLOG_TRANSPORT_TLS;
+    s->mqtt_broker_url = "mqtts://broker.example.com:8883";
+    s->mqtt_username = "station";
+    s->mqtt_password = "p@ss'word\"&";
+    s->mqtt_topic = "station/sensor";
+    s->mqtt_status_topic = "station/status";
+    s->weight_tare = -12345;
+    s->weight_scale = _IQ16(0.0123);
+    s->weight_gain = HX711_GAIN_A_64;
+    s->weight_dt_gpio = 32;
+    s->weight_sck_gpio = 26;
+    s->pump_scl_gpio = 22;
+    s->pump_sda_gpio = 21;
+    s->pump_i2c_addr = 103;
+    s->pump_dispense_ml = 250;
+    s->ds18b20_gpio = 4;
+    s->ds18b20_pwr_gpio = -1;
+
+    for (size_t i = 0; i < 16; i++) {
+        uint8_t mac[6] = { 0xA4, 0xC1, 0x38, 0x10, 0x20, (uint8_t)i };
+        memcpy(mac_filters[i].mac_addr, mac, 6);
+        snprintf(mac_filters[i].name, sizeof(mac_filters[i].name), "Room %zu thermometer", i);
+        mac_filters[i].enabled = i % 3 != 0;
+        if (i < 8) {
+            memcpy(bindkeys[i].mac_addr, mac, 6);
+            for (int j = 0; j < BTHOME_BINDKEY_LEN; j++) {
+                bindkeys[i].key[j] = (uint8_t)(i * 16 + j);
+            }
+        }
+    }
+    s->mac_filters = mac_filters;
+    s->mac_filters_count = 16;
+    s->bthome_bindkeys = bindkeys;
+    s->bthome_bindkeys_count = 8;
+
+    // Three of the detected sensors are named, plus five that are unplugged
+    for (size_t i = 0; i < 8; i++) {
+        ds18b20_names[i].address = i < 3 ? fixture_ds18b20_detected[i] : 0x28AA000000000000ULL + i;
+        snprintf(ds18b20_names[i].name, sizeof(ds18b20_names[i].name), "Probe %zu", i);
+    }
+    s->ds18b20_names = ds18b20_names;
+    s->ds18b20_names_count = 8;
+
+    s->selected_bthome_object_ids = object_ids;
+    s->selected_bthome_object_ids_count = sizeof(object_ids);
+}
+
+void fixture_settings_page(settings_page_t *page, const settings_t *s) {
+    memset(page, 0, sizeof(*page));
+    page->settings = s;
+    page->ds18b20_detected = fixture_ds18b20_detected;
+    page->ds18b20_detected_count = FIXTURE_DS18B20_DETECTED;
+    page->ota_status = "";
+    page->mqtt_error = "Connection refused";
+    page->pump_error = NULL;
+    page->firmware_version = "1.4.0";
+    page->firmware_hash = "0123456789abcdef";
+    page->css_url = "/static/settings.css?v=0123456789abcdef";
+    page->js_url = "/static/settings.js?v=0123456789abcdef";
+}
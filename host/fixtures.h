@@ -0,0 +1,26 @@
+#ifndef FIXTURES_H
+#define FIXTURES_H
+
+#include <stdint.h>
+#include "settings.h"
+#include "settings_page.h"
+
+// Shared test data for the host benchmarks
+
+#define FIXTURE_DS18B20_DETECTED 5
+
+extern const uint64_t fixture_ds18b20_detected[FIXTURE_DS18B20_DETECTED];
+
+/**
+ * @brief A fully configured station: every list near what the page is used with
+ *
+ * The lists are static, so s is only valid until the next call.
+ */
+void fixture_settings(settings_t *s);
+
+/**
+ * @brief The settings page for s, with the fixture's detected DS18B20s
+ */
+void fixture_settings_page(settings_page_t *page, const settings_t *s);
+
+#endif // FIXTURES_H
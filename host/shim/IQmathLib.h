@@ -0,0 +1,14 @@
+#ifndef HOST_IQMATHLIB_H
+#define HOST_IQMATHLIB_H
+
+#include <stdint.h>
+
+// Host stand-in for the Q16 part of espressif/iqmath
+
+typedef int32_t _iq16;
+
+#define _IQ16(x)        ((_iq16)((x) * 65536.0))
+#define _IQ16toF(x)     ((float)(x) / 65536.0f)
+#define _IQ16int(x)     ((x) >> 16)
+
+#endif // HOST_IQMATHLIB_H
@@ -0,0 +1,69 @@
+#include <stddef.h>
+#include "bthome.h"
+
+// Subset of the BTHome v2 object table, enough to render the settings page
+// and exercise the decoder paths on the host.
+static const struct {
+    const char *name;
+    const char *unit;
+} objects[256] = {
+    [0x01] = { "battery", "percent" },
+    [0x02] = { "temperature", "degrees_celsius" },
+    [0x03] = { "humidity", "percent" },
+    [0x04] = { "pressure", "hectopascals" },
+    [0x05] = { "illuminance", "lux" },
+    [0x06] = { "mass", "kilograms" },
+    [0x07] = { "mass", "pounds" },
+    [0x08] = { "dewpoint", "degrees_celsius" },
+    [0x09] = { "count", "" },
+    [0x0A] = { "energy", "kilowatt_hours" },
+    [0x0B] = { "power", "watts" },
+    [0x0C] = { "voltage", "volts" },
+    [0x0D] = { "pm2_5", "micrograms_per_cubic_meter" },
+    [0x0E] = { "pm10", "micrograms_per_cubic_meter" },
+    [0x0F] = { "generic_boolean", "" },
+    [0x10] = { "power_on", "" },
+    [0x11] = { "opening", "" },
+    [0x12] = { "co2", "ppm" },
+    [0x13] = { "tvoc", "micrograms_per_cubic_meter" },
+    [0x14] = { "moisture", "percent" },
+    [0x15] = { "battery_low", "" },
+    [0x16] = { "battery_charging", "" },
+    [0x1A] = { "door", "" },
+    [0x1E] = { "light", "" },
+    [0x21] = { "motion", "" },
+    [0x2C] = { "vibration", "" },
+    [0x2D] = { "window", "" },
+    [0x2E] = { "humidity", "percent" },
+    [0x2F] = { "moisture", "percent" },
+    [0x3A] = { "button", "" },
+    [0x3C] = { "dimmer", "" },
+    [0x3D] = { "count", "" },
+    [0x3F] = { "rotation", "degrees" },
+    [0x40] = { "distance", "millimeters" },
+    [0x41] = { "distance", "meters" },
+    [0x42] = { "duration", "seconds" },
+    [0x43] = { "current", "amperes" },
+    [0x44] = { "speed", "meters_per_second" },
+    [0x45] = { "temperature", "degrees_celsius" },
+    [0x46] = { "uv_index", "" },
+    [0x47] = { "volume", "liters" },
+    [0x48] = { "volume", "milliliters" },
+    [0x49] = { "volume_flow_rate", "cubic_meters_per_hour" },
+    [0x4A] = { "voltage", "volts" },
+    [0x4B] = { "gas", "cubic_meters" },
+    [0x4D] = { "energy", "kilowatt_hours" },
+    [0x4F] = { "water", "liters" },
+    [0x51] = { "acceleration", "meters_per_second_squared" },
+    [0x52] = { "gyroscope", "degrees_per_second" },
+    [0x57] = { "temperature", "degrees_celsius" },
+    [0x58] = { "temperature", "degrees_celsius" },
+};
+
+const char *bthome_get_object_name(uint8_t object_id) {
+    return objects[object_id].name;
+}
+
+const char *bthome_get_object_unit(uint8_t object_id) {
+    return objects[object_id].name != NULL ? objects[object_id].unit : NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef HOST_BTHOME_H
+#define HOST_BTHOME_H
+
+#include <stdint.h>
+
+// Host stand-in for the bthome component's object table (see bthome.c)
+
+// Object IDs
+#define BTHOME_SENSOR_BATTERY               0x01
+#define BTHOME_SENSOR_TEMPERATURE           0x02
+#define BTHOME_SENSOR_HUMIDITY              0x03
+#define BTHOME_SENSOR_PRESSURE              0x04
+#define BTHOME_SENSOR_ILLUMINANCE           0x05
+#define BTHOME_SENSOR_DEWPOINT              0x08
+#define BTHOME_BINARY_VIBRATION             0x2C
+#define BTHOME_EVENT_BUTTON                 0x3A
+#define BTHOME_EVENT_DIMMER                 0x3C
+#define BTHOME_SENSOR_DISTANCE_MM           0x40
+#define BTHOME_SENSOR_TEMPERATURE_SINT16_1  0x45
+#define BTHOME_SENSOR_TEMPERATURE_SINT8     0x57
+#define BTHOME_SENSOR_TEMPERATURE_SINT8_035 0x58
+
+// Event values
+#define BTHOME_BUTTON_PRESS                 0x01
+#define BTHOME_BUTTON_DOUBLE_PRESS          0x02
+#define BTHOME_BUTTON_TRIPLE_PRESS          0x03
+#define BTHOME_BUTTON_LONG_PRESS            0x04
+#define BTHOME_BUTTON_LONG_DOUBLE_PRESS     0x05
+#define BTHOME_BUTTON_LONG_TRIPLE_PRESS     0x06
+#define BTHOME_BUTTON_HOLD_PRESS            0x80
+#define BTHOME_DIMMER_ROTATE_LEFT           0x01
+#define BTHOME_DIMMER_ROTATE_RIGHT          0x02
+
+const char *bthome_get_object_name(uint8_t object_id);
+const char *bthome_get_object_unit(uint8_t object_id);
+
+#endif // HOST_BTHOME_H
@@ -0,0 +1,22 @@
+#ifndef HOST_DS18B20_H
+#define HOST_DS18B20_H
+
+#include "onewire_bus.h"
+
+// Host stand-in for the espressif/ds18b20 component; sim/ds18b20.c
+// simulates the probes
+
+typedef struct ds18b20_device_t *ds18b20_device_handle_t;
+
+typedef struct {
+    int reserved;
+} ds18b20_config_t;
+
+esp_err_t ds18b20_new_device_from_enumeration(onewire_device_t *device, const ds18b20_config_t *config,
+                                              ds18b20_device_handle_t *ret_ds18b20);
+esp_err_t ds18b20_del_device(ds18b20_device_handle_t ds18b20);
+esp_err_t ds18b20_get_device_address(ds18b20_device_handle_t ds18b20, onewire_device_address_t *ret_address);
+esp_err_t ds18b20_trigger_temperature_conversion_for_all(onewire_bus_handle_t bus);
+esp_err_t ds18b20_get_temperature(ds18b20_device_handle_t ds18b20, float *temperature);
+
+#endif // HOST_DS18B20_H
@@ -0,0 +1,18 @@
+#ifndef HOST_ESP_APP_DESC_H
+#define HOST_ESP_APP_DESC_H
+
+#include <stddef.h>
+#include <string.h>
+
+// Host stand-in for esp_app_desc.h
+
+static inline int esp_app_get_elf_sha256(char *dst, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    strncpy(dst, "host", size - 1);
+    dst[size - 1] = '\0';
+    return (int)strlen(dst);
+}
+
+#endif // HOST_ESP_APP_DESC_H
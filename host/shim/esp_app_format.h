@@ -0,0 +1,17 @@
+#ifndef HOST_ESP_APP_FORMAT_H
+#define HOST_ESP_APP_FORMAT_H
+
+#include <stdint.h>
+
+// Host stand-in for esp_app_format.h
+
+typedef struct {
+    char version[32];
+    char project_name[32];
+    char time[16];
+    char date[16];
+    char idf_ver[32];
+    uint8_t app_elf_sha256[32];
+} esp_app_desc_t;
+
+#endif // HOST_ESP_APP_FORMAT_H
@@ -0,0 +1,10 @@
+#ifndef HOST_ESP_GAP_BLE_API_H
+#define HOST_ESP_GAP_BLE_API_H
+
+#include <stdint.h>
+
+// Host stand-in for Bluedroid's esp_gap_ble_api.h
+
+typedef uint8_t esp_bd_addr_t[6];
+
+#endif // HOST_ESP_GAP_BLE_API_H
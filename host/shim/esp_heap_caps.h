@@ -0,0 +1,48 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+// Host stand-in for esp_heap_caps.h; every capability is the C heap
+
+#define MALLOC_CAP_8BIT         (1 << 2)
+#define MALLOC_CAP_SPIRAM       (1 << 10)
+#define MALLOC_CAP_INTERNAL     (1 << 11)
+#define MALLOC_CAP_DEFAULT      (1 << 12)
+
+static inline void *heap_caps_malloc(size_t size, uint32_t caps) {
+    return malloc(size);
+}
+
+static inline void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    return calloc(n, size);
+}
+
+static inline void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps) {
+    return realloc(ptr, size);
+}
+
+static inline void heap_caps_free(void *ptr) {
+    free(ptr);
+}
+
+static inline size_t heap_caps_get_allocated_size(void *ptr) {
+    return malloc_usable_size(ptr);
+}
+
+// glibc does not report these; /debug/heap shows zeros on the host
+static inline size_t heap_caps_get_free_size(uint32_t caps) {
+    return 0;
+}
+
+static inline size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return 0;
+}
+
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return 0;
+}
+
+#endif // HOST_ESP_HEAP_CAPS_H
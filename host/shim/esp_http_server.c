@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_http_server.h"
+
+#define MAX_HANDLERS 64
+
+typedef struct {
+    httpd_uri_t handlers[MAX_HANDLERS];
+    size_t count;
+} host_server_t;
+
+typedef struct {
+    httpd_host_response_t *resp;
+    size_t cap;
+    const char *body;
+    size_t body_pos;
+    bool discard;               // Count the body but do not keep it
+} host_req_t;
+
+httpd_handle_t httpd_host_start(void) {
+    return calloc(1, sizeof(host_server_t));
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    host_server_t *server = handle;
+    if (server == NULL || uri_handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (server->count == MAX_HANDLERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    server->handlers[server->count++] = *uri_handler;
+    return ESP_OK;
+}
+
+static const httpd_uri_t *find_handler(host_server_t *server, httpd_method_t method, const char *uri) {
+    size_t path_len = strcspn(uri, "?");
+    for (size_t i = 0; i < server->count; i++) {
+        const httpd_uri_t *h = &server->handlers[i];
+        if (h->method == method && strlen(h->uri) == path_len && strncmp(h->uri, uri, path_len) == 0) {
+            return h;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t httpd_host_request(httpd_handle_t handle, httpd_method_t method, const char *uri,
+                             const char *body, httpd_host_response_t *resp) {
+    httpd_host_response_t discard;
+    bool keep = resp != NULL;
+    if (!keep) {
+        resp = &discard;
+    }
+    memset(resp, 0, sizeof(*resp));
+    const httpd_uri_t *h = find_handler(handle, method, uri);
+    if (h == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    host_req_t state = { .resp = resp, .body = body, .discard = !keep };
+    httpd_req_t req = {
+        .handle = handle,
+        .method = method,
+        .content_len = body != NULL ? strlen(body) : 0,
+        .aux = &state,
+        .user_ctx = h->user_ctx,
+    };
+    strncpy(req.uri, uri, HTTPD_MAX_URI_LEN);
+    strcpy(resp->status, HTTPD_200);
+    strcpy(resp->type, "text/html");
+
+    esp_err_t err = h->handler(&req);
+    if (keep && resp->body == NULL) {
+        resp->body = calloc(1, 1);
+    }
+    return err;
+}
+
+static host_req_t *req_state(httpd_req_t *r) {
+    return r->aux;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+    strncpy(req_state(r)->resp->status, status, sizeof(req_state(r)->resp->status) - 1);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    strncpy(req_state(r)->resp->type, type, sizeof(req_state(r)->resp->type) - 1);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    host_req_t *state = req_state(r);
+    httpd_host_response_t *resp = state->resp;
+    if (buf == NULL) {
+        return ESP_OK;
+    }
+    size_t len = buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len;
+    if (state->discard) {
+        resp->body_len += len;
+        return ESP_OK;
+    }
+    if (resp->body_len + len + 1 > state->cap) {
+        size_t cap = state->cap ? state->cap : 1024;
+        while (cap < resp->body_len + len + 1) {
+            cap *= 2;
+        }
+        char *body = realloc(resp->body, cap);
+        if (body == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        resp->body = body;
+        state->cap = cap;
+    }
+    memcpy(resp->body + resp->body_len, buf, len);
+    resp->body_len += len;
+    resp->body[resp->body_len] = '\0';
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    return httpd_resp_send_chunk(r, buf != NULL ? buf : "", buf != NULL ? buf_len : 0);
+}
+
+esp_err_t httpd_resp_send_500(httpd_req_t *r) {
+    httpd_resp_set_status(r, HTTPD_500);
+    return httpd_resp_send(r, "Internal Server Error", HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+    host_req_t *state = req_state(r);
+    size_t left = r->content_len - state->body_pos;
+    size_t n = left < buf_len ? left : buf_len;
+    memcpy(buf, state->body + state->body_pos, n);
+    state->body_pos += n;
+    return (int)n;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+    const char *q = strchr(r->uri, '?');
+    return q != NULL ? strlen(q + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+    const char *q = strchr(r->uri, '?');
+    if (q == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (strlen(q + 1) >= buf_len) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    strcpy(buf, q + 1);
+    return ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+    size_t key_len = strlen(key);
+    const char *p = qry;
+    while (p != NULL && *p != '\0') {
+        const char *end = strchr(p, '&');
+        size_t len = end != NULL ? (size_t)(end - p) : strlen(p);
+        if (len > key_len && strncmp(p, key, key_len) == 0 && p[key_len] == '=') {
+            size_t vlen = len - key_len - 1;
+            if (val_size == 0) {
+                return ESP_ERR_HTTPD_RESULT_TRUNC;
+            }
+            size_t n = vlen < val_size - 1 ? vlen : val_size - 1;
+            memcpy(val, p + key_len + 1, n);
+            val[n] = '\0';
+            return n < vlen ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        p = end != NULL ? end + 1 : NULL;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
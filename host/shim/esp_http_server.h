@@ -0,0 +1,108 @@
+#ifndef HOST_ESP_HTTP_SERVER_H
+#define HOST_ESP_HTTP_SERVER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+// Host stand-in for esp_http_server.h. Requests are dispatched in-process
+// by httpd_host_request (see esp_http_server.c); there is no socket.
+
+#define HTTPD_MAX_URI_LEN       512
+#define HTTPD_RESP_USE_STRLEN   -1
+
+#define HTTPD_200       "200 OK"
+#define HTTPD_204       "204 No Content"
+#define HTTPD_400       "400 Bad Request"
+#define HTTPD_404       "404 Not Found"
+#define HTTPD_500       "500 Internal Server Error"
+
+#define ESP_ERR_HTTPD_RESULT_TRUNC  0xb007
+
+#define HTTPD_SOCK_ERR_FAIL     -1
+#define HTTPD_SOCK_ERR_INVALID  -2
+#define HTTPD_SOCK_ERR_TIMEOUT  -3
+
+typedef void *httpd_handle_t;
+
+typedef enum {
+    HTTP_DELETE = 0,
+    HTTP_GET = 1,
+    HTTP_HEAD = 2,
+    HTTP_POST = 3,
+    HTTP_PUT = 4,
+} httpd_method_t;
+
+typedef struct httpd_req {
+    httpd_handle_t handle;
+    int method;
+    char uri[HTTPD_MAX_URI_LEN + 1];
+    size_t content_len;
+    void *aux;                  // Host request state
+    void *user_ctx;
+} httpd_req_t;
+
+typedef struct httpd_uri {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+} httpd_uri_t;
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+
+// There are no sessions on the host: requests have no socket and a send
+// override is never called
+typedef int (*httpd_send_func_t)(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags);
+
+static inline int httpd_req_to_sockfd(httpd_req_t *r) {
+    return -1;
+}
+
+static inline esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func) {
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_500(httpd_req_t *r);
+
+static inline esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str) {
+    return httpd_resp_send(r, str, HTTPD_RESP_USE_STRLEN);
+}
+
+static inline esp_err_t httpd_resp_sendstr_chunk(httpd_req_t *r, const char *str) {
+    return httpd_resp_send_chunk(r, str, str != NULL ? HTTPD_RESP_USE_STRLEN : 0);
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len);
+size_t httpd_req_get_url_query_len(httpd_req_t *r);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size);
+
+// Host only
+
+typedef struct {
+    char status[32];
+    char type[64];
+    char *body;                 // NUL terminated; owned by the caller
+    size_t body_len;
+} httpd_host_response_t;
+
+httpd_handle_t httpd_host_start(void);
+
+/**
+ * @brief Run the handler registered for uri (query string allowed) and
+ *        collect its response
+ *
+ * @param resp The response, or NULL to discard it
+ * @return ESP_ERR_NOT_FOUND if no handler matches, else what the handler
+ *         returned. resp->body must be freed by the caller.
+ */
+esp_err_t httpd_host_request(httpd_handle_t handle, httpd_method_t method, const char *uri,
+                             const char *body, httpd_host_response_t *resp);
+
+#endif // HOST_ESP_HTTP_SERVER_H
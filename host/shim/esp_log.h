@@ -0,0 +1,64 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "sdkconfig.h"
+#include "esp_timer.h"
+
+// Host stand-in for ESP-IDF's esp_log.h: errors and warnings go to stderr
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+// Info and below are compiled, so arguments are still type-checked, but
+// never printed
+#define ESP_LOG_DISCARD(tag, fmt, ...) do { if (0) printf("%s" fmt, tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGI(tag, fmt, ...) ESP_LOG_DISCARD(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ESP_LOG_DISCARD(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) ESP_LOG_DISCARD(tag, fmt, ##__VA_ARGS__)
+
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+
+static inline esp_log_level_t esp_log_level_get(const char *tag) {
+    return ESP_LOG_INFO;
+}
+
+static inline uint32_t esp_log_timestamp(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// Formats like the real one, so deferred logging costs the same, but only
+// errors and warnings are printed
+static inline void __attribute__((format(printf, 3, 4)))
+esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (level <= ESP_LOG_WARN) {
+        fputs(line, stderr);
+    }
+}
+
+#define ESP_LOG_LEVEL_LOCAL(level, tag, fmt, ...) do {                      \
+        if ((level) == ESP_LOG_ERROR) {                                     \
+            ESP_LOGE(tag, fmt, ##__VA_ARGS__);                              \
+        } else if ((level) == ESP_LOG_WARN) {                               \
+            ESP_LOGW(tag, fmt, ##__VA_ARGS__);                              \
+        } else {                                                            \
+            ESP_LOG_DISCARD(tag, fmt, ##__VA_ARGS__);                       \
+        }                                                                   \
+    } while (0)
+
+#endif // HOST_ESP_LOG_H
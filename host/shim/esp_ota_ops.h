@@ -0,0 +1,18 @@
+#ifndef HOST_ESP_OTA_OPS_H
+#define HOST_ESP_OTA_OPS_H
+
+#include "esp_app_format.h"
+
+// Host stand-in for esp_ota_ops.h
+
+static inline const esp_app_desc_t *esp_app_get_description(void) {
+    static const esp_app_desc_t desc = {
+        .version = "host",
+        .project_name = "sensor_station",
+        .time = __TIME__,
+        .date = __DATE__,
+    };
+    return &desc;
+}
+
+#endif // HOST_ESP_OTA_OPS_H
@@ -0,0 +1,28 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// Host stand-in for FreeRTOS, on top of pthreads (see freertos.c). One tick
+// is one millisecond; priorities, core affinity and stack sizes are ignored.
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE             0
+#define pdTRUE              1
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+
+#define configTICK_RATE_HZ          1000
+#define configMINIMAL_STACK_SIZE    768
+#define portTICK_PERIOD_MS          1
+#define portNUM_PROCESSORS          2
+#define tskNO_AFFINITY              ((BaseType_t)0x7fffffff)
+#define portMAX_DELAY               ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(ms))
+
+#endif // HOST_FREERTOS_H
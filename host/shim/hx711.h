@@ -0,0 +1,28 @@
+#ifndef HOST_HX711_H
+#define HOST_HX711_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Host stand-in for the esp-idf-lib hx711 component; sim/hx711.c simulates
+// the load cell
+
+typedef enum {
+    HX711_GAIN_A_128 = 0,
+    HX711_GAIN_B_32,
+    HX711_GAIN_A_64,
+} hx711_gain_t;
+
+typedef struct {
+    int dout;
+    int pd_sck;
+    hx711_gain_t gain;
+} hx711_t;
+
+esp_err_t hx711_init(hx711_t *dev);
+esp_err_t hx711_power_down(hx711_t *dev, bool down);
+esp_err_t hx711_wait(hx711_t *dev, size_t timeout_ms);
+esp_err_t hx711_read_data(hx711_t *dev, int32_t *data);
+
+#endif // HOST_HX711_H
@@ -0,0 +1,33 @@
+#ifndef HOST_MBEDTLS_CCM_H
+#define HOST_MBEDTLS_CCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host stand-in for the part of mbedtls/ccm.h the BTHome decryption uses,
+// implemented with OpenSSL (see mbedtls_ccm.c)
+
+#define MBEDTLS_ERR_CCM_BAD_INPUT       -0x000D
+#define MBEDTLS_ERR_CCM_AUTH_FAILED     -0x000F
+
+typedef enum {
+    MBEDTLS_CIPHER_ID_NONE = 0,
+    MBEDTLS_CIPHER_ID_AES = 2,
+} mbedtls_cipher_id_t;
+
+typedef struct {
+    uint8_t key[32];
+    unsigned int keybits;
+} mbedtls_ccm_context;
+
+void mbedtls_ccm_init(mbedtls_ccm_context *ctx);
+int mbedtls_ccm_setkey(mbedtls_ccm_context *ctx, mbedtls_cipher_id_t cipher,
+                       const unsigned char *key, unsigned int keybits);
+void mbedtls_ccm_free(mbedtls_ccm_context *ctx);
+int mbedtls_ccm_auth_decrypt(mbedtls_ccm_context *ctx, size_t length,
+                             const unsigned char *iv, size_t iv_len,
+                             const unsigned char *add, size_t add_len,
+                             const unsigned char *input, unsigned char *output,
+                             const unsigned char *tag, size_t tag_len);
+
+#endif // HOST_MBEDTLS_CCM_H
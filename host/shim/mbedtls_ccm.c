@@ -0,0 +1,43 @@
+#include <string.h>
+#include <openssl/evp.h>
+#include "mbedtls/ccm.h"
+
+void mbedtls_ccm_init(mbedtls_ccm_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_ccm_setkey(mbedtls_ccm_context *ctx, mbedtls_cipher_id_t cipher,
+                       const unsigned char *key, unsigned int keybits) {
+    if (cipher != MBEDTLS_CIPHER_ID_AES || (keybits != 128 && keybits != 256)) {
+        return MBEDTLS_ERR_CCM_BAD_INPUT;
+    }
+    memcpy(ctx->key, key, keybits / 8);
+    ctx->keybits = keybits;
+    return 0;
+}
+
+void mbedtls_ccm_free(mbedtls_ccm_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_ccm_auth_decrypt(mbedtls_ccm_context *ctx, size_t length,
+                             const unsigned char *iv, size_t iv_len,
+                             const unsigned char *add, size_t add_len,
+                             const unsigned char *input, unsigned char *output,
+                             const unsigned char *tag, size_t tag_len) {
+    EVP_CIPHER_CTX *evp = EVP_CIPHER_CTX_new();
+    if (evp == NULL) {
+        return MBEDTLS_ERR_CCM_BAD_INPUT;
+    }
+    const EVP_CIPHER *cipher = ctx->keybits == 256 ? EVP_aes_256_ccm() : EVP_aes_128_ccm();
+    int out_len;
+    int ok = EVP_DecryptInit_ex(evp, cipher, NULL, NULL, NULL) &&
+             EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_CCM_SET_IVLEN, (int)iv_len, NULL) &&
+             EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_CCM_SET_TAG, (int)tag_len, (void *)tag) &&
+             EVP_DecryptInit_ex(evp, NULL, NULL, ctx->key, iv) &&
+             EVP_DecryptUpdate(evp, NULL, &out_len, NULL, (int)length) &&
+             (add_len == 0 || EVP_DecryptUpdate(evp, NULL, &out_len, add, (int)add_len)) &&
+             EVP_DecryptUpdate(evp, output, &out_len, input, (int)length) > 0;
+    EVP_CIPHER_CTX_free(evp);
+    return ok ? 0 : MBEDTLS_ERR_CCM_AUTH_FAILED;
+}
@@ -0,0 +1,16 @@
+#ifndef HOST_NVS_FLASH_H
+#define HOST_NVS_FLASH_H
+
+#include "esp_err.h"
+
+// Host stand-in for nvs_flash.h; there is no flash to initialize
+
+static inline esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+static inline esp_err_t nvs_flash_erase(void) {
+    return ESP_OK;
+}
+
+#endif // HOST_NVS_FLASH_H
@@ -0,0 +1,61 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+// Host stand-in for the generated sdkconfig.h; values match sdkconfig
+
+#define CONFIG_HTTPD_BASIC_AUTH_PASSWORD "admin"
+#define CONFIG_OTA_FIRMWARE_UPGRADE_URL "https://github.com/jcodybaker/esp32-sensor-station/releases/latest/download/weight.bin"
+#define CONFIG_ESP_WIFI_SSID ""
+#define CONFIG_ESP_WIFI_PASSWORD ""
+#define CONFIG_ESP_WIFI_HOSTNAME "weight-sensor"
+#define CONFIG_WEIGHT_TARE 0
+#define CONFIG_WEIGHT_SCALE 0x100
+#define CONFIG_WEIGHT_GAIN 128
+#define CONFIG_PUMP_DEFAULT_DISPENSE_ML 8
+#define CONFIG_WEIGHT_SAMPLE_TIMES 10
+#define CONFIG_SENSORS_MAX_COUNT 512
+#define CONFIG_BTHOME_MAX_SENSORS 256
+#define CONFIG_BTHOME_MAX_DEVICES 64
+#define CONFIG_BTHOME_CACHE_SIZE 64
+#define CONFIG_BTHOME_DEDUP_WINDOW_MS 2000
+#define CONFIG_ALLOC_PROF 1
+#define CONFIG_BUF_POOL_SMALL_BLOCKS 4
+#define CONFIG_BUF_POOL_MEDIUM_BLOCKS 5
+#define CONFIG_BUF_POOL_LARGE_BLOCKS 2
+#define CONFIG_TASK_WEIGHT_CORE 1
+#define CONFIG_TASK_WEIGHT_PRIORITY 6
+#define CONFIG_TASK_WEIGHT_STACK 3840
+#define CONFIG_TASK_DS18B20_CORE 1
+#define CONFIG_TASK_DS18B20_PRIORITY 6
+#define CONFIG_TASK_DS18B20_STACK 3840
+#define CONFIG_TASK_PUMP_MONITOR_CORE 1
+#define CONFIG_TASK_PUMP_MONITOR_PRIORITY 5
+#define CONFIG_TASK_PUMP_MONITOR_STACK 4096
+#define CONFIG_TASK_MQTT_STATUS_CORE -1
+#define CONFIG_TASK_MQTT_STATUS_PRIORITY 4
+#define CONFIG_TASK_MQTT_STATUS_STACK 4096
+#define CONFIG_TASK_SENSOR_CLEANUP_CORE -1
+#define CONFIG_TASK_SENSOR_CLEANUP_PRIORITY 2
+#define CONFIG_TASK_SENSOR_CLEANUP_STACK 2048
+#define CONFIG_TASK_SYSLOG_CORE -1
+#define CONFIG_TASK_SYSLOG_PRIORITY 3
+#define CONFIG_TASK_SYSLOG_STACK 4096
+#define CONFIG_TASK_SYSLOG_TLS_STACK 8192
+#define CONFIG_TASK_BTHOME_SCAN_CORE 0
+#define CONFIG_TASK_BTHOME_SCAN_PRIORITY 4
+#define CONFIG_TASK_BTHOME_SCAN_STACK 3072
+#define CONFIG_TASK_DLOG_CORE -1
+#define CONFIG_TASK_DLOG_PRIORITY 2
+#define CONFIG_TASK_DLOG_STACK 3072
+#define CONFIG_TASK_OTA_CORE -1
+#define CONFIG_TASK_OTA_PRIORITY 5
+#define CONFIG_TASK_OTA_STACK 8192
+
+// Not set on the host: DLOG falls back to ESP_LOG, and there is no PSRAM.
+// dlog.c and bench.c are built with it, to time DLOGI.
+// #define CONFIG_DLOG_DEFERRED 1
+#define CONFIG_DLOG_RING_SIZE 4096
+#define CONFIG_DLOG_HISTORY_SIZE 4096
+// #define CONFIG_SENSORS_ALLOC_SPIRAM 1
+
+#endif // HOST_SDKCONFIG_H
@@ -0,0 +1,125 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "bthome_decoder.h"
+#include "bthome_scan.h"
+#include "sim.h"
+
+// Stands in for bthome_scan.c: instead of the radio, a task builds BTHome v2
+// advertisements for the configured devices and hands them to the observer.
+
+static const char *TAG = "sim_ble";
+
+static sim_ble_device_t devices[SIM_BLE_MAX_DEVICES];
+static size_t device_count;
+static atomic_uint_fast64_t adverts;
+static bthome_scan_adv_cb_t adv_cb;
+
+void sim_ble_configure(const sim_ble_device_t *d, size_t count) {
+    device_count = count < SIM_BLE_MAX_DEVICES ? count : SIM_BLE_MAX_DEVICES;
+    memcpy(devices, d, device_count * sizeof(*d));
+}
+
+uint64_t sim_ble_adverts(void) {
+    return atomic_load(&adverts);
+}
+
+static size_t put_le16(uint8_t *p, int32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    return 2;
+}
+
+// Flags, BTHome service data and the local name, as a device would send them
+static size_t build_advert(const sim_ble_device_t *dev, uint8_t packet_id, uint8_t *adv) {
+    size_t n = 0;
+    adv[n++] = 2;
+    adv[n++] = 0x01;                // Flags
+    adv[n++] = 0x06;
+
+    size_t len_at = n++;
+    adv[n++] = 0x16;                // Service data, 16-bit UUID
+    adv[n++] = BTHOME_UUID_LO;
+    adv[n++] = BTHOME_UUID_HI;
+    adv[n++] = 2 << BTHOME_INFO_VERSION_SHIFT;
+    adv[n++] = 0x00;                // Packet ID
+    adv[n++] = packet_id;
+    adv[n++] = 0x01;                // Battery, %
+    adv[n++] = dev->battery;
+    adv[n++] = 0x02;                // Temperature, 0.01 °C
+    n += put_le16(&adv[n], (int32_t)(dev->celsius * 100.0f));
+    adv[n++] = 0x03;                // Humidity, 0.01 %
+    n += put_le16(&adv[n], (int32_t)(dev->humidity * 100.0f));
+    adv[len_at] = (uint8_t)(n - len_at - 1);
+
+    if (dev->name != NULL) {
+        size_t name_len = strlen(dev->name);
+        if (name_len > 20) {
+            name_len = 20;
+        }
+        adv[n++] = (uint8_t)(name_len + 1);
+        adv[n++] = 0x09;            // Complete local name
+        memcpy(&adv[n], dev->name, name_len);
+        n += name_len;
+    }
+    return n;
+}
+
+static uint8_t packet_ids[SIM_BLE_MAX_DEVICES];
+
+void sim_ble_deliver(size_t index) {
+    sim_ble_device_t *dev = &devices[index];
+    uint8_t packet_id = packet_ids[index]++;
+    uint8_t adv[62];
+    size_t len = build_advert(dev, packet_id, adv);
+    for (uint8_t r = 0; r < (dev->repeats ? dev->repeats : 1); r++) {
+        adv_cb(dev->addr, -60 - (int)(index % 30), adv, len);
+        atomic_fetch_add(&adverts, 1);
+    }
+    // Readings drift a little between packets
+    dev->celsius += (packet_id & 1) ? 0.1f : -0.05f;
+}
+
+static void ble_task(void *arg) {
+    int64_t next_us[SIM_BLE_MAX_DEVICES] = { 0 };
+
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        int64_t wake = now + 1000000;
+        for (size_t i = 0; i < device_count; i++) {
+            if (devices[i].interval_ms == 0) {
+                continue;
+            }
+            if (now >= next_us[i]) {
+                sim_ble_deliver(i);
+                next_us[i] = now + (int64_t)devices[i].interval_ms * 1000;
+            }
+            if (next_us[i] < wake) {
+                wake = next_us[i];
+            }
+        }
+        int64_t sleep_ms = (wake - esp_timer_get_time()) / 1000;
+        vTaskDelay(pdMS_TO_TICKS(sleep_ms > 0 ? sleep_ms : 1));
+    }
+}
+
+esp_err_t bthome_scan_start(bthome_scan_adv_cb_t callback) {
+    adv_cb = callback;
+    if (xTaskCreate(ble_task, "sim_ble", 4096, NULL, 5, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create BLE simulation task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int64_t bthome_scan_wide_since_us(void) {
+    return 0;  // The simulated receiver hears every advertisement
+}
+
+void bthome_scan_get_stats(bthome_scan_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->duty = 1.0f;
+}
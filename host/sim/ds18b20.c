@@ -0,0 +1,118 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "ds18b20.h"
+#include "sim.h"
+
+struct onewire_bus_t {
+    int gpio;
+};
+
+struct onewire_device_iter_t {
+    onewire_bus_handle_t bus;
+    size_t next;
+};
+
+struct ds18b20_device_t {
+    size_t probe;
+};
+
+static sim_ds18b20_probe_t probes[SIM_DS18B20_MAX];
+static size_t probe_count;
+static uint32_t conversion_ms = 750;
+static atomic_uint_fast64_t reads;
+
+void sim_ds18b20_configure(const sim_ds18b20_probe_t *p, size_t count, uint32_t ms) {
+    probe_count = count < SIM_DS18B20_MAX ? count : SIM_DS18B20_MAX;
+    memcpy(probes, p, probe_count * sizeof(*p));
+    conversion_ms = ms;
+}
+
+uint64_t sim_ds18b20_reads(void) {
+    return atomic_load(&reads);
+}
+
+esp_err_t onewire_new_bus_rmt(const onewire_bus_config_t *bus_config,
+                              const onewire_bus_rmt_config_t *rmt_config, onewire_bus_handle_t *ret_bus) {
+    struct onewire_bus_t *bus = calloc(1, sizeof(*bus));
+    if (bus == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    bus->gpio = bus_config->bus_gpio_num;
+    *ret_bus = bus;
+    return ESP_OK;
+}
+
+esp_err_t onewire_bus_del(onewire_bus_handle_t bus) {
+    free(bus);
+    return ESP_OK;
+}
+
+esp_err_t onewire_new_device_iter(onewire_bus_handle_t bus, onewire_device_iter_handle_t *ret_iter) {
+    struct onewire_device_iter_t *iter = calloc(1, sizeof(*iter));
+    if (iter == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    iter->bus = bus;
+    *ret_iter = iter;
+    return ESP_OK;
+}
+
+esp_err_t onewire_device_iter_get_next(onewire_device_iter_handle_t iter, onewire_device_t *dev) {
+    if (iter->next >= probe_count) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    dev->bus = iter->bus;
+    dev->address = probes[iter->next++].address;
+    return ESP_OK;
+}
+
+esp_err_t onewire_del_device_iter(onewire_device_iter_handle_t iter) {
+    free(iter);
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_new_device_from_enumeration(onewire_device_t *device, const ds18b20_config_t *config,
+                                              ds18b20_device_handle_t *ret_ds18b20) {
+    for (size_t i = 0; i < probe_count; i++) {
+        if (probes[i].address == device->address) {
+            struct ds18b20_device_t *ds = calloc(1, sizeof(*ds));
+            if (ds == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            ds->probe = i;
+            *ret_ds18b20 = ds;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t ds18b20_del_device(ds18b20_device_handle_t ds18b20) {
+    free(ds18b20);
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_get_device_address(ds18b20_device_handle_t ds18b20, onewire_device_address_t *ret_address) {
+    *ret_address = probes[ds18b20->probe].address;
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_trigger_temperature_conversion_for_all(onewire_bus_handle_t bus) {
+    vTaskDelay(pdMS_TO_TICKS(conversion_ms));
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_get_temperature(ds18b20_device_handle_t ds18b20, float *temperature) {
+    double t = esp_timer_get_time() / 1e6;
+    const sim_ds18b20_probe_t *probe = &probes[ds18b20->probe];
+    // Round to the 12-bit resolution of 1/16 degree
+    float c = probe->celsius + 0.5f * (float)sin(t / 30.0 + (double)ds18b20->probe);
+    *temperature = roundf(c * 16.0f) / 16.0f;
+    atomic_fetch_add(&reads, 1);
+    return ESP_OK;
+}
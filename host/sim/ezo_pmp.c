@@ -0,0 +1,123 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "driver/i2c_master.h"
+#include "sim.h"
+
+// Response codes, the first byte of every read
+#define EZO_SUCCESS     1
+#define EZO_SYNTAX      2
+#define EZO_NO_DATA     255
+
+struct i2c_master_bus_t {
+    int sda;
+    int scl;
+};
+
+struct i2c_master_dev_t {
+    uint16_t address;
+    char response[40];
+    size_t response_len;
+};
+
+static sim_ezo_pmp_config_t config = {
+    .address = 0x67,
+    .voltage = 12.1f,
+};
+static float total_ml;
+static atomic_uint_fast64_t commands;
+
+void sim_ezo_pmp_configure(const sim_ezo_pmp_config_t *c) {
+    config = *c;
+}
+
+uint64_t sim_ezo_pmp_commands(void) {
+    return atomic_load(&commands);
+}
+
+float sim_ezo_pmp_total_ml(void) {
+    return total_ml;
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle) {
+    struct i2c_master_bus_t *bus = calloc(1, sizeof(*bus));
+    if (bus == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    bus->sda = bus_config->sda_io_num;
+    bus->scl = bus_config->scl_io_num;
+    *ret_bus_handle = bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus_handle) {
+    free(bus_handle);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config,
+                                    i2c_master_dev_handle_t *ret_handle) {
+    struct i2c_master_dev_t *dev = calloc(1, sizeof(*dev));
+    if (dev == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    dev->address = dev_config->device_address;
+    *ret_handle = dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle) {
+    free(handle);
+    return ESP_OK;
+}
+
+static void respond(struct i2c_master_dev_t *dev, uint8_t code, const char *text) {
+    dev->response[0] = (char)code;
+    int n = snprintf(dev->response + 1, sizeof(dev->response) - 1, "%s", text);
+    dev->response_len = 1 + (size_t)n + 1;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t dev, const uint8_t *write_buffer, size_t write_size,
+                              int xfer_timeout_ms) {
+    if (dev->address != config.address) {
+        // Nobody acknowledges the address
+        return ESP_FAIL;
+    }
+    char cmd[40];
+    size_t len = write_size < sizeof(cmd) - 1 ? write_size : sizeof(cmd) - 1;
+    memcpy(cmd, write_buffer, len);
+    cmd[len] = '\0';
+    atomic_fetch_add(&commands, 1);
+
+    char text[40];
+    float ml;
+    if (strcmp(cmd, "I") == 0) {
+        respond(dev, EZO_SUCCESS, "?I,PMP,1.0");
+    } else if (strcmp(cmd, "PV,?") == 0) {
+        snprintf(text, sizeof(text), "?PV,%.1f", config.voltage);
+        respond(dev, EZO_SUCCESS, text);
+    } else if (strcmp(cmd, "TV,?") == 0) {
+        snprintf(text, sizeof(text), "?TV,%.2f", total_ml);
+        respond(dev, EZO_SUCCESS, text);
+    } else if (sscanf(cmd, "D,%f", &ml) == 1) {
+        total_ml += ml;
+        respond(dev, EZO_SUCCESS, "");
+    } else if (strncmp(cmd, "Cal,", 4) == 0) {
+        respond(dev, EZO_SUCCESS, "");
+    } else {
+        respond(dev, EZO_SYNTAX, "");
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t dev, uint8_t *read_buffer, size_t read_size,
+                             int xfer_timeout_ms) {
+    if (dev->response_len == 0) {
+        respond(dev, EZO_NO_DATA, "");
+    }
+    size_t n = dev->response_len < read_size ? dev->response_len : read_size;
+    memcpy(read_buffer, dev->response, n);
+    dev->response_len = 0;
+    return ESP_OK;
+}
@@ -0,0 +1,53 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "hx711.h"
+#include "sim.h"
+
+static sim_hx711_config_t config = {
+    .load_raw = 150000,
+    .swing_raw = 2000,
+    .noise_raw = 50,
+    .sample_us = 12500,
+};
+static atomic_uint_fast64_t samples;
+
+void sim_hx711_configure(const sim_hx711_config_t *c) {
+    config = *c;
+}
+
+uint64_t sim_hx711_samples(void) {
+    return atomic_load(&samples);
+}
+
+esp_err_t hx711_init(hx711_t *dev) {
+    if (dev == NULL || dev->dout < 0 || dev->pd_sck < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t hx711_power_down(hx711_t *dev, bool down) {
+    return ESP_OK;
+}
+
+esp_err_t hx711_wait(hx711_t *dev, size_t timeout_ms) {
+    // A conversion completes every sample_us
+    if (config.sample_us / 1000 > timeout_ms) {
+        vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+        return ESP_ERR_TIMEOUT;
+    }
+    vTaskDelay(pdMS_TO_TICKS(config.sample_us / 1000));
+    return ESP_OK;
+}
+
+esp_err_t hx711_read_data(hx711_t *dev, int32_t *data) {
+    double t = esp_timer_get_time() / 1e6;
+    int32_t noise = config.noise_raw > 0 ? rand() % (2 * config.noise_raw + 1) - config.noise_raw : 0;
+    *data = config.load_raw + (int32_t)(config.swing_raw * sin(t / 10.0)) + noise;
+    atomic_fetch_add(&samples, 1);
+    return ESP_OK;
+}
@@ -0,0 +1,69 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_gap_ble_api.h"
+
+// Simulated devices behind the host shims. Each is configured before the
+// firmware module that drives it is initialized, and runs in real time.
+
+// HX711 load cell (hx711.c): raw counts of load_raw plus a slow sine of
+// amplitude swing_raw and uniform noise of +/- noise_raw
+typedef struct {
+    int32_t load_raw;
+    int32_t swing_raw;
+    int32_t noise_raw;
+    uint32_t sample_us;         // Conversion time; 12500 is the 80 SPS setting
+} sim_hx711_config_t;
+
+void sim_hx711_configure(const sim_hx711_config_t *config);
+uint64_t sim_hx711_samples(void);
+
+// DS18B20 probes on one 1-Wire bus (ds18b20.c)
+#define SIM_DS18B20_MAX 8
+
+typedef struct {
+    uint64_t address;
+    float celsius;              // Mean; each probe wanders +/- 0.5 around it
+} sim_ds18b20_probe_t;
+
+void sim_ds18b20_configure(const sim_ds18b20_probe_t *probes, size_t count, uint32_t conversion_ms);
+uint64_t sim_ds18b20_reads(void);
+
+// Atlas Scientific EZO-PMP peristaltic pump on I2C (ezo_pmp.c). Answers "I",
+// "PV,?", "TV,?" and "D,<ml>"; dispensing adds to the total volume at once.
+typedef struct {
+    uint16_t address;
+    float voltage;
+} sim_ezo_pmp_config_t;
+
+void sim_ezo_pmp_configure(const sim_ezo_pmp_config_t *config);
+uint64_t sim_ezo_pmp_commands(void);
+float sim_ezo_pmp_total_ml(void);
+
+// BTHome v2 advertisers (ble.c), delivered through bthome_scan_start. Each
+// device sends temperature, humidity and battery every interval_ms, repeated
+// `repeats` times like real devices do. Devices with an interval of 0 only
+// send when sim_ble_deliver is called.
+#define SIM_BLE_MAX_DEVICES 64
+
+typedef struct {
+    esp_bd_addr_t addr;
+    const char *name;           // Local name, or NULL
+    uint32_t interval_ms;
+    uint8_t repeats;
+    float celsius;
+    float humidity;
+    uint8_t battery;
+} sim_ble_device_t;
+
+void sim_ble_configure(const sim_ble_device_t *devices, size_t count);
+
+/**
+ * @brief Send one advertisement from device index now, on the calling thread
+ */
+void sim_ble_deliver(size_t index);
+uint64_t sim_ble_adverts(void);
+
+#endif // SIM_H
@@ -0,0 +1,114 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "buf_pool.h"
+#include "http_server.h"
+#include "http_stats.h"
+#include "mqtt_payload.h"
+#include "mqtt_publisher.h"
+#include "sensors_stream.h"
+#include "dlog.h"
+#include "www.h"
+#include "station_host.h"
+
+bool g_ntp_initialized = true;
+
+static settings_t *current_settings;
+
+static SemaphoreHandle_t mqtt_mutex;
+static char mqtt_buffer[1024];
+static char mqtt_last[1024];
+static station_host_mqtt_stats_t mqtt_stats;
+
+void station_host_init(settings_t *settings) {
+    current_settings = settings;
+    mqtt_mutex = xSemaphoreCreateMutex();
+    buf_pool_init();
+}
+
+// Settings
+
+const settings_t *settings_snapshot_acquire(settings_read_t *read) {
+    *read = 0;
+    return current_settings;
+}
+
+void settings_snapshot_release(settings_read_t read) {
+}
+
+const char* settings_get_ds18b20_name(const settings_t *settings, uint64_t address) {
+    if (settings == NULL || settings->ds18b20_names == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < settings->ds18b20_names_count; i++) {
+        if (settings->ds18b20_names[i].address == address) {
+            return settings->ds18b20_names[i].name;
+        }
+    }
+    return NULL;
+}
+
+// HTTP server; there is no authentication on the host
+
+esp_err_t httpd_register_uri_handler_with_basic_auth(void *settings, httpd_handle_t handle, httpd_uri_t *uri_handler) {
+    return httpd_register_uri_handler_timed(handle, uri_handler);
+}
+
+void http_server_auth_reset(void) {
+}
+
+const char *www_asset_url(const char *path) {
+    return path;
+}
+
+// Sensor stream; no clients connect on the host
+
+esp_err_t sensors_stream_init(httpd_handle_t server) {
+    return ESP_OK;
+}
+
+void sensors_stream_mark(int sensor_id) {
+}
+
+void sensors_stream_get_stats(sensors_stream_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+// MQTT
+
+bool mqtt_is_enabled(void) {
+    return mqtt_mutex != NULL;
+}
+
+esp_err_t mqtt_publish_single_sensor(int sensor_id) {
+    const sensor_info_t *sensor = sensors_get_info(sensor_id);
+    sensor_state_t state;
+    if (sensor == NULL || !sensors_get_state(sensor_id, &state)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(mqtt_mutex, portMAX_DELAY);
+    const char *hostname = current_settings->hostname != NULL ? current_settings->hostname : "";
+    int len = mqtt_payload_sensor(mqtt_buffer, sizeof(mqtt_buffer), hostname, sensor, &state);
+    if (len < 0) {
+        mqtt_stats.errors++;
+        xSemaphoreGive(mqtt_mutex);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    mqtt_stats.messages++;
+    mqtt_stats.bytes += (uint64_t)len;
+    memcpy(mqtt_last, mqtt_buffer, (size_t)len + 1);
+    xSemaphoreGive(mqtt_mutex);
+    return ESP_OK;
+}
+
+void station_host_mqtt_stats(station_host_mqtt_stats_t *stats, char *last, size_t last_size) {
+    xSemaphoreTake(mqtt_mutex, portMAX_DELAY);
+    *stats = mqtt_stats;
+    if (last != NULL && last_size > 0) {
+        snprintf(last, last_size, "%s", mqtt_last);
+    }
+    xSemaphoreGive(mqtt_mutex);
+}
@@ -0,0 +1,28 @@
+#ifndef STATION_HOST_H
+#define STATION_HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "settings.h"
+
+// Host versions of the firmware services the sensor modules call into:
+// settings snapshots, the HTTP auth wrapper, the sensor stream and an MQTT
+// publisher that formats each message and counts it instead of sending it.
+
+typedef struct {
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t errors;            // Payloads that did not fit
+} station_host_mqtt_stats_t;
+
+/**
+ * @brief Use settings as the current snapshot; it must outlive the run
+ */
+void station_host_init(settings_t *settings);
+
+/**
+ * @brief MQTT counters, and the last sensor payload copied into last
+ */
+void station_host_mqtt_stats(station_host_mqtt_stats_t *stats, char *last, size_t last_size);
+
+#endif // STATION_HOST_H
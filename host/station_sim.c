@@ -0,0 +1,151 @@
+// Runs the sensor pipeline on the host against simulated devices: the HX711
+// load cell, DS18B20 probes, the EZO-PMP pump and BTHome advertisers feed the
+// real weight, temperature, pump and BTHome modules, which update the sensor
+// registry and publish over (simulated) MQTT. At the end the HTTP handlers
+// are called in-process and their output printed.
+//
+//   station_sim [seconds] [ble_devices]
+//
+// Prints the Prometheus sensor metrics, then a summary of what each
+// simulated device and the MQTT publisher saw.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "bthome_observer.h"
+#include "buf_pool.h"
+#include "http_server.h"
+#include "pump.h"
+#include "sensors.h"
+#include "temperature.h"
+#include "weight.h"
+#include "sim/sim.h"
+#include "station_host.h"
+#define ALLOC_PROF_NO_WRAP
+#include "alloc_prof.h"
+
+static esp_err_t metrics_handler(httpd_req_t *req) {
+    settings_t *settings = req->user_ctx;
+    char buf[2048];
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    http_chunk_writer_t w;
+    http_chunk_writer_init(&w, req, buf, sizeof(buf));
+    sensors_write_metrics(&w, settings->hostname);
+    alloc_prof_write_metrics(&w, settings->hostname);
+    buf_pool_write_metrics(&w, settings->hostname);
+    return http_chunk_writer_finish(&w);
+}
+
+static void request(httpd_handle_t server, httpd_method_t method, const char *uri, bool print) {
+    httpd_host_response_t resp;
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = httpd_host_request(server, method, uri, NULL, &resp);
+    int64_t elapsed = esp_timer_get_time() - start;
+    if (err == ESP_ERR_NOT_FOUND) {
+        fprintf(stderr, "%s: no handler\n", uri);
+        return;
+    }
+    if (print) {
+        fputs(resp.body, stdout);
+    }
+    fprintf(stderr, "%-22s %s, %zu bytes in %lld us\n", uri, resp.status, resp.body_len, (long long)elapsed);
+    free(resp.body);
+}
+
+int main(int argc, char **argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    int ble_count = argc > 2 ? atoi(argv[2]) : 16;
+    if (ble_count > SIM_BLE_MAX_DEVICES) {
+        ble_count = SIM_BLE_MAX_DEVICES;
+    }
+
+    static mac_filter_t filters[SIM_BLE_MAX_DEVICES];
+    static sim_ble_device_t ble[SIM_BLE_MAX_DEVICES];
+    for (int i = 0; i < ble_count; i++) {
+        uint8_t addr[6] = { 0xA4, 0xC1, 0x38, 0x00, (uint8_t)(i >> 8), (uint8_t)i };
+        memcpy(filters[i].mac_addr, addr, 6);
+        snprintf(filters[i].name, sizeof(filters[i].name), "Room %d", i);
+        filters[i].enabled = true;
+        memcpy(ble[i].addr, addr, 6);
+        ble[i].name = "ATC_SIM";
+        ble[i].interval_ms = 1000 + 50 * i;
+        ble[i].repeats = 3;
+        ble[i].celsius = 18.0f + (float)(i % 8);
+        ble[i].humidity = 40.0f + (float)(i % 20);
+        ble[i].battery = (uint8_t)(100 - i % 50);
+    }
+    static uint8_t object_ids[] = { 0x01, 0x02, 0x03 };
+    static ds18b20_name_t ds_names[] = { { 0x28FF000000000001ULL, "Tank" } };
+
+    static settings_t settings = {
+        .hostname = "station-sim",
+        .weight_tare = 150000,
+        .weight_scale = _IQ16(0.01),
+        .weight_gain = HX711_GAIN_A_64,
+        .selected_bthome_object_ids = object_ids,
+        .selected_bthome_object_ids_count = sizeof(object_ids),
+        .mac_filters = filters,
+        .ds18b20_names = ds_names,
+        .ds18b20_names_count = 1,
+        .ds18b20_gpio = 4,
+        .ds18b20_pwr_gpio = -1,
+        .weight_dt_gpio = 32,
+        .weight_sck_gpio = 26,
+        .pump_scl_gpio = 22,
+        .pump_sda_gpio = 21,
+        .pump_i2c_addr = 0x67,
+        .pump_dispense_ml = 8,
+    };
+    settings.mac_filters_count = (size_t)ble_count;
+
+    sim_ble_configure(ble, (size_t)ble_count);
+    sim_ds18b20_probe_t probes[] = {
+        { 0x28FF000000000001ULL, 21.5f },
+        { 0x28FF000000000002ULL, 4.0f },
+    };
+    sim_ds18b20_configure(probes, 2, 750);
+
+    station_host_init(&settings);
+    httpd_handle_t server = httpd_host_start();
+    httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_handler,
+        .user_ctx = &settings,
+    };
+    httpd_register_uri_handler(server, &metrics_uri);
+    alloc_prof_register(&settings, server);
+
+    sensors_init(&settings, server);
+    weight_init(&settings);
+    init_ds18b20(&settings);
+    pump_init(&settings, server);
+    bthome_observer_init(&settings, server);
+
+    vTaskDelay(pdMS_TO_TICKS(seconds * 1000));
+
+    request(server, HTTP_GET, "/metrics", true);
+    request(server, HTTP_GET, "/sensors/data", false);
+    request(server, HTTP_GET, "/debug/heap", false);
+    request(server, HTTP_GET, "/bthome/packets", false);
+    request(server, HTTP_POST, "/pump/dispense?ml=5", false);
+
+    station_host_mqtt_stats_t mqtt;
+    char last[256];
+    station_host_mqtt_stats(&mqtt, last, sizeof(last));
+    fprintf(stderr, "sensors registered     %d\n", sensors_get_count());
+    fprintf(stderr, "hx711 samples          %llu\n", (unsigned long long)sim_hx711_samples());
+    fprintf(stderr, "ds18b20 reads          %llu\n", (unsigned long long)sim_ds18b20_reads());
+    fprintf(stderr, "ezo-pmp commands       %llu (%.1f ml dispensed)\n",
+            (unsigned long long)sim_ezo_pmp_commands(), sim_ezo_pmp_total_ml());
+    fprintf(stderr, "ble advertisements     %llu\n", (unsigned long long)sim_ble_adverts());
+    fprintf(stderr, "mqtt messages          %llu (%llu bytes, %llu too large)\n",
+            (unsigned long long)mqtt.messages, (unsigned long long)mqtt.bytes,
+            (unsigned long long)mqtt.errors);
+    fprintf(stderr, "last mqtt payload      %s\n", last);
+    return 0;
+}
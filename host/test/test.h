@@ -0,0 +1,38 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+// Minimal assertions for the host tests. A failed CHECK reports and carries
+// on, so one run shows every failure; main() returns test_result().
+
+extern int test_failures;
+
+#define CHECK(cond) do {                                                      \
+    if (!(cond)) {                                                            \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++;                                                      \
+    }                                                                         \
+} while (0)
+
+#define CHECK_EQ(a, b) do {                                                   \
+    long long a_ = (long long)(a), b_ = (long long)(b);                       \
+    if (a_ != b_) {                                                           \
+        fprintf(stderr, "%s:%d: CHECK_EQ failed: %s == %lld, expected %lld\n", \
+                __FILE__, __LINE__, #a, a_, b_);                              \
+        test_failures++;                                                      \
+    }                                                                         \
+} while (0)
+
+#define TEST_DEFINE_FAILURES int test_failures = 0
+
+static inline int test_result(const char *name) {
+    if (test_failures != 0) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+        return 1;
+    }
+    fprintf(stderr, "%s: ok\n", name);
+    return 0;
+}
+
+#endif // HOST_TEST_H
@@ -0,0 +1,178 @@
+// log_ring: records of odd lengths wrapping a small ring many times. Every
+// claim must stay inside the buffer, including the padding header written
+// when a record does not fit before the end. Then a consumer task that only
+// wakes on notifications must still see every record.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "log_ring.h"
+#include "test.h"
+#include "alloc_prof.h"
+
+TEST_DEFINE_FAILURES;
+
+#define RING_SIZE 256
+
+// Payload byte i of record seq, so a record overwritten by another shows up
+static uint8_t pattern(uint32_t seq, size_t i) {
+    return (uint8_t)(seq * 31 + i);
+}
+
+static void check_in_buffer(const log_ring_t *ring, const void *p, size_t len) {
+    const uint8_t *b = p;
+    CHECK(b >= ring->buf + sizeof(log_ring_hdr_t));
+    CHECK(b + len <= ring->buf + ring->size);
+}
+
+// Claims are whole headers, so the head can never stop closer to the end of
+// the buffer than a padding header needs
+static void check_head(log_ring_t *ring) {
+    uint32_t head = atomic_load(&ring->head);
+    CHECK_EQ((head & ring->mask) % sizeof(log_ring_hdr_t), 0);
+}
+
+static bool read_one(log_ring_t *ring, uint32_t seq) {
+    size_t len;
+    uint8_t type;
+    const uint8_t *p = log_ring_peek(ring, &len, &type);
+    if (p == NULL) {
+        return false;
+    }
+    check_in_buffer(ring, p, len);
+    CHECK_EQ(type, seq & 0xff);
+    CHECK_EQ(len, 1 + seq % 13);
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] != pattern(seq, i)) {
+            CHECK_EQ(p[i], pattern(seq, i));
+            break;
+        }
+    }
+    log_ring_release(ring);
+    return true;
+}
+
+// Reserve generously, commit an odd length: the trimmed tail is given back,
+// which is what used to leave the head 4 bytes short of the end
+static void test_wrap_odd_lengths(void) {
+    log_ring_t ring;
+    CHECK_EQ(log_ring_init(&ring, RING_SIZE), ESP_OK);
+    CHECK_EQ(ring.size, RING_SIZE);
+
+    uint32_t written = 0, read = 0;
+    for (int round = 0; round < 2000; round++) {
+        // Keep one to three records in flight so the head visits every offset
+        int batch = 1 + round % 3;
+        for (int i = 0; i < batch; i++) {
+            size_t len = 1 + written % 13;
+            size_t max_len = len + (written % 5) * 3;
+            log_ring_reservation_t res;
+            uint8_t *p = log_ring_reserve(&ring, max_len, &res);
+            if (p == NULL) {
+                break;
+            }
+            check_in_buffer(&ring, p, max_len);
+            for (size_t j = 0; j < len; j++) {
+                p[j] = pattern(written, j);
+            }
+            log_ring_commit(&ring, &res, len, (uint8_t)written);
+            check_head(&ring);
+            written++;
+        }
+        while (read_one(&ring, read)) {
+            read++;
+        }
+    }
+    CHECK_EQ(read, written);
+    CHECK(written > 4 * RING_SIZE / 16);
+    CHECK_EQ(atomic_load(&ring.dropped), 0);
+    CHECK_EQ(atomic_load(&ring.records), written);
+    free(ring.buf);
+}
+
+// A full ring drops new records and keeps the old ones intact
+static void test_full(void) {
+    log_ring_t ring;
+    CHECK_EQ(log_ring_init(&ring, RING_SIZE), ESP_OK);
+
+    uint32_t written = 0;
+    log_ring_reservation_t res;
+    uint8_t *p;
+    while ((p = log_ring_reserve(&ring, 1 + written % 13, &res)) != NULL) {
+        check_in_buffer(&ring, p, 1 + written % 13);
+        for (size_t j = 0; j < 1 + written % 13; j++) {
+            p[j] = pattern(written, j);
+        }
+        log_ring_commit(&ring, &res, 1 + written % 13, (uint8_t)written);
+        written++;
+    }
+    CHECK_EQ(atomic_load(&ring.dropped), 1);
+    CHECK(atomic_load(&ring.high_water) <= RING_SIZE);
+
+    uint32_t read = 0;
+    while (read_one(&ring, read)) {
+        read++;
+    }
+    CHECK_EQ(read, written);
+    free(ring.buf);
+}
+
+#define WAKE_RECORDS 20000
+
+static log_ring_t wake_ring;
+static _Atomic uint32_t consumed;
+static _Atomic uint32_t wakeups;
+
+// Sleeps far longer than the test runs, so a lost notification shows up as
+// records left unread
+static void consumer_task(void *arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(60000));
+        atomic_fetch_add(&wakeups, 1);
+        size_t len;
+        while (log_ring_peek(&wake_ring, &len, NULL) != NULL) {
+            log_ring_release(&wake_ring);
+            atomic_fetch_add(&consumed, 1);
+        }
+    }
+}
+
+static void test_wakeups(void) {
+    CHECK_EQ(log_ring_init(&wake_ring, 4096), ESP_OK);
+    TaskHandle_t consumer;
+    CHECK_EQ(xTaskCreate(consumer_task, "consumer", 4096, NULL, 5, &consumer), pdPASS);
+    atomic_store(&wake_ring.consumer, consumer);
+
+    uint32_t committed = 0;
+    for (uint32_t i = 0; i < WAKE_RECORDS; i++) {
+        log_ring_reservation_t res;
+        uint8_t *p = log_ring_reserve(&wake_ring, 16, &res);
+        if (p == NULL) {
+            vTaskDelay(1);     // Full: let the consumer catch up
+            continue;
+        }
+        memset(p, (int)i, 1 + i % 16);
+        log_ring_commit(&wake_ring, &res, 1 + i % 16, 0);
+        committed++;
+        if (i % 1000 == 0) {
+            vTaskDelay(1);     // Let it go idle now and then
+        }
+    }
+
+    for (int ms = 0; ms < 5000 && atomic_load(&consumed) != committed; ms++) {
+        vTaskDelay(1);
+    }
+    CHECK(committed > WAKE_RECORDS / 2);
+    CHECK_EQ(atomic_load(&consumed), committed);
+    // One notification per burst, not per record
+    CHECK(atomic_load(&wakeups) < committed / 2);
+}
+
+int main(void) {
+    test_wrap_odd_lengths();
+    test_full();
+    test_wakeups();
+    return test_result("test_log_ring");
+}
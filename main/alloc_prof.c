@@ -0,0 +1,310 @@
+#define ALLOC_PROF_NO_WRAP
+#include "alloc_prof.h"
+#include <inttypes.h>
+#include <esp_log.h>
+
+static const char *TAG = "alloc_prof";
+
+#if CONFIG_ALLOC_PROF
+#define ALLOC_PROF_ENABLED 1
+#else
+#define ALLOC_PROF_ENABLED 0
+#endif
+
+static const uint32_t bucket_bounds[ALLOC_PROF_BUCKETS] = ALLOC_PROF_BUCKET_BOUNDS;
+
+// Tags in first-use order, newest first; entries are never removed
+static _Atomic(alloc_prof_tag_t *) tags;
+
+#if CONFIG_ALLOC_PROF
+
+// Precedes every profiled block, padded to keep the caller's pointer at the
+// allocator's alignment: 8 bytes on the ESP32
+typedef struct {
+    _Alignas(max_align_t) alloc_prof_tag_t *tag;
+    uint32_t size;
+} block_header_t;
+
+static void tag_list(alloc_prof_tag_t *tag) {
+    if (atomic_exchange(&tag->listed, true)) {
+        return;
+    }
+    const char *slash = strrchr(tag->name, '/');
+    if (slash != NULL) {
+        tag->name = slash + 1;
+    }
+    alloc_prof_tag_t *head = atomic_load(&tags);
+    do {
+        tag->next = head;
+    } while (!atomic_compare_exchange_weak(&tags, &head, tag));
+}
+
+static int bucket_of(uint32_t size) {
+    if (size <= bucket_bounds[0]) {
+        return 0;
+    }
+    // Buckets grow by a factor of four: ceil(log2(size)) 5..6 is bucket 1,
+    // 7..8 bucket 2 and so on
+    int bits = 32 - __builtin_clz(size - 1);
+    int bucket = (bits - 3) / 2;
+    return bucket < ALLOC_PROF_BUCKETS - 1 ? bucket : ALLOC_PROF_BUCKETS - 1;
+}
+
+static uint32_t block_overhead(block_header_t *hdr) {
+    return (uint32_t)(heap_caps_get_allocated_size(hdr) - hdr->size);
+}
+
+static void *account_alloc(alloc_prof_tag_t *tag, block_header_t *hdr, size_t size) {
+    if (!atomic_load_explicit(&tag->listed, memory_order_relaxed)) {
+        tag_list(tag);
+    }
+    if (hdr == NULL) {
+        atomic_fetch_add_explicit(&tag->failures, 1, memory_order_relaxed);
+        return NULL;
+    }
+    hdr->tag = tag;
+    hdr->size = (uint32_t)size;
+
+    atomic_fetch_add_explicit(&tag->allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tag->bytes, size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tag->sizes[bucket_of(size)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tag->live_blocks, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tag->overhead_bytes, block_overhead(hdr), memory_order_relaxed);
+    uint_fast32_t live = atomic_fetch_add_explicit(&tag->live_bytes, size, memory_order_relaxed) + size;
+    uint_fast32_t peak = atomic_load_explicit(&tag->peak_bytes, memory_order_relaxed);
+    while (live > peak &&
+           !atomic_compare_exchange_weak_explicit(&tag->peak_bytes, &peak, live,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+    return hdr + 1;
+}
+
+static void account_free(block_header_t *hdr) {
+    alloc_prof_tag_t *tag = hdr->tag;
+    atomic_fetch_add_explicit(&tag->frees, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&tag->live_bytes, hdr->size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&tag->live_blocks, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&tag->overhead_bytes, block_overhead(hdr), memory_order_relaxed);
+}
+
+void *alloc_prof_malloc(alloc_prof_tag_t *tag, size_t size, uint32_t caps) {
+    block_header_t *hdr = NULL;
+    if (size <= UINT32_MAX - sizeof(block_header_t)) {
+        hdr = caps != 0 ? heap_caps_malloc(sizeof(*hdr) + size, caps) : malloc(sizeof(*hdr) + size);
+    }
+    return account_alloc(tag, hdr, size);
+}
+
+void *alloc_prof_calloc(alloc_prof_tag_t *tag, size_t n, size_t size, uint32_t caps) {
+    if (size != 0 && n > (UINT32_MAX - sizeof(block_header_t)) / size) {
+        return account_alloc(tag, NULL, 0);
+    }
+    void *ptr = alloc_prof_malloc(tag, n * size, caps);
+    if (ptr != NULL) {
+        memset(ptr, 0, n * size);
+    }
+    return ptr;
+}
+
+void *alloc_prof_realloc(alloc_prof_tag_t *tag, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return alloc_prof_malloc(tag, size, 0);
+    }
+    if (size == 0) {
+        alloc_prof_free(ptr);
+        return NULL;
+    }
+    if (size > UINT32_MAX - sizeof(block_header_t)) {
+        return account_alloc(tag, NULL, 0);
+    }
+
+    // Counted as a free of the old block and an allocation by the caller
+    block_header_t *hdr = (block_header_t *)ptr - 1;
+    block_header_t old = *hdr;
+    uint32_t old_overhead = block_overhead(hdr);
+    block_header_t *moved = realloc(hdr, sizeof(*hdr) + size);
+    if (moved == NULL) {
+        return account_alloc(tag, NULL, 0);
+    }
+    alloc_prof_tag_t *old_tag = old.tag;
+    atomic_fetch_add_explicit(&old_tag->frees, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&old_tag->live_bytes, old.size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&old_tag->live_blocks, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&old_tag->overhead_bytes, old_overhead, memory_order_relaxed);
+    return account_alloc(tag, moved, size);
+}
+
+void alloc_prof_free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    block_header_t *hdr = (block_header_t *)ptr - 1;
+    account_free(hdr);
+    free(hdr);
+}
+
+static char *copy_string(alloc_prof_tag_t *tag, const char *s, size_t len) {
+    char *copy = alloc_prof_malloc(tag, len + 1, 0);
+    if (copy != NULL) {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+char *alloc_prof_strdup(alloc_prof_tag_t *tag, const char *s) {
+    return copy_string(tag, s, strlen(s));
+}
+
+char *alloc_prof_strndup(alloc_prof_tag_t *tag, const char *s, size_t n) {
+    return copy_string(tag, s, strnlen(s, n));
+}
+
+int alloc_prof_vasprintf(alloc_prof_tag_t *tag, char **out, const char *fmt, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    *out = NULL;
+    if (len < 0) {
+        return -1;
+    }
+    char *buf = alloc_prof_malloc(tag, (size_t)len + 1, 0);
+    if (buf == NULL) {
+        return -1;
+    }
+    vsnprintf(buf, (size_t)len + 1, fmt, args);
+    *out = buf;
+    return len;
+}
+
+int alloc_prof_asprintf(alloc_prof_tag_t *tag, char **out, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = alloc_prof_vasprintf(tag, out, fmt, args);
+    va_end(args);
+    return len;
+}
+
+#endif // CONFIG_ALLOC_PROF
+
+typedef struct {
+    const char *name;
+    const char *help;
+    const char *type;
+    size_t offset;
+} tag_metric_t;
+
+static const tag_metric_t tag_metrics[] = {
+    { "heap_alloc_total", "Successful allocations per source file", "counter",
+      offsetof(alloc_prof_tag_t, allocs) },
+    { "heap_free_total", "Frees of blocks allocated per source file", "counter",
+      offsetof(alloc_prof_tag_t, frees) },
+    { "heap_alloc_failures_total", "Failed allocations per source file", "counter",
+      offsetof(alloc_prof_tag_t, failures) },
+    { "heap_live_bytes", "Requested bytes not yet freed per source file", "gauge",
+      offsetof(alloc_prof_tag_t, live_bytes) },
+    { "heap_live_blocks", "Blocks not yet freed per source file", "gauge",
+      offsetof(alloc_prof_tag_t, live_blocks) },
+    { "heap_peak_bytes", "Highest heap_live_bytes since boot per source file", "gauge",
+      offsetof(alloc_prof_tag_t, peak_bytes) },
+    { "heap_overhead_bytes", "Heap used by live blocks beyond the requested size per source file", "gauge",
+      offsetof(alloc_prof_tag_t, overhead_bytes) },
+};
+
+static uint32_t load(const alloc_prof_tag_t *tag, size_t offset) {
+    return (uint32_t)atomic_load_explicit((atomic_uint_fast32_t *)((char *)tag + offset), memory_order_relaxed);
+}
+
+void alloc_prof_write_metrics(http_chunk_writer_t *w, const char *hostname) {
+    alloc_prof_tag_t *head = atomic_load(&tags);
+    if (head == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(tag_metrics) / sizeof(tag_metrics[0]); i++) {
+        const tag_metric_t *m = &tag_metrics[i];
+        http_chunk_printf(w, "# HELP %s %s\n# TYPE %s %s\n", m->name, m->help, m->name, m->type);
+        for (alloc_prof_tag_t *tag = head; tag != NULL; tag = tag->next) {
+            http_chunk_printf(w, "%s{hostname=\"%s\",tag=\"%s\"} %" PRIu32 "\n",
+                              m->name, hostname, tag->name, load(tag, m->offset));
+        }
+    }
+
+    http_chunk_printf(w,
+                      "# HELP heap_alloc_size_bytes Requested allocation sizes per source file\n"
+                      "# TYPE heap_alloc_size_bytes histogram\n");
+    for (alloc_prof_tag_t *tag = head; tag != NULL; tag = tag->next) {
+        uint32_t count = 0;
+        for (int b = 0; b < ALLOC_PROF_BUCKETS; b++) {
+            count += (uint32_t)atomic_load_explicit(&tag->sizes[b], memory_order_relaxed);
+            if (bucket_bounds[b] != 0) {
+                http_chunk_printf(w, "heap_alloc_size_bytes_bucket{hostname=\"%s\",tag=\"%s\",le=\"%" PRIu32 "\"} %" PRIu32 "\n",
+                                  hostname, tag->name, bucket_bounds[b], count);
+            } else {
+                http_chunk_printf(w, "heap_alloc_size_bytes_bucket{hostname=\"%s\",tag=\"%s\",le=\"+Inf\"} %" PRIu32 "\n",
+                                  hostname, tag->name, count);
+            }
+        }
+        http_chunk_printf(w,
+                          "heap_alloc_size_bytes_sum{hostname=\"%s\",tag=\"%s\"} %" PRIu32 "\n"
+                          "heap_alloc_size_bytes_count{hostname=\"%s\",tag=\"%s\"} %" PRIu32 "\n",
+                          hostname, tag->name, load(tag, offsetof(alloc_prof_tag_t, bytes)),
+                          hostname, tag->name, count);
+    }
+}
+
+static esp_err_t debug_heap_handler(httpd_req_t *req) {
+    char buf[1024];
+    http_chunk_writer_t w;
+    httpd_resp_set_type(req, "application/json");
+    http_chunk_writer_init(&w, req, buf, sizeof(buf));
+
+    // External fragmentation: the share of free memory unusable for a
+    // request as large as the free total
+    size_t free_bytes = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+    double fragmentation = free_bytes > 0 ? 1.0 - (double)largest / (double)free_bytes : 0.0;
+    http_chunk_printf(&w,
+                      "{\"enabled\":%s,\"heap\":{\"free_bytes\":%u,\"min_free_bytes\":%u,"
+                      "\"largest_free_block_bytes\":%u,\"fragmentation\":%.3f},\"tags\":[",
+                      ALLOC_PROF_ENABLED ? "true" : "false", (unsigned)free_bytes,
+                      (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+                      (unsigned)largest, fragmentation);
+
+    for (alloc_prof_tag_t *tag = atomic_load(&tags); tag != NULL; tag = tag->next) {
+        http_chunk_printf(&w, "%s{\"tag\":\"%s\"", tag == atomic_load(&tags) ? "" : ",", tag->name);
+        for (size_t i = 0; i < sizeof(tag_metrics) / sizeof(tag_metrics[0]); i++) {
+            // heap_alloc_total -> alloc_total and so on
+            http_chunk_printf(&w, ",\"%s\":%" PRIu32, tag_metrics[i].name + 5, load(tag, tag_metrics[i].offset));
+        }
+        http_chunk_printf(&w, ",\"bytes_total\":%" PRIu32 ",\"sizes\":{",
+                          load(tag, offsetof(alloc_prof_tag_t, bytes)));
+        for (int b = 0; b < ALLOC_PROF_BUCKETS; b++) {
+            uint32_t n = (uint32_t)atomic_load_explicit(&tag->sizes[b], memory_order_relaxed);
+            if (bucket_bounds[b] != 0) {
+                http_chunk_printf(&w, "%s\"%" PRIu32 "\":%" PRIu32, b == 0 ? "" : ",", bucket_bounds[b], n);
+            } else {
+                http_chunk_printf(&w, ",\"+Inf\":%" PRIu32, n);
+            }
+        }
+        http_chunk_printf(&w, "}}");
+    }
+    http_chunk_printf(&w, "]}\n");
+    return http_chunk_writer_finish(&w);
+}
+
+static httpd_uri_t debug_heap_uri = {
+    .uri       = "/debug/heap",
+    .method    = HTTP_GET,
+    .handler   = debug_heap_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t alloc_prof_register(void *settings, httpd_handle_t server) {
+    esp_err_t err = httpd_register_uri_handler_with_basic_auth(settings, server, &debug_heap_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register %s: %s", debug_heap_uri.uri, esp_err_to_name(err));
+    }
+    return err;
+}
@@ -0,0 +1,106 @@
+#ifndef ALLOC_PROF_H
+#define ALLOC_PROF_H
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_http_server.h>
+#include "sdkconfig.h"
+#include "http_server.h"
+
+// Heap profiler for the code in main/.
+//
+// A source file that includes this header after its other includes has its
+// malloc, calloc, realloc, free, strdup, strndup, asprintf, vasprintf and
+// heap_caps_{malloc,calloc,free} calls routed through the profiler, which
+// counts them against a tag named after the file (or ALLOC_PROF_TAG if it is
+// defined before the include). Each block carries a small header recording
+// its tag and size, so a block may be freed from any profiled file, but
+// memory allocated elsewhere (by IDF components) must be released through
+// their own functions, never with a profiled free(), and vice versa.
+//
+// Per tag it keeps call counts, live and peak bytes, allocator overhead and a
+// histogram of request sizes, exported in /metrics and GET /debug/heap.
+// Counters are 32 bits and wrap.
+//
+// Without CONFIG_ALLOC_PROF the header only declares the exporters; the
+// allocation calls are left alone and cost nothing.
+
+// Upper bounds of the request size histogram; the last bucket is unbounded
+#define ALLOC_PROF_BUCKETS 6
+#define ALLOC_PROF_BUCKET_BOUNDS { 16, 64, 256, 1024, 4096, 0 }
+
+typedef struct alloc_prof_tag {
+    const char *name;
+    struct alloc_prof_tag *next;
+    atomic_bool listed;
+    atomic_uint_fast32_t allocs;
+    atomic_uint_fast32_t frees;
+    atomic_uint_fast32_t failures;
+    atomic_uint_fast32_t bytes;             // Requested, all time
+    atomic_uint_fast32_t live_bytes;        // Requested, not yet freed
+    atomic_uint_fast32_t live_blocks;
+    atomic_uint_fast32_t peak_bytes;        // Highest live_bytes
+    atomic_uint_fast32_t overhead_bytes;    // Block size beyond the request, live blocks
+    atomic_uint_fast32_t sizes[ALLOC_PROF_BUCKETS];
+} alloc_prof_tag_t;
+
+/**
+ * @brief Write the per-tag Prometheus metrics (nothing when disabled)
+ */
+void alloc_prof_write_metrics(http_chunk_writer_t *w, const char *hostname);
+
+/**
+ * @brief Register GET /debug/heap
+ */
+esp_err_t alloc_prof_register(void *settings, httpd_handle_t server);
+
+#if CONFIG_ALLOC_PROF
+
+// caps of 0 allocates as malloc() does
+void *alloc_prof_malloc(alloc_prof_tag_t *tag, size_t size, uint32_t caps);
+void *alloc_prof_calloc(alloc_prof_tag_t *tag, size_t n, size_t size, uint32_t caps);
+void *alloc_prof_realloc(alloc_prof_tag_t *tag, void *ptr, size_t size);
+void alloc_prof_free(void *ptr);
+char *alloc_prof_strdup(alloc_prof_tag_t *tag, const char *s);
+char *alloc_prof_strndup(alloc_prof_tag_t *tag, const char *s, size_t n);
+int alloc_prof_vasprintf(alloc_prof_tag_t *tag, char **out, const char *fmt, va_list args)
+    __attribute__((format(printf, 3, 0)));
+int alloc_prof_asprintf(alloc_prof_tag_t *tag, char **out, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Files that only need the exporters, and alloc_prof.c itself, define
+// ALLOC_PROF_NO_WRAP before the include
+#ifndef ALLOC_PROF_NO_WRAP
+
+// The file being compiled; the directory is dropped when the tag is listed
+#ifndef ALLOC_PROF_TAG
+#define ALLOC_PROF_TAG __BASE_FILE__
+#endif
+
+static alloc_prof_tag_t alloc_prof_file_tag __attribute__((unused)) = { .name = ALLOC_PROF_TAG };
+
+#define malloc(size)                    alloc_prof_malloc(&alloc_prof_file_tag, (size), 0)
+#define calloc(n, size)                 alloc_prof_calloc(&alloc_prof_file_tag, (n), (size), 0)
+#define realloc(ptr, size)              alloc_prof_realloc(&alloc_prof_file_tag, (ptr), (size))
+#define free(ptr)                       alloc_prof_free(ptr)
+#define strdup(s)                       alloc_prof_strdup(&alloc_prof_file_tag, (s))
+#define strndup(s, n)                   alloc_prof_strndup(&alloc_prof_file_tag, (s), (n))
+#define asprintf(out, ...)              alloc_prof_asprintf(&alloc_prof_file_tag, (out), __VA_ARGS__)
+#define vasprintf(out, fmt, args)       alloc_prof_vasprintf(&alloc_prof_file_tag, (out), (fmt), (args))
+#define heap_caps_malloc(size, caps)    alloc_prof_malloc(&alloc_prof_file_tag, (size), (caps))
+#define heap_caps_calloc(n, size, caps) alloc_prof_calloc(&alloc_prof_file_tag, (n), (size), (caps))
+#define heap_caps_free(ptr)             alloc_prof_free(ptr)
+
+#endif // ALLOC_PROF_NO_WRAP
+
+#endif // CONFIG_ALLOC_PROF
+
+#endif // ALLOC_PROF_H
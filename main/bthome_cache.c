@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "bthome_cache.h"
+#include "alloc_prof.h"
+
+static const char *TAG = "bthome_cache";
+
+#define NIL (-1)
+
+// O(1) LFU: entries hang off a list of frequency buckets kept in ascending
+// order, each holding its entries least recently seen first, so the victim is
+// always the head of the first bucket. A chained hash on the MAC finds an
+// existing entry. All storage is allocated once at init.
+typedef struct {
+    bthome_cache_entry_t data;
+    int16_t prev, next;         // Neighbours within the bucket
+    int16_t hash_next;          // Next entry in the same hash chain
+    int16_t bucket;             // Owning bucket, NIL when the slot is free
+} cache_slot_t;
+
+typedef struct {
+    uint32_t frequency;
+    int16_t head, tail;         // Entries, least recently seen first
+    int16_t prev, next;         // Neighbouring buckets, ascending frequency
+} freq_bucket_t;
+
+static cache_slot_t *slots = NULL;
+static freq_bucket_t *buckets = NULL;
+static int16_t *hash_heads = NULL;
+static size_t hash_mask = 0;
+static int16_t bucket_list = NIL;      // Lowest-frequency bucket
+static int16_t free_slots = NIL;       // Free lists, linked through .next
+static int16_t free_buckets = NIL;
+static SemaphoreHandle_t cache_mutex = NULL;
+
+static uint32_t mac_hash(const esp_bd_addr_t addr) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash = (hash ^ addr[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int16_t hash_find(const esp_bd_addr_t addr) {
+    int16_t s = hash_heads[mac_hash(addr) & hash_mask];
+    while (s != NIL && memcmp(slots[s].data.addr, addr, 6) != 0) {
+        s = slots[s].hash_next;
+    }
+    return s;
+}
+
+static void hash_insert(int16_t s) {
+    int16_t *head = &hash_heads[mac_hash(slots[s].data.addr) & hash_mask];
+    slots[s].hash_next = *head;
+    *head = s;
+}
+
+static void hash_remove(int16_t s) {
+    int16_t *link = &hash_heads[mac_hash(slots[s].data.addr) & hash_mask];
+    while (*link != s) {
+        link = &slots[*link].hash_next;
+    }
+    *link = slots[s].hash_next;
+}
+
+// Take a bucket from the free list and link it in after `after` (NIL = front)
+static int16_t bucket_alloc(uint32_t frequency, int16_t after) {
+    int16_t b = free_buckets;
+    free_buckets = buckets[b].next;
+
+    buckets[b].frequency = frequency;
+    buckets[b].head = buckets[b].tail = NIL;
+    buckets[b].prev = after;
+    buckets[b].next = (after == NIL) ? bucket_list : buckets[after].next;
+    if (buckets[b].next != NIL) {
+        buckets[buckets[b].next].prev = b;
+    }
+    if (after == NIL) {
+        bucket_list = b;
+    } else {
+        buckets[after].next = b;
+    }
+    return b;
+}
+
+static void bucket_free(int16_t b) {
+    if (buckets[b].prev != NIL) {
+        buckets[buckets[b].prev].next = buckets[b].next;
+    } else {
+        bucket_list = buckets[b].next;
+    }
+    if (buckets[b].next != NIL) {
+        buckets[buckets[b].next].prev = buckets[b].prev;
+    }
+    buckets[b].next = free_buckets;
+    free_buckets = b;
+}
+
+static void bucket_append(int16_t b, int16_t s) {
+    slots[s].bucket = b;
+    slots[s].next = NIL;
+    slots[s].prev = buckets[b].tail;
+    if (buckets[b].tail != NIL) {
+        slots[buckets[b].tail].next = s;
+    } else {
+        buckets[b].head = s;
+    }
+    buckets[b].tail = s;
+}
+
+// Unlink an entry from its bucket, releasing the bucket if it empties
+static void bucket_remove(int16_t s) {
+    int16_t b = slots[s].bucket;
+    if (slots[s].prev != NIL) {
+        slots[slots[s].prev].next = slots[s].next;
+    } else {
+        buckets[b].head = slots[s].next;
+    }
+    if (slots[s].next != NIL) {
+        slots[slots[s].next].prev = slots[s].prev;
+    } else {
+        buckets[b].tail = slots[s].prev;
+    }
+    slots[s].bucket = NIL;
+    if (buckets[b].head == NIL) {
+        bucket_free(b);
+    }
+}
+
+// Count another sighting: move the entry to the next frequency bucket
+static void touch(int16_t s) {
+    int16_t b = slots[s].bucket;
+    uint32_t frequency = buckets[b].frequency;
+    int16_t next = buckets[b].next;
+    bool sole = buckets[b].head == s && buckets[b].tail == s;
+
+    if (frequency == UINT32_MAX) {
+        // Saturated; just refresh its recency. A sole occupant already is
+        // the most recent, and removing it would free the bucket.
+        if (!sole) {
+            bucket_remove(s);
+            bucket_append(b, s);
+        }
+        return;
+    }
+    if (next != NIL && buckets[next].frequency == frequency + 1) {
+        bucket_remove(s);
+        bucket_append(next, s);
+    } else if (sole) {
+        // Sole occupant and no neighbour to join: renumber the bucket
+        buckets[b].frequency++;
+    } else {
+        next = bucket_alloc(frequency + 1, b);
+        bucket_remove(s);
+        bucket_append(next, s);
+    }
+    slots[s].data.frequency = frequency + 1;
+}
+
+static void free_storage(void) {
+    free(slots);
+    free(buckets);
+    free(hash_heads);
+    slots = NULL;
+    buckets = NULL;
+    hash_heads = NULL;
+}
+
+esp_err_t bthome_cache_init(void) {
+    size_t hash_size = 1;
+    while (hash_size < BTHOME_CACHE_SIZE) {
+        hash_size <<= 1;
+    }
+
+    slots = calloc(BTHOME_CACHE_SIZE, sizeof(cache_slot_t));
+    // One spare bucket: a move can allocate the next bucket before the
+    // old one empties
+    buckets = calloc(BTHOME_CACHE_SIZE + 1, sizeof(freq_bucket_t));
+    hash_heads = malloc(hash_size * sizeof(int16_t));
+    if (slots == NULL || buckets == NULL || hash_heads == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate cache for %d devices", BTHOME_CACHE_SIZE);
+        free_storage();
+        return ESP_ERR_NO_MEM;
+    }
+    hash_mask = hash_size - 1;
+    for (size_t i = 0; i < hash_size; i++) {
+        hash_heads[i] = NIL;
+    }
+
+    for (int i = 0; i < BTHOME_CACHE_SIZE; i++) {
+        slots[i].bucket = NIL;
+        slots[i].next = (i + 1 < BTHOME_CACHE_SIZE) ? i + 1 : NIL;
+    }
+    free_slots = 0;
+    for (int i = 0; i <= BTHOME_CACHE_SIZE; i++) {
+        buckets[i].next = (i < BTHOME_CACHE_SIZE) ? i + 1 : NIL;
+    }
+    free_buckets = 0;
+    bucket_list = NIL;
+
+    cache_mutex = xSemaphoreCreateMutex();
+    if (cache_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create cache mutex");
+        free_storage();
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void bthome_cache_put(const esp_bd_addr_t addr, int rssi, const uint8_t *adv, size_t adv_len,
+                      const struct timeval *now) {
+    if (cache_mutex == NULL) {
+        return;
+    }
+    if (adv_len > BTHOME_ADV_MAX_LEN) {
+        adv_len = BTHOME_ADV_MAX_LEN;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+
+    int16_t s = hash_find(addr);
+    if (s != NIL) {
+        touch(s);
+    } else {
+        if (free_slots != NIL) {
+            s = free_slots;
+            free_slots = slots[s].next;
+        } else {
+            // Evict the least frequently, then least recently, seen device
+            s = buckets[bucket_list].head;
+            bucket_remove(s);
+            hash_remove(s);
+        }
+        memcpy(slots[s].data.addr, addr, 6);
+        slots[s].data.frequency = 1;
+        int16_t b = bucket_list;
+        if (b == NIL || buckets[b].frequency != 1) {
+            b = bucket_alloc(1, NIL);
+        }
+        bucket_append(b, s);
+        hash_insert(s);
+    }
+
+    bthome_cache_entry_t *entry = &slots[s].data;
+    entry->rssi = rssi;
+    entry->last_seen = *now;
+    entry->adv_len = (uint8_t)adv_len;
+    memcpy(entry->adv, adv, adv_len);
+
+    xSemaphoreGive(cache_mutex);
+}
+
+void bthome_cache_foreach(bthome_cache_entry_iterator_t callback, void *user_data) {
+    if (cache_mutex == NULL || callback == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < BTHOME_CACHE_SIZE; i++) {
+        bthome_cache_entry_t entry;
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        bool occupied = slots[i].bucket != NIL;
+        if (occupied) {
+            entry = slots[i].data;
+        }
+        xSemaphoreGive(cache_mutex);
+
+        // Call outside the lock so page rendering never stalls the BLE callback
+        if (occupied && !callback(&entry, user_data)) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef BTHOME_CACHE_H
+#define BTHOME_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <esp_err.h>
+#include "esp_gap_ble_api.h"
+
+// Number of devices whose last advertisement is kept (Kconfig BTHOME_CACHE_SIZE)
+#define BTHOME_CACHE_SIZE CONFIG_BTHOME_CACHE_SIZE
+
+// Legacy advertising data plus scan response
+#define BTHOME_ADV_MAX_LEN 62
+
+// Last advertisement seen from a device, kept as raw bytes and decoded only
+// when someone looks at it
+typedef struct {
+    esp_bd_addr_t addr;
+    int rssi;
+    uint32_t frequency;         // Advertisements seen while cached
+    struct timeval last_seen;
+    uint8_t adv_len;
+    uint8_t adv[BTHOME_ADV_MAX_LEN];
+} bthome_cache_entry_t;
+
+// Callback for bthome_cache_foreach; return false to stop
+typedef bool (*bthome_cache_entry_iterator_t)(const bthome_cache_entry_t *entry, void *user_data);
+
+esp_err_t bthome_cache_init(void);
+
+/**
+ * @brief Store the latest advertisement from a device
+ *
+ * O(1). When the cache is full, the least frequently seen device is evicted,
+ * the least recently seen one among equals.
+ */
+void bthome_cache_put(const esp_bd_addr_t addr, int rssi, const uint8_t *adv, size_t adv_len,
+                      const struct timeval *now);
+
+// Iterate over cached devices. Entries are copied under the lock and the
+// callback runs outside it.
+void bthome_cache_foreach(bthome_cache_entry_iterator_t callback, void *user_data);
+
+#endif // BTHOME_CACHE_H
@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "mbedtls/ccm.h"
+#include "bthome_crypto.h"
+#include "alloc_prof.h"
+
+static const char *TAG = "bthome_crypto";
+
+#define NONCE_LEN 13
+
+typedef struct {
+    esp_bd_addr_t addr;
+    uint8_t key[BTHOME_BINDKEY_LEN];
+    mbedtls_ccm_context ccm;    // Key schedule expanded once, at load
+    uint32_t last_counter;
+    bool has_counter;
+    bool occupied;
+} key_entry_t;
+
+// Open-addressed table keyed on MAC, at least twice the number of keys
+static key_entry_t *key_table = NULL;
+static size_t key_table_mask = 0;
+static SemaphoreHandle_t key_mutex = NULL;
+static bthome_crypto_stats_t crypto_stats;
+
+static uint32_t mac_hash(const esp_bd_addr_t addr) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash = (hash ^ addr[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Find the slot holding addr, or the empty slot where it would go. The table
+// is never full, so the probe always terminates.
+static key_entry_t *key_slot(key_entry_t *table, size_t mask, const esp_bd_addr_t addr) {
+    size_t i = mac_hash(addr) & mask;
+    while (table[i].occupied && memcmp(table[i].addr, addr, 6) != 0) {
+        i = (i + 1) & mask;
+    }
+    return &table[i];
+}
+
+static void free_table(key_entry_t *table, size_t mask) {
+    if (table == NULL) {
+        return;
+    }
+    for (size_t i = 0; i <= mask; i++) {
+        if (table[i].occupied) {
+            mbedtls_ccm_free(&table[i].ccm);
+        }
+    }
+    // Don't leave key material behind in the heap
+    memset(table, 0, (mask + 1) * sizeof(key_entry_t));
+    free(table);
+}
+
+esp_err_t bthome_crypto_init(const settings_t *settings) {
+    key_mutex = xSemaphoreCreateMutex();
+    if (key_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create key mutex");
+        return ESP_FAIL;
+    }
+    return bthome_crypto_load(settings);
+}
+
+esp_err_t bthome_crypto_load(const settings_t *settings) {
+    if (key_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t slots = 1;
+    while (slots < 2 * settings->bthome_bindkeys_count) {
+        slots <<= 1;
+    }
+    if (slots < 2) {
+        slots = 2;  // Keep one empty slot so lookups terminate
+    }
+    key_entry_t *table = calloc(slots, sizeof(key_entry_t));
+    if (table == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate key table (%u slots)", (unsigned)slots);
+        return ESP_ERR_NO_MEM;
+    }
+    size_t mask = slots - 1;
+
+    int loaded = 0;
+    for (size_t i = 0; i < settings->bthome_bindkeys_count; i++) {
+        const bthome_bindkey_t *bk = &settings->bthome_bindkeys[i];
+        key_entry_t *entry = key_slot(table, mask, bk->mac_addr);
+        if (entry->occupied) {
+            continue;  // Duplicate MAC; first key wins
+        }
+        mbedtls_ccm_init(&entry->ccm);
+        int ret = mbedtls_ccm_setkey(&entry->ccm, MBEDTLS_CIPHER_ID_AES, bk->key, BTHOME_BINDKEY_LEN * 8);
+        if (ret != 0) {
+            ESP_LOGE(TAG, "Failed to set key for %02X:%02X:%02X:%02X:%02X:%02X: -0x%04x",
+                     bk->mac_addr[0], bk->mac_addr[1], bk->mac_addr[2],
+                     bk->mac_addr[3], bk->mac_addr[4], bk->mac_addr[5], -ret);
+            mbedtls_ccm_free(&entry->ccm);
+            continue;
+        }
+        memcpy(entry->addr, bk->mac_addr, 6);
+        memcpy(entry->key, bk->key, BTHOME_BINDKEY_LEN);
+        entry->occupied = true;
+        loaded++;
+    }
+
+    xSemaphoreTake(key_mutex, portMAX_DELAY);
+    // Carry replay state over for devices that kept their key, so a reload
+    // doesn't reopen the window for old packets
+    if (key_table != NULL) {
+        for (size_t i = 0; i <= mask; i++) {
+            key_entry_t *entry = &table[i];
+            if (!entry->occupied) {
+                continue;
+            }
+            key_entry_t *old = key_slot(key_table, key_table_mask, entry->addr);
+            if (old->occupied && memcmp(old->key, entry->key, BTHOME_BINDKEY_LEN) == 0) {
+                entry->last_counter = old->last_counter;
+                entry->has_counter = old->has_counter;
+            }
+        }
+    }
+    key_entry_t *old_table = key_table;
+    size_t old_mask = key_table_mask;
+    key_table = table;
+    key_table_mask = mask;
+    xSemaphoreGive(key_mutex);
+
+    free_table(old_table, old_mask);
+    ESP_LOGI(TAG, "Loaded %d BTHome bindkeys", loaded);
+    return ESP_OK;
+}
+
+// Run AES-CCM for an entry. Called with the mutex held.
+static int ccm_decrypt(key_entry_t *entry, const esp_bd_addr_t addr, const bthome_adv_t *adv, uint8_t *out) {
+    // Nonce: MAC | UUID (little-endian) | device info | counter (as sent)
+    uint8_t nonce[NONCE_LEN];
+    memcpy(nonce, addr, 6);
+    nonce[6] = BTHOME_UUID_LO;
+    nonce[7] = BTHOME_UUID_HI;
+    nonce[8] = adv->device_info;
+    memcpy(&nonce[9], adv->payload + adv->payload_len, BTHOME_COUNTER_LEN);
+
+    return mbedtls_ccm_auth_decrypt(&entry->ccm, adv->payload_len, nonce, sizeof(nonce),
+                                    NULL, 0, adv->payload, out, adv->mic, BTHOME_MIC_LEN);
+}
+
+esp_err_t bthome_crypto_decrypt(const esp_bd_addr_t addr, const bthome_adv_t *adv, uint8_t *out) {
+    if (key_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(key_mutex, portMAX_DELAY);
+
+    key_entry_t *entry = key_table ? key_slot(key_table, key_table_mask, addr) : NULL;
+    if (entry == NULL || !entry->occupied) {
+        crypto_stats.no_key++;
+        xSemaphoreGive(key_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Cheap check first: anything not newer than the last authenticated
+    // packet is a replay, and never reaches the cipher
+    if (entry->has_counter && adv->counter <= entry->last_counter) {
+        crypto_stats.replays++;
+        xSemaphoreGive(key_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int ret = ccm_decrypt(entry, addr, adv, out);
+    if (ret != 0) {
+        crypto_stats.auth_failures++;
+        xSemaphoreGive(key_mutex);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // Only an authenticated packet may advance the counter
+    entry->last_counter = adv->counter;
+    entry->has_counter = true;
+    crypto_stats.decrypted++;
+
+    xSemaphoreGive(key_mutex);
+    return ESP_OK;
+}
+
+esp_err_t bthome_crypto_peek(const esp_bd_addr_t addr, const bthome_adv_t *adv, uint8_t *out) {
+    if (key_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(key_mutex, portMAX_DELAY);
+    key_entry_t *entry = key_table ? key_slot(key_table, key_table_mask, addr) : NULL;
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    if (entry != NULL && entry->occupied) {
+        err = (ccm_decrypt(entry, addr, adv, out) == 0) ? ESP_OK : ESP_ERR_INVALID_CRC;
+    }
+    xSemaphoreGive(key_mutex);
+    return err;
+}
+
+void bthome_crypto_get_stats(bthome_crypto_stats_t *stats) {
+    if (key_mutex == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(key_mutex, portMAX_DELAY);
+    *stats = crypto_stats;
+    xSemaphoreGive(key_mutex);
+}
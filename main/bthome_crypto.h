@@ -0,0 +1,58 @@
+#ifndef BTHOME_CRYPTO_H
+#define BTHOME_CRYPTO_H
+
+#include <stdint.h>
+#include <esp_err.h>
+#include "esp_gap_ble_api.h"
+#include "settings.h"
+#include "bthome_decoder.h"
+
+// Outcome counters for encrypted advertisements
+typedef struct {
+    uint32_t decrypted;         // Authenticated and decrypted
+    uint32_t no_key;            // No bindkey configured for the sender
+    uint32_t replays;           // Counter not newer than the last accepted one
+    uint32_t auth_failures;     // MIC check failed (wrong key or tampered)
+} bthome_crypto_stats_t;
+
+/**
+ * @brief Set up the bindkey table and load the configured keys
+ */
+esp_err_t bthome_crypto_init(const settings_t *settings);
+
+/**
+ * @brief Rebuild the bindkey table from settings
+ *
+ * Keys take effect immediately. Replay state is kept for devices whose key
+ * did not change.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before bthome_crypto_init, or
+ *         ESP_ERR_NO_MEM
+ */
+esp_err_t bthome_crypto_load(const settings_t *settings);
+
+/**
+ * @brief Authenticate and decrypt an encrypted BTHome payload
+ *
+ * @param addr Advertiser address, part of the nonce
+ * @param adv Parsed advertisement with adv->encrypted set
+ * @param out Receives adv->payload_len bytes of plain text
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if there is no key for addr,
+ *         ESP_ERR_INVALID_STATE if the counter was replayed, or
+ *         ESP_ERR_INVALID_CRC if authentication failed
+ */
+esp_err_t bthome_crypto_decrypt(const esp_bd_addr_t addr, const bthome_adv_t *adv, uint8_t *out);
+
+/**
+ * @brief Decrypt an advertisement that was already accepted once
+ *
+ * Used to decode cached advertisements on demand. Skips the replay check and
+ * leaves the counter and statistics alone.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND or ESP_ERR_INVALID_CRC
+ */
+esp_err_t bthome_crypto_peek(const esp_bd_addr_t addr, const bthome_adv_t *adv, uint8_t *out);
+
+void bthome_crypto_get_stats(bthome_crypto_stats_t *stats);
+
+#endif // BTHOME_CRYPTO_H
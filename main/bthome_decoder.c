@@ -0,0 +1,252 @@
+#include <string.h>
+#include "bthome_decoder.h"
+
+// AD structure types
+#define AD_TYPE_SHORT_NAME        0x08
+#define AD_TYPE_COMPLETE_NAME     0x09
+#define AD_TYPE_SERVICE_DATA_16   0x16
+
+// Object IDs with special handling
+#define OBJ_PACKET_ID       0x00
+#define OBJ_BUTTON_EVENT    0x3A
+#define OBJ_DIMMER_EVENT    0x3C
+#define OBJ_TEXT            0x53
+#define OBJ_RAW             0x54
+#define OBJ_DEVICE_TYPE     0xF0
+#define OBJ_FW_VERSION_4    0xF1
+#define OBJ_FW_VERSION_3    0xF2
+
+typedef struct {
+    uint8_t size;       // Bytes of data following the object ID; 0 = unknown ID
+    bool is_signed;
+    float factor;
+} object_format_t;
+
+#define U(n, f) { (n), false, (f) }
+#define S(n, f) { (n), true, (f) }
+
+// Sizes and scaling of the BTHome v2 sensor and binary sensor objects
+static const object_format_t object_formats[] = {
+    [0x01] = U(1, 1.0f),        // battery %
+    [0x02] = S(2, 0.01f),       // temperature °C
+    [0x03] = U(2, 0.01f),       // humidity %
+    [0x04] = U(3, 0.01f),       // pressure hPa
+    [0x05] = U(3, 0.01f),       // illuminance lux
+    [0x06] = U(2, 0.01f),       // mass kg
+    [0x07] = U(2, 0.01f),       // mass lb
+    [0x08] = S(2, 0.01f),       // dew point °C
+    [0x09] = U(1, 1.0f),        // count
+    [0x0A] = U(3, 0.001f),      // energy kWh
+    [0x0B] = U(3, 0.01f),       // power W
+    [0x0C] = U(2, 0.001f),      // voltage V
+    [0x0D] = U(2, 1.0f),        // pm2.5
+    [0x0E] = U(2, 1.0f),        // pm10
+    [0x0F] = U(1, 1.0f),        // generic boolean
+    [0x10] = U(1, 1.0f), [0x11] = U(1, 1.0f), [0x12] = U(2, 1.0f),   // power, opening, CO2
+    [0x13] = U(2, 1.0f),        // TVOC
+    [0x14] = U(2, 0.01f),       // moisture %
+    [0x15] = U(1, 1.0f), [0x16] = U(1, 1.0f), [0x17] = U(1, 1.0f),
+    [0x18] = U(1, 1.0f), [0x19] = U(1, 1.0f), [0x1A] = U(1, 1.0f),
+    [0x1B] = U(1, 1.0f), [0x1C] = U(1, 1.0f), [0x1D] = U(1, 1.0f),
+    [0x1E] = U(1, 1.0f), [0x1F] = U(1, 1.0f), [0x20] = U(1, 1.0f),
+    [0x21] = U(1, 1.0f), [0x22] = U(1, 1.0f), [0x23] = U(1, 1.0f),
+    [0x24] = U(1, 1.0f), [0x25] = U(1, 1.0f), [0x26] = U(1, 1.0f),
+    [0x27] = U(1, 1.0f), [0x28] = U(1, 1.0f), [0x29] = U(1, 1.0f),
+    [0x2A] = U(1, 1.0f), [0x2B] = U(1, 1.0f), [0x2C] = U(1, 1.0f),
+    [0x2D] = U(1, 1.0f),        // binary sensors 0x15-0x2D
+    [0x2E] = U(1, 1.0f),        // humidity %
+    [0x2F] = U(1, 1.0f),        // moisture %
+    [0x3D] = U(2, 1.0f),        // count
+    [0x3E] = U(4, 1.0f),        // count
+    [0x3F] = S(2, 0.1f),        // rotation °
+    [0x40] = U(2, 1.0f),        // distance mm
+    [0x41] = U(2, 0.1f),        // distance m
+    [0x42] = U(3, 0.001f),      // duration s
+    [0x43] = U(2, 0.001f),      // current A
+    [0x44] = U(2, 0.01f),       // speed m/s
+    [0x45] = S(2, 0.1f),        // temperature °C
+    [0x46] = U(1, 0.1f),        // UV index
+    [0x47] = U(2, 0.1f),        // volume L
+    [0x48] = U(2, 1.0f),        // volume mL
+    [0x49] = U(2, 0.001f),      // volume flow rate m3/hr
+    [0x4A] = U(2, 0.1f),        // voltage V
+    [0x4B] = U(3, 0.001f),      // gas m3
+    [0x4C] = U(4, 0.001f),      // gas m3
+    [0x4D] = U(4, 0.001f),      // energy kWh
+    [0x4E] = U(4, 0.001f),      // volume L
+    [0x4F] = U(4, 0.001f),      // water L
+    [0x50] = U(4, 1.0f),        // timestamp
+    [0x51] = U(2, 0.001f),      // acceleration m/s²
+    [0x52] = U(2, 0.001f),      // gyroscope °/s
+    [0x55] = U(4, 0.001f),      // volume storage L
+    [0x56] = U(2, 1.0f),        // conductivity µS/cm
+    [0x57] = S(1, 1.0f),        // temperature °C
+    [0x58] = S(1, 0.35f),       // temperature °C
+    [0x59] = S(1, 1.0f),        // count
+    [0x5A] = S(2, 1.0f),        // count
+    [0x5B] = S(4, 1.0f),        // count
+    [0x5C] = S(4, 0.01f),       // power W
+    [0x5D] = S(2, 0.001f),      // current A
+    [0x5E] = U(2, 0.01f),       // direction °
+    [0x5F] = U(2, 0.1f),        // precipitation mm
+    [0x60] = U(1, 1.0f),        // channel
+    [0x61] = U(2, 1.0f),        // rotational speed rpm
+};
+
+#undef U
+#undef S
+
+#define OBJECT_FORMAT_COUNT (sizeof(object_formats) / sizeof(object_formats[0]))
+
+static uint32_t read_le(const uint8_t *p, size_t n) {
+    uint32_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v |= (uint32_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static float decode_value(const uint8_t *p, const object_format_t *fmt) {
+    uint32_t raw = read_le(p, fmt->size);
+    if (fmt->is_signed && fmt->size < 4 && (raw & (1u << (8 * fmt->size - 1)))) {
+        raw |= ~0u << (8 * fmt->size);  // Sign-extend
+    }
+    return fmt->is_signed ? (int32_t)raw * fmt->factor : raw * fmt->factor;
+}
+
+esp_err_t bthome_adv_parse(const uint8_t *data, size_t len, bthome_adv_t *adv) {
+    const uint8_t *service_data = NULL;
+    size_t service_data_len = 0;
+
+    memset(adv, 0, sizeof(*adv));
+
+    size_t pos = 0;
+    while (pos < len) {
+        uint8_t field_len = data[pos];
+        if (field_len == 0) {
+            break;  // Padding at the end of the advertisement
+        }
+        if (pos + 1 + field_len > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        uint8_t type = data[pos + 1];
+        const uint8_t *field = &data[pos + 2];
+        size_t field_data_len = field_len - 1;
+
+        if (type == AD_TYPE_SERVICE_DATA_16 && field_data_len >= 3 &&
+            field[0] == BTHOME_UUID_LO && field[1] == BTHOME_UUID_HI) {
+            service_data = field + 2;
+            service_data_len = field_data_len - 2;
+        } else if (type == AD_TYPE_COMPLETE_NAME ||
+                   (type == AD_TYPE_SHORT_NAME && !adv->complete_name)) {
+            adv->name = (const char *)field;
+            adv->name_len = field_data_len;
+            adv->complete_name = (type == AD_TYPE_COMPLETE_NAME);
+        }
+        pos += 1 + field_len;
+    }
+
+    if (service_data == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    adv->device_info = service_data[0];
+    adv->version = service_data[0] >> BTHOME_INFO_VERSION_SHIFT;
+    adv->encrypted = (service_data[0] & BTHOME_INFO_ENCRYPTED) != 0;
+    adv->trigger_based = (service_data[0] & BTHOME_INFO_TRIGGER_BASED) != 0;
+    adv->payload = service_data + 1;
+    adv->payload_len = service_data_len - 1;
+
+    if (adv->encrypted) {
+        if (adv->payload_len < BTHOME_COUNTER_LEN + BTHOME_MIC_LEN) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        adv->payload_len -= BTHOME_COUNTER_LEN + BTHOME_MIC_LEN;
+        adv->counter = read_le(adv->payload + adv->payload_len, BTHOME_COUNTER_LEN);
+        adv->mic = adv->payload + adv->payload_len + BTHOME_COUNTER_LEN;
+    }
+    return ESP_OK;
+}
+
+esp_err_t bthome_decode(const bthome_adv_t *adv, const uint8_t *payload, size_t len,
+                        bthome_frame_t *frame) {
+    memset(frame, 0, sizeof(*frame));
+    frame->version = adv->version;
+    frame->encrypted = adv->encrypted;
+    frame->trigger_based = adv->trigger_based;
+    if (adv->name != NULL) {
+        size_t name_len = adv->name_len < sizeof(frame->device_name) - 1 ?
+                          adv->name_len : sizeof(frame->device_name) - 1;
+        memcpy(frame->device_name, adv->name, name_len);
+        frame->use_complete_name = adv->complete_name;
+    }
+
+    size_t pos = 0;
+    while (pos < len) {
+        uint8_t object_id = payload[pos++];
+        const uint8_t *p = &payload[pos];
+        size_t remaining = len - pos;
+        size_t size;
+
+        switch (object_id) {
+            case OBJ_PACKET_ID:
+                size = 1;
+                if (remaining >= size) {
+                    frame->has_packet_id = true;
+                    frame->packet_id = p[0];
+                }
+                break;
+            case OBJ_BUTTON_EVENT:
+            case OBJ_DIMMER_EVENT:
+                size = (object_id == OBJ_DIMMER_EVENT) ? 2 : 1;
+                if (remaining >= size && frame->event_count < BTHOME_FRAME_MAX_EVENTS) {
+                    bthome_frame_event_t *e = &frame->events[frame->event_count++];
+                    e->event_type = object_id;
+                    e->event_value = p[0];
+                    e->steps = (size == 2) ? (int8_t)p[1] : 0;
+                }
+                break;
+            case OBJ_TEXT:
+            case OBJ_RAW:
+                // Length-prefixed; not exposed as measurements
+                size = remaining > 0 ? 1 + p[0] : 1;
+                break;
+            case OBJ_DEVICE_TYPE:
+                size = 2;
+                break;
+            case OBJ_FW_VERSION_4:
+                size = 4;
+                break;
+            case OBJ_FW_VERSION_3:
+                size = 3;
+                break;
+            default: {
+                if (object_id >= OBJECT_FORMAT_COUNT || object_formats[object_id].size == 0) {
+                    return ESP_OK;
+                }
+                const object_format_t *fmt = &object_formats[object_id];
+                size = fmt->size;
+                if (remaining >= size && frame->measurement_count < BTHOME_FRAME_MAX_MEASUREMENTS) {
+                    bthome_frame_measurement_t *m = &frame->measurements[frame->measurement_count++];
+                    m->object_id = object_id;
+                    m->value = decode_value(p, fmt);
+                }
+                break;
+            }
+        }
+
+        if (remaining < size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        pos += size;
+    }
+    return ESP_OK;
+}
+
+bool bthome_peek_packet_id(const uint8_t *payload, size_t len, uint8_t *packet_id) {
+    if (len < 2 || payload[0] != OBJ_PACKET_ID) {
+        return false;
+    }
+    *packet_id = payload[1];
+    return true;
+}
@@ -0,0 +1,110 @@
+#ifndef BTHOME_DECODER_H
+#define BTHOME_DECODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// BTHome service UUID 0xFCD2, little-endian as it appears on air
+#define BTHOME_UUID_LO 0xD2
+#define BTHOME_UUID_HI 0xFC
+
+// Device information byte
+#define BTHOME_INFO_ENCRYPTED     0x01
+#define BTHOME_INFO_TRIGGER_BASED 0x04
+#define BTHOME_INFO_VERSION_SHIFT 5
+
+// Encrypted payloads end with a 4-byte counter and a 4-byte MIC
+#define BTHOME_COUNTER_LEN 4
+#define BTHOME_MIC_LEN     4
+
+// Longest object payload a legacy advertisement plus scan response can carry
+#define BTHOME_MAX_PAYLOAD_LEN 62
+
+#define BTHOME_FRAME_MAX_MEASUREMENTS 16
+#define BTHOME_FRAME_MAX_EVENTS 4
+#define BTHOME_FRAME_NAME_MAX_LEN 32
+
+// A BTHome advertisement located in raw advertising data. Pointers refer into
+// the caller's buffer.
+typedef struct {
+    uint8_t device_info;        // Raw device information byte (part of the nonce)
+    uint8_t version;
+    bool encrypted;
+    bool trigger_based;
+    const uint8_t *payload;     // Object data; ciphertext when encrypted
+    size_t payload_len;
+    uint32_t counter;           // Encryption counter (encrypted only)
+    const uint8_t *mic;         // Message integrity check (encrypted only)
+    const char *name;           // Local name, not NUL terminated (may be NULL)
+    size_t name_len;
+    bool complete_name;
+} bthome_adv_t;
+
+typedef struct {
+    uint8_t object_id;
+    float value;                // Scaled to the object's unit
+} bthome_frame_measurement_t;
+
+typedef struct {
+    uint8_t event_type;
+    uint8_t event_value;
+    int8_t steps;               // Dimmer events only
+} bthome_frame_event_t;
+
+// A fully decoded BTHome advertisement with fixed-size storage, so frames can
+// be copied and cached without allocating
+typedef struct {
+    uint8_t version;
+    bool encrypted;
+    bool trigger_based;
+    bool has_packet_id;
+    uint8_t packet_id;
+    uint8_t measurement_count;
+    uint8_t event_count;
+    bthome_frame_measurement_t measurements[BTHOME_FRAME_MAX_MEASUREMENTS];
+    bthome_frame_event_t events[BTHOME_FRAME_MAX_EVENTS];
+    char device_name[BTHOME_FRAME_NAME_MAX_LEN];    // NUL terminated, empty if absent
+    bool use_complete_name;
+} bthome_frame_t;
+
+/**
+ * @brief Find the BTHome service data and local name in raw advertising data
+ *
+ * @param data Advertising data, optionally followed by the scan response
+ * @param len Length of data
+ * @param adv Filled in on success
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if there is no BTHome service data, or
+ *         ESP_ERR_INVALID_SIZE if the advertisement is malformed
+ */
+esp_err_t bthome_adv_parse(const uint8_t *data, size_t len, bthome_adv_t *adv);
+
+/**
+ * @brief Decode BTHome objects into a frame
+ *
+ * @param adv Advertisement the payload came from (header and name are copied)
+ * @param payload Plain-text object data: adv->payload, or its decryption
+ * @param len Length of payload
+ * @param frame Filled in on success. Objects beyond the frame's capacity are
+ *        dropped.
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE if an object is truncated. Decoding
+ *         stops at the first unknown object ID, since its size cannot be known.
+ */
+esp_err_t bthome_decode(const bthome_adv_t *adv, const uint8_t *payload, size_t len,
+                        bthome_frame_t *frame);
+
+/**
+ * @brief Read the packet ID without decoding the rest of the payload
+ *
+ * Objects are sent in ascending ID order, so the packet ID (object 0x00) can
+ * only be the first one. Lets repeats be dropped before bthome_decode().
+ *
+ * @param payload Plain-text object data
+ * @param len Length of payload
+ * @param packet_id Set if the payload starts with a packet ID
+ * @return true if it does
+ */
+bool bthome_peek_packet_id(const uint8_t *payload, size_t len, uint8_t *packet_id);
+
+#endif // BTHOME_DECODER_H
@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "bthome_devices.h"
+#include "alloc_prof.h"
+
+static const char *TAG = "bthome_devices";
+
+// Smoothing factors for the running averages
+#define RSSI_EWMA_ALPHA     (1.0f / 8.0f)
+#define INTERVAL_EWMA_ALPHA (1.0f / 8.0f)
+#define JITTER_GAIN         (1.0f / 16.0f)   // As in RFC 3550 section 6.4.1
+
+// Larger packet ID steps are too likely to have wrapped to give a period
+#define MAX_PACKET_ID_STEP  16
+
+#define DEDUP_WINDOW_US ((int64_t)CONFIG_BTHOME_DEDUP_WINDOW_MS * 1000)
+
+typedef struct {
+    bthome_device_stats_t stats;
+    int64_t last_unique_us;     // Arrival of the last non-duplicate packet
+    float last_interval_s;      // Previous inter-arrival time, for jitter
+    uint32_t last_packet_id;
+    int last_packet_id_bits;    // 0 when the last packet had no ID
+    bool occupied;
+} device_entry_t;
+
+// Open-addressed table keyed on MAC, at least twice BTHOME_MAX_DEVICES slots
+static device_entry_t *device_table = NULL;
+static size_t device_table_mask = 0;
+static int device_count = 0;
+static uint32_t untracked_count = 0;
+static SemaphoreHandle_t device_mutex = NULL;
+
+static uint32_t mac_hash(const esp_bd_addr_t addr) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash = (hash ^ addr[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Find the entry for addr, or the empty slot where it would go. Called with
+// the mutex held; the table is never full, so the probe always terminates.
+static device_entry_t *device_slot(const esp_bd_addr_t addr) {
+    size_t i = mac_hash(addr) & device_table_mask;
+    while (device_table[i].occupied && memcmp(device_table[i].stats.addr, addr, 6) != 0) {
+        i = (i + 1) & device_table_mask;
+    }
+    return &device_table[i];
+}
+
+// Find the entry for addr, creating it if there is room. Called with the mutex held.
+static device_entry_t *find_or_add_device(const esp_bd_addr_t addr) {
+    device_entry_t *entry = device_slot(addr);
+    if (entry->occupied) {
+        return entry;
+    }
+
+    if (device_count >= BTHOME_MAX_DEVICES) {
+        untracked_count++;
+        return NULL;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->stats.addr, addr, 6);
+    entry->occupied = true;
+    device_count++;
+    return entry;
+}
+
+esp_err_t bthome_devices_init(void) {
+    size_t slots = 1;
+    while (slots < 2 * BTHOME_MAX_DEVICES) {
+        slots <<= 1;
+    }
+    device_table = calloc(slots, sizeof(device_entry_t));
+    if (device_table == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate device table (%u slots)", (unsigned)slots);
+        return ESP_ERR_NO_MEM;
+    }
+    device_table_mask = slots - 1;
+
+    device_mutex = xSemaphoreCreateMutex();
+    if (device_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create device mutex");
+        free(device_table);
+        device_table = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// One period estimate from the interval since the last unique packet, or 0
+static float period_sample(const device_entry_t *entry, float interval_s, uint32_t packet_id,
+                           int packet_id_bits, int64_t wide_since_us) {
+    if (packet_id_bits == 0) {
+        // No way to count missed packets: only trust unbroken wide scanning
+        return entry->last_unique_us >= wide_since_us ? interval_s : 0.0f;
+    }
+    if (entry->last_packet_id_bits != packet_id_bits) {
+        return 0.0f;
+    }
+    uint32_t mask = packet_id_bits >= 32 ? UINT32_MAX : (1u << packet_id_bits) - 1;
+    uint32_t step = (packet_id - entry->last_packet_id) & mask;
+    if (step == 0 || step > MAX_PACKET_ID_STEP) {
+        return 0.0f;
+    }
+    return interval_s / step;
+}
+
+bool bthome_devices_observe(const esp_bd_addr_t addr, int rssi, uint32_t packet_id,
+                            int packet_id_bits, int64_t wide_since_us, int64_t now_us) {
+    if (device_mutex == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(device_mutex, portMAX_DELAY);
+
+    device_entry_t *entry = find_or_add_device(addr);
+    if (entry == NULL) {
+        xSemaphoreGive(device_mutex);
+        return false;
+    }
+
+    bthome_device_stats_t *stats = &entry->stats;
+    stats->packets++;
+    if (stats->packets == 1) {
+        stats->rssi_ewma = rssi;
+    } else {
+        stats->rssi_ewma += RSSI_EWMA_ALPHA * (rssi - stats->rssi_ewma);
+    }
+    stats->last_seen_us = now_us;
+
+    bool duplicate = packet_id_bits != 0 && entry->last_packet_id_bits == packet_id_bits &&
+                     entry->last_packet_id == packet_id &&
+                     now_us - entry->last_unique_us < DEDUP_WINDOW_US;
+    if (duplicate) {
+        stats->duplicates++;
+        xSemaphoreGive(device_mutex);
+        return true;
+    }
+
+    // Inter-arrival statistics are based on unique packets only, so they
+    // reflect the device's advertising interval rather than its repeat burst
+    if (entry->last_unique_us != 0) {
+        float interval_s = (now_us - entry->last_unique_us) / 1e6f;
+        if (stats->interval_ewma_s == 0.0f) {
+            stats->interval_ewma_s = interval_s;
+        } else {
+            stats->interval_ewma_s += INTERVAL_EWMA_ALPHA * (interval_s - stats->interval_ewma_s);
+        }
+        if (entry->last_interval_s > 0.0f) {
+            float d = fabsf(interval_s - entry->last_interval_s);
+            stats->jitter_s += JITTER_GAIN * (d - stats->jitter_s);
+        }
+        entry->last_interval_s = interval_s;
+
+        float sample = period_sample(entry, interval_s, packet_id, packet_id_bits, wide_since_us);
+        if (sample > 0.0f) {
+            if (stats->period_s == 0.0f) {
+                stats->period_s = sample;
+            } else {
+                float d = fabsf(sample - stats->period_s);
+                stats->period_jitter_s += JITTER_GAIN * (d - stats->period_jitter_s);
+                stats->period_s += INTERVAL_EWMA_ALPHA * (sample - stats->period_s);
+            }
+        }
+    }
+    entry->last_unique_us = now_us;
+    entry->last_packet_id = packet_id;
+    entry->last_packet_id_bits = packet_id_bits;
+
+    xSemaphoreGive(device_mutex);
+    return false;
+}
+
+bool bthome_devices_check_repeat(const esp_bd_addr_t addr, uint32_t packet_id, int64_t now_us) {
+    if (device_mutex == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(device_mutex, portMAX_DELAY);
+    device_entry_t *entry = device_slot(addr);
+    bool duplicate = entry->occupied && entry->last_packet_id_bits == 32 &&
+                     entry->last_packet_id == packet_id &&
+                     now_us - entry->last_unique_us < DEDUP_WINDOW_US;
+    if (duplicate) {
+        entry->stats.packets++;
+        entry->stats.duplicates++;
+    }
+    xSemaphoreGive(device_mutex);
+    return duplicate;
+}
+
+bool bthome_devices_get(const esp_bd_addr_t addr, bthome_device_stats_t *stats) {
+    if (device_mutex == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(device_mutex, portMAX_DELAY);
+    device_entry_t *entry = device_slot(addr);
+    bool found = entry->occupied;
+    if (found) {
+        *stats = entry->stats;
+    }
+    xSemaphoreGive(device_mutex);
+    return found;
+}
+
+void bthome_devices_iterate(bthome_device_iterator_t callback, void *user_data) {
+    if (device_mutex == NULL || callback == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i <= device_table_mask; i++) {
+        bthome_device_stats_t stats;
+        xSemaphoreTake(device_mutex, portMAX_DELAY);
+        bool occupied = device_table[i].occupied;
+        if (occupied) {
+            stats = device_table[i].stats;
+        }
+        xSemaphoreGive(device_mutex);
+
+        // Call outside the lock so a slow consumer never stalls the BLE callback
+        if (occupied && !callback(&stats, user_data)) {
+            break;
+        }
+    }
+}
+
+uint32_t bthome_devices_untracked(void) {
+    return untracked_count;
+}
@@ -0,0 +1,63 @@
+#ifndef BTHOME_DEVICES_H
+#define BTHOME_DEVICES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "esp_gap_ble_api.h"
+
+// Maximum number of BTHome advertisers tracked for dedupe and statistics.
+// Only devices in the MAC filters are tracked, so passers-by and spoofed
+// addresses cannot take the slots or add metric labels.
+#define BTHOME_MAX_DEVICES CONFIG_BTHOME_MAX_DEVICES
+
+// Per-device reception statistics
+typedef struct {
+    esp_bd_addr_t addr;
+    uint32_t packets;           // Advertisements received, including repeats
+    uint32_t duplicates;        // Repeats dropped by packet ID
+    float rssi_ewma;            // Smoothed RSSI in dBm
+    float interval_ewma_s;      // Smoothed time between unique packets
+    float jitter_s;             // Smoothed inter-arrival variation (RFC 3550 style)
+    float period_s;             // Advertising period, for the scan scheduler; 0 until known
+    float period_jitter_s;      // Smoothed variation of the period estimates
+    int64_t last_seen_us;       // esp_timer time of the last advertisement
+} bthome_device_stats_t;
+
+// Callback for bthome_devices_iterate; return false to stop
+typedef bool (*bthome_device_iterator_t)(const bthome_device_stats_t *stats, void *user_data);
+
+esp_err_t bthome_devices_init(void);
+
+// Record an advertisement from a device in the MAC filters; for encrypted
+// devices, only once it has been authenticated. packet_id is the BTHome
+// packet ID object (packet_id_bits 8), or the encryption counter for
+// encrypted devices (32); packet_id_bits is 0 when there is neither.
+// wide_since_us is when the receiver last started scanning wide without a
+// break (bthome_scan_wide_since_us()). Returns true if it repeats the device's
+// last packet ID within CONFIG_BTHOME_DEDUP_WINDOW_MS and should be dropped.
+//
+// The receiver misses most advertisements while it scans at a low duty
+// cycle, so the interval between two received packets can be any multiple of
+// the period. period_s is therefore learned from the interval divided by the
+// packet ID step, or for devices without a packet ID, only from intervals the
+// receiver scanned wide throughout.
+bool bthome_devices_observe(const esp_bd_addr_t addr, int rssi, uint32_t packet_id,
+                            int packet_id_bits, int64_t wide_since_us, int64_t now_us);
+
+// Check an encrypted advertisement's counter before decrypting it. Returns
+// true, counting a duplicate, if it repeats the last authenticated packet of
+// a tracked device within the dedup window. Never adds a device or touches
+// the RSSI and interval statistics, which follow authenticated packets only.
+bool bthome_devices_check_repeat(const esp_bd_addr_t addr, uint32_t packet_id, int64_t now_us);
+
+// Copy the statistics of one device. Returns false if it is not tracked.
+bool bthome_devices_get(const esp_bd_addr_t addr, bthome_device_stats_t *stats);
+
+// Iterate over all tracked devices. The stats are copies taken under the lock.
+void bthome_devices_iterate(bthome_device_iterator_t callback, void *user_data);
+
+// Advertisements from devices that could not be tracked because the table was full
+uint32_t bthome_devices_untracked(void);
+
+#endif // BTHOME_DEVICES_H
@@ -0,0 +1,294 @@
+#include <math.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_gap_ble_api.h"
+#include "bthome_devices.h"
+#include "bthome_scan.h"
+#include "task_config.h"
+
+static const char *TAG = "bthome_scan";
+
+#define SCHEDULER_TICK_MS       100
+#define GUARD_S                 (CONFIG_BTHOME_SCAN_GUARD_MS / 1000.0f)
+#define DISCOVERY_INTERVAL_US   ((int64_t)CONFIG_BTHOME_SCAN_DISCOVERY_INTERVAL_S * 1000000)
+#define DISCOVERY_DURATION_US   ((int64_t)CONFIG_BTHOME_SCAN_DISCOVERY_DURATION_S * 1000000)
+#define LEARN_TIMEOUT_S         120.0f  // Scan wide this long to learn or re-acquire a device
+#define LOST_PERIODS            4.0f    // Re-acquire a device after this many missed arrivals
+
+// Interval and window are in units of 0.625ms
+static const esp_ble_scan_params_t scan_params[BTHOME_SCAN_MODE_COUNT] = {
+    [BTHOME_SCAN_MODE_WIDE] = {
+        .scan_type          = BLE_SCAN_TYPE_PASSIVE,    // Lower power
+        .own_addr_type      = BLE_ADDR_TYPE_PUBLIC,
+        .scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ALL,
+        .scan_interval      = 0x50,                     // 50ms
+        .scan_window        = 0x30,                     // 30ms
+        .scan_duplicate     = BLE_SCAN_DUPLICATE_DISABLE,   // Every advertisement carries new data
+    },
+    [BTHOME_SCAN_MODE_BACKGROUND] = {
+        .scan_type          = BLE_SCAN_TYPE_PASSIVE,
+        .own_addr_type      = BLE_ADDR_TYPE_PUBLIC,
+        .scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ALL,
+        .scan_interval      = 0x800,                    // 1.28s
+        .scan_window        = 0x30,                     // 30ms
+        .scan_duplicate     = BLE_SCAN_DUPLICATE_DISABLE,
+    },
+};
+
+static const char *mode_names[BTHOME_SCAN_MODE_COUNT] = { "wide", "background" };
+
+static bthome_scan_adv_cb_t adv_callback = NULL;
+
+// Mode changes go stop -> set params -> start, driven by GAP events.
+// desired_mode is written by the scheduler, the rest by the Bluetooth task.
+static volatile bthome_scan_mode_t desired_mode = BTHOME_SCAN_MODE_WIDE;
+static volatile bthome_scan_mode_t pending_mode = BTHOME_SCAN_MODE_WIDE;
+static volatile int active_mode = -1;              // -1 while not scanning
+static volatile bool switching = false;
+static bool scan_started = false;
+static int64_t wide_since_us = INT64_MAX;          // Start of the current wide scan
+
+static SemaphoreHandle_t stats_mutex = NULL;
+static bthome_scan_stats_t scan_stats;
+static int64_t mode_since_us = 0;
+
+static float mode_duty(bthome_scan_mode_t mode) {
+    return (float)scan_params[mode].scan_window / scan_params[mode].scan_interval;
+}
+
+// Close the accounting period of the active mode
+static void account_active_mode(int64_t now_us) {
+    if (active_mode < 0) {
+        return;
+    }
+    double seconds = (now_us - mode_since_us) / 1e6;
+    xSemaphoreTake(stats_mutex, portMAX_DELAY);
+    scan_stats.mode_seconds[active_mode] += seconds;
+    scan_stats.radio_seconds += seconds * mode_duty(active_mode);
+    xSemaphoreGive(stats_mutex);
+    mode_since_us = now_us;
+}
+
+static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
+    switch (event) {
+        case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
+            if (param->scan_param_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(TAG, "Failed to set scan parameters: %d", param->scan_param_cmpl.status);
+                switching = false;
+                break;
+            }
+            // Scan continuously (duration 0)
+            esp_ble_gap_start_scanning(0);
+            break;
+        case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
+            if (param->scan_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(TAG, "Failed to start BLE scan: %d", param->scan_start_cmpl.status);
+                switching = false;
+                break;
+            }
+            mode_since_us = esp_timer_get_time();
+            xSemaphoreTake(stats_mutex, portMAX_DELAY);
+            if (scan_started) {
+                scan_stats.mode_switches++;
+            } else {
+                scan_started = true;
+                ESP_LOGI(TAG, "BLE scanner started, listening for BTHome advertisements...");
+            }
+            scan_stats.mode = pending_mode;
+            scan_stats.duty = mode_duty(pending_mode);
+            xSemaphoreGive(stats_mutex);
+            active_mode = pending_mode;
+            wide_since_us = active_mode == BTHOME_SCAN_MODE_WIDE ? mode_since_us : INT64_MAX;
+            switching = false;
+            ESP_LOGD(TAG, "Scanning in %s mode", mode_names[active_mode]);
+            break;
+        case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT:
+            account_active_mode(esp_timer_get_time());
+            active_mode = -1;
+            wide_since_us = INT64_MAX;
+            pending_mode = desired_mode;
+            if (esp_ble_gap_set_scan_params((esp_ble_scan_params_t *)&scan_params[pending_mode]) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to set %s scan parameters", mode_names[pending_mode]);
+                switching = false;
+            }
+            break;
+        case ESP_GAP_BLE_SCAN_RESULT_EVT:
+            if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT && adv_callback != NULL) {
+                adv_callback(param->scan_rst.bda, param->scan_rst.rssi, param->scan_rst.ble_adv,
+                             param->scan_rst.adv_data_len + param->scan_rst.scan_rsp_len);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+#if CONFIG_BTHOME_SCAN_ADAPTIVE
+// Whether an enabled device is due to advertise soon (or is still being learned)
+static bool arrival_expected(const settings_t *settings, int64_t now_us) {
+    if (settings == NULL || settings->mac_filters == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < settings->mac_filters_count; i++) {
+        const mac_filter_t *filter = &settings->mac_filters[i];
+        bthome_device_stats_t stats;
+        if (!filter->enabled || !bthome_devices_get(filter->mac_addr, &stats)) {
+            continue;  // Never seen: left to discovery
+        }
+
+        // period_s, not interval_ewma_s: the observed interval grows with
+        // every packet background mode misses, which would make it miss more
+        float since = (now_us - stats.last_seen_us) / 1e6f;
+        float period = stats.period_s;
+        if (period <= 0.0f) {
+            // Period not known yet; keep listening for the second packet
+            if (since < LEARN_TIMEOUT_S) {
+                return true;
+            }
+            continue;
+        }
+        if (since > LOST_PERIODS * period) {
+            // Missed several arrivals: the period or phase has drifted, so
+            // scan wide until it is heard again, then leave it to discovery
+            if (since < LOST_PERIODS * period + LEARN_TIMEOUT_S) {
+                return true;
+            }
+            continue;
+        }
+
+        // Open a window of +/- guard around each expected arrival, widened
+        // by the variation of the period. Late packets fall just after a
+        // multiple of the period, early ones just before.
+        float guard = GUARD_S + 3.0f * stats.period_jitter_s;
+        if (2.0f * guard >= period) {
+            return true;
+        }
+        float phase = fmodf(since, period);
+        if (phase >= period - guard || (since >= period - guard && phase <= guard)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void request_mode(bthome_scan_mode_t mode) {
+    desired_mode = mode;
+    if (switching || active_mode == (int)mode || active_mode < 0) {
+        return;
+    }
+    switching = true;
+    if (esp_ble_gap_stop_scanning() != ESP_OK) {
+        switching = false;
+    }
+}
+
+static void scan_scheduler_task(void *pvParameters) {
+    int64_t next_discovery_us = 0;
+    int64_t discovery_end_us = 0;
+
+    while (1) {
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= next_discovery_us) {
+            discovery_end_us = now_us + DISCOVERY_DURATION_US;
+            next_discovery_us = now_us + DISCOVERY_INTERVAL_US;
+        }
+
+        settings_read_t read;
+        const settings_t *settings = settings_snapshot_acquire(&read);
+        bool wide = now_us < discovery_end_us || arrival_expected(settings, now_us);
+        settings_snapshot_release(read);
+        request_mode(wide ? BTHOME_SCAN_MODE_WIDE : BTHOME_SCAN_MODE_BACKGROUND);
+
+        vTaskDelay(pdMS_TO_TICKS(SCHEDULER_TICK_MS));
+    }
+}
+#endif
+
+esp_err_t bthome_scan_start(bthome_scan_adv_cb_t callback) {
+    adv_callback = callback;
+
+    stats_mutex = xSemaphoreCreateMutex();
+    if (stats_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create stats mutex");
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to release classic BT memory: %s", esp_err_to_name(ret));
+    }
+
+    esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
+    ret = esp_bt_controller_init(&bt_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize BT controller: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = esp_bt_controller_enable(ESP_BT_MODE_BLE);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable BT controller: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = esp_bluedroid_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize Bluedroid: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = esp_bluedroid_enable();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable Bluedroid: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = esp_ble_gap_register_callback(gap_event_handler);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register GAP callback: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // Start wide; scanning begins from the SCAN_PARAM_SET_COMPLETE event
+    switching = true;
+    pending_mode = BTHOME_SCAN_MODE_WIDE;
+    ret = esp_ble_gap_set_scan_params((esp_ble_scan_params_t *)&scan_params[BTHOME_SCAN_MODE_WIDE]);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set scan parameters: %s", esp_err_to_name(ret));
+        switching = false;
+        return ret;
+    }
+
+#if CONFIG_BTHOME_SCAN_ADAPTIVE
+    if (task_config_create(TASK_BTHOME_SCAN, scan_scheduler_task, NULL, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create scan scheduler task; scanning continuously");
+    }
+#endif
+    return ESP_OK;
+}
+
+int64_t bthome_scan_wide_since_us(void) {
+    return wide_since_us;
+}
+
+void bthome_scan_get_stats(bthome_scan_stats_t *stats) {
+    if (stats_mutex == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    int mode = active_mode;
+    int64_t since_us = mode_since_us;
+    xSemaphoreTake(stats_mutex, portMAX_DELAY);
+    *stats = scan_stats;
+    xSemaphoreGive(stats_mutex);
+
+    // Include the time spent in the current mode so far
+    if (mode >= 0) {
+        double seconds = (esp_timer_get_time() - since_us) / 1e6;
+        stats->mode_seconds[mode] += seconds;
+        stats->radio_seconds += seconds * mode_duty(mode);
+    }
+}
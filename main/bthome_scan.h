@@ -0,0 +1,50 @@
+#ifndef BTHOME_SCAN_H
+#define BTHOME_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "esp_gap_ble_api.h"
+#include "settings.h"
+
+// Called from the Bluetooth task for every advertisement (plus scan response)
+typedef void (*bthome_scan_adv_cb_t)(const esp_bd_addr_t addr, int rssi, const uint8_t *data, size_t len);
+
+typedef enum {
+    BTHOME_SCAN_MODE_WIDE = 0,      // High duty cycle, around expected arrivals and for discovery
+    BTHOME_SCAN_MODE_BACKGROUND,    // Low duty cycle, leaves the radio to WiFi
+    BTHOME_SCAN_MODE_COUNT,
+} bthome_scan_mode_t;
+
+typedef struct {
+    bthome_scan_mode_t mode;                        // Mode currently programmed
+    float duty;                                     // Window / interval of that mode
+    double mode_seconds[BTHOME_SCAN_MODE_COUNT];    // Time spent in each mode
+    double radio_seconds;                           // Time the receiver was scanning
+    uint32_t mode_switches;
+} bthome_scan_stats_t;
+
+/**
+ * @brief Bring up the BLE controller and Bluedroid and start scanning
+ *
+ * With CONFIG_BTHOME_SCAN_ADAPTIVE, a scheduler learns the advertising period
+ * of each enabled device from bthome_devices and scans wide only around
+ * expected arrivals, backing off to a low duty cycle in between. Periodic
+ * discovery windows pick up new and lost devices. The enabled devices are
+ * read from the current settings snapshot on every scheduler tick.
+ */
+esp_err_t bthome_scan_start(bthome_scan_adv_cb_t callback);
+
+void bthome_scan_get_stats(bthome_scan_stats_t *stats);
+
+/**
+ * @brief esp_timer time at which the receiver started scanning wide
+ *
+ * INT64_MAX while it is not. An advertisement interval that starts after
+ * this time was scanned wide throughout, so it was not stretched by missed
+ * packets. Only valid in the advertisement callback, which runs on the same
+ * Bluetooth task that handles the mode changes.
+ */
+int64_t bthome_scan_wide_since_us(void);
+
+#endif // BTHOME_SCAN_H
@@ -0,0 +1,161 @@
+#include <inttypes.h>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include "sdkconfig.h"
+#include "buf_pool.h"
+#include "alloc_prof.h"
+
+static const char *TAG = "buf_pool";
+
+#define NO_BLOCK 0xFFFFu
+
+// The free list is a stack of block indices. The head packs the top index in
+// the low 16 bits with a count of pops in the high 16, so a pop that raced
+// with a pop and push of the same block fails its compare-and-swap (ABA).
+typedef struct {
+    uint32_t block_size;
+    uint16_t count;
+    uint8_t *blocks;
+    _Atomic uint16_t *next;         // Index below each free block
+    _Atomic uint32_t head;
+    _Atomic uint32_t in_use;
+    _Atomic uint32_t in_use_max;
+    _Atomic uint32_t gets;
+    _Atomic uint32_t exhausted;
+} pool_t;
+
+static pool_t pools[] = {
+    { .block_size = BUF_POOL_SMALL, .count = CONFIG_BUF_POOL_SMALL_BLOCKS },
+    { .block_size = BUF_POOL_MEDIUM, .count = CONFIG_BUF_POOL_MEDIUM_BLOCKS },
+    { .block_size = BUF_POOL_LARGE, .count = CONFIG_BUF_POOL_LARGE_BLOCKS },
+};
+
+#define POOL_COUNT (sizeof(pools) / sizeof(pools[0]))
+
+static void push(pool_t *pool, uint16_t index) {
+    uint32_t head = atomic_load(&pool->head);
+    do {
+        atomic_store_explicit(&pool->next[index], (uint16_t)(head & 0xFFFF), memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak(&pool->head, &head, (head & 0xFFFF0000u) | index));
+}
+
+static void *pop(pool_t *pool) {
+    uint32_t head = atomic_load(&pool->head);
+    uint32_t next;
+    do {
+        uint16_t index = head & 0xFFFF;
+        if (index == NO_BLOCK) {
+            return NULL;
+        }
+        next = ((head + 0x10000u) & 0xFFFF0000u) |
+               atomic_load_explicit(&pool->next[index], memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak(&pool->head, &head, next));
+    return pool->blocks + (size_t)(head & 0xFFFF) * pool->block_size;
+}
+
+esp_err_t buf_pool_init(void) {
+    for (size_t p = 0; p < POOL_COUNT; p++) {
+        pool_t *pool = &pools[p];
+        if (pool->blocks != NULL) {
+            continue;
+        }
+        atomic_store(&pool->head, NO_BLOCK);
+        if (pool->count == 0) {
+            continue;
+        }
+        pool->blocks = heap_caps_malloc((size_t)pool->count * pool->block_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        pool->next = calloc(pool->count, sizeof(*pool->next));
+        if (pool->blocks == NULL || pool->next == NULL) {
+            ESP_LOGE(TAG, "No memory for %u blocks of %" PRIu32 " bytes", pool->count, pool->block_size);
+            heap_caps_free(pool->blocks);
+            free(pool->next);
+            pool->blocks = NULL;
+            pool->next = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+        for (int i = pool->count - 1; i >= 0; i--) {
+            push(pool, (uint16_t)i);
+        }
+    }
+    return ESP_OK;
+}
+
+void *buf_pool_get(size_t size) {
+    for (size_t p = 0; p < POOL_COUNT; p++) {
+        pool_t *pool = &pools[p];
+        if (size > pool->block_size || pool->count == 0) {
+            continue;
+        }
+        // Only the smallest size that fits is used, so a burst of small
+        // requests cannot take the blocks the large handlers need
+        void *buf = pop(pool);
+        if (buf == NULL) {
+            atomic_fetch_add(&pool->exhausted, 1);
+            ESP_LOGW(TAG, "All %u blocks of %" PRIu32 " bytes in use", pool->count, pool->block_size);
+            return NULL;
+        }
+        atomic_fetch_add(&pool->gets, 1);
+        uint32_t in_use = atomic_fetch_add(&pool->in_use, 1) + 1;
+        uint32_t max = atomic_load(&pool->in_use_max);
+        while (in_use > max && !atomic_compare_exchange_weak(&pool->in_use_max, &max, in_use)) {
+        }
+        return buf;
+    }
+    ESP_LOGE(TAG, "No block size fits %u bytes", (unsigned)size);
+    return NULL;
+}
+
+void buf_pool_put(void *buf) {
+    if (buf == NULL) {
+        return;
+    }
+    for (size_t p = 0; p < POOL_COUNT; p++) {
+        pool_t *pool = &pools[p];
+        uint8_t *b = buf;
+        if (pool->blocks != NULL && b >= pool->blocks &&
+            b < pool->blocks + (size_t)pool->count * pool->block_size) {
+            atomic_fetch_sub(&pool->in_use, 1);
+            push(pool, (uint16_t)((b - pool->blocks) / pool->block_size));
+            return;
+        }
+    }
+    ESP_LOGE(TAG, "%p is not a pool block", buf);
+}
+
+void buf_pool_write_metrics(http_chunk_writer_t *w, const char *hostname) {
+    http_chunk_printf(w,
+                      "# HELP buf_pool_blocks Preallocated buffers by block size\n"
+                      "# TYPE buf_pool_blocks gauge\n");
+    for (size_t p = 0; p < POOL_COUNT; p++) {
+        http_chunk_printf(w, "buf_pool_blocks{hostname=\"%s\",size=\"%" PRIu32 "\"} %u\n",
+                          hostname, pools[p].block_size, pools[p].blocks != NULL ? pools[p].count : 0);
+    }
+    http_chunk_printf(w,
+                      "# HELP buf_pool_in_use Buffers currently taken by block size\n"
+                      "# TYPE buf_pool_in_use gauge\n");
+    for (size_t p = 0; p < POOL_COUNT; p++) {
+        http_chunk_printf(w, "buf_pool_in_use{hostname=\"%s\",size=\"%" PRIu32 "\"} %" PRIu32 "\n",
+                          hostname, pools[p].block_size, atomic_load(&pools[p].in_use));
+    }
+    http_chunk_printf(w,
+                      "# HELP buf_pool_in_use_max Most buffers taken at once by block size\n"
+                      "# TYPE buf_pool_in_use_max gauge\n");
+    for (size_t p = 0; p < POOL_COUNT; p++) {
+        http_chunk_printf(w, "buf_pool_in_use_max{hostname=\"%s\",size=\"%" PRIu32 "\"} %" PRIu32 "\n",
+                          hostname, pools[p].block_size, atomic_load(&pools[p].in_use_max));
+    }
+    http_chunk_printf(w,
+                      "# HELP buf_pool_gets_total Buffers handed out by block size\n"
+                      "# TYPE buf_pool_gets_total counter\n");
+    for (size_t p = 0; p < POOL_COUNT; p++) {
+        http_chunk_printf(w, "buf_pool_gets_total{hostname=\"%s\",size=\"%" PRIu32 "\"} %" PRIu32 "\n",
+                          hostname, pools[p].block_size, atomic_load(&pools[p].gets));
+    }
+    http_chunk_printf(w,
+                      "# HELP buf_pool_exhausted_total Requests refused because every block of the size was taken\n"
+                      "# TYPE buf_pool_exhausted_total counter\n");
+    for (size_t p = 0; p < POOL_COUNT; p++) {
+        http_chunk_printf(w, "buf_pool_exhausted_total{hostname=\"%s\",size=\"%" PRIu32 "\"} %" PRIu32 "\n",
+                          hostname, pools[p].block_size, atomic_load(&pools[p].exhausted));
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef BUF_POOL_H
+#define BUF_POOL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "http_server.h"
+
+// Preallocated fixed-size buffers for HTTP handlers and other short-lived
+// work, so per-request buffers do not come from (and fragment) the heap.
+//
+// There are three block sizes, each a lock-free stack of free blocks carved
+// from one allocation at boot. buf_pool_get() hands out a block of the
+// smallest size that fits, or NULL when those are all in use; there is no
+// fallback to the heap. Exhaustion is counted in
+// buf_pool_exhausted_total{size}, and callers answer 503 or skip the work.
+// Any task may get and put blocks.
+//
+// Block counts are set by Kconfig BUF_POOL_{SMALL,MEDIUM,LARGE}_BLOCKS.
+
+#define BUF_POOL_SMALL      256
+#define BUF_POOL_MEDIUM     1024
+#define BUF_POOL_LARGE      2048
+
+/**
+ * @brief Allocate the blocks; call once before the HTTP server starts
+ */
+esp_err_t buf_pool_init(void);
+
+/**
+ * @brief Take a block of at least size bytes
+ *
+ * @return NULL if size is larger than BUF_POOL_LARGE, or every block that
+ *         would fit is in use (counted as an exhaustion)
+ */
+void *buf_pool_get(size_t size);
+
+/**
+ * @brief Return a block from buf_pool_get(); NULL is ignored
+ */
+void buf_pool_put(void *buf);
+
+/**
+ * @brief Write the pool metrics in Prometheus text format
+ */
+void buf_pool_write_metrics(http_chunk_writer_t *w, const char *hostname);
+
+#endif // BUF_POOL_H
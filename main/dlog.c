@@ -0,0 +1,460 @@
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_app_desc.h"
+#include "http_server.h"
+#include "dlog.h"
+#include "task_config.h"
+#include "alloc_prof.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+static const char *TAG = "dlog";
+
+// After a wakeup the task waits this long before draining, so a burst of
+// records costs one notification; log_ring only notifies an idle consumer
+#define BATCH_MS 10
+
+#define HISTORY_MASK (CONFIG_DLOG_HISTORY_SIZE - 1)
+_Static_assert((CONFIG_DLOG_HISTORY_SIZE & HISTORY_MASK) == 0, "CONFIG_DLOG_HISTORY_SIZE must be a power of two");
+
+static log_ring_t dlog_ring;
+static TaskHandle_t dlog_task_handle = NULL;
+static SemaphoreHandle_t consumer_mutex = NULL;     // The ring has one consumer at a time
+static _Atomic uint32_t truncated_count = 0;
+
+// Recent raw records for /debug/dlog: [u16 length][record], oldest dropped
+// first. Written by the ring consumer only.
+static uint8_t *history = NULL;
+static uint32_t history_head = 0;
+static uint32_t history_tail = 0;
+static SemaphoreHandle_t history_mutex = NULL;
+
+// Writer side, called from hot paths
+
+bool dlog_begin(dlog_writer_t *w, esp_log_level_t level, const char *tag, const char *fmt) {
+    w->buf = log_ring_reserve(&dlog_ring, DLOG_MAX_RECORD, &w->res);
+    if (w->buf == NULL) {
+        return false;
+    }
+    dlog_header_t hdr = {
+        .timestamp = esp_log_timestamp(),
+        .tag = (uint32_t)(uintptr_t)tag,
+        .fmt = (uint32_t)(uintptr_t)fmt,
+        .level = (uint8_t)level,
+    };
+    memcpy(w->buf, &hdr, sizeof(hdr));
+    w->len = sizeof(hdr);
+    return true;
+}
+
+static void put_arg(dlog_writer_t *w, uint8_t type, const void *value, size_t size) {
+    dlog_header_t *hdr = (dlog_header_t *)w->buf;
+    if (w->len + 1 + size > DLOG_MAX_RECORD) {
+        hdr->truncated = 1;
+        return;
+    }
+    w->buf[w->len++] = type;
+    memcpy(w->buf + w->len, value, size);
+    w->len += size;
+    hdr->nargs++;
+}
+
+void dlog_arg_i32(dlog_writer_t *w, int32_t v) { put_arg(w, DLOG_ARG_I32, &v, sizeof(v)); }
+void dlog_arg_u32(dlog_writer_t *w, uint32_t v) { put_arg(w, DLOG_ARG_U32, &v, sizeof(v)); }
+void dlog_arg_i64(dlog_writer_t *w, int64_t v) { put_arg(w, DLOG_ARG_I64, &v, sizeof(v)); }
+void dlog_arg_u64(dlog_writer_t *w, uint64_t v) { put_arg(w, DLOG_ARG_U64, &v, sizeof(v)); }
+void dlog_arg_f32(dlog_writer_t *w, float v) { put_arg(w, DLOG_ARG_F32, &v, sizeof(v)); }
+void dlog_arg_f64(dlog_writer_t *w, double v) { put_arg(w, DLOG_ARG_F64, &v, sizeof(v)); }
+void dlog_arg_mac(dlog_writer_t *w, dlog_mac_t v) { put_arg(w, DLOG_ARG_MAC, v.addr, sizeof(v.addr)); }
+
+void dlog_arg_ptr(dlog_writer_t *w, const void *v) {
+    uint32_t addr = (uint32_t)(uintptr_t)v;
+    put_arg(w, DLOG_ARG_PTR, &addr, sizeof(addr));
+}
+
+void dlog_arg_str(dlog_writer_t *w, const char *v) {
+    dlog_header_t *hdr = (dlog_header_t *)w->buf;
+    if (v == NULL) {
+        v = "(null)";
+    }
+    size_t len = strnlen(v, DLOG_MAX_STRING);
+    if (w->len + 2 + len > DLOG_MAX_RECORD) {
+        if (w->len + 2 >= DLOG_MAX_RECORD) {
+            hdr->truncated = 1;
+            return;
+        }
+        len = DLOG_MAX_RECORD - w->len - 2;
+    }
+    w->buf[w->len++] = DLOG_ARG_STR;
+    w->buf[w->len++] = (uint8_t)len;
+    memcpy(w->buf + w->len, v, len);
+    w->len += len;
+    hdr->nargs++;
+}
+
+void dlog_end(dlog_writer_t *w) {
+    if (((dlog_header_t *)w->buf)->truncated) {
+        atomic_fetch_add_explicit(&truncated_count, 1, memory_order_relaxed);
+    }
+    log_ring_commit(&dlog_ring, &w->res, w->len, 0);
+}
+
+const char *dlog_mac_str(const uint8_t *addr, char *buf) {
+    snprintf(buf, 18, "%02X:%02X:%02X:%02X:%02X:%02X",
+             addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
+    return buf;
+}
+
+// Consumer side
+
+typedef struct {
+    uint8_t type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double f;
+        uint8_t mac[6];
+        struct {
+            const char *str;
+            size_t len;
+        };
+    };
+} dlog_value_t;
+
+static bool next_arg(const uint8_t **p, const uint8_t *end, dlog_value_t *v) {
+    if (*p >= end) {
+        return false;
+    }
+    v->type = *(*p)++;
+    size_t size;
+    switch (v->type) {
+        case DLOG_ARG_I32: case DLOG_ARG_U32: case DLOG_ARG_F32: case DLOG_ARG_PTR: size = 4; break;
+        case DLOG_ARG_I64: case DLOG_ARG_U64: case DLOG_ARG_F64: size = 8; break;
+        case DLOG_ARG_MAC: size = 6; break;
+        case DLOG_ARG_STR: size = (*p < end) ? 1 + **p : 1; break;
+        default: return false;
+    }
+    if ((size_t)(end - *p) < size) {
+        return false;
+    }
+
+    switch (v->type) {
+        case DLOG_ARG_I32: { int32_t x; memcpy(&x, *p, 4); v->i = x; v->u = (uint64_t)(int64_t)x; break; }
+        case DLOG_ARG_U32: case DLOG_ARG_PTR: { uint32_t x; memcpy(&x, *p, 4); v->u = x; break; }
+        case DLOG_ARG_I64: memcpy(&v->i, *p, 8); break;
+        case DLOG_ARG_U64: memcpy(&v->u, *p, 8); break;
+        case DLOG_ARG_F32: { float x; memcpy(&x, *p, 4); v->f = x; break; }
+        case DLOG_ARG_F64: memcpy(&v->f, *p, 8); break;
+        case DLOG_ARG_MAC: memcpy(v->mac, *p, 6); break;
+        case DLOG_ARG_STR: v->str = (const char *)*p + 1; v->len = **p; break;
+    }
+    *p += size;
+    return true;
+}
+
+static int64_t value_as_int(const dlog_value_t *v) {
+    switch (v->type) {
+        case DLOG_ARG_F32: case DLOG_ARG_F64: return (int64_t)v->f;
+        case DLOG_ARG_I32: case DLOG_ARG_I64: return v->i;
+        default: return (int64_t)v->u;
+    }
+}
+
+static double value_as_double(const dlog_value_t *v) {
+    switch (v->type) {
+        case DLOG_ARG_F32: case DLOG_ARG_F64: return v->f;
+        case DLOG_ARG_I32: case DLOG_ARG_I64: return (double)v->i;
+        default: return (double)v->u;
+    }
+}
+
+// Format one conversion of the record's format string. Length modifiers are
+// replaced so the stored value is passed with a type matching the spec; '*'
+// widths are not recorded and are dropped.
+static int format_one(char *out, size_t cap, const char *spec, size_t spec_len, char conv,
+                      const dlog_value_t *v) {
+    char fmt[24];
+    size_t n = 0;
+    fmt[n++] = '%';
+    for (size_t i = 1; i < spec_len - 1 && n < sizeof(fmt) - 4; i++) {
+        if (strchr("hlLqjzt*", spec[i]) == NULL) {
+            fmt[n++] = spec[i];
+        }
+    }
+
+    switch (conv) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': {
+            long long x = value_as_int(v);
+            // A 32-bit argument read as unsigned is 32 bits wide, as ESP_LOG prints it
+            if (conv != 'd' && conv != 'i' && (v->type == DLOG_ARG_I32 || v->type == DLOG_ARG_U32)) {
+                x = (uint32_t)x;
+            }
+            fmt[n++] = 'l';
+            fmt[n++] = 'l';
+            fmt[n++] = conv;
+            fmt[n] = '\0';
+            return snprintf(out, cap, fmt, x);
+        }
+        case 'c':
+            fmt[n++] = 'c';
+            fmt[n] = '\0';
+            return snprintf(out, cap, fmt, (int)value_as_int(v));
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            fmt[n++] = conv;
+            fmt[n] = '\0';
+            return snprintf(out, cap, fmt, value_as_double(v));
+        case 'p':
+            return snprintf(out, cap, "0x%08" PRIx32, (uint32_t)v->u);
+        case 's': {
+            // The recorded length goes in as the precision, capped by the spec's own
+            int precision = INT_MAX;
+            const char *dot = memchr(fmt, '.', n);
+            if (dot != NULL) {
+                fmt[n] = '\0';
+                precision = atoi(dot + 1);
+                n = dot - fmt;
+            }
+            fmt[n++] = '.';
+            fmt[n++] = '*';
+            fmt[n++] = 's';
+            fmt[n] = '\0';
+            if (v->type == DLOG_ARG_STR) {
+                return snprintf(out, cap, fmt, MIN((int)v->len, precision), v->str);
+            }
+            if (v->type == DLOG_ARG_MAC) {
+                char mac_str[18];
+                return snprintf(out, cap, fmt, MIN(17, precision), dlog_mac_str(v->mac, mac_str));
+            }
+            return snprintf(out, cap, "<%c>", v->type);
+        }
+        default:
+            return snprintf(out, cap, "<%%%c?>", conv);
+    }
+}
+
+size_t dlog_format(const uint8_t *record, size_t len, char *out, size_t cap) {
+    dlog_header_t hdr;
+    if (cap == 0) {
+        return 0;
+    }
+    if (len < sizeof(hdr)) {
+        out[0] = '\0';
+        return 0;
+    }
+    memcpy(&hdr, record, sizeof(hdr));
+    const uint8_t *p = record + sizeof(hdr);
+    const uint8_t *end = record + len;
+    const char *fmt = (const char *)(uintptr_t)hdr.fmt;
+
+    size_t o = 0;
+#define ROOM (cap - o)
+#define ADVANCE(n) do { int _n = (n); o += (_n < 0) ? 0 : ((size_t)_n >= ROOM ? ROOM - 1 : (size_t)_n); } while (0)
+    while (*fmt && o < cap - 1) {
+        if (*fmt != '%') {
+            out[o++] = *fmt++;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            out[o++] = '%';
+            fmt += 2;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        const char *spec = fmt++;
+        while (*fmt && strchr("-+ #0123456789.*hlLqjzt", *fmt)) {
+            fmt++;
+        }
+        if (*fmt == '\0') {
+            break;
+        }
+        char conv = *fmt++;
+        dlog_value_t v;
+        if (!next_arg(&p, end, &v)) {
+            ADVANCE(snprintf(out + o, ROOM, "%s", hdr.truncated ? "<truncated>" : "<?>"));
+            continue;
+        }
+        ADVANCE(format_one(out + o, ROOM, spec, fmt - spec, conv, &v));
+    }
+#undef ADVANCE
+#undef ROOM
+    out[o] = '\0';
+    return o;
+}
+
+static void history_put(const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        history[(history_head + i) & HISTORY_MASK] = data[i];
+    }
+    history_head += len;
+}
+
+static uint16_t history_record_len(uint32_t pos) {
+    return history[pos & HISTORY_MASK] | (history[(pos + 1) & HISTORY_MASK] << 8);
+}
+
+static void history_append(const uint8_t *record, size_t len) {
+    uint32_t need = len + 2;
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    while (history_head - history_tail + need > CONFIG_DLOG_HISTORY_SIZE) {
+        history_tail += 2 + history_record_len(history_tail);
+    }
+    uint8_t prefix[2] = { len & 0xff, len >> 8 };
+    history_put(prefix, 2);
+    history_put(record, len);
+    xSemaphoreGive(history_mutex);
+}
+
+static const char *level_formats[] = {
+    [ESP_LOG_ERROR] = "E (%" PRIu32 ") %s: %s\n",
+    [ESP_LOG_WARN] = "W (%" PRIu32 ") %s: %s\n",
+    [ESP_LOG_INFO] = "I (%" PRIu32 ") %s: %s\n",
+    [ESP_LOG_DEBUG] = "D (%" PRIu32 ") %s: %s\n",
+    [ESP_LOG_VERBOSE] = "V (%" PRIu32 ") %s: %s\n",
+};
+
+void dlog_flush(void) {
+    if (consumer_mutex == NULL) {
+        return;
+    }
+    char text[256];
+    xSemaphoreTake(consumer_mutex, portMAX_DELAY);
+    const uint8_t *record;
+    size_t len;
+    while ((record = log_ring_peek(&dlog_ring, &len, NULL)) != NULL) {
+        dlog_header_t hdr;
+        memcpy(&hdr, record, sizeof(hdr));
+        if (history != NULL) {
+            history_append(record, len);
+        }
+        dlog_format(record, len, text, sizeof(text));
+        log_ring_release(&dlog_ring);
+
+        if (hdr.level >= ESP_LOG_ERROR && hdr.level <= ESP_LOG_VERBOSE) {
+            const char *tag = (const char *)(uintptr_t)hdr.tag;
+            esp_log_write(hdr.level, tag, level_formats[hdr.level], hdr.timestamp, tag, text);
+        }
+    }
+    xSemaphoreGive(consumer_mutex);
+}
+
+static void dlog_task(void *pvParameters) {
+    while (1) {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000)) != 0) {
+            vTaskDelay(pdMS_TO_TICKS(BATCH_MS));
+        }
+        dlog_flush();
+    }
+}
+
+static esp_err_t dlog_dump_handler(httpd_req_t *req) {
+    char buf[512];
+    char elf_sha256[65];
+    http_chunk_writer_t w;
+
+    esp_app_get_elf_sha256(elf_sha256, sizeof(elf_sha256));
+    httpd_resp_set_type(req, "application/octet-stream");
+    http_chunk_writer_init(&w, req, buf, sizeof(buf));
+
+    // Text header, then the raw records, oldest first. Whole records are
+    // copied into buf under the lock and sent without it, so a slow client
+    // never holds up the consumer.
+    http_chunk_printf(&w, "DLOG 1\nelf_sha256 %s\n\n", elf_sha256);
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    uint32_t pos = history_tail;
+    uint32_t end = history_head;
+    xSemaphoreGive(history_mutex);
+
+    while (w.err == ESP_OK) {
+        xSemaphoreTake(history_mutex, portMAX_DELAY);
+        // Records overwritten while the last batch was sent are skipped
+        if ((int32_t)(pos - history_tail) < 0) {
+            pos = history_tail;
+        }
+        while ((int32_t)(end - pos) > 0) {
+            uint32_t size = 2 + history_record_len(pos);
+            if (size > w.size - w.len) {
+                break;
+            }
+            for (uint32_t i = 0; i < size; i++) {
+                w.buf[w.len++] = history[(pos + i) & HISTORY_MASK];
+            }
+            pos += size;
+        }
+        bool done = (int32_t)(end - pos) <= 0;
+        xSemaphoreGive(history_mutex);
+
+        if (done) {
+            break;
+        }
+        w.err = httpd_resp_send_chunk(req, w.buf, w.len);
+        w.len = 0;
+    }
+    return http_chunk_writer_finish(&w);
+}
+
+static httpd_uri_t dlog_dump_uri = {
+    .uri       = "/debug/dlog",
+    .method    = HTTP_GET,
+    .handler   = dlog_dump_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t dlog_init(void) {
+#if !CONFIG_DLOG_DEFERRED
+    return ESP_OK;
+#endif
+    esp_err_t err = log_ring_init(&dlog_ring, CONFIG_DLOG_RING_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate dlog ring: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    consumer_mutex = xSemaphoreCreateMutex();
+    if (consumer_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create dlog consumer mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    history_mutex = xSemaphoreCreateMutex();
+    history = malloc(CONFIG_DLOG_HISTORY_SIZE);
+    if (history_mutex == NULL || history == NULL) {
+        ESP_LOGW(TAG, "No memory for dlog history; /debug/dlog disabled");
+        free(history);
+        history = NULL;
+    }
+
+    if (task_config_create(TASK_DLOG, dlog_task, NULL, &dlog_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create dlog task");
+        return ESP_ERR_NO_MEM;
+    }
+    atomic_store(&dlog_ring.consumer, dlog_task_handle);
+    return ESP_OK;
+}
+
+esp_err_t dlog_register(settings_t *settings, httpd_handle_t http_server) {
+    if (history == NULL) {
+        return ESP_OK;
+    }
+    esp_err_t err = httpd_register_uri_handler_with_basic_auth(settings, http_server, &dlog_dump_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register %s: %s", dlog_dump_uri.uri, esp_err_to_name(err));
+    }
+    return err;
+}
+
+void dlog_get_stats(dlog_stats_t *stats) {
+    stats->records = atomic_load(&dlog_ring.records);
+    stats->dropped = atomic_load(&dlog_ring.dropped);
+    stats->truncated = atomic_load(&truncated_count);
+    stats->ring_high_water = atomic_load(&dlog_ring.high_water);
+}
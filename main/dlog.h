@@ -0,0 +1,178 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "log_ring.h"
+#include "settings.h"
+
+// Deferred logging for hot paths.
+//
+// DLOGx(tag, fmt, ...) takes the same arguments as ESP_LOGx but records only
+// the format string pointer, the tag pointer and the raw argument values in a
+// ring. The "dlog" task formats records later and writes them through the
+// normal log output (console, syslog, level and rate limits). Recent records
+// are also kept in binary form at GET /debug/dlog for tools/dlog_decode.py,
+// which resolves the pointers from the firmware ELF.
+//
+// Only arguments of scalar, string and DLOG_MAC() type are supported; strings
+// are copied, so they need not outlive the call. Up to 8 arguments.
+//
+// Record layout (little endian, also parsed by tools/dlog_decode.py):
+//   dlog_header_t, then per argument a type byte and its payload:
+//   'i'/'u' 4 bytes, 'l'/'L' 8 bytes, 'f' float, 'd' double, 'p' 4 bytes,
+//   's' length byte then bytes, 'm' 6 bytes.
+
+#define DLOG_MAX_RECORD     128     // Bytes per record, header included
+#define DLOG_MAX_STRING     48      // Longest string argument kept
+
+#define DLOG_ARG_I32    'i'
+#define DLOG_ARG_U32    'u'
+#define DLOG_ARG_I64    'l'
+#define DLOG_ARG_U64    'L'
+#define DLOG_ARG_F32    'f'
+#define DLOG_ARG_F64    'd'
+#define DLOG_ARG_PTR    'p'
+#define DLOG_ARG_STR    's'
+#define DLOG_ARG_MAC    'm'
+
+typedef struct {
+    uint32_t timestamp;     // esp_log_timestamp() when recorded
+    uint32_t tag;           // Address of the tag string
+    uint32_t fmt;           // Address of the format string
+    uint8_t level;          // esp_log_level_t
+    uint8_t nargs;
+    uint8_t truncated;      // Arguments did not fit
+    uint8_t reserved;
+} dlog_header_t;
+
+// A MAC address argument, printed as AA:BB:CC:DD:EE:FF by "%s"
+typedef struct {
+    uint8_t addr[6];
+} dlog_mac_t;
+
+/**
+ * @brief Format a MAC address into buf (at least 18 bytes)
+ */
+const char *dlog_mac_str(const uint8_t *addr, char *buf);
+
+#if CONFIG_DLOG_DEFERRED
+#define DLOG_MAC(a) ((dlog_mac_t){ { (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5] } })
+#else
+#define DLOG_MAC(a) dlog_mac_str((a), (char[18]){ 0 })
+#endif
+
+typedef struct {
+    log_ring_reservation_t res;
+    uint8_t *buf;
+    size_t len;
+} dlog_writer_t;
+
+typedef struct {
+    uint32_t records;       // Records written by hot paths
+    uint32_t dropped;       // Records lost because the ring was full
+    uint32_t truncated;     // Records missing arguments that did not fit
+    uint32_t ring_high_water;
+} dlog_stats_t;
+
+/**
+ * @brief Allocate the ring and start the formatting task
+ *
+ * Call before any DLOG use; earlier records are dropped.
+ */
+esp_err_t dlog_init(void);
+
+/**
+ * @brief Register GET /debug/dlog (binary dump of recent records)
+ */
+esp_err_t dlog_register(settings_t *settings, httpd_handle_t http_server);
+
+void dlog_get_stats(dlog_stats_t *stats);
+
+/**
+ * @brief Format and write out the records waiting in the ring now
+ *
+ * The dlog task does this whenever a record is committed. Callable from any
+ * task, e.g. before a restart; consumers take turns under a mutex.
+ */
+void dlog_flush(void);
+
+/**
+ * @brief Format a record's message (without the level/timestamp/tag prefix)
+ *
+ * @return Length written, excluding the terminator
+ */
+size_t dlog_format(const uint8_t *record, size_t len, char *out, size_t cap);
+
+bool dlog_begin(dlog_writer_t *w, esp_log_level_t level, const char *tag, const char *fmt);
+void dlog_end(dlog_writer_t *w);
+
+void dlog_arg_i32(dlog_writer_t *w, int32_t v);
+void dlog_arg_u32(dlog_writer_t *w, uint32_t v);
+void dlog_arg_i64(dlog_writer_t *w, int64_t v);
+void dlog_arg_u64(dlog_writer_t *w, uint64_t v);
+void dlog_arg_f32(dlog_writer_t *w, float v);
+void dlog_arg_f64(dlog_writer_t *w, double v);
+void dlog_arg_ptr(dlog_writer_t *w, const void *v);
+void dlog_arg_str(dlog_writer_t *w, const char *v);
+void dlog_arg_mac(dlog_writer_t *w, dlog_mac_t v);
+
+#define DLOG_ARG(w, x) _Generic((x),                                        \
+    _Bool: dlog_arg_u32,                                                    \
+    char: dlog_arg_i32,                                                     \
+    signed char: dlog_arg_i32,                                              \
+    unsigned char: dlog_arg_u32,                                            \
+    short: dlog_arg_i32,                                                    \
+    unsigned short: dlog_arg_u32,                                           \
+    int: dlog_arg_i32,                                                      \
+    unsigned int: dlog_arg_u32,                                             \
+    long: dlog_arg_i64,                                                     \
+    unsigned long: dlog_arg_u64,                                            \
+    long long: dlog_arg_i64,                                                \
+    unsigned long long: dlog_arg_u64,                                       \
+    float: dlog_arg_f32,                                                    \
+    double: dlog_arg_f64,                                                   \
+    char *: dlog_arg_str,                                                   \
+    const char *: dlog_arg_str,                                             \
+    dlog_mac_t: dlog_arg_mac,                                               \
+    default: dlog_arg_ptr)((w), (x));
+
+#define DLOG_A0(w)
+#define DLOG_A1(w, a) DLOG_ARG(w, a)
+#define DLOG_A2(w, a, ...) DLOG_ARG(w, a) DLOG_A1(w, __VA_ARGS__)
+#define DLOG_A3(w, a, ...) DLOG_ARG(w, a) DLOG_A2(w, __VA_ARGS__)
+#define DLOG_A4(w, a, ...) DLOG_ARG(w, a) DLOG_A3(w, __VA_ARGS__)
+#define DLOG_A5(w, a, ...) DLOG_ARG(w, a) DLOG_A4(w, __VA_ARGS__)
+#define DLOG_A6(w, a, ...) DLOG_ARG(w, a) DLOG_A5(w, __VA_ARGS__)
+#define DLOG_A7(w, a, ...) DLOG_ARG(w, a) DLOG_A6(w, __VA_ARGS__)
+#define DLOG_A8(w, a, ...) DLOG_ARG(w, a) DLOG_A7(w, __VA_ARGS__)
+#define DLOG_PICK(_0, _1, _2, _3, _4, _5, _6, _7, _8, name, ...) name
+#define DLOG_ARGS(w, ...) DLOG_PICK(_0, ##__VA_ARGS__, DLOG_A8, DLOG_A7, DLOG_A6, DLOG_A5, \
+                                    DLOG_A4, DLOG_A3, DLOG_A2, DLOG_A1, DLOG_A0)(w, ##__VA_ARGS__)
+
+#if CONFIG_DLOG_DEFERRED
+#define DLOG_LEVEL(level, tag, fmt, ...) do {                               \
+        if (LOG_LOCAL_LEVEL >= (level) && esp_log_level_get(tag) >= (level)) { \
+            dlog_writer_t _dlog_w;                                          \
+            if (dlog_begin(&_dlog_w, (level), (tag), (fmt))) {              \
+                DLOG_ARGS(&_dlog_w, ##__VA_ARGS__)                          \
+                dlog_end(&_dlog_w);                                         \
+            }                                                               \
+        }                                                                   \
+    } while (0)
+#else
+#define DLOG_LEVEL(level, tag, fmt, ...) ESP_LOG_LEVEL_LOCAL(level, tag, fmt, ##__VA_ARGS__)
+#endif
+
+#define DLOGE(tag, fmt, ...) DLOG_LEVEL(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...) DLOG_LEVEL(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...) DLOG_LEVEL(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define DLOGD(tag, fmt, ...) DLOG_LEVEL(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define DLOGV(tag, fmt, ...) DLOG_LEVEL(ESP_LOG_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+#endif // DLOG_H
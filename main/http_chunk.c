@@ -0,0 +1,105 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "http_server.h"
+
+// Chunked response writer, apart from the server setup so it builds on the
+// host as well
+
+static const char *TAG = "httpd";
+
+void http_chunk_writer_init(http_chunk_writer_t *w, httpd_req_t *req, char *buf, size_t size)
+{
+    w->req = req;
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->err = ESP_OK;
+}
+
+static void http_chunk_flush(http_chunk_writer_t *w)
+{
+    if (w->len == 0 || w->err != ESP_OK) {
+        return;
+    }
+    w->err = httpd_resp_send_chunk(w->req, w->buf, w->len);
+    w->len = 0;
+}
+
+void http_chunk_printf(http_chunk_writer_t *w, const char *fmt, ...)
+{
+    if (w->err != ESP_OK) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(w->buf + w->len, w->size - w->len, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        return;
+    }
+
+    if ((size_t)n >= w->size - w->len) {
+        // Did not fit: drop the partial write, flush and format again
+        w->buf[w->len] = '\0';
+        http_chunk_flush(w);
+        if (w->err != ESP_OK) {
+            return;
+        }
+        va_start(args, fmt);
+        n = vsnprintf(w->buf, w->size, fmt, args);
+        va_end(args);
+        if (n < 0) {
+            return;
+        }
+        if ((size_t)n >= w->size) {
+            ESP_LOGW(TAG, "Truncated %d byte write to %u byte chunk", n, (unsigned)w->size);
+            n = w->size - 1;
+        }
+    }
+    w->len += n;
+}
+
+esp_err_t http_chunk_writer_finish(http_chunk_writer_t *w)
+{
+    http_chunk_flush(w);
+    if (w->err != ESP_OK) {
+        return w->err;
+    }
+    return httpd_resp_send_chunk(w->req, NULL, 0);
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void http_url_decode(char *s)
+{
+    char *out = s;
+    while (*s) {
+        int hi, lo;
+        if (*s == '%' && (hi = hex_value(s[1])) >= 0 && (lo = hex_value(s[2])) >= 0) {
+            *out++ = (char)(hi << 4 | lo);
+            s += 3;
+        } else if (*s == '+') {
+            *out++ = ' ';
+            s++;
+        } else {
+            *out++ = *s++;
+        }
+    }
+    *out = '\0';
+}
+
+esp_err_t http_resp_send_busy(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    return httpd_resp_sendstr(req, "Busy, try again");
+}
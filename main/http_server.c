@@ -1,13 +1,20 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdio.h>
+#include <stdbool.h>
 #include <esp_log.h>
 #include <esp_http_server.h>
 #include "esp_check.h"
 #include "esp_tls_crypto.h"
 #include "esp_tls.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
 #include "settings.h"
-#include "metrics.h"
+#include "http_server.h"
+#include "http_stats.h"
+#include "alloc_prof.h"
 
 
 // Shamelessly borrowed from https://github.com/espressif/esp-idf/blob/v5.5.1/examples/protocols/http_server/simple/main/main.c
@@ -22,6 +29,8 @@ typedef struct {
 
 #define HTTPD_401      "401 UNAUTHORIZED"           /*!< HTTP Response 401 */
 
+static void http_session_reset(void);
+
 static char *http_auth_basic(const char *username, const char *password)
 {
     size_t out;
@@ -38,7 +47,6 @@ static char *http_auth_basic(const char *username, const char *password)
         ESP_LOGE(TAG, "No enough memory for user information");
         return NULL;
     }
-    atomic_fetch_add(&malloc_count_http_server, 1); //asprintf for user_info
     esp_crypto_base64_encode(NULL, 0, &n, (const unsigned char *)user_info, strlen(user_info));
 
     /* 6: The length of the "Basic " string
@@ -46,86 +54,261 @@ static char *http_auth_basic(const char *username, const char *password)
      * 1: Number of bytes for a reserved which be used to fill zero
     */
     digest = calloc(1, 6 + n + 1);
-    atomic_fetch_add(&malloc_count_http_server, 1);
     if (digest) {
         strcpy(digest, "Basic ");
         esp_crypto_base64_encode((unsigned char *)digest + 6, n, &out, (const unsigned char *)user_info, strlen(user_info));
     }
     free(user_info);
-    atomic_fetch_add(&free_count_http_server, 1);
     return digest;
 }
 
-/* An HTTP GET handler */
-static esp_err_t basic_auth_get_handler(httpd_req_t *req)
+// Longest Authorization header compared: "Basic " plus base64 of
+// "admin:<password>" for the longest password settings accepts
+#define AUTH_HEADER_MAX 384
+
+// Expected Authorization header, built on first use and again after the
+// password changes. Only touched from the HTTP server task.
+static char *auth_expected = NULL;
+static size_t auth_expected_len = 0;
+static const char *auth_password = NULL;
+
+static bool auth_equal(const char *a, size_t a_len, const char *b, size_t b_len)
 {
-    char *buf = NULL;
-    size_t buf_len = 0;
-    basic_auth_wrap_t *wrapper = req->user_ctx;
-    ESP_LOGI(TAG, "basic_auth_get_handler settings ptr %p", wrapper->settings);
-
-    buf_len = httpd_req_get_hdr_value_len(req, "Authorization") + 1;
-    if (buf_len > 1) {
-        buf = calloc(1, buf_len);
-        atomic_fetch_add(&malloc_count_http_server, 1);
-        if (!buf) {
-            ESP_LOGE(TAG, "No enough memory for basic authorization");
-            return ESP_ERR_NO_MEM;
-        }
+    // Constant time in the contents; the length is not secret
+    if (a_len != b_len) {
+        return false;
+    }
+    volatile uint8_t diff = 0;
+    for (size_t i = 0; i < a_len; i++) {
+        diff |= (uint8_t)a[i] ^ (uint8_t)b[i];
+    }
+    return diff == 0;
+}
+
+static bool auth_update_expected(settings_t *settings)
+{
+    if (auth_expected != NULL && auth_password == settings->password) {
+        return true;
+    }
+    char *expected = http_auth_basic("admin", settings->password);
+    if (expected == NULL) {
+        return false;
+    }
+    if (auth_expected != NULL) {
+        memset(auth_expected, 0, auth_expected_len);
+        free(auth_expected);
+    }
+    auth_expected = expected;
+    auth_expected_len = strlen(expected);
+    auth_password = settings->password;
+    http_session_reset();
+    return true;
+}
+
+void http_server_auth_reset(void)
+{
+    // settings_t.password was replaced; rebuild on the next request
+    auth_password = NULL;
+}
+
+#if CONFIG_HTTPD_SESSION_COOKIE
 
-        if (httpd_req_get_hdr_value_str(req, "Authorization", buf, buf_len) == ESP_OK) {
-            ESP_LOGI(TAG, "Found header => Authorization: %s", buf);
+// Session cookies: "<expiry:8 hex><nonce:8 hex>.<tag:32 hex>" where tag is
+// the first 16 bytes of HMAC-SHA256(key, expiry || nonce). The key is random
+// per boot and per password, so restarting or changing the password ends all
+// sessions. Recently checked tokens are cached so most requests skip the HMAC.
+#define SESSION_COOKIE_NAME "session"
+#define SESSION_PAYLOAD_LEN 8
+#define SESSION_TAG_LEN 16
+#define SESSION_TOKEN_LEN (SESSION_PAYLOAD_LEN * 2 + 1 + SESSION_TAG_LEN * 2)
+#define SESSION_CACHE_SIZE 4
+
+typedef struct {
+    uint8_t tag[SESSION_TAG_LEN];
+    uint32_t expiry;            // 0 when unused
+} session_cache_entry_t;
+
+static uint8_t session_key[32];
+static bool session_key_set = false;
+static session_cache_entry_t session_cache[SESSION_CACHE_SIZE];
+static uint32_t session_cache_next = 0;
+
+static uint32_t session_now(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+static void session_hmac(const uint8_t payload[SESSION_PAYLOAD_LEN], uint8_t tag[SESSION_TAG_LEN])
+{
+    // HMAC-SHA256 on stack contexts, so checking a token never allocates
+    uint8_t pad[64];
+    uint8_t inner[32];
+    mbedtls_sha256_context ctx;
+
+    mbedtls_sha256_init(&ctx);
+    memset(pad, 0x36, sizeof(pad));
+    for (size_t i = 0; i < sizeof(session_key); i++) {
+        pad[i] ^= session_key[i];
+    }
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, pad, sizeof(pad));
+    mbedtls_sha256_update(&ctx, payload, SESSION_PAYLOAD_LEN);
+    mbedtls_sha256_finish(&ctx, inner);
+
+    memset(pad, 0x5c, sizeof(pad));
+    for (size_t i = 0; i < sizeof(session_key); i++) {
+        pad[i] ^= session_key[i];
+    }
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, pad, sizeof(pad));
+    mbedtls_sha256_update(&ctx, inner, sizeof(inner));
+    mbedtls_sha256_finish(&ctx, inner);
+    mbedtls_sha256_free(&ctx);
+
+    memcpy(tag, inner, SESSION_TAG_LEN);
+}
+
+static bool hex_decode(const char *hex, uint8_t *out, size_t len)
+{
+    for (size_t i = 0; i < len * 2; i++) {
+        char c = hex[i];
+        uint8_t v;
+        if (c >= '0' && c <= '9') {
+            v = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            v = c - 'a' + 10;
         } else {
-            ESP_LOGE(TAG, "No auth value received");
+            return false;
         }
+        out[i / 2] = (i % 2) ? (out[i / 2] | v) : (uint8_t)(v << 4);
+    }
+    return true;
+}
 
-        char *auth_credentials = http_auth_basic("admin", wrapper->settings->password);
-        ESP_LOGI(TAG, "Expected Authorization: %s", auth_credentials);
-        ESP_LOGI(TAG, "Received Authorization: %s", buf);
-        ESP_LOGI(TAG, "password: %s", wrapper->settings->password);
-        if (!auth_credentials) {
-            ESP_LOGE(TAG, "No enough memory for basic authorization credentials");
-            free(buf);
-            atomic_fetch_add(&free_count_http_server, 1);
-            return ESP_ERR_NO_MEM;
-        }
+static void http_session_reset(void)
+{
+    esp_fill_random(session_key, sizeof(session_key));
+    session_key_set = true;
+    memset(session_cache, 0, sizeof(session_cache));
+}
 
-        if (strncmp(auth_credentials, buf, buf_len)) {
-            ESP_LOGE(TAG, "Not authenticated");
-            httpd_resp_set_status(req, HTTPD_401);
-            httpd_resp_set_hdr(req, "Connection", "keep-alive");
-            httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"Weight\"");
-            httpd_resp_send(req, NULL, 0);
-        } else {
-            ESP_LOGI(TAG, "Authenticated!");
-            req->user_ctx = wrapper->user_ctx;
-            free(auth_credentials);
-            atomic_fetch_add(&free_count_http_server, 1);
-            free(buf);
-            atomic_fetch_add(&free_count_http_server, 1);
-            return wrapper->handler(req);
+static bool session_check(httpd_req_t *req)
+{
+    char token[SESSION_TOKEN_LEN + 1];
+    size_t token_len = sizeof(token);
+    uint8_t payload[SESSION_PAYLOAD_LEN];
+    uint8_t tag[SESSION_TAG_LEN];
+    uint8_t expected[SESSION_TAG_LEN];
+
+    if (!session_key_set ||
+        httpd_req_get_cookie_val(req, SESSION_COOKIE_NAME, token, &token_len) != ESP_OK ||
+        strlen(token) != SESSION_TOKEN_LEN || token[SESSION_PAYLOAD_LEN * 2] != '.' ||
+        !hex_decode(token, payload, SESSION_PAYLOAD_LEN) ||
+        !hex_decode(token + SESSION_PAYLOAD_LEN * 2 + 1, tag, SESSION_TAG_LEN)) {
+        return false;
+    }
+
+    uint32_t expiry = ((uint32_t)payload[0] << 24) | ((uint32_t)payload[1] << 16) |
+                      ((uint32_t)payload[2] << 8) | payload[3];
+    if (expiry <= session_now()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < SESSION_CACHE_SIZE; i++) {
+        if (session_cache[i].expiry == expiry &&
+            auth_equal((const char *)session_cache[i].tag, SESSION_TAG_LEN, (const char *)tag, SESSION_TAG_LEN)) {
+            return true;
         }
-        free(auth_credentials);
-        atomic_fetch_add(&free_count_http_server, 1);
-        free(buf);
-        atomic_fetch_add(&free_count_http_server, 1);
-    } else {
-        ESP_LOGE(TAG, "No auth header received");
-        httpd_resp_set_status(req, HTTPD_401);
-        httpd_resp_set_hdr(req, "Connection", "keep-alive");
-        httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"Weight\"");
-        httpd_resp_send(req, NULL, 0);
     }
 
+    session_hmac(payload, expected);
+    if (!auth_equal((const char *)expected, SESSION_TAG_LEN, (const char *)tag, SESSION_TAG_LEN)) {
+        return false;
+    }
+    session_cache_entry_t *entry = &session_cache[session_cache_next++ % SESSION_CACHE_SIZE];
+    memcpy(entry->tag, tag, SESSION_TAG_LEN);
+    entry->expiry = expiry;
+    return true;
+}
+
+// Header values must outlive the handler call; the server runs one request at a time
+static char session_set_cookie[sizeof(SESSION_COOKIE_NAME) + SESSION_TOKEN_LEN + 80];
+
+static void session_issue(httpd_req_t *req)
+{
+    uint8_t payload[SESSION_PAYLOAD_LEN];
+    uint8_t tag[SESSION_TAG_LEN];
+    uint32_t expiry = session_now() + CONFIG_HTTPD_SESSION_TTL_S;
+
+    payload[0] = expiry >> 24;
+    payload[1] = expiry >> 16;
+    payload[2] = expiry >> 8;
+    payload[3] = expiry;
+    esp_fill_random(payload + 4, SESSION_PAYLOAD_LEN - 4);
+    session_hmac(payload, tag);
+
+    int n = snprintf(session_set_cookie, sizeof(session_set_cookie), SESSION_COOKIE_NAME "=");
+    for (size_t i = 0; i < SESSION_PAYLOAD_LEN; i++) {
+        n += snprintf(session_set_cookie + n, sizeof(session_set_cookie) - n, "%02x", payload[i]);
+    }
+    n += snprintf(session_set_cookie + n, sizeof(session_set_cookie) - n, ".");
+    for (size_t i = 0; i < SESSION_TAG_LEN; i++) {
+        n += snprintf(session_set_cookie + n, sizeof(session_set_cookie) - n, "%02x", tag[i]);
+    }
+    snprintf(session_set_cookie + n, sizeof(session_set_cookie) - n,
+             "; Path=/; Max-Age=%d; HttpOnly; SameSite=Strict", CONFIG_HTTPD_SESSION_TTL_S);
+    httpd_resp_set_hdr(req, "Set-Cookie", session_set_cookie);
+}
+
+#else
+
+static void http_session_reset(void)
+{
+}
+
+#endif // CONFIG_HTTPD_SESSION_COOKIE
+
+static esp_err_t basic_auth_get_handler(httpd_req_t *req)
+{
+    basic_auth_wrap_t *wrapper = req->user_ctx;
+
+    if (!auth_update_expected(wrapper->settings)) {
+        ESP_LOGE(TAG, "No enough memory for basic authorization credentials");
+        return ESP_ERR_NO_MEM;
+    }
+
+#if CONFIG_HTTPD_SESSION_COOKIE
+    if (session_check(req)) {
+        req->user_ctx = wrapper->user_ctx;
+        return wrapper->handler(req);
+    }
+#endif
+
+    char buf[AUTH_HEADER_MAX];
+    size_t buf_len = httpd_req_get_hdr_value_len(req, "Authorization");
+    if (buf_len > 0 && buf_len < sizeof(buf) &&
+        httpd_req_get_hdr_value_str(req, "Authorization", buf, sizeof(buf)) == ESP_OK &&
+        auth_equal(auth_expected, auth_expected_len, buf, buf_len)) {
+        ESP_LOGD(TAG, "Authenticated %s", req->uri);
+#if CONFIG_HTTPD_SESSION_COOKIE
+        session_issue(req);
+#endif
+        req->user_ctx = wrapper->user_ctx;
+        return wrapper->handler(req);
+    }
+
+    ESP_LOGW(TAG, "Not authenticated: %s", buf_len > 0 ? "bad credentials" : "no Authorization header");
+    httpd_resp_set_status(req, HTTPD_401);
+    httpd_resp_set_hdr(req, "Connection", "keep-alive");
+    httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"Weight\"");
+    httpd_resp_send(req, NULL, 0);
     return ESP_OK;
 }
 
 esp_err_t httpd_register_uri_handler_with_basic_auth(void *settings_ptr, httpd_handle_t server, httpd_uri_t *uri_handler)
 {
     settings_t *settings = (settings_t *)settings_ptr;
-    ESP_LOGI(TAG, "httpd_register_uri_handler_with_basic_auth settings ptr %p", settings);
     basic_auth_wrap_t *wrapper = malloc(sizeof(basic_auth_wrap_t));
-    atomic_fetch_add(&malloc_count_http_server, 1);
     if (!wrapper) {
         ESP_LOGE(TAG, "No enough memory for basic auth wrapper");
         return ESP_ERR_NO_MEM;
@@ -135,19 +318,11 @@ esp_err_t httpd_register_uri_handler_with_basic_auth(void *settings_ptr, httpd_h
     wrapper->user_ctx = uri_handler->user_ctx;
     wrapper->settings = settings;
 
-    httpd_uri_t *wrapped_uri_handler = malloc(sizeof(httpd_uri_t));
-    atomic_fetch_add(&malloc_count_http_server, 1);
-    if (!wrapped_uri_handler) {
-        ESP_LOGE(TAG, "No enough memory for wrapped URI handler");
-        free(wrapper);
-        atomic_fetch_add(&free_count_http_server, 1);
-        return ESP_ERR_NO_MEM;
-    }
-    memcpy(wrapped_uri_handler, uri_handler, sizeof(httpd_uri_t));
-    wrapped_uri_handler->user_ctx = wrapper;
-    wrapped_uri_handler->handler = basic_auth_get_handler;
+    httpd_uri_t wrapped_uri_handler = *uri_handler;
+    wrapped_uri_handler.user_ctx = wrapper;
+    wrapped_uri_handler.handler = basic_auth_get_handler;
 
-    return httpd_register_uri_handler(server, wrapped_uri_handler);
+    return httpd_register_uri_handler_timed(server, &wrapped_uri_handler);
 }
 
 httpd_handle_t http_server_init(void)
@@ -155,7 +330,8 @@ httpd_handle_t http_server_init(void)
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.lru_purge_enable = true;
-    config.max_uri_handlers = 16;
+    config.max_uri_handlers = HTTP_SERVER_MAX_URI_HANDLERS;
+    config.open_fn = http_stats_session_open;
     
     // Start the httpd server
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
@@ -2,9 +2,43 @@
 #define HTTP_SERVER_H
 
 #include <esp_http_server.h>
+#include <stddef.h>
+
+// Buffered writer for chunked responses. Output accumulates in buf and is
+// flushed with httpd_resp_send_chunk() whenever the next write does not fit,
+// so the response size is not bounded by the buffer size.
+typedef struct {
+    httpd_req_t *req;
+    char *buf;
+    size_t size;
+    size_t len;
+    esp_err_t err;      // First send error; later writes are dropped
+} http_chunk_writer_t;
+
+// Routes the server accepts; also the size of the timing table (http_stats.h)
+#define HTTP_SERVER_MAX_URI_HANDLERS 32
 
 httpd_handle_t http_server_init();
 
+// Registers with timing as well (httpd_register_uri_handler_timed())
 esp_err_t httpd_register_uri_handler_with_basic_auth(void *settings, httpd_handle_t handle, httpd_uri_t *uri_handler);
 
-#endif // HTTP_SERVER_H
\ No newline at end of file
+// Call after replacing settings_t.password. The expected credentials are
+// rebuilt on the next request and existing session cookies stop working.
+void http_server_auth_reset(void);
+
+void http_chunk_writer_init(http_chunk_writer_t *w, httpd_req_t *req, char *buf, size_t size);
+
+void http_chunk_printf(http_chunk_writer_t *w, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Flush remaining output and terminate the chunked response
+esp_err_t http_chunk_writer_finish(http_chunk_writer_t *w);
+
+// 503 with Retry-After, for when a buffer pool (buf_pool.h) is exhausted
+esp_err_t http_resp_send_busy(httpd_req_t *req);
+
+// Decode a form or query string value in place ('+' and %XX); the result is
+// never longer than the input
+void http_url_decode(char *s);
+
+#endif // HTTP_SERVER_H
@@ -0,0 +1,210 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "http_stats.h"
+
+static const char *TAG = "http_stats";
+
+#define CODE_CLASSES    6       // 1xx to 5xx, then none
+
+typedef struct {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+    atomic_uint_fast32_t in_flight;
+    atomic_uint_fast32_t latency[HTTP_STATS_BUCKETS];  // Per bucket, not cumulative
+    _Atomic uint64_t latency_us;
+    _Atomic uint64_t bytes;
+    atomic_uint_fast32_t codes[CODE_CLASSES];
+} http_route_t;
+
+static http_route_t routes[HTTP_STATS_MAX_ROUTES];
+static atomic_uint route_count;
+
+// The request being handled. Handlers run one at a time on the server task,
+// which is also where the send function runs, so these need no locking.
+static http_route_t *current_route;
+static int current_fd = -1;
+static int current_status;
+
+static const char *code_labels[CODE_CLASSES] = { "1xx", "2xx", "3xx", "4xx", "5xx", "none" };
+
+static const char *method_name(httpd_method_t method) {
+    switch (method) {
+    case HTTP_DELETE: return "DELETE";
+    case HTTP_GET:    return "GET";
+    case HTTP_HEAD:   return "HEAD";
+    case HTTP_POST:   return "POST";
+    case HTTP_PUT:    return "PUT";
+    default:          return "OTHER";
+    }
+}
+
+// Buckets are 250 us times powers of four: 250 us, 1 ms, 4 ms ... 4.096 s
+static uint32_t bucket_bound_us(int bucket) {
+    return 250u << (2 * bucket);
+}
+
+static int latency_bucket(int64_t us) {
+    for (int b = 0; b < HTTP_STATS_BUCKETS - 1; b++) {
+        if (us <= bucket_bound_us(b)) {
+            return b;
+        }
+    }
+    return HTTP_STATS_BUCKETS - 1;
+}
+
+static esp_err_t timed_handler(httpd_req_t *req) {
+    http_route_t *route = req->user_ctx;
+    req->user_ctx = route->user_ctx;
+
+    atomic_fetch_add(&route->in_flight, 1);
+    current_route = route;
+    current_fd = httpd_req_to_sockfd(req);
+    current_status = 0;
+    int64_t start = esp_timer_get_time();
+
+    esp_err_t err = route->handler(req);
+
+    int64_t us = esp_timer_get_time() - start;
+    int code = current_status;
+    current_route = NULL;
+    current_fd = -1;
+    atomic_fetch_sub(&route->in_flight, 1);
+
+    atomic_fetch_add(&route->latency[latency_bucket(us)], 1);
+    atomic_fetch_add(&route->latency_us, (uint64_t)us);
+    atomic_fetch_add(&route->codes[code >= 100 && code < 600 ? code / 100 - 1 : CODE_CLASSES - 1], 1);
+    return err;
+}
+
+esp_err_t httpd_register_uri_handler_timed(httpd_handle_t server, const httpd_uri_t *uri_handler) {
+    unsigned index = atomic_fetch_add(&route_count, 1);
+    if (index >= HTTP_STATS_MAX_ROUTES) {
+        atomic_fetch_sub(&route_count, 1);
+        ESP_LOGW(TAG, "No room to time %s", uri_handler->uri);
+        return httpd_register_uri_handler(server, uri_handler);
+    }
+
+    http_route_t *route = &routes[index];
+    route->uri = uri_handler->uri;
+    route->method = uri_handler->method;
+    route->handler = uri_handler->handler;
+    route->user_ctx = uri_handler->user_ctx;
+
+    httpd_uri_t timed = *uri_handler;
+    timed.handler = timed_handler;
+    timed.user_ctx = route;
+    esp_err_t err = httpd_register_uri_handler(server, &timed);
+    if (err != ESP_OK) {
+        // Keep the slot; it reports zeros
+        route->handler = NULL;
+    }
+    return err;
+}
+
+// httpd's default send function, counting for the current request
+static int counting_send(httpd_handle_t server, int sockfd, const char *buf, size_t buf_len, int flags) {
+    if (buf == NULL) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    int ret = send(sockfd, buf, buf_len, flags);
+    if (ret < 0) {
+        switch (errno) {
+        case EAGAIN:
+        case EINTR:
+            return HTTPD_SOCK_ERR_TIMEOUT;
+        case EINVAL:
+        case EBADF:
+        case EFAULT:
+        case ENOTSOCK:
+            return HTTPD_SOCK_ERR_INVALID;
+        default:
+            return HTTPD_SOCK_ERR_FAIL;
+        }
+    }
+
+    if (current_route != NULL && sockfd == current_fd) {
+        // httpd sends the status line at the start of its first send
+        if (current_status == 0 && ret >= 12 && memcmp(buf, "HTTP/1.", 7) == 0) {
+            current_status = (buf[9] - '0') * 100 + (buf[10] - '0') * 10 + (buf[11] - '0');
+        }
+        atomic_fetch_add(&current_route->bytes, (uint64_t)ret);
+    }
+    return ret;
+}
+
+esp_err_t http_stats_session_open(httpd_handle_t server, int sockfd) {
+    return httpd_sess_set_send_override(server, sockfd, counting_send);
+}
+
+void http_stats_write_metrics(http_chunk_writer_t *w, const char *hostname) {
+    unsigned count = atomic_load(&route_count);
+    if (count > HTTP_STATS_MAX_ROUTES) {
+        count = HTTP_STATS_MAX_ROUTES;
+    }
+
+    http_chunk_printf(w,
+                      "# HELP http_request_duration_seconds Time spent in the handler per route\n"
+                      "# TYPE http_request_duration_seconds histogram\n");
+    for (unsigned i = 0; i < count; i++) {
+        const http_route_t *r = &routes[i];
+        const char *method = method_name(r->method);
+        uint32_t cumulative = 0;
+        for (int b = 0; b < HTTP_STATS_BUCKETS; b++) {
+            cumulative += (uint32_t)atomic_load(&r->latency[b]);
+            if (b < HTTP_STATS_BUCKETS - 1) {
+                uint32_t bound = bucket_bound_us(b);
+                http_chunk_printf(w, "http_request_duration_seconds_bucket{hostname=\"%s\",route=\"%s\",method=\"%s\",le=\"%" PRIu32 ".%06" PRIu32 "\"} %" PRIu32 "\n",
+                                  hostname, r->uri, method, bound / 1000000, bound % 1000000, cumulative);
+            } else {
+                http_chunk_printf(w, "http_request_duration_seconds_bucket{hostname=\"%s\",route=\"%s\",method=\"%s\",le=\"+Inf\"} %" PRIu32 "\n",
+                                  hostname, r->uri, method, cumulative);
+            }
+        }
+        uint64_t us = atomic_load(&r->latency_us);
+        http_chunk_printf(w,
+                          "http_request_duration_seconds_sum{hostname=\"%s\",route=\"%s\",method=\"%s\"} %" PRIu64 ".%06" PRIu64 "\n"
+                          "http_request_duration_seconds_count{hostname=\"%s\",route=\"%s\",method=\"%s\"} %" PRIu32 "\n",
+                          hostname, r->uri, method, us / 1000000, us % 1000000,
+                          hostname, r->uri, method, cumulative);
+    }
+
+    http_chunk_printf(w,
+                      "# HELP http_requests_total Requests per route by status class\n"
+                      "# TYPE http_requests_total counter\n");
+    for (unsigned i = 0; i < count; i++) {
+        const http_route_t *r = &routes[i];
+        for (int c = 0; c < CODE_CLASSES; c++) {
+            uint32_t n = (uint32_t)atomic_load(&r->codes[c]);
+            // Only classes seen; "none" is a handler that failed without responding
+            if (n > 0 || c == 1) {
+                http_chunk_printf(w, "http_requests_total{hostname=\"%s\",route=\"%s\",method=\"%s\",code=\"%s\"} %" PRIu32 "\n",
+                                  hostname, r->uri, method_name(r->method), code_labels[c], n);
+            }
+        }
+    }
+
+    http_chunk_printf(w,
+                      "# HELP http_response_bytes_total Bytes sent per route, headers included\n"
+                      "# TYPE http_response_bytes_total counter\n");
+    for (unsigned i = 0; i < count; i++) {
+        const http_route_t *r = &routes[i];
+        http_chunk_printf(w, "http_response_bytes_total{hostname=\"%s\",route=\"%s\",method=\"%s\"} %" PRIu64 "\n",
+                          hostname, r->uri, method_name(r->method), (uint64_t)atomic_load(&r->bytes));
+    }
+
+    http_chunk_printf(w,
+                      "# HELP http_requests_in_flight Requests being handled per route\n"
+                      "# TYPE http_requests_in_flight gauge\n");
+    for (unsigned i = 0; i < count; i++) {
+        const http_route_t *r = &routes[i];
+        http_chunk_printf(w, "http_requests_in_flight{hostname=\"%s\",route=\"%s\",method=\"%s\"} %" PRIu32 "\n",
+                          hostname, r->uri, method_name(r->method), (uint32_t)atomic_load(&r->in_flight));
+    }
+}
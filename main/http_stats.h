@@ -0,0 +1,43 @@
+#ifndef HTTP_STATS_H
+#define HTTP_STATS_H
+
+#include <stddef.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "http_server.h"
+
+// Per-route request timing for the HTTP server.
+//
+// Handlers registered with httpd_register_uri_handler_timed() (which
+// httpd_register_uri_handler_with_basic_auth() also uses) run inside a
+// wrapper that records, per route: a latency histogram, requests by status
+// class, response bytes and requests in flight. The status and bytes come
+// from the session send function installed by http_stats_session_open(), so
+// they include the headers and whatever the handler sent, however it sent it.
+//
+// Routes live in a fixed table claimed at registration; a request only
+// updates counters. The histogram buckets grow by a factor of four from
+// 250 us to 4.096 s.
+
+#define HTTP_STATS_MAX_ROUTES   HTTP_SERVER_MAX_URI_HANDLERS
+#define HTTP_STATS_BUCKETS      9       // Including +Inf
+
+/**
+ * @brief Register a handler with timing; the uri string must outlive the
+ *        server, as with a static httpd_uri_t
+ *
+ * Falls back to an untimed registration when the route table is full.
+ */
+esp_err_t httpd_register_uri_handler_timed(httpd_handle_t server, const httpd_uri_t *uri_handler);
+
+/**
+ * @brief httpd_config_t.open_fn: install the counting send function
+ */
+esp_err_t http_stats_session_open(httpd_handle_t server, int sockfd);
+
+/**
+ * @brief Write the per-route metrics in Prometheus text format
+ */
+void http_stats_write_metrics(http_chunk_writer_t *w, const char *hostname);
+
+#endif // HTTP_STATS_H
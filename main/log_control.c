@@ -0,0 +1,509 @@
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "http_server.h"
+#include "syslog.h"
+#include "log_control.h"
+
+static const char *TAG = "log_control";
+
+#define MAX_TAGS            64      // Power of two
+#define MAX_SAVED_LEVELS    32
+#define TAG_MAX_LEN         32
+#define SUMMARY_PERIOD_US   (5 * 1000000LL)
+
+#define RATE_INTERVAL_MS    (CONFIG_LOG_RATE_LIMIT_PER_S > 0 ? 1000 / CONFIG_LOG_RATE_LIMIT_PER_S : 0)
+#define RATE_TOLERANCE_MS   (RATE_INTERVAL_MS * (CONFIG_LOG_RATE_LIMIT_BURST - 1))
+
+// Per-tag state, inserted lock-free by whichever task logs first
+typedef struct {
+    _Atomic(const char *) tag;
+    // Token bucket kept as the time the bucket is next full (GCRA), so a
+    // line is admitted with a single compare-and-swap
+    _Atomic uint32_t full_at_ms;
+    _Atomic uint32_t lines;
+    _Atomic uint32_t bytes;
+    _Atomic uint32_t suppressed;
+    _Atomic uint32_t pending;       // Suppressed since the last summary
+} tag_state_t;
+
+typedef struct {
+    char tag[TAG_MAX_LEN];
+    uint8_t level;
+} saved_level_t;
+
+static tag_state_t tags[MAX_TAGS];
+static tag_state_t untagged = { .tag = "-" };
+static tag_state_t overflow = { .tag = "other" };
+
+static vprintf_like_t console_vprintf = NULL;
+static esp_timer_handle_t summary_timer = NULL;
+
+// Saved levels; only touched from the HTTP and MQTT tasks
+static SemaphoreHandle_t levels_mutex = NULL;
+static saved_level_t saved_levels[MAX_SAVED_LEVELS];
+static size_t saved_levels_count = 0;
+
+static const struct {
+    const char *name;
+    esp_log_level_t level;
+} level_names[] = {
+    { "none", ESP_LOG_NONE },
+    { "error", ESP_LOG_ERROR },
+    { "warn", ESP_LOG_WARN },
+    { "info", ESP_LOG_INFO },
+    { "debug", ESP_LOG_DEBUG },
+    { "verbose", ESP_LOG_VERBOSE },
+};
+
+static const char *level_name(esp_log_level_t level) {
+    for (size_t i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+        if (level_names[i].level == level) {
+            return level_names[i].name;
+        }
+    }
+    return "unknown";
+}
+
+static bool parse_level(const char *name, size_t len, esp_log_level_t *level) {
+    while (len > 0 && (name[len - 1] == '\n' || name[len - 1] == '\r' || name[len - 1] == ' ')) {
+        len--;
+    }
+    for (size_t i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+        if (strlen(level_names[i].name) == len && strncasecmp(level_names[i].name, name, len) == 0) {
+            *level = level_names[i].level;
+            return true;
+        }
+    }
+    if (len == 7 && strncasecmp(name, "warning", 7) == 0) {
+        *level = ESP_LOG_WARN;
+        return true;
+    }
+    return false;
+}
+
+static uint32_t hash_tag(const char *tag) {
+    uint32_t hash = 2166136261u;
+    for (const char *p = tag; *p; p++) {
+        hash ^= (uint8_t)*p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static tag_state_t *lookup_tag(const char *tag) {
+    uint32_t slot = hash_tag(tag) & (MAX_TAGS - 1);
+    for (int probe = 0; probe < MAX_TAGS; probe++) {
+        tag_state_t *state = &tags[(slot + probe) & (MAX_TAGS - 1)];
+        const char *existing = atomic_load_explicit(&state->tag, memory_order_acquire);
+        if (existing == NULL) {
+            if (atomic_compare_exchange_strong(&state->tag, &existing, tag)) {
+                return state;
+            }
+            // Lost the race; existing now holds the winner's tag
+        }
+        if (existing == tag || strcmp(existing, tag) == 0) {
+            return state;
+        }
+    }
+    return &overflow;
+}
+
+static bool admit(tag_state_t *state) {
+    if (RATE_INTERVAL_MS == 0) {
+        return true;
+    }
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+    uint32_t full_at = atomic_load_explicit(&state->full_at_ms, memory_order_relaxed);
+    uint32_t next;
+    do {
+        uint32_t base = (int32_t)(full_at - now) > 0 ? full_at : now;
+        if ((int32_t)(base - now) > RATE_TOLERANCE_MS) {
+            return false;
+        }
+        next = base + RATE_INTERVAL_MS;
+    } while (!atomic_compare_exchange_weak_explicit(&state->full_at_ms, &full_at, next,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    return true;
+}
+
+// Find the tag of an ESP-IDF log line without formatting it. Log macros
+// expand to "<letter> (%" PRIu32 ") %s: " format, with the timestamp and
+// tag as the first two arguments.
+static bool peek_tag(const char *fmt, va_list args, char *letter, const char **tag) {
+    static const char prefix[] = " (%" PRIu32 ") %s: ";
+
+    if (fmt == NULL) {
+        return false;
+    }
+    if (fmt[0] == '\033') {
+        // Skip the colour escape
+        fmt = strchr(fmt, 'm');
+        if (fmt == NULL) {
+            return false;
+        }
+        fmt++;
+    }
+    if (fmt[0] == '\0' || strchr("EWIDV", fmt[0]) == NULL ||
+        strncmp(fmt + 1, prefix, sizeof(prefix) - 1) != 0) {
+        return false;
+    }
+
+    va_list peek;
+    va_copy(peek, args);
+    (void)va_arg(peek, uint32_t);
+    *tag = va_arg(peek, const char *);
+    va_end(peek);
+    *letter = fmt[0];
+    return *tag != NULL;
+}
+
+// Write to the console and hand the line to syslog
+static int emit(const char *fmt, va_list args) {
+    int ret = 0;
+    if (console_vprintf) {
+        va_list console_args;
+        va_copy(console_args, args);
+        ret = console_vprintf(fmt, console_args);
+        va_end(console_args);
+    }
+    syslog_write(fmt, args);
+    return ret;
+}
+
+static int emitf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int ret = emit(fmt, args);
+    va_end(args);
+    return ret;
+}
+
+static void emit_summary(const char *tag, uint32_t count) {
+    emitf("W (%" PRIu32 ") %s: %" PRIu32 " messages suppressed\n", esp_log_timestamp(), tag, count);
+}
+
+static int log_control_vprintf(const char *fmt, va_list args) {
+    char letter = 0;
+    const char *tag = NULL;
+    tag_state_t *state = peek_tag(fmt, args, &letter, &tag) ? lookup_tag(tag) : &untagged;
+
+    if (letter != 'E' && state != &untagged && !admit(state)) {
+        atomic_fetch_add_explicit(&state->suppressed, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&state->pending, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    int ret = emit(fmt, args);
+    atomic_fetch_add_explicit(&state->lines, 1, memory_order_relaxed);
+    if (ret > 0) {
+        atomic_fetch_add_explicit(&state->bytes, ret, memory_order_relaxed);
+    }
+    return ret;
+}
+
+// Report suppressed lines once per period rather than once per line
+static void summary_timer_cb(void *arg) {
+    for (int i = 0; i < MAX_TAGS; i++) {
+        const char *tag = atomic_load_explicit(&tags[i].tag, memory_order_acquire);
+        if (tag == NULL) {
+            continue;
+        }
+        uint32_t pending = atomic_exchange_explicit(&tags[i].pending, 0, memory_order_relaxed);
+        if (pending > 0) {
+            emit_summary(tag, pending);
+        }
+    }
+    uint32_t pending = atomic_exchange_explicit(&overflow.pending, 0, memory_order_relaxed);
+    if (pending > 0) {
+        emit_summary(overflow.tag, pending);
+    }
+}
+
+static esp_err_t save_levels(void) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open("loglevel", NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (saved_levels_count > 0) {
+        err = nvs_set_blob(handle, "levels", saved_levels, saved_levels_count * sizeof(saved_level_t));
+    } else {
+        err = nvs_erase_key(handle, "levels");
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+static void load_levels(void) {
+    nvs_handle_t handle;
+    if (nvs_open("loglevel", NVS_READONLY, &handle) != ESP_OK) {
+        return;     // Nothing saved yet
+    }
+    size_t size = sizeof(saved_levels);
+    esp_err_t err = nvs_get_blob(handle, "levels", saved_levels, &size);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGE(TAG, "Failed to read saved log levels: %s", esp_err_to_name(err));
+        }
+        return;
+    }
+
+    saved_levels_count = size / sizeof(saved_level_t);
+    for (size_t i = 0; i < saved_levels_count; i++) {
+        saved_levels[i].tag[TAG_MAX_LEN - 1] = '\0';
+        esp_log_level_set(saved_levels[i].tag, saved_levels[i].level);
+        ESP_LOGI(TAG, "Log level for '%s' set to %s", saved_levels[i].tag, level_name(saved_levels[i].level));
+    }
+}
+
+static bool valid_tag(const char *tag, size_t len) {
+    if (len == 0 || len >= TAG_MAX_LEN) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        // Printable and safe to emit in JSON and metric labels
+        if (tag[i] < ' ' || tag[i] > '~' || tag[i] == '"' || tag[i] == '\\') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static esp_err_t set_level(const char *tag, size_t tag_len, esp_log_level_t level, bool persist) {
+    if (!valid_tag(tag, tag_len)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char name[TAG_MAX_LEN];
+    memcpy(name, tag, tag_len);
+    name[tag_len] = '\0';
+
+    xSemaphoreTake(levels_mutex, portMAX_DELAY);
+    esp_err_t err = ESP_OK;
+    if (persist) {
+        size_t i;
+        for (i = 0; i < saved_levels_count; i++) {
+            if (strcmp(saved_levels[i].tag, name) == 0) {
+                break;
+            }
+        }
+        if (i == saved_levels_count) {
+            if (saved_levels_count == MAX_SAVED_LEVELS) {
+                err = ESP_ERR_NO_MEM;
+            } else {
+                strcpy(saved_levels[i].tag, name);
+                saved_levels_count++;
+            }
+        }
+        if (err == ESP_OK) {
+            saved_levels[i].level = level;
+            err = save_levels();
+        }
+    }
+    if (err == ESP_OK) {
+        esp_log_level_set(name, level);
+    }
+    xSemaphoreGive(levels_mutex);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Log level for '%s' set to %s", name, level_name(level));
+    } else {
+        ESP_LOGE(TAG, "Failed to set log level for '%s': %s", name, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t log_control_set_level(const char *tag, const char *level, bool persist) {
+    esp_log_level_t parsed;
+    if (tag == NULL || level == NULL || !parse_level(level, strlen(level), &parsed)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return set_level(tag, strlen(tag), parsed, persist);
+}
+
+esp_err_t log_control_mqtt_message(const char *topic, int topic_len, const char *data, int data_len) {
+    const char *end = topic + topic_len;
+    size_t suffix_len = strlen(LOG_CONTROL_MQTT_TOPIC);
+    const char *tag = NULL;
+    for (const char *p = topic; p + suffix_len <= end; p++) {
+        if (memcmp(p, LOG_CONTROL_MQTT_TOPIC, suffix_len) == 0) {
+            tag = p + suffix_len;
+        }
+    }
+    esp_log_level_t level;
+    if (tag == NULL || !parse_level(data, data_len, &level)) {
+        ESP_LOGW(TAG, "Ignoring log level message on %.*s", topic_len, topic);
+        return ESP_ERR_INVALID_ARG;
+    }
+    return set_level(tag, end - tag, level, true);
+}
+
+void log_control_foreach_tag(log_control_tag_cb_t cb, void *ctx) {
+    tag_state_t *extra[] = { &untagged, &overflow };
+    for (int i = 0; i < MAX_TAGS + 2; i++) {
+        tag_state_t *state = i < MAX_TAGS ? &tags[i] : extra[i - MAX_TAGS];
+        log_control_tag_stats_t stats = {
+            .tag = atomic_load_explicit(&state->tag, memory_order_acquire),
+            .lines = atomic_load_explicit(&state->lines, memory_order_relaxed),
+            .bytes = atomic_load_explicit(&state->bytes, memory_order_relaxed),
+            .suppressed = atomic_load_explicit(&state->suppressed, memory_order_relaxed),
+        };
+        if (stats.tag != NULL && (stats.lines > 0 || stats.suppressed > 0)) {
+            cb(&stats, ctx);
+        }
+    }
+}
+
+typedef struct {
+    http_chunk_writer_t *w;
+    bool first;
+} tags_json_ctx_t;
+
+static void write_tag_json(const log_control_tag_stats_t *stats, void *ctx) {
+    tags_json_ctx_t *json = (tags_json_ctx_t *)ctx;
+    http_chunk_printf(json->w, "%s\"%s\":{\"lines\":%lu,\"bytes\":%lu,\"suppressed\":%lu}",
+                      json->first ? "" : ",", stats->tag,
+                      (unsigned long)stats->lines, (unsigned long)stats->bytes,
+                      (unsigned long)stats->suppressed);
+    json->first = false;
+}
+
+static esp_err_t log_levels_handler(httpd_req_t *req) {
+    char buf[512];
+    http_chunk_writer_t w;
+    httpd_resp_set_type(req, "application/json");
+    http_chunk_writer_init(&w, req, buf, sizeof(buf));
+
+    http_chunk_printf(&w, "{\"default\":\"%s\",\"levels\":{", level_name(esp_log_level_get("*")));
+    xSemaphoreTake(levels_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < saved_levels_count; i++) {
+        http_chunk_printf(&w, "%s\"%s\":\"%s\"", i > 0 ? "," : "",
+                          saved_levels[i].tag, level_name(saved_levels[i].level));
+    }
+    xSemaphoreGive(levels_mutex);
+    http_chunk_printf(&w, "},\"tags\":{");
+    tags_json_ctx_t json = { .w = &w, .first = true };
+    log_control_foreach_tag(write_tag_json, &json);
+    http_chunk_printf(&w, "}}");
+    return http_chunk_writer_finish(&w);
+}
+
+static esp_err_t log_level_handler(httpd_req_t *req) {
+    // Room for a fully percent-encoded tag
+    char body[3 * TAG_MAX_LEN + 64];
+    size_t content_len = req->content_len;
+    if (content_len == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected tag=<tag>&level=<level>");
+        return ESP_FAIL;
+    }
+    if (content_len >= sizeof(body)) {
+        httpd_resp_set_status(req, "413 Content Too Large");
+        httpd_resp_send(req, "Request body too large", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    size_t received = 0;
+    while (received < content_len) {
+        int ret = httpd_req_recv(req, body + received, content_len - received);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Request timeout");
+            } else {
+                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to read POST data");
+            }
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    body[received] = '\0';
+
+    // Still encoded here; longer decoded tags are refused by set_level()
+    char tag[3 * TAG_MAX_LEN];
+    char level[16];
+    if (httpd_query_key_value(body, "tag", tag, sizeof(tag)) != ESP_OK ||
+        httpd_query_key_value(body, "level", level, sizeof(level)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected tag=<tag>&level=<level>");
+        return ESP_FAIL;
+    }
+    http_url_decode(tag);
+    http_url_decode(level);
+
+    esp_err_t err = log_control_set_level(tag, level, true);
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid tag or level");
+        return ESP_FAIL;
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    httpd_resp_set_status(req, "204 No Content");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static httpd_uri_t log_levels_uri = {
+    .uri       = "/log/levels",
+    .method    = HTTP_GET,
+    .handler   = log_levels_handler,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t log_level_uri = {
+    .uri       = "/log/level",
+    .method    = HTTP_POST,
+    .handler   = log_level_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t log_control_init(void) {
+    if (console_vprintf != NULL) {
+        return ESP_OK;
+    }
+
+    levels_mutex = xSemaphoreCreateMutex();
+    if (levels_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create log levels mutex");
+        return ESP_ERR_NO_MEM;
+    }
+    load_levels();
+
+    console_vprintf = esp_log_set_vprintf(log_control_vprintf);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = summary_timer_cb,
+        .name = "log_summary",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &summary_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(summary_timer, SUMMARY_PERIOD_US);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to start suppression summary timer: %s", esp_err_to_name(err));
+    }
+    return ESP_OK;
+}
+
+esp_err_t log_control_register(settings_t *settings, httpd_handle_t http_server) {
+    esp_err_t err = httpd_register_uri_handler_with_basic_auth(settings, http_server, &log_levels_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register %s: %s", log_levels_uri.uri, esp_err_to_name(err));
+        return err;
+    }
+    err = httpd_register_uri_handler_with_basic_auth(settings, http_server, &log_level_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register %s: %s", log_level_uri.uri, esp_err_to_name(err));
+    }
+    return err;
+}
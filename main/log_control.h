@@ -0,0 +1,57 @@
+#ifndef LOG_CONTROL_H
+#define LOG_CONTROL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "esp_log.h"
+#include "settings.h"
+
+// MQTT topics are <hostname>/log/level/<tag>, payload the level name
+#define LOG_CONTROL_MQTT_TOPIC "/log/level/"
+
+typedef struct {
+    const char *tag;            // "-" for output without an ESP-IDF tag
+    uint32_t lines;             // Lines written
+    uint32_t bytes;             // Bytes written to the console
+    uint32_t suppressed;        // Lines dropped by the rate limiter
+} log_control_tag_stats_t;
+
+typedef void (*log_control_tag_cb_t)(const log_control_tag_stats_t *stats, void *ctx);
+
+/**
+ * @brief Install the log output hook and apply the saved tag levels
+ *
+ * Call once, early, after NVS is initialised. All ESP-IDF log output then
+ * goes through a per-tag rate limiter before reaching the console and
+ * syslog. Error lines are never rate limited.
+ */
+esp_err_t log_control_init(void);
+
+/**
+ * @brief Register GET /log/levels and POST /log/level
+ */
+esp_err_t log_control_register(settings_t *settings, httpd_handle_t http_server);
+
+/**
+ * @brief Set the level of a tag ("*" for the default)
+ *
+ * @param level "none", "error", "warn", "info", "debug" or "verbose"
+ * @param persist Save to NVS so the level survives a restart
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, or ESP_ERR_NO_MEM if too many tags
+ *         have saved levels
+ */
+esp_err_t log_control_set_level(const char *tag, const char *level, bool persist);
+
+/**
+ * @brief Handle a message on <hostname>/log/level/<tag>
+ */
+esp_err_t log_control_mqtt_message(const char *topic, int topic_len, const char *data, int data_len);
+
+/**
+ * @brief Call cb with the counters of every tag seen so far
+ */
+void log_control_foreach_tag(log_control_tag_cb_t cb, void *ctx);
+
+#endif // LOG_CONTROL_H
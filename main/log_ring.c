@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+#include "log_ring.h"
+#include "alloc_prof.h"
+
+#define STATE_COMMITTED 0x01u
+#define STATE_PADDING   0x02u
+#define STATE_TYPE_SHIFT 8
+
+#define HDR_SIZE ((uint32_t)sizeof(log_ring_hdr_t))
+
+// Claims are whole multiples of the header size. The ring size is a power of
+// two of at least 64, so the space left before the end of the buffer then
+// always has room for the padding header.
+#define ALIGN_HDR(n) (((n) + HDR_SIZE - 1) & ~(HDR_SIZE - 1))
+
+static inline log_ring_hdr_t *hdr_at(log_ring_t *ring, uint32_t pos) {
+    return (log_ring_hdr_t *)&ring->buf[pos & ring->mask];
+}
+
+esp_err_t log_ring_init(log_ring_t *ring, size_t size) {
+    uint32_t ring_size = 64;
+    while (ring_size < size) {
+        ring_size <<= 1;
+    }
+    if (ring_size > 65536) {
+        return ESP_ERR_INVALID_SIZE;    // Record sizes are 16-bit
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->buf = calloc(1, ring_size);
+    if (ring->buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ring->size = ring_size;
+    ring->mask = ring_size - 1;
+    atomic_store(&ring->consumer_idle, 1);
+    return ESP_OK;
+}
+
+void *log_ring_reserve(log_ring_t *ring, size_t max_len, log_ring_reservation_t *res) {
+    uint32_t need = ALIGN_HDR(HDR_SIZE + (uint32_t)max_len);
+    if (ring->buf == NULL || need > ring->size / 2) {
+        if (ring->buf != NULL) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        }
+        return NULL;
+    }
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t pad;
+    uint32_t used;
+    do {
+        uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        uint32_t contig = ring->size - (head & ring->mask);
+        pad = (need > contig) ? contig : 0;
+        used = head - tail + pad + need;
+        if (used > ring->size) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&ring->head, &head, head + pad + need,
+                                                    memory_order_acq_rel, memory_order_relaxed));
+
+    uint32_t high = atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+    while (used > high &&
+           !atomic_compare_exchange_weak_explicit(&ring->high_water, &high, used,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    if (pad) {
+        // Skip to the start of the buffer; the padding is ready immediately
+        log_ring_hdr_t *pad_hdr = hdr_at(ring, head);
+        pad_hdr->size = (uint16_t)pad;
+        pad_hdr->len = 0;
+        atomic_store_explicit(&pad_hdr->state, STATE_COMMITTED | STATE_PADDING, memory_order_release);
+    }
+
+    res->pos = head + pad;
+    res->end = head + pad + need;
+    res->hdr = hdr_at(ring, res->pos);
+    return res->hdr + 1;
+}
+
+void log_ring_commit(log_ring_t *ring, log_ring_reservation_t *res, size_t len, uint8_t type) {
+    uint32_t size = res->end - res->pos;
+    uint32_t trimmed = ALIGN_HDR(HDR_SIZE + (uint32_t)len);
+
+    // Give back the unused tail if nobody has claimed space after us
+    if (trimmed < size) {
+        uint32_t expected = res->end;
+        if (atomic_compare_exchange_strong_explicit(&ring->head, &expected, res->pos + trimmed,
+                                                    memory_order_acq_rel, memory_order_relaxed)) {
+            size = trimmed;
+        }
+    }
+
+    res->hdr->size = (uint16_t)size;
+    res->hdr->len = (uint16_t)len;
+    atomic_store_explicit(&res->hdr->state, STATE_COMMITTED | ((uint32_t)type << STATE_TYPE_SHIFT),
+                          memory_order_release);
+    atomic_fetch_add_explicit(&ring->records, 1, memory_order_relaxed);
+
+    // Pairs with the fence in log_ring_peek: either the consumer sees this
+    // record, or we see it idle and wake it. The handle is read once since
+    // it may be cleared while we are here.
+    TaskHandle_t consumer = atomic_load_explicit(&ring->consumer, memory_order_acquire);
+    if (consumer != NULL) {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_exchange_explicit(&ring->consumer_idle, 0, memory_order_relaxed)) {
+            xTaskNotifyGive(consumer);
+        }
+    }
+}
+
+// Zero a consumed record and advance the tail past it
+static void release_at(log_ring_t *ring, uint32_t tail, uint32_t size) {
+    memset(&ring->buf[tail & ring->mask], 0, size);
+    atomic_store_explicit(&ring->tail, tail + size, memory_order_release);
+}
+
+const void *log_ring_peek(log_ring_t *ring, size_t *len, uint8_t *type) {
+    if (ring->buf == NULL) {
+        return NULL;
+    }
+
+    bool idle = false;
+    while (1) {
+        uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint32_t state = 0;
+        log_ring_hdr_t *hdr = hdr_at(ring, tail);
+        if (tail != atomic_load_explicit(&ring->head, memory_order_acquire)) {
+            state = atomic_load_explicit(&hdr->state, memory_order_acquire);
+        }
+        if (!(state & STATE_COMMITTED)) {
+            // Empty, or the oldest record is still being written. Ask for a
+            // notification, then look once more for a commit that missed it.
+            if (idle) {
+                return NULL;
+            }
+            atomic_store_explicit(&ring->consumer_idle, 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            idle = true;
+            continue;
+        }
+        if (idle) {
+            atomic_store_explicit(&ring->consumer_idle, 0, memory_order_relaxed);
+            idle = false;
+        }
+        if (state & STATE_PADDING) {
+            release_at(ring, tail, hdr->size);
+            continue;
+        }
+        *len = hdr->len;
+        if (type != NULL) {
+            *type = (uint8_t)(state >> STATE_TYPE_SHIFT);
+        }
+        return hdr + 1;
+    }
+}
+
+void log_ring_release(log_ring_t *ring) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    release_at(ring, tail, hdr_at(ring, tail)->size);
+}
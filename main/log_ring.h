@@ -0,0 +1,85 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Lock-free multi-producer, single-consumer ring of variable-length records.
+//
+// Producers claim space with a compare-and-swap on the head, fill it in place
+// and commit it; no lock is held, so any task may log. Records never wrap:
+// when one does not fit before the end of the buffer the remainder is claimed
+// as padding. The consumer reads records in order and stops at the first one
+// that is still being written. Released space is zeroed, which is what lets a
+// producer's header read as "not committed" until it is.
+//
+// The consumer is woken only when a commit follows a log_ring_peek that found
+// nothing to read, so a burst costs one notification rather than one per
+// record. The consumer must therefore drain until log_ring_peek returns NULL
+// before it waits.
+
+typedef struct {
+    _Atomic uint32_t state;     // 0 until committed; then flags and record type
+    uint16_t size;              // Bytes occupied, including this header
+    uint16_t len;               // Payload bytes
+} log_ring_hdr_t;
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;              // Power of two
+    uint32_t mask;
+    _Atomic uint32_t head;      // Next byte to claim (free-running)
+    _Atomic uint32_t tail;      // Oldest byte not yet released (free-running)
+    _Atomic uint32_t dropped;   // Records that did not fit
+    _Atomic uint32_t high_water;    // Most bytes ever in use
+    _Atomic uint32_t records;   // Records committed
+    _Atomic uint32_t consumer_idle; // The consumer found nothing to read
+    _Atomic(TaskHandle_t) consumer; // Notified on commit after that, if set
+} log_ring_t;
+
+// A claimed, uncommitted record
+typedef struct {
+    log_ring_hdr_t *hdr;
+    uint32_t pos;               // Free-running position of the header
+    uint32_t end;               // Free-running end of the claim
+} log_ring_reservation_t;
+
+/**
+ * @brief Allocate a ring of at least size bytes (rounded up to a power of two)
+ */
+esp_err_t log_ring_init(log_ring_t *ring, size_t size);
+
+/**
+ * @brief Claim space for a record of up to max_len payload bytes
+ *
+ * @return Payload pointer, or NULL if the ring is full (counted as a drop)
+ */
+void *log_ring_reserve(log_ring_t *ring, size_t max_len, log_ring_reservation_t *res);
+
+/**
+ * @brief Publish a reserved record
+ *
+ * @param len Payload bytes actually used (<= max_len). If no other producer
+ *        has claimed space since, the unused tail of the claim is given back.
+ * @param type Record type, returned to the consumer by log_ring_peek
+ */
+void log_ring_commit(log_ring_t *ring, log_ring_reservation_t *res, size_t len, uint8_t type);
+
+/**
+ * @brief Consumer: get the oldest record without removing it
+ *
+ * @return Payload pointer, or NULL if the ring is empty or the oldest record
+ *         is still being written
+ */
+const void *log_ring_peek(log_ring_t *ring, size_t *len, uint8_t *type);
+
+/**
+ * @brief Consumer: drop the record returned by the last log_ring_peek
+ */
+void log_ring_release(log_ring_t *ring);
+
+#endif // LOG_RING_H
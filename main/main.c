@@ -22,6 +22,12 @@
 #include "driver/i2c_master.h"
 #include "pump.h"
 #include "syslog.h"
+#include "log_control.h"
+#include "dlog.h"
+#include "www.h"
+#include "buf_pool.h"
+#include "task_stats.h"
+#include "alloc_prof.h"
 
 bool g_ntp_initialized = false;
 
@@ -36,9 +42,12 @@ void app_main(void)
     ESP_ERROR_CHECK(ret);
 
     ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    // Route all log output through the per-tag levels and rate limiter
+    log_control_init();
+    dlog_init();
     
     settings_t *settings = malloc(sizeof(settings_t));
-    atomic_fetch_add(&malloc_count_main, 1);
     ESP_LOGI("main", "app_main settings ptr %p", settings);
 
     ESP_ERROR_CHECK(settings_init(settings));
@@ -54,8 +63,16 @@ void app_main(void)
         mqtt_publisher_init(settings);  // Initialize MQTT client after WiFi
     }
     
+    // Before the server, whose handlers take their buffers from it
+    ESP_ERROR_CHECK(buf_pool_init());
     httpd_handle_t http_server = http_server_init();
+    www_init(http_server);
     settings_register(settings, http_server);
+    log_control_register(settings, http_server);
+    dlog_register(settings, http_server);
+    alloc_prof_register(settings, http_server);
+    task_stats_init();
+    task_stats_register(settings, http_server);
     
     // Only initialize sensors if NOT in OTA mode
     if (!ota_mode) {
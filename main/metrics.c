@@ -1,49 +1,302 @@
 #include "metrics.h"
 #include "wifi.h"
 #include "sensors.h"
+#include "http_server.h"
+#include "http_stats.h"
+#include "bthome_devices.h"
+#include "bthome_crypto.h"
+#include "bthome_scan.h"
+#include "syslog.h"
+#include "log_control.h"
+#include "dlog.h"
+#include "sensors_stream.h"
+#include "buf_pool.h"
+#include "task_stats.h"
+#include "task_config.h"
 #include <esp_log.h>
 #include <esp_timer.h>
 #include <esp_heap_caps.h>
+#include <nvs.h>
 #include <string.h>
 #include <stdio.h>
 #include <sys/time.h>
+#if CONFIG_LWIP_STATS
+#include "lwip/stats.h"
+#endif
+#include "alloc_prof.h"
 
 static const char *TAG = "metrics";
 
-// Define atomic malloc counters
-atomic_uint_fast32_t malloc_count_settings = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t malloc_count_metrics = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t malloc_count_sensors = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t malloc_count_pump = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t malloc_count_main = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t malloc_count_http_server = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t malloc_count_syslog = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t malloc_count_mqtt_publisher = ATOMIC_VAR_INIT(0);
-
-// Define atomic free counters
-atomic_uint_fast32_t free_count_settings = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t free_count_metrics = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t free_count_sensors = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t free_count_pump = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t free_count_main = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t free_count_http_server = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t free_count_syslog = ATOMIC_VAR_INIT(0);
-atomic_uint_fast32_t free_count_mqtt_publisher = ATOMIC_VAR_INIT(0);
+// BTHome per-device reception metrics. Prometheus expects all samples of a
+// family together, so the device table is walked once per family.
+typedef enum {
+    BTHOME_DEVICE_PACKETS,
+    BTHOME_DEVICE_DUPLICATES,
+    BTHOME_DEVICE_DUPLICATE_RATIO,
+    BTHOME_DEVICE_PACKET_RATE,
+    BTHOME_DEVICE_RSSI,
+    BTHOME_DEVICE_JITTER,
+    BTHOME_DEVICE_PERIOD,
+    BTHOME_DEVICE_FAMILY_COUNT
+} bthome_device_family_t;
+
+static const struct {
+    const char *name;
+    const char *type;
+    const char *help;
+} bthome_device_families[BTHOME_DEVICE_FAMILY_COUNT] = {
+    [BTHOME_DEVICE_PACKETS] = { "bthome_device_packets_total", "counter",
+        "BTHome advertisements received per device, including repeats" },
+    [BTHOME_DEVICE_DUPLICATES] = { "bthome_device_duplicates_total", "counter",
+        "BTHome advertisements dropped as repeats of the previous packet ID" },
+    [BTHOME_DEVICE_DUPLICATE_RATIO] = { "bthome_device_duplicate_ratio", "gauge",
+        "Fraction of BTHome advertisements that were repeats" },
+    [BTHOME_DEVICE_PACKET_RATE] = { "bthome_device_packets_per_second", "gauge",
+        "Unique BTHome packets per second, from the smoothed inter-arrival time" },
+    [BTHOME_DEVICE_RSSI] = { "bthome_device_rssi_dbm", "gauge",
+        "Smoothed RSSI of BTHome advertisements in dBm" },
+    [BTHOME_DEVICE_JITTER] = { "bthome_device_jitter_seconds", "gauge",
+        "Smoothed variation of the time between unique BTHome packets in seconds" },
+    [BTHOME_DEVICE_PERIOD] = { "bthome_device_period_seconds", "gauge",
+        "Advertising period the BLE scan scheduler expects from a BTHome device" },
+};
+
+typedef struct {
+    http_chunk_writer_t *w;
+    const char *hostname;
+    bthome_device_family_t family;
+} bthome_device_metrics_ctx_t;
+
+static bool write_bthome_device_metric(const bthome_device_stats_t *stats, void *user_data) {
+    bthome_device_metrics_ctx_t *ctx = (bthome_device_metrics_ctx_t *)user_data;
+    const char *name = bthome_device_families[ctx->family].name;
+    
+    char mac[18];
+    snprintf(mac, sizeof(mac), "%02X:%02X:%02X:%02X:%02X:%02X",
+             stats->addr[0], stats->addr[1], stats->addr[2],
+             stats->addr[3], stats->addr[4], stats->addr[5]);
+    
+    switch (ctx->family) {
+        case BTHOME_DEVICE_PACKETS:
+            http_chunk_printf(ctx->w, "%s{hostname=\"%s\",mac=\"%s\"} %lu\n",
+                              name, ctx->hostname, mac, (unsigned long)stats->packets);
+            break;
+        case BTHOME_DEVICE_DUPLICATES:
+            http_chunk_printf(ctx->w, "%s{hostname=\"%s\",mac=\"%s\"} %lu\n",
+                              name, ctx->hostname, mac, (unsigned long)stats->duplicates);
+            break;
+        case BTHOME_DEVICE_DUPLICATE_RATIO:
+            http_chunk_printf(ctx->w, "%s{hostname=\"%s\",mac=\"%s\"} %.3f\n",
+                              name, ctx->hostname, mac,
+                              stats->packets ? (float)stats->duplicates / stats->packets : 0.0f);
+            break;
+        case BTHOME_DEVICE_PACKET_RATE:
+            // Needs at least two unique packets to have an interval
+            if (stats->interval_ewma_s > 0.0f) {
+                http_chunk_printf(ctx->w, "%s{hostname=\"%s\",mac=\"%s\"} %.4f\n",
+                                  name, ctx->hostname, mac, 1.0f / stats->interval_ewma_s);
+            }
+            break;
+        case BTHOME_DEVICE_RSSI:
+            http_chunk_printf(ctx->w, "%s{hostname=\"%s\",mac=\"%s\"} %.1f\n",
+                              name, ctx->hostname, mac, stats->rssi_ewma);
+            break;
+        case BTHOME_DEVICE_JITTER:
+            http_chunk_printf(ctx->w, "%s{hostname=\"%s\",mac=\"%s\"} %.3f\n",
+                              name, ctx->hostname, mac, stats->jitter_s);
+            break;
+        case BTHOME_DEVICE_PERIOD:
+            if (stats->period_s > 0.0f) {
+                http_chunk_printf(ctx->w, "%s{hostname=\"%s\",mac=\"%s\"} %.3f\n",
+                                  name, ctx->hostname, mac, stats->period_s);
+            }
+            break;
+        default:
+            break;
+    }
+    return ctx->w->err == ESP_OK;
+}
+
+static void write_bthome_device_metrics(http_chunk_writer_t *w, const char *hostname) {
+    bthome_device_metrics_ctx_t ctx = { .w = w, .hostname = hostname };
+    for (int family = 0; family < BTHOME_DEVICE_FAMILY_COUNT; family++) {
+        ctx.family = family;
+        http_chunk_printf(w, "# HELP %s %s\n# TYPE %s %s\n",
+                          bthome_device_families[family].name,
+                          bthome_device_families[family].help,
+                          bthome_device_families[family].name,
+                          bthome_device_families[family].type);
+        bthome_devices_iterate(write_bthome_device_metric, &ctx);
+    }
+    
+    http_chunk_printf(w,
+                      "# HELP bthome_untracked_packets_total BTHome advertisements from devices beyond the tracking table\n"
+                      "# TYPE bthome_untracked_packets_total counter\n"
+                      "bthome_untracked_packets_total{hostname=\"%s\"} %lu\n",
+                      hostname, (unsigned long)bthome_devices_untracked());
+    
+    bthome_crypto_stats_t crypto;
+    bthome_crypto_get_stats(&crypto);
+    http_chunk_printf(w,
+                      "# HELP bthome_encrypted_packets_total Encrypted BTHome advertisements by outcome\n"
+                      "# TYPE bthome_encrypted_packets_total counter\n"
+                      "bthome_encrypted_packets_total{hostname=\"%s\",result=\"decrypted\"} %lu\n"
+                      "bthome_encrypted_packets_total{hostname=\"%s\",result=\"no_key\"} %lu\n"
+                      "bthome_encrypted_packets_total{hostname=\"%s\",result=\"replay\"} %lu\n"
+                      "bthome_encrypted_packets_total{hostname=\"%s\",result=\"auth_failed\"} %lu\n",
+                      hostname, (unsigned long)crypto.decrypted,
+                      hostname, (unsigned long)crypto.no_key,
+                      hostname, (unsigned long)crypto.replays,
+                      hostname, (unsigned long)crypto.auth_failures);
+}
+
+// BLE scan duty against IP traffic, to see how the two share the radio
+static void write_radio_metrics(http_chunk_writer_t *w, const char *hostname) {
+    bthome_scan_stats_t scan;
+    bthome_scan_get_stats(&scan);
+    
+    http_chunk_printf(w,
+                      "# HELP bthome_scan_mode_seconds_total Time spent in each BLE scan mode\n"
+                      "# TYPE bthome_scan_mode_seconds_total counter\n"
+                      "bthome_scan_mode_seconds_total{hostname=\"%s\",mode=\"wide\"} %.1f\n"
+                      "bthome_scan_mode_seconds_total{hostname=\"%s\",mode=\"background\"} %.1f\n",
+                      hostname, scan.mode_seconds[BTHOME_SCAN_MODE_WIDE],
+                      hostname, scan.mode_seconds[BTHOME_SCAN_MODE_BACKGROUND]);
+    http_chunk_printf(w,
+                      "# HELP bthome_scan_radio_seconds_total Time the BLE receiver spent scanning; its rate is the average scan duty\n"
+                      "# TYPE bthome_scan_radio_seconds_total counter\n"
+                      "bthome_scan_radio_seconds_total{hostname=\"%s\"} %.1f\n",
+                      hostname, scan.radio_seconds);
+    http_chunk_printf(w,
+                      "# HELP bthome_scan_duty_ratio Scan window over scan interval of the current mode\n"
+                      "# TYPE bthome_scan_duty_ratio gauge\n"
+                      "bthome_scan_duty_ratio{hostname=\"%s\"} %.3f\n",
+                      hostname, scan.duty);
+    http_chunk_printf(w,
+                      "# HELP bthome_scan_mode_switches_total BLE scan mode changes\n"
+                      "# TYPE bthome_scan_mode_switches_total counter\n"
+                      "bthome_scan_mode_switches_total{hostname=\"%s\"} %lu\n",
+                      hostname, (unsigned long)scan.mode_switches);
+    
+#if CONFIG_LWIP_STATS
+    http_chunk_printf(w,
+                      "# HELP lwip_ip_packets_total IP packets handled by the network stack\n"
+                      "# TYPE lwip_ip_packets_total counter\n"
+                      "lwip_ip_packets_total{hostname=\"%s\",direction=\"rx\"} %lu\n"
+                      "lwip_ip_packets_total{hostname=\"%s\",direction=\"tx\"} %lu\n",
+                      hostname, (unsigned long)lwip_stats.ip.recv,
+                      hostname, (unsigned long)lwip_stats.ip.xmit);
+    http_chunk_printf(w,
+                      "# HELP lwip_ip_dropped_packets_total IP packets dropped by the network stack\n"
+                      "# TYPE lwip_ip_dropped_packets_total counter\n"
+                      "lwip_ip_dropped_packets_total{hostname=\"%s\"} %lu\n",
+                      hostname, (unsigned long)lwip_stats.ip.drop);
+    http_chunk_printf(w,
+                      "# HELP lwip_tcp_segments_total TCP segments handled by the network stack\n"
+                      "# TYPE lwip_tcp_segments_total counter\n"
+                      "lwip_tcp_segments_total{hostname=\"%s\",direction=\"rx\"} %lu\n"
+                      "lwip_tcp_segments_total{hostname=\"%s\",direction=\"tx\"} %lu\n",
+                      hostname, (unsigned long)lwip_stats.tcp.recv,
+                      hostname, (unsigned long)lwip_stats.tcp.xmit);
+#endif
+}
+
+typedef struct {
+    http_chunk_writer_t *w;
+    const char *hostname;
+    const char *metric;         // Which counter to print
+} log_tag_metrics_ctx_t;
+
+static void write_log_tag_metric(const log_control_tag_stats_t *stats, void *arg) {
+    log_tag_metrics_ctx_t *ctx = (log_tag_metrics_ctx_t *)arg;
+    uint32_t value = strcmp(ctx->metric, "log_lines_total") == 0 ? stats->lines
+                   : strcmp(ctx->metric, "log_bytes_total") == 0 ? stats->bytes
+                   : stats->suppressed;
+    http_chunk_printf(ctx->w, "%s{hostname=\"%s\",tag=\"%s\"} %lu\n",
+                      ctx->metric, ctx->hostname, stats->tag, (unsigned long)value);
+}
+
+static void write_log_metrics(http_chunk_writer_t *w, const char *hostname) {
+    static const char *metrics[][2] = {
+        { "log_lines_total", "Log lines written, by tag" },
+        { "log_bytes_total", "Log bytes written to the console, by tag" },
+        { "log_suppressed_total", "Log lines dropped by the rate limiter, by tag" },
+    };
+    for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); i++) {
+        http_chunk_printf(w,
+                          "# HELP %s %s\n"
+                          "# TYPE %s counter\n",
+                          metrics[i][0], metrics[i][1], metrics[i][0]);
+        log_tag_metrics_ctx_t ctx = { .w = w, .hostname = hostname, .metric = metrics[i][0] };
+        log_control_foreach_tag(write_log_tag_metric, &ctx);
+    }
+}
+
+typedef struct {
+    http_chunk_writer_t *w;
+    const char *hostname;
+    int counter;                // 0 writes, 1 erases, 2 unchanged
+} settings_nvs_metrics_ctx_t;
+
+static void write_settings_nvs_key_metric(const settings_nvs_key_stats_t *stats, void *arg) {
+    settings_nvs_metrics_ctx_t *ctx = (settings_nvs_metrics_ctx_t *)arg;
+    static const char *names[] = {
+        "settings_nvs_writes_total", "settings_nvs_erases_total", "settings_nvs_unchanged_total",
+    };
+    uint32_t value = ctx->counter == 0 ? stats->writes
+                   : ctx->counter == 1 ? stats->erases
+                   : stats->unchanged;
+    http_chunk_printf(ctx->w, "%s{hostname=\"%s\",key=\"%s\"} %lu\n",
+                      names[ctx->counter], ctx->hostname, stats->nvs_key, (unsigned long)value);
+}
+
+// Flash wear from settings saves
+static void write_settings_nvs_metrics(http_chunk_writer_t *w, const char *hostname) {
+    static const char *families[][2] = {
+        { "settings_nvs_writes_total", "Settings values written to NVS, by key" },
+        { "settings_nvs_erases_total", "Settings lists erased from NVS because they became empty, by key" },
+        { "settings_nvs_unchanged_total", "Submitted settings values that matched the stored value and were not written, by key" },
+    };
+    for (int i = 0; i < 3; i++) {
+        http_chunk_printf(w, "# HELP %s %s\n# TYPE %s counter\n",
+                          families[i][0], families[i][1], families[i][0]);
+        settings_nvs_metrics_ctx_t ctx = { .w = w, .hostname = hostname, .counter = i };
+        settings_nvs_foreach_key(write_settings_nvs_key_metric, &ctx);
+    }
+    http_chunk_printf(w,
+                      "# HELP settings_nvs_commits_total NVS commits made by settings saves\n"
+                      "# TYPE settings_nvs_commits_total counter\n"
+                      "settings_nvs_commits_total{hostname=\"%s\"} %lu\n",
+                      hostname, (unsigned long)settings_nvs_commits());
+
+    nvs_stats_t nvs;
+    if (nvs_get_stats(NULL, &nvs) == ESP_OK) {
+        http_chunk_printf(w,
+                          "# HELP nvs_entries NVS partition entries by state\n"
+                          "# TYPE nvs_entries gauge\n"
+                          "nvs_entries{hostname=\"%s\",state=\"used\"} %u\n"
+                          "nvs_entries{hostname=\"%s\",state=\"free\"} %u\n",
+                          hostname, (unsigned)nvs.used_entries,
+                          hostname, (unsigned)nvs.free_entries);
+    }
+}
 
 static esp_err_t metrics_handler(httpd_req_t *req) {
     settings_t *settings = (settings_t *)req->user_ctx;
     
-    // Allocate larger buffer for BTHome metrics
-    size_t response_size = 8192;
-    char *response = malloc(response_size);
-    atomic_fetch_add(&malloc_count_metrics, 1);
+    // Output is streamed in chunks, so the buffer only bounds the chunk size
+    size_t response_size = BUF_POOL_LARGE;
+    char *response = buf_pool_get(response_size);
     if (response == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for metrics response");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+        return http_resp_send_busy(req);
     }
     
-    int offset = 0;
+    httpd_resp_set_status(req, HTTPD_200);
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    httpd_resp_set_hdr(req, "Connection", "keep-alive");
+    
+    http_chunk_writer_t w;
+    http_chunk_writer_init(&w, req, response, response_size);
     
     // Get uptime in seconds
     int64_t uptime_us = esp_timer_get_time();
@@ -58,60 +311,124 @@ static esp_err_t metrics_handler(httpd_req_t *req) {
     
     // Build Prometheus text format response
     
-    // Get all sensors from sensors.c
-    int sensor_count = sensors_get_count();
-    for (int i = 0; i < sensor_count; i++) {
-        const sensor_data_t *sensor = sensors_get_by_index(i);
-        if (sensor == NULL || sensor->metric_name[0] == '\0') {
-            continue;
-        }
-        
-        // Output HELP and TYPE for this sensor
-        offset += snprintf(response + offset, response_size - offset,
-                          "# HELP %s %s", sensor->metric_name, sensor->display_name);
-        
-        if (sensor->unit[0] != '\0') {
-            offset += snprintf(response + offset, response_size - offset,
-                              " in %s", sensor->unit);
-        }
-        
-        offset += snprintf(response + offset, response_size - offset, "\n");
-        offset += snprintf(response + offset, response_size - offset,
-                          "# TYPE %s gauge\n", sensor->metric_name);
-        
-        // Output value if available
-        if (sensor->available && sensor->last_updated > 0) {
-            // Convert timestamp to milliseconds for Prometheus
-            int64_t timestamp_ms = (int64_t)sensor->last_updated * 1000;
-            
-            offset += snprintf(response + offset, response_size - offset,
-                              "%s{hostname=\"%s\"%s%s%s%s%s%s} %.2f %lld\n", 
-                              sensor->metric_name, hostname, 
-
-                              sensor->device_name[0] != '\0' ? ",device_name=\"" : "",
-                              sensor->device_name[0] != '\0' ? sensor->device_name : "",
-                              sensor->device_name[0] != '\0' ? "\"" : "",
-
-                              sensor->device_id[0] != '\0' ? ",device_id=\"" : "",
-                              sensor->device_id[0] != '\0' ? sensor->device_id : "",
-                              sensor->device_id[0] != '\0' ? "\"" : "",
-
-                              sensor->value, timestamp_ms);
-        }
-    }
+    sensors_write_metrics(&w, hostname);
+    
+    // BTHome reception statistics
+    write_bthome_device_metrics(&w, hostname);
     
     // WiFi RSSI metric
-    offset += snprintf(response + offset, response_size - offset,
+    http_chunk_printf(&w,
                       "# HELP wifi_rssi_dbm WiFi signal strength in dBm\n"
                       "# TYPE wifi_rssi_dbm gauge\n");
     
     if (rssi != 0) {
-        offset += snprintf(response + offset, response_size - offset,
+        http_chunk_printf(&w,
                           "wifi_rssi_dbm{hostname=\"%s\"} %d\n", hostname, rssi);
     }
     
+    // BLE/WiFi coexistence
+    write_radio_metrics(&w, hostname);
+    
+    // Syslog ring
+    syslog_stats_t syslog_stats;
+    syslog_get_stats(&syslog_stats);
+    http_chunk_printf(&w,
+                      "# HELP syslog_ring_size_bytes Capacity of the syslog ring buffer\n"
+                      "# TYPE syslog_ring_size_bytes gauge\n"
+                      "syslog_ring_size_bytes{hostname=\"%s\"} %lu\n"
+                      "# HELP syslog_ring_high_water_bytes Most bytes ever waiting in the syslog ring buffer\n"
+                      "# TYPE syslog_ring_high_water_bytes gauge\n"
+                      "syslog_ring_high_water_bytes{hostname=\"%s\"} %lu\n",
+                      hostname, (unsigned long)syslog_stats.ring_size,
+                      hostname, (unsigned long)syslog_stats.ring_high_water);
+    http_chunk_printf(&w,
+                      "# HELP syslog_ring_records_total Log lines queued for syslog\n"
+                      "# TYPE syslog_ring_records_total counter\n"
+                      "syslog_ring_records_total{hostname=\"%s\"} %lu\n"
+                      "# HELP syslog_ring_dropped_total Log lines dropped because the syslog ring buffer was full\n"
+                      "# TYPE syslog_ring_dropped_total counter\n"
+                      "syslog_ring_dropped_total{hostname=\"%s\"} %lu\n",
+                      hostname, (unsigned long)syslog_stats.records,
+                      hostname, (unsigned long)syslog_stats.dropped);
+    http_chunk_printf(&w,
+                      "# HELP syslog_messages_total Syslog messages by outcome\n"
+                      "# TYPE syslog_messages_total counter\n"
+                      "syslog_messages_total{hostname=\"%s\",result=\"sent\"} %lu\n"
+                      "syslog_messages_total{hostname=\"%s\",result=\"dropped\"} %lu\n",
+                      hostname, (unsigned long)syslog_stats.messages,
+                      hostname, (unsigned long)syslog_stats.messages_dropped);
+    http_chunk_printf(&w,
+                      "# HELP syslog_writes_total Syslog datagrams (UDP) or stream writes (TCP/TLS)\n"
+                      "# TYPE syslog_writes_total counter\n"
+                      "syslog_writes_total{hostname=\"%s\"} %lu\n"
+                      "# HELP syslog_bytes_total Syslog bytes sent, including framing\n"
+                      "# TYPE syslog_bytes_total counter\n"
+                      "syslog_bytes_total{hostname=\"%s\"} %llu\n",
+                      hostname, (unsigned long)syslog_stats.writes,
+                      hostname, (unsigned long long)syslog_stats.bytes);
+    http_chunk_printf(&w,
+                      "# HELP syslog_send_errors_total Failed syslog writes\n"
+                      "# TYPE syslog_send_errors_total counter\n"
+                      "syslog_send_errors_total{hostname=\"%s\"} %lu\n"
+                      "# HELP syslog_connects_total Syslog transport connections opened\n"
+                      "# TYPE syslog_connects_total counter\n"
+                      "syslog_connects_total{hostname=\"%s\"} %lu\n"
+                      "# HELP syslog_dns_lookups_total Syslog server DNS lookups\n"
+                      "# TYPE syslog_dns_lookups_total counter\n"
+                      "syslog_dns_lookups_total{hostname=\"%s\"} %lu\n",
+                      hostname, (unsigned long)syslog_stats.send_errors,
+                      hostname, (unsigned long)syslog_stats.connects,
+                      hostname, (unsigned long)syslog_stats.dns_lookups);
+
+    // Log volume per tag
+    write_log_metrics(&w, hostname);
+
+    // Live sensor stream
+    sensors_stream_stats_t stream_stats;
+    sensors_stream_get_stats(&stream_stats);
+    http_chunk_printf(&w,
+                      "# HELP sensors_stream_clients Connected /sensors/stream clients\n"
+                      "# TYPE sensors_stream_clients gauge\n"
+                      "sensors_stream_clients{hostname=\"%s\"} %lu\n"
+                      "# HELP sensors_stream_events_total Sensor stream events sent\n"
+                      "# TYPE sensors_stream_events_total counter\n"
+                      "sensors_stream_events_total{hostname=\"%s\"} %lu\n"
+                      "# HELP sensors_stream_rejected_total Sensor stream clients refused because the limit was reached\n"
+                      "# TYPE sensors_stream_rejected_total counter\n"
+                      "sensors_stream_rejected_total{hostname=\"%s\"} %lu\n"
+                      "# HELP sensors_stream_stalled_total Sensor stream clients dropped for not reading\n"
+                      "# TYPE sensors_stream_stalled_total counter\n"
+                      "sensors_stream_stalled_total{hostname=\"%s\"} %lu\n",
+                      hostname, (unsigned long)stream_stats.clients,
+                      hostname, (unsigned long)stream_stats.events,
+                      hostname, (unsigned long)stream_stats.rejected,
+                      hostname, (unsigned long)stream_stats.stalled);
+
+    // Deferred logging
+    dlog_stats_t dlog_stats;
+    dlog_get_stats(&dlog_stats);
+    http_chunk_printf(&w,
+                      "# HELP dlog_records_total Deferred log records written\n"
+                      "# TYPE dlog_records_total counter\n"
+                      "dlog_records_total{hostname=\"%s\"} %lu\n"
+                      "# HELP dlog_dropped_total Deferred log records dropped because the ring was full\n"
+                      "# TYPE dlog_dropped_total counter\n"
+                      "dlog_dropped_total{hostname=\"%s\"} %lu\n"
+                      "# HELP dlog_truncated_total Deferred log records missing arguments that did not fit\n"
+                      "# TYPE dlog_truncated_total counter\n"
+                      "dlog_truncated_total{hostname=\"%s\"} %lu\n"
+                      "# HELP dlog_ring_high_water_bytes Most bytes ever waiting in the deferred log ring\n"
+                      "# TYPE dlog_ring_high_water_bytes gauge\n"
+                      "dlog_ring_high_water_bytes{hostname=\"%s\"} %lu\n",
+                      hostname, (unsigned long)dlog_stats.records,
+                      hostname, (unsigned long)dlog_stats.dropped,
+                      hostname, (unsigned long)dlog_stats.truncated,
+                      hostname, (unsigned long)dlog_stats.ring_high_water);
+
+    write_settings_nvs_metrics(&w, hostname);
+
     // Uptime metric
-    offset += snprintf(response + offset, response_size - offset,
+    http_chunk_printf(&w,
                       "# HELP uptime_seconds System uptime in seconds\n"
                       "# TYPE uptime_seconds counter\n"
                       "uptime_seconds{hostname=\"%s\"} %lld\n", hostname, uptime_seconds);
@@ -120,91 +437,33 @@ static esp_err_t metrics_handler(httpd_req_t *req) {
     uint32_t free_heap = esp_get_free_heap_size();
     uint32_t min_free_heap = esp_get_minimum_free_heap_size();
     
-    offset += snprintf(response + offset, response_size - offset,
+    http_chunk_printf(&w,
                       "# HELP heap_free_bytes Current free heap memory in bytes\n"
                       "# TYPE heap_free_bytes gauge\n"
                       "heap_free_bytes{hostname=\"%s\"} %lu\n", hostname, free_heap);
     
-    offset += snprintf(response + offset, response_size - offset,
+    http_chunk_printf(&w,
                       "# HELP heap_min_free_bytes Minimum free heap memory ever reached in bytes\n"
                       "# TYPE heap_min_free_bytes gauge\n"
                       "heap_min_free_bytes{hostname=\"%s\"} %lu\n", hostname, min_free_heap);
     
     uint32_t largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
-    offset += snprintf(response + offset, response_size - offset,
+    http_chunk_printf(&w,
                       "# HELP heap_largest_free_block_bytes Largest contiguous free memory block in bytes\n"
                       "# TYPE heap_largest_free_block_bytes gauge\n"
                       "heap_largest_free_block_bytes{hostname=\"%s\"} %lu\n", hostname, largest_free_block);
     
-    // Malloc count metrics
-    offset += snprintf(response + offset, response_size - offset,
-                      "# HELP malloc_count_total Total number of malloc calls per source file\n"
-                      "# TYPE malloc_count_total counter\n");
-    
-    offset += snprintf(response + offset, response_size - offset,
-                      "malloc_count_total{hostname=\"%s\",file=\"settings.c\"} %u\n", 
-                      hostname, atomic_load(&malloc_count_settings));
-    offset += snprintf(response + offset, response_size - offset,
-                      "malloc_count_total{hostname=\"%s\",file=\"metrics.c\"} %u\n", 
-                      hostname, atomic_load(&malloc_count_metrics));
-    offset += snprintf(response + offset, response_size - offset,
-                      "malloc_count_total{hostname=\"%s\",file=\"sensors.c\"} %u\n", 
-                      hostname, atomic_load(&malloc_count_sensors));
-    offset += snprintf(response + offset, response_size - offset,
-                      "malloc_count_total{hostname=\"%s\",file=\"pump.c\"} %u\n", 
-                      hostname, atomic_load(&malloc_count_pump));
-    offset += snprintf(response + offset, response_size - offset,
-                      "malloc_count_total{hostname=\"%s\",file=\"main.c\"} %u\n", 
-                      hostname, atomic_load(&malloc_count_main));
-    offset += snprintf(response + offset, response_size - offset,
-                      "malloc_count_total{hostname=\"%s\",file=\"http_server.c\"} %u\n", 
-                      hostname, atomic_load(&malloc_count_http_server));
-    offset += snprintf(response + offset, response_size - offset,
-                      "malloc_count_total{hostname=\"%s\",file=\"syslog.c\"} %u\n", 
-                      hostname, atomic_load(&malloc_count_syslog));
-    offset += snprintf(response + offset, response_size - offset,
-                      "malloc_count_total{hostname=\"%s\",file=\"mqtt_publisher.c\"} %u\n", 
-                      hostname, atomic_load(&malloc_count_mqtt_publisher));
-    
-    // Free count metrics
-    offset += snprintf(response + offset, response_size - offset,
-                      "# HELP free_count_total Total number of free calls per source file\n"
-                      "# TYPE free_count_total counter\n");
-    
-    offset += snprintf(response + offset, response_size - offset,
-                      "free_count_total{hostname=\"%s\",file=\"settings.c\"} %u\n", 
-                      hostname, atomic_load(&free_count_settings));
-    offset += snprintf(response + offset, response_size - offset,
-                      "free_count_total{hostname=\"%s\",file=\"metrics.c\"} %u\n", 
-                      hostname, atomic_load(&free_count_metrics));
-    offset += snprintf(response + offset, response_size - offset,
-                      "free_count_total{hostname=\"%s\",file=\"sensors.c\"} %u\n", 
-                      hostname, atomic_load(&free_count_sensors));
-    offset += snprintf(response + offset, response_size - offset,
-                      "free_count_total{hostname=\"%s\",file=\"pump.c\"} %u\n", 
-                      hostname, atomic_load(&free_count_pump));
-    offset += snprintf(response + offset, response_size - offset,
-                      "free_count_total{hostname=\"%s\",file=\"main.c\"} %u\n", 
-                      hostname, atomic_load(&free_count_main));
-    offset += snprintf(response + offset, response_size - offset,
-                      "free_count_total{hostname=\"%s\",file=\"http_server.c\"} %u\n", 
-                      hostname, atomic_load(&free_count_http_server));
-    offset += snprintf(response + offset, response_size - offset,
-                      "free_count_total{hostname=\"%s\",file=\"syslog.c\"} %u\n", 
-                      hostname, atomic_load(&free_count_syslog));
-    offset += snprintf(response + offset, response_size - offset,
-                      "free_count_total{hostname=\"%s\",file=\"mqtt_publisher.c\"} %u\n", 
-                      hostname, atomic_load(&free_count_mqtt_publisher));
-    
-    // Set response headers and send
-    httpd_resp_set_status(req, HTTPD_200);
-    httpd_resp_set_type(req, "text/plain; version=0.0.4");
-    httpd_resp_set_hdr(req, "Connection", "keep-alive");
-    httpd_resp_send(req, response, offset);
+    // Heap use by source file
+    alloc_prof_write_metrics(&w, hostname);
+    buf_pool_write_metrics(&w, hostname);
+    task_stats_write_metrics(&w, hostname);
+    task_config_write_metrics(&w, hostname);
+    http_stats_write_metrics(&w, hostname);
+    
+    esp_err_t err = http_chunk_writer_finish(&w);
     
-    free(response);
-    atomic_fetch_add(&free_count_metrics, 1);
-    return ESP_OK;
+    buf_pool_put(response);
+    return err;
 }
 
 static httpd_uri_t metrics_uri = {
@@ -216,7 +475,7 @@ static httpd_uri_t metrics_uri = {
 
 void metrics_init(settings_t *settings, httpd_handle_t server) {
     metrics_uri.user_ctx = settings;
-    esp_err_t err = httpd_register_uri_handler(server, &metrics_uri);
+    esp_err_t err = httpd_register_uri_handler_timed(server, &metrics_uri);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error (%s) registering metrics handler!", esp_err_to_name(err));
     } else {
@@ -0,0 +1,63 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include "mqtt_payload.h"
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+} payload_t;
+
+static void append(payload_t *p, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void append(payload_t *p, const char *fmt, ...) {
+    if (p->overflow) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(p->buf + p->len, p->size - p->len, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= p->size - p->len) {
+        p->overflow = true;
+        return;
+    }
+    p->len += n;
+}
+
+static int finish(const payload_t *p) {
+    return p->overflow ? -1 : (int)p->len;
+}
+
+int mqtt_payload_status(char *buf, size_t size, const mqtt_status_t *status) {
+    payload_t p = { .buf = buf, .size = size };
+    append(&p, "{\"timestamp\":%lld,", (long long)status->timestamp_ms);
+    append(&p, "\"hostname\":\"%s\",", status->hostname);
+    append(&p, "\"uptime_seconds\":%lld,", (long long)status->uptime_seconds);
+    append(&p, "\"wifi_rssi_dbm\":%d,", status->wifi_rssi);
+    append(&p, "\"heap_free_bytes\":%lu,", (unsigned long)status->heap_free);
+    append(&p, "\"heap_min_free_bytes\":%lu,", (unsigned long)status->heap_min_free);
+    append(&p, "\"heap_largest_free_block_bytes\":%lu}", (unsigned long)status->heap_largest_free_block);
+    return finish(&p);
+}
+
+int mqtt_payload_sensor(char *buf, size_t size, const char *hostname,
+                        const sensor_info_t *sensor, const sensor_state_t *state) {
+    payload_t p = { .buf = buf, .size = size };
+    append(&p, "{\"timestamp\":%lld,", (long long)state->last_updated);
+    append(&p, "\"hostname\":\"%s\",", hostname);
+    append(&p, "\"sensor\":{");
+    append(&p, "\"metric_name\":\"%s\",", sensor->metric_name);
+    append(&p, "\"display_name\":\"%s\",", sensor->display_name);
+    append(&p, "\"unit\":\"%s\",", sensor->unit);
+    append(&p, "\"value\":%.2f", state->value);
+    if (sensor->device_name[0] != '\0') {
+        append(&p, ",\"device_name\":\"%s\"", sensor->device_name);
+    }
+    if (sensor->device_id[0] != '\0') {
+        append(&p, ",\"device_id\":\"%s\"", sensor->device_id);
+    }
+    append(&p, "}}");
+    return finish(&p);
+}
@@ -0,0 +1,39 @@
+#ifndef MQTT_PAYLOAD_H
+#define MQTT_PAYLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sensors.h"
+
+// JSON documents published over MQTT. Formatting is kept apart from the
+// client so it builds on the host as well.
+
+// Device status, published every 30 seconds
+typedef struct {
+    int64_t timestamp_ms;
+    const char *hostname;
+    int64_t uptime_seconds;
+    int8_t wifi_rssi;
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    uint32_t heap_largest_free_block;
+} mqtt_status_t;
+
+/**
+ * @brief Format the status document
+ *
+ * @return Length written, not counting the terminator, or -1 if it did not
+ *         fit in size bytes
+ */
+int mqtt_payload_status(char *buf, size_t size, const mqtt_status_t *status);
+
+/**
+ * @brief Format the document for one sensor reading
+ *
+ * @return Length written, not counting the terminator, or -1 if it did not
+ *         fit in size bytes
+ */
+int mqtt_payload_sensor(char *buf, size_t size, const char *hostname,
+                        const sensor_info_t *sensor, const sensor_state_t *state);
+
+#endif // MQTT_PAYLOAD_H
@@ -1,7 +1,9 @@
 #include "mqtt_publisher.h"
+#include "mqtt_payload.h"
+#include "log_control.h"
 #include "sensors.h"
 #include "wifi.h"
-#include "metrics.h"
+#include "task_config.h"
 #include <esp_log.h>
 #include <string.h>
 #include <stdio.h>
@@ -12,11 +14,18 @@
 #include <freertos/semphr.h>
 #include <mqtt_client.h>
 #include <esp_crt_bundle.h>
+#include "alloc_prof.h"
 
 static const char *TAG = "mqtt_publisher";
 
 static esp_mqtt_client_handle_t mqtt_client = NULL;
-static settings_t *mqtt_settings = NULL;
+static bool mqtt_initialized = false;
+// Copies taken at init keep publishing, which runs in the sensor tasks, clear
+// of settings saves. mqtt_publisher_reconfigure replaces them, and the client,
+// while holding json_mutex.
+static char *mqtt_hostname = NULL;
+static char *mqtt_topic = NULL;
+static char *mqtt_status_topic = NULL;
 static bool mqtt_connected = false;
 static char *json_buffer = NULL;
 static size_t json_buffer_size = 1024;
@@ -49,9 +58,23 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
     esp_mqtt_event_handle_t event = event_data;
     
     switch ((esp_mqtt_event_id_t)event_id) {
-        case MQTT_EVENT_CONNECTED:
+        case MQTT_EVENT_CONNECTED: {
             ESP_LOGI(TAG, "MQTT connected to broker");
             mqtt_connected = true;
+
+            // Listen for log level changes; subscriptions do not survive a reconnect
+            char topic[96];
+            const char *hostname = (mqtt_hostname != NULL && mqtt_hostname[0] != '\0')
+                                    ? mqtt_hostname : "weight-station";
+            snprintf(topic, sizeof(topic), "%s" LOG_CONTROL_MQTT_TOPIC "+", hostname);
+            if (esp_mqtt_client_subscribe(mqtt_client, topic, 1) < 0) {
+                ESP_LOGW(TAG, "Failed to subscribe to %s", topic);
+            }
+            break;
+        }
+
+        case MQTT_EVENT_DATA:
+            log_control_mqtt_message(event->topic, event->topic_len, event->data, event->data_len);
             break;
             
         case MQTT_EVENT_DISCONNECTED:
@@ -89,15 +112,37 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
     }
 }
 
+static char *mqtt_copy_setting(const char *value) {
+    char *copy = strdup(value != NULL ? value : "");
+    return copy;
+}
+
+static void mqtt_free_setting(char **value) {
+    if (*value != NULL) {
+        free(*value);
+        *value = NULL;
+    }
+}
+
 esp_err_t mqtt_publisher_init(settings_t *settings)
 {
-    mqtt_settings = settings;
-    
+    mqtt_initialized = true;
+
     // Check if MQTT is configured
     if (!settings->mqtt_broker_url || strlen(settings->mqtt_broker_url) == 0) {
         ESP_LOGI(TAG, "MQTT not configured, skipping initialization");
         return ESP_OK;
     }
+
+    if (mqtt_hostname == NULL) {
+        mqtt_hostname = mqtt_copy_setting(settings->hostname);
+        mqtt_topic = mqtt_copy_setting(settings->mqtt_topic);
+        mqtt_status_topic = mqtt_copy_setting(settings->mqtt_status_topic);
+        if (mqtt_hostname == NULL || mqtt_topic == NULL || mqtt_status_topic == NULL) {
+            ESP_LOGE(TAG, "Failed to copy MQTT settings");
+            return ESP_ERR_NO_MEM;
+        }
+    }
     
     ESP_LOGI(TAG, "Initializing MQTT client");
     ESP_LOGI(TAG, "MQTT Broker: %s", settings->mqtt_broker_url);
@@ -123,7 +168,6 @@ esp_err_t mqtt_publisher_init(settings_t *settings)
     // Allocate JSON buffer
     if (json_buffer == NULL) {
         json_buffer = malloc(json_buffer_size);
-        atomic_fetch_add(&malloc_count_mqtt_publisher, 1);
         if (json_buffer == NULL) {
             ESP_LOGE(TAG, "Failed to allocate JSON buffer");
             return ESP_ERR_NO_MEM;
@@ -178,14 +222,7 @@ esp_err_t mqtt_publisher_init(settings_t *settings)
     
     // Start periodic status publishing task
     if (mqtt_status_task_handle == NULL) {
-        BaseType_t task_created = xTaskCreate(
-            mqtt_status_task,
-            "mqtt_status",
-            4096,
-            NULL,
-            5,
-            &mqtt_status_task_handle
-        );
+        BaseType_t task_created = task_config_create(TASK_MQTT_STATUS, mqtt_status_task, NULL, &mqtt_status_task_handle);
         
         if (task_created != pdPASS) {
             ESP_LOGE(TAG, "Failed to create MQTT status task");
@@ -220,12 +257,6 @@ esp_err_t mqtt_publish_status(void)
         return ESP_FAIL;
     }
     
-    // Get default topic if not configured
-    const char *topic = mqtt_settings->mqtt_status_topic;
-    if (!topic || strlen(topic) == 0) {
-        topic = "station/status";
-    }
-    
     // Take mutex to protect JSON buffer
     if (json_mutex == NULL || json_buffer == NULL) {
         ESP_LOGE(TAG, "MQTT client not properly initialized");
@@ -236,45 +267,38 @@ esp_err_t mqtt_publish_status(void)
         ESP_LOGE(TAG, "Failed to acquire JSON mutex");
         return ESP_FAIL;
     }
+    // The client and topics may have been replaced while waiting
+    if (!mqtt_is_enabled()) {
+        xSemaphoreGive(json_mutex);
+        return ESP_FAIL;
+    }
     
-    // Use pre-allocated JSON buffer
-    char *json = json_buffer;
-    size_t json_size = json_buffer_size;
-    
-    int offset = 0;
-    offset += snprintf(json + offset, json_size - offset, "{");
+    // Get default topic if not configured
+    const char *topic = mqtt_status_topic;
+    if (!topic || strlen(topic) == 0) {
+        topic = "station/status";
+    }
     
-    // Add timestamp
     struct timeval tv_now;
     gettimeofday(&tv_now, NULL);
-    int64_t timestamp_ms = (int64_t)tv_now.tv_sec * 1000LL + (int64_t)tv_now.tv_usec / 1000LL;
-    offset += snprintf(json + offset, json_size - offset, "\"timestamp\":%lld,", timestamp_ms);
-    
-    // Add hostname
-    const char *hostname = (mqtt_settings->hostname != NULL && mqtt_settings->hostname[0] != '\0') 
-                            ? mqtt_settings->hostname : "weight-station";
-    offset += snprintf(json + offset, json_size - offset, "\"hostname\":\"%s\",", hostname);
-    
-    // Add uptime
-    int64_t uptime_us = esp_timer_get_time();
-    int64_t uptime_seconds = uptime_us / 1000000;
-    offset += snprintf(json + offset, json_size - offset, "\"uptime_seconds\":%lld,", uptime_seconds);
-    
-    // Add WiFi RSSI
-    int8_t rssi = wifi_get_rssi();
-    offset += snprintf(json + offset, json_size - offset, "\"wifi_rssi_dbm\":%d,", rssi);
-    
-    // Add heap metrics
-    uint32_t free_heap = esp_get_free_heap_size();
-    uint32_t min_free_heap = esp_get_minimum_free_heap_size();
-    uint32_t largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
-    
-    offset += snprintf(json + offset, json_size - offset, 
-                      "\"heap_free_bytes\":%lu,", free_heap);
-    offset += snprintf(json + offset, json_size - offset, 
-                      "\"heap_min_free_bytes\":%lu,", min_free_heap);
-    offset += snprintf(json + offset, json_size - offset, 
-                      "\"heap_largest_free_block_bytes\":%lu}", largest_free_block);
+    mqtt_status_t status = {
+        .timestamp_ms = (int64_t)tv_now.tv_sec * 1000LL + (int64_t)tv_now.tv_usec / 1000LL,
+        .hostname = (mqtt_hostname != NULL && mqtt_hostname[0] != '\0') ? mqtt_hostname : "weight-station",
+        .uptime_seconds = esp_timer_get_time() / 1000000,
+        .wifi_rssi = wifi_get_rssi(),
+        .heap_free = esp_get_free_heap_size(),
+        .heap_min_free = esp_get_minimum_free_heap_size(),
+        .heap_largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT),
+    };
+    
+    // Use pre-allocated JSON buffer
+    char *json = json_buffer;
+    int offset = mqtt_payload_status(json, json_buffer_size, &status);
+    if (offset < 0) {
+        ESP_LOGE(TAG, "Status message does not fit in %u bytes", (unsigned)json_buffer_size);
+        xSemaphoreGive(json_mutex);
+        return ESP_ERR_INVALID_SIZE;
+    }
         
     // Publish to MQTT
     int msg_id = esp_mqtt_client_publish(mqtt_client, topic, json, offset, 0, 0);
@@ -298,12 +322,6 @@ esp_err_t mqtt_publish_single_sensor(int sensor_id)
         return ESP_FAIL;
     }
     
-    // Get default topic if not configured
-    const char *topic = mqtt_settings->mqtt_topic;
-    if (!topic || strlen(topic) == 0) {
-        topic = "station/sensor";
-    }
-    
     // Take mutex to protect JSON buffer
     if (json_mutex == NULL || json_buffer == NULL) {
         ESP_LOGE(TAG, "MQTT client not properly initialized");
@@ -314,64 +332,46 @@ esp_err_t mqtt_publish_single_sensor(int sensor_id)
         ESP_LOGE(TAG, "Failed to acquire JSON mutex");
         return ESP_FAIL;
     }
+    // The client and topics may have been replaced while waiting
+    if (!mqtt_is_enabled()) {
+        xSemaphoreGive(json_mutex);
+        return ESP_FAIL;
+    }
+    
+    // Get default topic if not configured
+    const char *topic = mqtt_topic;
+    if (!topic || strlen(topic) == 0) {
+        topic = "station/sensor";
+    }
     
     // Get the sensor data
-    const sensor_data_t *sensor = sensors_get_by_index(sensor_id);
-    if (sensor == NULL || sensor->metric_name[0] == '\0') {
+    const sensor_info_t *sensor = sensors_get_info(sensor_id);
+    sensor_state_t state;
+    if (sensor == NULL || sensor->metric_name[0] == '\0' || !sensors_get_state(sensor_id, &state)) {
         ESP_LOGW(TAG, "Sensor %d not found or has no metric name", sensor_id);
         xSemaphoreGive(json_mutex);
         return ESP_FAIL;
     }
     
     // Only publish if sensor is available
-    if (!sensor->available || sensor->last_updated == 0) {
+    if (!(state.flags & SENSOR_FLAG_AVAILABLE) || state.last_updated == 0) {
         ESP_LOGD(TAG, "Sensor %d is not available, skipping publish", sensor_id);
         xSemaphoreGive(json_mutex);
         return ESP_OK;
     }
     
+    const char *hostname = (mqtt_hostname != NULL && mqtt_hostname[0] != '\0') 
+                            ? mqtt_hostname : "station";
+    
     // Use pre-allocated JSON buffer
     char *json = json_buffer;
-    size_t json_size = json_buffer_size;
-    
-    int offset = 0;
-    offset += snprintf(json + offset, json_size - offset, "{");
-    
-    // Add timestamp from sensor's last_updated
-    offset += snprintf(json + offset, json_size - offset, "\"timestamp\":%lld,", (long long)sensor->last_updated);
-    
-    // Add hostname
-    const char *hostname = (mqtt_settings->hostname != NULL && mqtt_settings->hostname[0] != '\0') 
-                            ? mqtt_settings->hostname : "station";
-    offset += snprintf(json + offset, json_size - offset, "\"hostname\":\"%s\",", hostname);
-    
-    // Add sensor array with single sensor
-    offset += snprintf(json + offset, json_size - offset, "\"sensor\":");
-    
-    offset += snprintf(json + offset, json_size - offset, "{");
-    offset += snprintf(json + offset, json_size - offset, 
-                      "\"metric_name\":\"%s\",", sensor->metric_name);
-    offset += snprintf(json + offset, json_size - offset, 
-                      "\"display_name\":\"%s\",", sensor->display_name);
-    offset += snprintf(json + offset, json_size - offset, 
-                      "\"unit\":\"%s\",", sensor->unit);
-    offset += snprintf(json + offset, json_size - offset, 
-                      "\"value\":%.2f", sensor->value);
-    
-    // Add optional device name and ID
-    if (sensor->device_name[0] != '\0') {
-        offset += snprintf(json + offset, json_size - offset, 
-                          ",\"device_name\":\"%s\"", sensor->device_name);
-    }
-    if (sensor->device_id[0] != '\0') {
-        offset += snprintf(json + offset, json_size - offset, 
-                          ",\"device_id\":\"%s\"", sensor->device_id);
+    int offset = mqtt_payload_sensor(json, json_buffer_size, hostname, sensor, &state);
+    if (offset < 0) {
+        ESP_LOGE(TAG, "Sensor %d message does not fit in %u bytes", sensor_id, (unsigned)json_buffer_size);
+        xSemaphoreGive(json_mutex);
+        return ESP_ERR_INVALID_SIZE;
     }
     
-    offset += snprintf(json + offset, json_size - offset, "}");
-    
-    offset += snprintf(json + offset, json_size - offset, "}");
-    
     // Publish to MQTT
     int msg_id = esp_mqtt_client_publish(mqtt_client, topic, json, offset, 0, 0);
     
@@ -388,6 +388,37 @@ esp_err_t mqtt_publish_single_sensor(int sensor_id)
     return ESP_OK;
 }
 
+static void mqtt_publisher_stop(void)
+{
+    // Publishing holds json_mutex from the connected check to the publish
+    bool locked = json_mutex != NULL && xSemaphoreTake(json_mutex, portMAX_DELAY) == pdTRUE;
+
+    if (mqtt_client != NULL) {
+        esp_mqtt_client_stop(mqtt_client);
+        esp_mqtt_client_destroy(mqtt_client);
+        mqtt_client = NULL;
+        mqtt_connected = false;
+    }
+    mqtt_free_setting(&mqtt_hostname);
+    mqtt_free_setting(&mqtt_topic);
+    mqtt_free_setting(&mqtt_status_topic);
+
+    if (locked) {
+        xSemaphoreGive(json_mutex);
+    }
+}
+
+esp_err_t mqtt_publisher_reconfigure(settings_t *settings)
+{
+    if (!mqtt_initialized) {
+        return ESP_OK;
+    }
+    // The status task keeps running; it skips publishing while disconnected
+    mqtt_publisher_stop();
+    ESP_LOGI(TAG, "MQTT client stopped for reconfiguration");
+    return mqtt_publisher_init(settings);
+}
+
 void mqtt_publisher_cleanup(void)
 {
     // Stop periodic status task
@@ -406,7 +437,6 @@ void mqtt_publisher_cleanup(void)
     
     if (json_buffer != NULL) {
         free(json_buffer);
-        atomic_fetch_add(&free_count_mqtt_publisher, 1);
         json_buffer = NULL;
     }
     
@@ -414,6 +444,10 @@ void mqtt_publisher_cleanup(void)
         vSemaphoreDelete(json_mutex);
         json_mutex = NULL;
     }
+
+    mqtt_free_setting(&mqtt_hostname);
+    mqtt_free_setting(&mqtt_topic);
+    mqtt_free_setting(&mqtt_status_topic);
     
     if (error_mutex != NULL) {
         vSemaphoreDelete(error_mutex);
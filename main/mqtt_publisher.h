@@ -13,6 +13,18 @@
  */
 esp_err_t mqtt_publisher_init(settings_t *settings);
 
+/**
+ * @brief Reconnect with new broker, credential and topic settings
+ * 
+ * Stops the client and starts it again from settings, or leaves it stopped
+ * if the broker URL was cleared. Does nothing if mqtt_publisher_init was
+ * never called.
+ * 
+ * @param settings Pointer to settings structure
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t mqtt_publisher_reconfigure(settings_t *settings);
+
 /**
  * @brief Publish all sensor data to MQTT
  * 
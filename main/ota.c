@@ -23,6 +23,7 @@
 
 #include "ota.h"
 #include "http_server.h"
+#include "task_config.h"
 
 #define HASH_LEN 32
 #define OTA_NVS_NAMESPACE "ota"
@@ -184,10 +185,15 @@ static void ota_load_status(void)
 
 void ota_task(void *pvParameter)
 {
-    settings_t *settings = (settings_t *)pvParameter;
+    // The download takes a while; work from a copy of the URL rather than
+    // holding a settings snapshot for all of it
+    char url[256];
+    settings_read_t read;
+    strlcpy(url, settings_snapshot_acquire(&read)->update_url, sizeof(url));
+    settings_snapshot_release(read);
     ESP_LOGI(TAG, "Starting OTA example task");
     esp_http_client_config_t config = {
-        .url = settings->update_url,
+        .url = url,
         .crt_bundle_attach = esp_crt_bundle_attach,
         .event_handler = _http_event_handler,
         .keep_alive_enable = true,
@@ -336,7 +342,7 @@ void ota_trigger_update_on_wifi_connect(void)
     }
     
     // Create OTA task
-    BaseType_t ret = xTaskCreate(&ota_task, "ota_task", 8192, ota_settings, 5, NULL);
+    BaseType_t ret = task_config_create(TASK_OTA, &ota_task, ota_settings, NULL);
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create OTA task");
         __atomic_clear(&update_in_progress, __ATOMIC_RELEASE);
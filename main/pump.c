@@ -1,13 +1,16 @@
 #include "pump.h"
 #include "http_server.h"
 #include "sensors.h"
-#include "metrics.h"
+#include "buf_pool.h"
+#include "task_config.h"
 #include <esp_log.h>
 #include <stdlib.h>
 #include <string.h>
 #include "driver/i2c_master.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "alloc_prof.h"
 
 #define PUMP_BUFFER_SIZE 41
 #define PUMP_PROCESSING_DELAY 300 // milliseconds
@@ -41,6 +44,20 @@ typedef struct {
 } pump_context_t;
 
 
+// Allocated by the first pump_init that finds the GPIOs configured and kept
+// from then on, since the HTTP handlers hold it as their user_ctx. The bus
+// and device handles are NULL while the pump is stopped.
+static pump_context_t *pump_context = NULL;
+static httpd_handle_t pump_server = NULL;
+static bool pump_initialized = false;
+static bool pump_handlers_registered = false;
+
+// The monitor task is asked to stop rather than deleted, so it never goes
+// away holding the pump mutex
+static TaskHandle_t pump_task_handle = NULL;
+static SemaphoreHandle_t pump_task_stopped = NULL;
+static volatile bool pump_stop_requested = false;
+
 char* pump_send_cmd(pump_context_t *pump_ctx, const char *cmd);
 
 static esp_err_t pump_dispense_ml_param_parser(httpd_req_t *req, int *out_amount) {
@@ -50,15 +67,13 @@ static esp_err_t pump_dispense_ml_param_parser(httpd_req_t *req, int *out_amount
         return ESP_OK;
     }
 
-    char *buf = malloc(buf_len);
-    atomic_fetch_add(&malloc_count_pump, 1);
+    char *buf = buf_pool_get(buf_len);
     if (!buf) {
         return ESP_ERR_NO_MEM;
     }
 
     if (httpd_req_get_url_query_str(req, buf, buf_len) != ESP_OK) {
-        free(buf);
-        atomic_fetch_add(&free_count_pump, 1);
+        buf_pool_put(buf);
         httpd_resp_set_status(req, "400 Bad Request");
         httpd_resp_send(req, "Failed to get query string", HTTPD_RESP_USE_STRLEN);
         return ESP_OK;
@@ -67,10 +82,10 @@ static esp_err_t pump_dispense_ml_param_parser(httpd_req_t *req, int *out_amount
     // Parse the 'ml' parameter
     char param[16];
     if (httpd_query_key_value(buf, "ml", param, sizeof(param)) != ESP_OK) {
-        free(buf);
+        buf_pool_put(buf);
         return ESP_OK;
     }
-    free(buf);
+    buf_pool_put(buf);
 
     // Convert to integer and validate range
     *out_amount = atoi(param);
@@ -117,7 +132,8 @@ static esp_err_t pump_dispense_handler(httpd_req_t *req) {
 static void pump_monitor_task(void *arg) {
     pump_context_t *pump_ctx = (pump_context_t *)arg;
     
-    while (1) {
+    while (!pump_stop_requested) {
+        task_loop_mark(TASK_PUMP_MONITOR);
         // Query voltage
         const char *voltage_response = pump_send_cmd(pump_ctx, "PV,?");
         if (voltage_response != NULL) {
@@ -152,9 +168,12 @@ static void pump_monitor_task(void *arg) {
             sensors_update(pump_ctx->total_volume_sensor_id, 0.0f, false);
         }
         
-        // Wait 10 seconds before next update
-        vTaskDelay(pdMS_TO_TICKS(10000));
+        // Wait 10 seconds before next update, or until pump_stop
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10000));
     }
+
+    xSemaphoreGive(pump_task_stopped);
+    vTaskDelete(NULL);
 }
 
 static esp_err_t pump_calibrate_start_handler(httpd_req_t *req) {
@@ -397,21 +416,96 @@ static httpd_uri_t pump_calibrate_submit_uri = {
     .user_ctx  = NULL
 };
 
+// Remove the device and bus; the monitor task must not be running
+static void pump_release_bus(pump_context_t *pump_ctx) {
+    xSemaphoreTake(pump_ctx->xSemaphore, portMAX_DELAY);
+    if (pump_ctx->dev_handle != NULL) {
+        i2c_master_bus_rm_device(pump_ctx->dev_handle);
+        pump_ctx->dev_handle = NULL;
+    }
+    if (pump_ctx->bus_handle != NULL) {
+        i2c_del_master_bus(pump_ctx->bus_handle);
+        pump_ctx->bus_handle = NULL;
+    }
+    xSemaphoreGive(pump_ctx->xSemaphore);
+}
+
+static void pump_register_handlers(settings_t *settings, httpd_handle_t server, pump_context_t *pump_ctx) {
+    pump_dispense_uri.user_ctx = pump_ctx;
+    pump_calibrate_start_uri.user_ctx = pump_ctx;
+    pump_calibrate_dispense_uri.user_ctx = pump_ctx;
+    pump_calibrate_input_uri.user_ctx = pump_ctx;
+    pump_calibrate_submit_uri.user_ctx = pump_ctx;
+    
+    // Register HTTP handlers
+    esp_err_t err_http = httpd_register_uri_handler_with_basic_auth(settings, server, &pump_dispense_uri);
+    if (err_http != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register pump dispense handler: %s", esp_err_to_name(err_http));
+    } else {
+        ESP_LOGI(TAG, "Registered pump dispense HTTP handler at /pump/dispense");
+    }
+    
+    err_http = httpd_register_uri_handler_with_basic_auth(settings, server, &pump_calibrate_start_uri);
+    if (err_http != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register calibration start handler: %s", esp_err_to_name(err_http));
+    }
+    
+    err_http = httpd_register_uri_handler_with_basic_auth(settings, server, &pump_calibrate_dispense_uri);
+    if (err_http != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register calibration dispense handler: %s", esp_err_to_name(err_http));
+    }
+    
+    err_http = httpd_register_uri_handler_with_basic_auth(settings, server, &pump_calibrate_input_uri);
+    if (err_http != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register calibration input handler: %s", esp_err_to_name(err_http));
+    }
+    
+    err_http = httpd_register_uri_handler_with_basic_auth(settings, server, &pump_calibrate_submit_uri);
+    if (err_http != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register calibration submit handler: %s", esp_err_to_name(err_http));
+    } else {
+        ESP_LOGI(TAG, "Registered pump calibration handlers");
+    }
+}
+
 void pump_init(settings_t *settings, httpd_handle_t server) {
+    pump_initialized = true;
+    pump_server = server;
+    error_buffer[0] = '\0';
     if (settings->pump_scl_gpio < 0 || settings->pump_sda_gpio < 0) {
         PUMP_ERROR_RETURN("Pump initialization skipped because weight sensor GPIOs are not configured");
         return;
     }
 
     ESP_LOGI(TAG, "Initializing pump on SCL GPIO %d, SDA GPIO %d", settings->pump_scl_gpio, settings->pump_sda_gpio);
-    pump_context_t *pump_ctx = malloc(sizeof(pump_context_t));
-    atomic_fetch_add(&malloc_count_pump, 1);
-    if (!pump_ctx) {
-        PUMP_ERROR_RETURN("Failed to allocate memory for pump");
-        return;
+    if (pump_context == NULL) {
+        pump_context_t *pump_ctx = malloc(sizeof(pump_context_t));
+        if (!pump_ctx) {
+            PUMP_ERROR_RETURN("Failed to allocate memory for pump");
+            return;
+        }
+        memset(pump_ctx, 0, sizeof(pump_context_t));
+        pump_ctx->voltage_sensor_id = -1;
+        pump_ctx->total_volume_sensor_id = -1;
+
+        pump_ctx->xSemaphore = xSemaphoreCreateMutex();
+        pump_task_stopped = xSemaphoreCreateBinary();
+        if (pump_ctx->xSemaphore == NULL || pump_task_stopped == NULL) {
+            PUMP_ERROR_RETURN("Failed to create semaphore for pump");
+            if (pump_ctx->xSemaphore != NULL) {
+                vSemaphoreDelete(pump_ctx->xSemaphore);
+            }
+            if (pump_task_stopped != NULL) {
+                vSemaphoreDelete(pump_task_stopped);
+                pump_task_stopped = NULL;
+            }
+            free(pump_ctx);
+            return;
+        }
+        pump_context = pump_ctx;
     }
+    pump_context_t *pump_ctx = pump_context;
     pump_ctx->settings = settings;
-    memset(pump_ctx->buf, 0, PUMP_BUFFER_SIZE);
 
     // Quick and dirty I2C setup to send "FIND" to address 0x67
     i2c_master_bus_config_t i2c_bus_config = {
@@ -423,7 +517,8 @@ void pump_init(settings_t *settings, httpd_handle_t server) {
         .flags.enable_internal_pullup = true,
     };
     
-    esp_err_t err = i2c_new_master_bus(&i2c_bus_config, &pump_ctx->bus_handle);
+    i2c_master_bus_handle_t bus_handle;
+    esp_err_t err = i2c_new_master_bus(&i2c_bus_config, &bus_handle);
     if (err != ESP_OK) {
         PUMP_ERROR_RETURN("Failed to create new I2C master bus");
         return;
@@ -434,94 +529,97 @@ void pump_init(settings_t *settings, httpd_handle_t server) {
         .device_address = settings->pump_i2c_addr,
         .scl_speed_hz = 100000,
     };
-    err = i2c_master_bus_add_device(pump_ctx->bus_handle, &dev_cfg, &pump_ctx->dev_handle);
+    i2c_master_dev_handle_t dev_handle;
+    err = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle);
     if (err != ESP_OK) {
+        i2c_del_master_bus(bus_handle);
         PUMP_ERROR_RETURN("Failed to add I2C device to bus");
         return;
     }
 
-    pump_ctx->xSemaphore = xSemaphoreCreateMutex();
-    if (pump_ctx->xSemaphore == NULL) {
-        PUMP_ERROR_RETURN("Failed to create semaphore for pump");
-        return;
-    }
+    xSemaphoreTake(pump_ctx->xSemaphore, portMAX_DELAY);
+    pump_ctx->bus_handle = bus_handle;
+    pump_ctx->dev_handle = dev_handle;
+    xSemaphoreGive(pump_ctx->xSemaphore);
 
     const char *response = pump_send_cmd(pump_ctx, "I");
     if (response == NULL) {
         PUMP_ERROR_RETURN("Failed to communicate with pump during initialization");
+        pump_release_bus(pump_ctx);
         return;
     }
     ESP_LOGI(TAG, "Pump initialized successfully, firmware version: %s", response);
 
-    // Register sensors
-    pump_ctx->voltage_sensor_id = sensors_register("Pump Voltage", "V", "pump_voltage_ml", "", "");
+    // Register sensors; a reconfigured pump keeps the ones it has
     if (pump_ctx->voltage_sensor_id < 0) {
-        ESP_LOGW(TAG, "Failed to register pump voltage sensor");
+        pump_ctx->voltage_sensor_id = sensors_register("Pump Voltage", "V", "pump_voltage_ml", "", "");
+        if (pump_ctx->voltage_sensor_id < 0) {
+            ESP_LOGW(TAG, "Failed to register pump voltage sensor");
+        }
     }
     
-    pump_ctx->total_volume_sensor_id = sensors_register("Pump Total Volume", "ml", "pump_total_volume_ml", "", "");
     if (pump_ctx->total_volume_sensor_id < 0) {
-        ESP_LOGW(TAG, "Failed to register pump total volume sensor");
+        pump_ctx->total_volume_sensor_id = sensors_register("Pump Total Volume", "ml", "pump_total_volume_ml", "", "");
+        if (pump_ctx->total_volume_sensor_id < 0) {
+            ESP_LOGW(TAG, "Failed to register pump total volume sensor");
+        }
     }
     
     // Create monitoring task
-    BaseType_t task_created = xTaskCreate(
-        pump_monitor_task,
-        "pump_monitor",
-        4096,
-        pump_ctx,
-        5,
-        NULL
-    );
+    pump_stop_requested = false;
+    BaseType_t task_created = task_config_create(TASK_PUMP_MONITOR, pump_monitor_task, pump_ctx, &pump_task_handle);
     if (task_created != pdPASS) {
         ESP_LOGE(TAG, "Failed to create pump monitor task");
+        pump_task_handle = NULL;
     } else {
         ESP_LOGI(TAG, "Pump monitor task started");
     }
 
-    pump_dispense_uri.user_ctx = pump_ctx;
-    pump_calibrate_start_uri.user_ctx = pump_ctx;
-    pump_calibrate_dispense_uri.user_ctx = pump_ctx;
-    pump_calibrate_input_uri.user_ctx = pump_ctx;
-    pump_calibrate_submit_uri.user_ctx = pump_ctx;
-    
-    // Register HTTP handlers
-    esp_err_t err_http = httpd_register_uri_handler_with_basic_auth(settings, server, &pump_dispense_uri);
-    if (err_http != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register pump dispense handler: %s", esp_err_to_name(err_http));
-    } else {
-        ESP_LOGI(TAG, "Registered pump dispense HTTP handler at /pump/dispense");
+    // Handlers stay registered while the pump is stopped; commands then fail
+    if (!pump_handlers_registered) {
+        pump_register_handlers(settings, server, pump_ctx);
+        pump_handlers_registered = true;
     }
-    
-    err_http = httpd_register_uri_handler_with_basic_auth(settings, server, &pump_calibrate_start_uri);
-    if (err_http != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register calibration start handler: %s", esp_err_to_name(err_http));
+}
+
+void pump_stop(void) {
+    if (pump_context == NULL) {
+        return;
     }
-    
-    err_http = httpd_register_uri_handler_with_basic_auth(settings, server, &pump_calibrate_dispense_uri);
-    if (err_http != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register calibration dispense handler: %s", esp_err_to_name(err_http));
+    if (pump_task_handle != NULL) {
+        pump_stop_requested = true;
+        xTaskNotifyGive(pump_task_handle);
+        xSemaphoreTake(pump_task_stopped, portMAX_DELAY);
+        pump_task_handle = NULL;
+        ESP_LOGI(TAG, "Pump monitor task stopped");
     }
-    
-    err_http = httpd_register_uri_handler_with_basic_auth(settings, server, &pump_calibrate_input_uri);
-    if (err_http != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register calibration input handler: %s", esp_err_to_name(err_http));
+    pump_release_bus(pump_context);
+    if (pump_context->voltage_sensor_id >= 0) {
+        sensors_update(pump_context->voltage_sensor_id, 0.0f, false);
     }
-    
-    err_http = httpd_register_uri_handler_with_basic_auth(settings, server, &pump_calibrate_submit_uri);
-    if (err_http != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register calibration submit handler: %s", esp_err_to_name(err_http));
-    } else {
-        ESP_LOGI(TAG, "Registered pump calibration handlers");
+    if (pump_context->total_volume_sensor_id >= 0) {
+        sensors_update(pump_context->total_volume_sensor_id, 0.0f, false);
     }
-    
-    return;
+}
+
+esp_err_t pump_reconfigure(settings_t *settings) {
+    if (!pump_initialized) {
+        return ESP_OK;
+    }
+    pump_stop();
+    pump_init(settings, pump_server);
+    return ESP_OK;
 }
 
 char* pump_send_cmd(pump_context_t *pump_ctx, const char *cmd) {
     if(!xSemaphoreTake(pump_ctx->xSemaphore, pdMS_TO_TICKS(PUMP_MAX_LOCK_WAIT_MS))) {
         return NULL;
     }
+    if (pump_ctx->dev_handle == NULL) {
+        PUMP_ERROR_RETURN("Pump is not configured");
+        xSemaphoreGive(pump_ctx->xSemaphore);
+        return NULL;
+    }
     esp_err_t err = i2c_master_transmit(pump_ctx->dev_handle, (uint8_t*)cmd, strlen(cmd), -1);
     if (err != ESP_OK) {
         PUMP_ERROR_RETURN("Failed to send `%s` command to pump: %s", cmd, esp_err_to_name(err));
@@ -544,7 +642,7 @@ char* pump_send_cmd(pump_context_t *pump_ctx, const char *cmd) {
                 xSemaphoreGive(pump_ctx->xSemaphore);
                 return NULL;
         }
-        switch (pump_ctx->buf[0]) {
+        switch ((uint8_t)pump_ctx->buf[0]) {
             case 1:
                 xSemaphoreGive(pump_ctx->xSemaphore);
                 return pump_ctx->buf+1;
@@ -2,9 +2,14 @@
 #define PUMP_H
 
 #include "settings.h"
+#include <esp_err.h>
 #include <esp_http_server.h>
 
 void pump_init(settings_t *settings, httpd_handle_t server);
+// Stop monitoring and release the I2C bus; sensors and handlers stay registered
+void pump_stop(void);
+// Restart on new GPIOs or address, unless pump_init was never called
+esp_err_t pump_reconfigure(settings_t *settings);
 
 const char* pump_get_last_error();
 
@@ -1,235 +1,121 @@
 #include "sensors.h"
 #include "settings.h"
-#include "metrics.h"
 #include "mqtt_publisher.h"
+#include "http_server.h"
+#include "http_stats.h"
+#include "sensors_stream.h"
+#include "buf_pool.h"
+#include "task_config.h"
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <esp_http_server.h>
 #include <esp_app_format.h>
 #include <esp_ota_ops.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/semphr.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <time.h>
 #include <inttypes.h>
+#include "alloc_prof.h"
 
 static const char *TAG = "sensors";
 
-// Sensor registry
-static sensor_data_t sensors[MAX_SENSORS];
-static int sensor_count = 0;
+// Sensor registry. The strings live in fixed-size chunks which are never moved
+// or freed, so sensors_get_info() pointers stay valid. The hot state is a single
+// contiguous array which doubles as it fills and is only accessed under the mutex,
+// as are the action links. sensor_count is bumped with release ordering once a
+// sensor is complete, so lock-free readers only see finished entries.
+#define SENSOR_CHUNK_COUNT ((MAX_SENSORS + SENSORS_CHUNK_SIZE - 1) / SENSORS_CHUNK_SIZE)
+
+#ifdef CONFIG_SENSORS_ALLOC_SPIRAM
+#define SENSOR_INFO_CAPS (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#else
+#define SENSOR_INFO_CAPS (MALLOC_CAP_DEFAULT)
+#endif
+
+typedef struct {
+    sensor_info_t info;
+    sensor_link_t link;
+} sensor_entry_t;
+
+static sensor_entry_t *sensor_chunks[SENSOR_CHUNK_COUNT];
+static sensor_state_t *sensor_states = NULL;
+static int sensor_states_capacity = 0;
+static atomic_int sensor_count = 0;
 static SemaphoreHandle_t sensors_mutex = NULL;
 
-#define SENSOR_STALE_TIMEOUT_SECONDS 600  // 10 minutes
+#define SENSOR_ENTRY(id) (&sensor_chunks[(id) / SENSORS_CHUNK_SIZE][(id) % SENSORS_CHUNK_SIZE])
+#define SENSOR_INFO(id) (&SENSOR_ENTRY(id)->info)
+#define SENSOR_LINK(id) (&SENSOR_ENTRY(id)->link)
 
-static const char *sensors_display_html = ""
-    "<!DOCTYPE html>\n"
-    "<html>\n"
-    "<head>\n"
-    "<title>Sensor Station</title>\n"
-    "<meta name='viewport' content='width=device-width, initial-scale=1'>\n"
-    "<style>\n"
-    "body { font-family: Arial, sans-serif; max-width: 800px; margin: 50px auto; padding: 20px; text-align: center; }\n"
-    "h1 { color: #333; }\n"
-    ".sensors-grid { display: grid; grid-template-columns: repeat(auto-fit, minmax(250px, 1fr)); gap: 20px; margin: 20px 0; }\n"
-    ".sensor-card { background: #f4f4f4; padding: 20px; border-radius: 8px; }\n"
-    ".sensor-name { font-size: 18px; color: #666; margin-bottom: 10px; }\n"
-    ".sensor-value { font-size: 48px; font-weight: bold; color: #4CAF50; margin: 10px 0; word-wrap: break-word; }\n"
-    ".sensor-unit { font-size: 20px; color: #666; }\n"
-    ".sensor-updated { font-size: 12px; color: #999; margin-top: 10px; }\n"
-    ".status { padding: 10px; margin: 10px 0; border-radius: 4px; }\n"
-    ".status.active { background: #d4edda; color: #155724; border: 1px solid #c3e6cb; }\n"
-    ".status.inactive { background: #f8d7da; color: #721c24; border: 1px solid #f5c6cb; }\n"
-    ".unavailable { opacity: 0.5; }\n"
-    ".unavailable .sensor-value { color: #999; }\n"
-    "a { display: inline-block; margin: 10px 10px; color: #4CAF50; text-decoration: none; font-size: 18px; }\n"
-    "a:hover { text-decoration: underline; }\n"
-    ".sensor-action { margin-top: 10px; }\n"
-    ".sensor-action button { background: #4CAF50; color: white; border: none; padding: 8px 16px; border-radius: 4px; cursor: pointer; font-size: 14px; }\n"
-    ".sensor-action button:hover { background: #45a049; }\n"
-    ".sensor-action button:disabled { background: #ccc; cursor: not-allowed; }\n"
-    "</style>\n"
-    "</head>\n"
-    "<body>\n"
-    "<h1>Sensor Station</h1>\n"
-    "<div id='sensors-container' class='sensors-grid'></div>\n"
-    "<div id='status' class='status inactive'>Loading...</div>\n"
-    "<a href='/settings'>Settings</a> | <a href='/bthome/packets'>BTHome Packets</a>\n"
-    "<script>\n"
-    "function formatTimeAgo(timestamp) {\n"
-    "  if (!timestamp || timestamp === 0) return 'Never';\n"
-    "  const now = Math.floor(Date.now() / 1000);\n"
-    "  const diff = now - timestamp;\n"
-    "  if (diff < 60) return diff + 's ago';\n"
-    "  if (diff < 3600) return Math.floor(diff / 60) + 'm ago';\n"
-    "  if (diff < 86400) return Math.floor(diff / 3600) + 'h ago';\n"
-    "  return Math.floor(diff / 86400) + 'd ago';\n"
-    "}\n"
-    "function updateSensors() {\n"
-    "  fetch('/sensors/data')\n"
-    "    .then(response => response.json())\n"
-    "    .then(data => {\n"
-    "      const container = document.getElementById('sensors-container');\n"
-    "      if (data.sensors && data.sensors.length > 0) {\n"
-    "        container.innerHTML = data.sensors.map(sensor => {\n"
-    "          const availClass = sensor.available ? '' : 'unavailable';\n"
-    "          const value = sensor.available ? sensor.value.toLocaleString(undefined, {maximumFractionDigits: 2}) : '--';\n"
-    "          const updated = formatTimeAgo(sensor.last_updated);\n"
-    "          const actionBtn = (sensor.link_url && sensor.link_text) ? \n"
-    "            `<div class='sensor-action'><button onclick='sensorAction(\"${sensor.link_url}\")' ${sensor.available ? '' : 'disabled'}>${sensor.link_text}</button></div>` : '';\n"
-    "          return `\n"
-    "            <div class='sensor-card ${availClass}'>\n"
-    "              <div class='sensor-name'>${sensor.name}</div>\n"
-    "              <div class='sensor-value'>${value}</div>\n"
-    "              <div class='sensor-unit'>${sensor.unit}</div>\n"
-    "              <div class='sensor-updated'>${updated}</div>\n"
-    "              ${actionBtn}\n"
-    "            </div>\n"
-    "          `;\n"
-    "        }).join('');\n"
-    "        document.getElementById('status').textContent = 'Active';\n"
-    "        document.getElementById('status').className = 'status active';\n"
-    "      } else {\n"
-    "        container.innerHTML = '<p style=\"grid-column: 1/-1; color: #999;\">No sensors registered</p>';\n"
-    "        document.getElementById('status').textContent = 'No sensors available';\n"
-    "        document.getElementById('status').className = 'status inactive';\n"
-    "      }\n"
-    "    })\n"
-    "    .catch(error => {\n"
-    "      document.getElementById('status').textContent = 'Error: ' + error;\n"
-    "      document.getElementById('status').className = 'status inactive';\n"
-    "    });\n"
-    "}\n"
-    "function sensorAction(url) {\n"
-    "  fetch(url, {method: 'POST'})\n"
-    "    .then(response => {\n"
-    "      if (response.ok) updateSensors();\n"
-    "      else alert('Action failed');\n"
-    "    })\n"
-    "    .catch(error => alert('Action error: ' + error));\n"
-    "}\n"
-    "updateSensors();\n"
-    "setInterval(updateSensors, 1000);\n"
-    "</script>\n"
-    "<footer style='margin-top: 40px; padding-top: 20px; border-top: 1px solid #ddd; text-align: center; color: #999; font-size: 12px;'>\n"
-    "<div id='version'>Loading version...</div>\n"
-    "</footer>\n"
-    "<script>\n"
-    "fetch('/version')\n"
-    "  .then(response => response.json())\n"
-    "  .then(data => {\n"
-    "    document.getElementById('version').innerHTML = \n"
-    "      'Firmware: ' + data.version + '<br>Hash: ' + data.hash;\n"
-    "  })\n"
-    "  .catch(() => {\n"
-    "    document.getElementById('version').textContent = 'Version info unavailable';\n"
-    "  });\n"
-    "</script>\n"
-    "</body>\n"
-    "</html>\n";
+// sensor_count for code holding sensors_mutex, the only writer
+#define COUNT_LOCKED() atomic_load_explicit(&sensor_count, memory_order_relaxed)
 
-static esp_err_t sensors_display_handler(httpd_req_t *req) {
-    settings_t *settings = (settings_t *)req->user_ctx;
-    const char *hostname = (settings->hostname != NULL && settings->hostname[0] != '\0') 
-                            ? settings->hostname : "unknown";
-    
-    // Create a buffer for the complete HTML with hostname
-    char *html_with_hostname = malloc(strlen(sensors_display_html) + strlen(hostname) + 32);
-    atomic_fetch_add(&malloc_count_sensors, 1);
-    if (html_with_hostname == NULL) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
-    }
-    
-    // Replace "Sensor Station</h1>" with "Sensor Station: hostname</h1>"
-    const char *marker = "Sensor Station</h1>";
-    const char *pos = strstr(sensors_display_html, marker);
-    if (pos != NULL) {
-        size_t before_len = pos - sensors_display_html;
-        strcpy(html_with_hostname, sensors_display_html);
-        html_with_hostname[before_len] = '\0';
-        strcat(html_with_hostname, "Sensor Station: ");
-        strcat(html_with_hostname, hostname);
-        strcat(html_with_hostname, "</h1>");
-        strcat(html_with_hostname, pos + strlen(marker));
-    } else {
-        strcpy(html_with_hostname, sensors_display_html);
-    }
-    
-    httpd_resp_set_status(req, HTTPD_200);
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_set_hdr(req, "Connection", "keep-alive");
-    httpd_resp_send(req, html_with_hostname, strlen(html_with_hostname));
-    free(html_with_hostname);
-    atomic_fetch_add(&free_count_sensors, 1);
-    return ESP_OK;
-}
+#define SENSOR_STALE_TIMEOUT_SECONDS 600  // 10 minutes
 
 static esp_err_t sensors_data_handler(httpd_req_t *req) {
-    // Build JSON response with all sensors
-    char *json_buf = malloc(2048); // Allocate buffer for JSON
-    atomic_fetch_add(&malloc_count_sensors, 1);
+    // Build JSON response with all sensors, streamed in chunks
+    char *json_buf = buf_pool_get(BUF_POOL_MEDIUM);
     if (json_buf == NULL) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
-    }
-    
-    if (sensors_mutex != NULL) {
-        xSemaphoreTake(sensors_mutex, portMAX_DELAY);
+        return http_resp_send_busy(req);
     }
     
-    int pos = snprintf(json_buf, 2048, "{\"sensors\":[");
+    httpd_resp_set_status(req, HTTPD_200);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Connection", "keep-alive");
     
-    for (int i = 0; i < sensor_count && pos < 2000; i++) {
-        if (sensors[i].display_name[0] == '\0' || sensors[i].unit[0] == '\0') {
-            continue;
-        }
-        if (i > 0) {
-            pos += snprintf(json_buf + pos, 2048 - pos, ",");
-        }
-        
-        // Build JSON object for this sensor
-        char sensor_json[512];
-        int spos = snprintf(sensor_json, sizeof(sensor_json),
-                       "{\"name\":\"%s\",\"unit\":\"%s\",\"value\":%.2f,\"last_updated\":%" PRId64 ",\"available\":%s",
-                       sensors[i].display_name,
-                       sensors[i].unit,
-                       sensors[i].value,
-                       (int64_t)sensors[i].last_updated,
-                       sensors[i].available ? "true" : "false");
-        
-        // Add optional link fields if present
-        if (sensors[i].link_url[0] != '\0' && sensors[i].link_text[0] != '\0') {
-            spos += snprintf(sensor_json + spos, sizeof(sensor_json) - spos,
-                           ",\"link_url\":\"%s\",\"link_text\":\"%s\"",
-                           sensors[i].link_url,
-                           sensors[i].link_text);
+    http_chunk_writer_t w;
+    http_chunk_writer_init(&w, req, json_buf, BUF_POOL_MEDIUM);
+    http_chunk_printf(&w, "{\"sensors\":[");
+    
+    bool first = true;
+    sensor_state_t states[SENSORS_CHUNK_SIZE];
+    int base = 0;
+    int n;
+    while ((n = sensors_get_states(base, states, SENSORS_CHUNK_SIZE)) > 0) {
+        for (int j = 0; j < n; j++) {
+            const sensor_info_t *info = sensors_get_info(base + j);
+            if (info == NULL || info->display_name[0] == '\0' || info->unit[0] == '\0') {
+                continue;
+            }
+            
+            http_chunk_printf(&w,
+                           "%s{\"id\":%d,\"name\":\"%s\",\"unit\":\"%s\",\"value\":%.2f,\"last_updated\":%" PRId64 ",\"available\":%s",
+                           first ? "" : ",",
+                           base + j,
+                           info->display_name,
+                           info->unit,
+                           states[j].value,
+                           (int64_t)states[j].last_updated,
+                           (states[j].flags & SENSOR_FLAG_AVAILABLE) ? "true" : "false");
+            first = false;
+            
+            // Add optional link fields if present
+            sensor_link_t link;
+            if ((states[j].flags & SENSOR_FLAG_LINK) && sensors_get_link(base + j, &link)) {
+                http_chunk_printf(&w, ",\"link_url\":\"%s\",\"link_text\":\"%s\"",
+                               link.url, link.text);
+            }
+            
+            http_chunk_printf(&w, "}");
         }
-        
-        spos += snprintf(sensor_json + spos, sizeof(sensor_json) - spos, "}");
-        
-        // Append to main buffer
-        pos += snprintf(json_buf + pos, 2048 - pos, "%s", sensor_json);
+        base += n;
     }
     
-    pos += snprintf(json_buf + pos, 2048 - pos, "]}");
+    http_chunk_printf(&w, "]}");
+    esp_err_t err = http_chunk_writer_finish(&w);
     
-    if (sensors_mutex != NULL) {
-        xSemaphoreGive(sensors_mutex);
-    }
-    
-    httpd_resp_set_status(req, HTTPD_200);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_set_hdr(req, "Connection", "keep-alive");
-    httpd_resp_send(req, json_buf, strlen(json_buf));
-    free(json_buf);
-    atomic_fetch_add(&free_count_sensors, 1);
-    return ESP_OK;
+    buf_pool_put(json_buf);
+    return err;
 }
 
 static esp_err_t version_handler(httpd_req_t *req) {
+    settings_t *settings = (settings_t *)req->user_ctx;
+    const char *hostname = (settings != NULL && settings->hostname != NULL) ? settings->hostname : "";
     const esp_app_desc_t *app_desc = esp_app_get_description();
-    char json_buf[256];
+    char json_buf[320];
     
     // Format the hash as a hex string (first 8 bytes for brevity)
     char hash_str[17];
@@ -239,8 +125,8 @@ static esp_err_t version_handler(httpd_req_t *req) {
     hash_str[16] = '\0';
     
     snprintf(json_buf, sizeof(json_buf), 
-            "{\"version\":\"%s\",\"hash\":\"%s\",\"date\":\"%s\",\"time\":\"%s\"}",
-            app_desc->version, hash_str, app_desc->date, app_desc->time);
+            "{\"version\":\"%s\",\"hash\":\"%s\",\"date\":\"%s\",\"time\":\"%s\",\"hostname\":\"%s\"}",
+            app_desc->version, hash_str, app_desc->date, app_desc->time, hostname);
     
     httpd_resp_set_status(req, HTTPD_200);
     httpd_resp_set_type(req, "application/json");
@@ -249,13 +135,6 @@ static esp_err_t version_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
-static httpd_uri_t sensors_display_uri = {
-    .uri       = "/",
-    .method    = HTTP_GET,
-    .handler   = sensors_display_handler,
-    .user_ctx  = NULL
-};
-
 static httpd_uri_t sensors_data_uri = {
     .uri       = "/sensors/data",
     .method    = HTTP_GET,
@@ -270,6 +149,49 @@ static httpd_uri_t version_uri = {
     .user_ctx  = NULL
 };
 
+// Make room for one more sensor. Called with sensors_mutex held.
+static bool sensors_reserve_slot(void) {
+    int id = COUNT_LOCKED();
+    
+    if (sensor_chunks[id / SENSORS_CHUNK_SIZE] == NULL) {
+        sensor_entry_t *chunk = heap_caps_calloc(SENSORS_CHUNK_SIZE, sizeof(sensor_entry_t), SENSOR_INFO_CAPS);
+        if (chunk == NULL) {
+            // Fall back to any available memory rather than dropping the sensor
+            chunk = calloc(SENSORS_CHUNK_SIZE, sizeof(sensor_entry_t));
+        }
+        if (chunk == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate sensor info chunk");
+            return false;
+        }
+        sensor_chunks[id / SENSORS_CHUNK_SIZE] = chunk;
+    }
+    
+    if (id >= sensor_states_capacity) {
+        int new_capacity = sensor_states_capacity ? sensor_states_capacity * 2 : SENSORS_CHUNK_SIZE;
+        if (new_capacity > MAX_SENSORS) {
+            new_capacity = MAX_SENSORS;
+        }
+        sensor_state_t *states = heap_caps_realloc(sensor_states, new_capacity * sizeof(sensor_state_t),
+                                                   MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (states == NULL) {
+            ESP_LOGE(TAG, "Failed to grow sensor state array to %d entries", new_capacity);
+            return false;
+        }
+        sensor_states = states;
+        sensor_states_capacity = new_capacity;
+    }
+    return true;
+}
+
+static void copy_field(char *dst, const char *src, size_t size) {
+    if (src != NULL) {
+        strncpy(dst, src, size - 1);
+        dst[size - 1] = '\0';
+    } else {
+        dst[0] = '\0';
+    }
+}
+
 int sensors_register(
     const char *display_name,
     const char *unit,
@@ -280,60 +202,36 @@ int sensors_register(
         xSemaphoreTake(sensors_mutex, portMAX_DELAY);
     }
     
-    if (sensor_count >= MAX_SENSORS) {
-        ESP_LOGE(TAG, "Cannot register sensor '%s': maximum number of sensors (%d) reached", 
-                 display_name, MAX_SENSORS);
+    int id = COUNT_LOCKED();
+    if (id >= MAX_SENSORS || !sensors_reserve_slot()) {
+        ESP_LOGE(TAG, "Cannot register sensor '%s': %d of %d sensors in use", 
+                 display_name, id, MAX_SENSORS);
         if (sensors_mutex != NULL) {
             xSemaphoreGive(sensors_mutex);
         }
         return -1;
     }
     
-    int id = sensor_count++;
+    sensor_info_t *info = SENSOR_INFO(id);
     
     // Copy name, unit, and metric_name, ensuring null termination
-    if (display_name != NULL && strlen(display_name) > 0) {
-        strncpy(sensors[id].display_name, display_name, SENSOR_DISPLAY_NAME_MAX_LEN - 1);
-        sensors[id].display_name[SENSOR_DISPLAY_NAME_MAX_LEN - 1] = '\0';
-    } else {
-        sensors[id].display_name[0] = '\0';
-    }
-
-    if (device_name && strlen(device_name) > 0) {
-        strncpy(sensors[id].device_name, device_name, SENSOR_DEVICE_NAME_MAX_LEN - 1);
-        sensors[id].device_name[SENSOR_DEVICE_NAME_MAX_LEN - 1] = '\0';
-    } else {
-        sensors[id].device_name[0] = '\0';
-    }
+    copy_field(info->display_name, display_name, sizeof(info->display_name));
+    copy_field(info->device_name, device_name, sizeof(info->device_name));
+    copy_field(info->device_id, device_id, sizeof(info->device_id));
+    copy_field(info->unit, unit, sizeof(info->unit));
+    copy_field(info->metric_name, metric_name, sizeof(info->metric_name));
+    SENSOR_LINK(id)->url[0] = '\0';
+    SENSOR_LINK(id)->text[0] = '\0';
     
-    if (device_id && strlen(device_id) > 0) {
-        strncpy(sensors[id].device_id, device_id, SENSOR_DEVICE_ID_MAX_LEN - 1);
-        sensors[id].device_id[SENSOR_DEVICE_ID_MAX_LEN - 1] = '\0';
-    } else {
-        sensors[id].device_id[0] = '\0';
-    }
-    
-    if (unit != NULL && strlen(unit) > 0) {
-        strncpy(sensors[id].unit, unit, SENSOR_UNIT_MAX_LEN - 1);
-        sensors[id].unit[SENSOR_UNIT_MAX_LEN - 1] = '\0';
-    } else {
-        sensors[id].unit[0] = '\0';
-    }
-    
-    if (metric_name && strlen(metric_name) > 0) {
-        strncpy(sensors[id].metric_name, metric_name, SENSOR_DISPLAY_NAME_MAX_LEN - 1);
-        sensors[id].metric_name[SENSOR_DISPLAY_NAME_MAX_LEN - 1] = '\0';
-    } else {
-        sensors[id].metric_name[0] = '\0';
-    }
+    sensor_states[id].value = 0.0f;
+    sensor_states[id].last_updated = 0;
+    sensor_states[id].flags = 0;
     
-    sensors[id].value = 0.0f;
-    sensors[id].last_updated = 0;
-    sensors[id].available = false;
-    sensors[id].link_url[0] = '\0';
-    sensors[id].link_text[0] = '\0';
+    // Publish the new sensor only once it is fully initialized
+    atomic_store_explicit(&sensor_count, id + 1, memory_order_release);
+    sensors_stream_mark(id);
     
-    ESP_LOGI(TAG, "Registered sensor %d: '%s' (%s) [metric: %s]", id, sensors[id].display_name, sensors[id].unit, sensors[id].metric_name);
+    ESP_LOGI(TAG, "Registered sensor %d: '%s' (%s) [metric: %s]", id, info->display_name, info->unit, info->metric_name);
     
     if (sensors_mutex != NULL) {
         xSemaphoreGive(sensors_mutex);
@@ -350,35 +248,41 @@ bool sensors_update_with_link(int sensor_id, float value, bool available, const
         xSemaphoreTake(sensors_mutex, portMAX_DELAY);
     }
     
-    if (sensor_id < 0 || sensor_id >= sensor_count) {
-        ESP_LOGE(TAG, "Invalid sensor_id %d (valid range: 0-%d)", sensor_id, sensor_count - 1);
+    if (sensor_id < 0 || sensor_id >= COUNT_LOCKED()) {
+        ESP_LOGE(TAG, "Invalid sensor_id %d (valid range: 0-%d)", sensor_id, COUNT_LOCKED() - 1);
         if (sensors_mutex != NULL) {
             xSemaphoreGive(sensors_mutex);
         }
         return false;
     }
     
-    sensors[sensor_id].value = value;
-    sensors[sensor_id].available = available;
-    sensors[sensor_id].last_updated = time(NULL);
-    
-    // Update link fields if provided
-    if (link_url != NULL && link_text != NULL) {
-        strncpy(sensors[sensor_id].link_url, link_url, sizeof(sensors[sensor_id].link_url) - 1);
-        sensors[sensor_id].link_url[sizeof(sensors[sensor_id].link_url) - 1] = '\0';
-        
-        strncpy(sensors[sensor_id].link_text, link_text, sizeof(sensors[sensor_id].link_text) - 1);
-        sensors[sensor_id].link_text[sizeof(sensors[sensor_id].link_text) - 1] = '\0';
-    } else {
-        // Clear link fields if not provided
-        sensors[sensor_id].link_url[0] = '\0';
-        sensors[sensor_id].link_text[0] = '\0';
+    sensor_state_t *state = &sensor_states[sensor_id];
+    state->value = value;
+    state->flags = available ? (state->flags | SENSOR_FLAG_AVAILABLE) : (state->flags & ~SENSOR_FLAG_AVAILABLE);
+    state->last_updated = time(NULL);
+    
+    // Update link fields if provided, clear them if not. Readers copy the
+    // link under the mutex (sensors_get_link()), so it can change in place.
+    sensor_link_t *link = SENSOR_LINK(sensor_id);
+    if (link_url != NULL && link_text != NULL && link_url[0] != '\0' && link_text[0] != '\0') {
+        if (strncmp(link->url, link_url, sizeof(link->url) - 1) != 0 ||
+            strncmp(link->text, link_text, sizeof(link->text) - 1) != 0) {
+            copy_field(link->url, link_url, sizeof(link->url));
+            copy_field(link->text, link_text, sizeof(link->text));
+        }
+        state->flags |= SENSOR_FLAG_LINK;
+    } else if (state->flags & SENSOR_FLAG_LINK) {
+        link->url[0] = '\0';
+        link->text[0] = '\0';
+        state->flags &= ~SENSOR_FLAG_LINK;
     }
     
     if (sensors_mutex != NULL) {
         xSemaphoreGive(sensors_mutex);
     }
     
+    sensors_stream_mark(sensor_id);
+    
     // Publish to MQTT if enabled (don't hold mutex during MQTT publish)
     if (mqtt_is_enabled()) {
         mqtt_publish_single_sensor(sensor_id);
@@ -388,42 +292,123 @@ bool sensors_update_with_link(int sensor_id, float value, bool available, const
 }
 
 float sensors_get_value(int sensor_id, bool *available) {
-    if (sensors_mutex != NULL) {
-        xSemaphoreTake(sensors_mutex, portMAX_DELAY);
-    }
-    
-    if (sensor_id < 0 || sensor_id >= sensor_count) {
-        ESP_LOGE(TAG, "Invalid sensor_id %d (valid range: 0-%d)", sensor_id, sensor_count - 1);
+    sensor_state_t state;
+    if (!sensors_get_state(sensor_id, &state)) {
+        ESP_LOGE(TAG, "Invalid sensor_id %d (valid range: 0-%d)", sensor_id, sensors_get_count() - 1);
         if (available) {
             *available = false;
         }
-        if (sensors_mutex != NULL) {
-            xSemaphoreGive(sensors_mutex);
-        }
         return 0.0f;
     }
     
     if (available) {
-        *available = sensors[sensor_id].available;
+        *available = (state.flags & SENSOR_FLAG_AVAILABLE) != 0;
+    }
+    return state.value;
+}
+
+int sensors_get_count(void) {
+    return atomic_load_explicit(&sensor_count, memory_order_acquire);
+}
+
+const sensor_info_t* sensors_get_info(int sensor_id) {
+    if (sensor_id < 0 || sensor_id >= sensors_get_count()) {
+        return NULL;
+    }
+    return SENSOR_INFO(sensor_id);
+}
+
+bool sensors_get_link(int sensor_id, sensor_link_t *link) {
+    if (sensor_id < 0) {
+        return false;
     }
     
-    float value = sensors[sensor_id].value;
+    if (sensors_mutex != NULL) {
+        xSemaphoreTake(sensors_mutex, portMAX_DELAY);
+    }
+    
+    bool found = sensor_id < COUNT_LOCKED() && (sensor_states[sensor_id].flags & SENSOR_FLAG_LINK);
+    if (found) {
+        *link = *SENSOR_LINK(sensor_id);
+    }
     
     if (sensors_mutex != NULL) {
         xSemaphoreGive(sensors_mutex);
     }
-    return value;
+    return found;
 }
 
-int sensors_get_count(void) {
-    return sensor_count;
+bool sensors_get_state(int sensor_id, sensor_state_t *state) {
+    return sensor_id >= 0 && sensors_get_states(sensor_id, state, 1) == 1;
 }
 
-const sensor_data_t* sensors_get_by_index(int index) {
-    if (index < 0 || index >= sensor_count) {
-        return NULL;
+int sensors_get_states(int first_id, sensor_state_t *states, int max) {
+    if (first_id < 0 || max <= 0) {
+        return 0;
+    }
+    
+    if (sensors_mutex != NULL) {
+        xSemaphoreTake(sensors_mutex, portMAX_DELAY);
+    }
+    
+    int n = 0;
+    int count = COUNT_LOCKED();
+    if (first_id < count) {
+        n = count - first_id;
+        if (n > max) {
+            n = max;
+        }
+        memcpy(states, &sensor_states[first_id], n * sizeof(sensor_state_t));
+    }
+    
+    if (sensors_mutex != NULL) {
+        xSemaphoreGive(sensors_mutex);
+    }
+    return n;
+}
+
+
+void sensors_write_metrics(http_chunk_writer_t *w, const char *hostname) {
+    // Copy sensor state in batches
+    sensor_state_t states[SENSORS_CHUNK_SIZE];
+    int base = 0;
+    int n;
+    while ((n = sensors_get_states(base, states, SENSORS_CHUNK_SIZE)) > 0) {
+        for (int j = 0; j < n; j++) {
+            const sensor_info_t *sensor = sensors_get_info(base + j);
+            const sensor_state_t *state = &states[j];
+            if (sensor == NULL || sensor->metric_name[0] == '\0') {
+                continue;
+            }
+            
+            // Output HELP and TYPE for this sensor
+            http_chunk_printf(w, "# HELP %s %s%s%s\n# TYPE %s gauge\n",
+                              sensor->metric_name, sensor->display_name,
+                              sensor->unit[0] != '\0' ? " in " : "", sensor->unit,
+                              sensor->metric_name);
+            
+            // Output value if available
+            if ((state->flags & SENSOR_FLAG_AVAILABLE) && state->last_updated > 0) {
+                // Convert timestamp to milliseconds for Prometheus
+                int64_t timestamp_ms = (int64_t)state->last_updated * 1000;
+                
+                http_chunk_printf(w,
+                                  "%s{hostname=\"%s\"%s%s%s%s%s%s} %.2f %lld\n", 
+                                  sensor->metric_name, hostname, 
+
+                                  sensor->device_name[0] != '\0' ? ",device_name=\"" : "",
+                                  sensor->device_name[0] != '\0' ? sensor->device_name : "",
+                                  sensor->device_name[0] != '\0' ? "\"" : "",
+
+                                  sensor->device_id[0] != '\0' ? ",device_id=\"" : "",
+                                  sensor->device_id[0] != '\0' ? sensor->device_id : "",
+                                  sensor->device_id[0] != '\0' ? "\"" : "",
+
+                                  state->value, (long long)timestamp_ms);
+            }
+        }
+        base += n;
     }
-    return &sensors[index];
 }
 
 
@@ -437,13 +422,15 @@ static void sensor_cleanup_task(void *pvParameters) {
         }
         
         time_t now = time(NULL);
-        for (int i = 0; i < sensor_count; i++) {
-            if (sensors[i].available && sensors[i].last_updated > 0) {
-                time_t age = now - sensors[i].last_updated;
+        for (int i = 0; i < COUNT_LOCKED(); i++) {
+            sensor_state_t *state = &sensor_states[i];
+            if ((state->flags & SENSOR_FLAG_AVAILABLE) && state->last_updated > 0) {
+                time_t age = now - state->last_updated;
                 if (age > SENSOR_STALE_TIMEOUT_SECONDS) {
                     ESP_LOGW(TAG, "Sensor %d (%s) is stale (%ld seconds old), marking unavailable",
-                             i, sensors[i].display_name, (long)age);
-                    sensors[i].available = false;
+                             i, SENSOR_INFO(i)->display_name, (long)age);
+                    state->flags &= ~SENSOR_FLAG_AVAILABLE;
+                    sensors_stream_mark(i);
                 }
             }
         }
@@ -456,9 +443,8 @@ static void sensor_cleanup_task(void *pvParameters) {
 
 void sensors_init(settings_t *settings, httpd_handle_t server)
 {
-    // Initialize sensor array
-    memset(sensors, 0, sizeof(sensors));
-    sensor_count = 0;
+    // Storage is allocated on demand by sensors_register()
+    atomic_store(&sensor_count, 0);
     
     // Create mutex for thread safety
     sensors_mutex = xSemaphoreCreateMutex();
@@ -467,25 +453,22 @@ void sensors_init(settings_t *settings, httpd_handle_t server)
     }
     
     // Start cleanup task
-    xTaskCreate(sensor_cleanup_task, "sensor_cleanup", 2048, NULL, 5, NULL);
+    task_config_create(TASK_SENSOR_CLEANUP, sensor_cleanup_task, NULL, NULL);
     
     // Set user_ctx to settings so handlers can access hostname
-    sensors_display_uri.user_ctx = settings;
+    version_uri.user_ctx = settings;
     
-    // Register HTTP handlers
-    esp_err_t err = httpd_register_uri_handler(server, &sensors_display_uri);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error (%s) registering sensor display handler!", esp_err_to_name(err));
-    }
-    
-    err = httpd_register_uri_handler(server, &sensors_data_uri);
+    // Register HTTP handlers; the page at / is a static asset (www.c)
+    esp_err_t err = httpd_register_uri_handler_timed(server, &sensors_data_uri);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error (%s) registering sensor data handler!", esp_err_to_name(err));
     }
     
-    err = httpd_register_uri_handler(server, &version_uri);
+    err = httpd_register_uri_handler_timed(server, &version_uri);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error (%s) registering version handler!", esp_err_to_name(err));
     }
     
+    sensors_stream_init(server);
+    
 }
\ No newline at end of file
@@ -6,28 +6,51 @@
 #include <time.h>
 #include "settings.h"
 #include <esp_http_server.h>
+#include "http_server.h"
 
-// Maximum number of sensors that can be registered
-#define MAX_SENSORS 60
+// Maximum number of sensors that can be registered (Kconfig SENSORS_MAX_COUNT).
+// Storage grows on demand, so unused capacity costs only a pointer per chunk.
+#define MAX_SENSORS CONFIG_SENSORS_MAX_COUNT
+
+// Sensors are allocated in chunks of this many entries; IDs never move
+#define SENSORS_CHUNK_SIZE 16
 
 // Maximum length for sensor name and unit strings
 #define SENSOR_DISPLAY_NAME_MAX_LEN 40
 #define SENSOR_DEVICE_NAME_MAX_LEN 32
 #define SENSOR_DEVICE_ID_MAX_LEN 20
 #define SENSOR_UNIT_MAX_LEN 16
+#define SENSOR_LINK_URL_MAX_LEN 64
+#define SENSOR_LINK_TEXT_MAX_LEN 32
+
+// sensor_state_t.flags
+#define SENSOR_FLAG_AVAILABLE 0x01
+#define SENSOR_FLAG_LINK      0x02  // Has an action link; see sensors_get_link()
 
+// Descriptive strings for a sensor. Written once at registration and never
+// changed, so the exporters read them without the lock.
 typedef struct {
     char display_name[SENSOR_DISPLAY_NAME_MAX_LEN];
     char unit[SENSOR_UNIT_MAX_LEN];
     char metric_name[SENSOR_DISPLAY_NAME_MAX_LEN];  // Prometheus metric name
     char device_name[SENSOR_DEVICE_NAME_MAX_LEN]; // Device label for Prometheus
     char device_id[SENSOR_DEVICE_ID_MAX_LEN];    // Device ID for Prometheus
-    float value;
+} sensor_info_t;
+
+// Optional action link, set by sensors_update_with_link(). It changes with
+// updates, so it is only handed out as a copy.
+typedef struct {
+    char url[SENSOR_LINK_URL_MAX_LEN];
+    char text[SENSOR_LINK_TEXT_MAX_LEN];
+} sensor_link_t;
+
+// Per-sensor values written on every update. Kept apart from sensor_info_t so
+// updates and exports only touch a few bytes per sensor.
+typedef struct {
     time_t last_updated;
-    bool available;
-    char link_url[64];      // Optional action link URL
-    char link_text[32];     // Optional action link text
-} sensor_data_t;
+    float value;
+    uint8_t flags;          // SENSOR_FLAG_*
+} sensor_state_t;
 
 /**
  * @brief Initialize the sensors subsystem and register HTTP handlers
@@ -46,6 +69,7 @@ void sensors_init(settings_t *settings, httpd_handle_t server);
  * @param device_name Optional device name label for Prometheus (can be NULL)
  * @param device_id Optional device ID label for Prometheus (can be NULL)s
  * @return int Sensor ID (index) if successful, -1 if registration failed
+ *         (registry full or out of memory)
  */
 int sensors_register(
     const char *display_name,
@@ -94,11 +118,57 @@ float sensors_get_value(int sensor_id, bool *available);
 int sensors_get_count(void);
 
 /**
- * @brief Get sensor data by index
- * 
- * @param index Sensor index (0 to sensor_count-1)
- * @return const sensor_data_t* Pointer to sensor data, or NULL if index is invalid
+ * @brief Get the descriptive strings of a sensor
+ *
+ * The returned pointer stays valid for the lifetime of the firmware; the
+ * registry never moves or frees a registered sensor.
+ *
+ * @param sensor_id Sensor ID (0 to sensor_count-1)
+ * @return const sensor_info_t* Pointer to sensor info, or NULL if the ID is invalid
+ */
+const sensor_info_t* sensors_get_info(int sensor_id);
+
+/**
+ * @brief Copy a sensor's action link
+ *
+ * Worth calling only for sensors whose state has SENSOR_FLAG_LINK.
+ *
+ * @param sensor_id Sensor ID (0 to sensor_count-1)
+ * @param link Destination for the copy
+ * @return true if the sensor has a link, false otherwise
+ */
+bool sensors_get_link(int sensor_id, sensor_link_t *link);
+
+/**
+ * @brief Get a consistent copy of a sensor's value, timestamp and flags
+ *
+ * @param sensor_id Sensor ID (0 to sensor_count-1)
+ * @param state Destination for the copy
+ * @return true if the sensor exists, false otherwise
+ */
+bool sensors_get_state(int sensor_id, sensor_state_t *state);
+
+/**
+ * @brief Copy the state of a run of consecutive sensors under a single lock
+ *
+ * Used by the exporters to walk the registry in batches.
+ *
+ * @param first_id First sensor ID to copy
+ * @param states Destination array
+ * @param max Capacity of the destination array
+ * @return int Number of states copied (0 once first_id is past the end)
+ */
+int sensors_get_states(int first_id, sensor_state_t *states, int max);
+
+/**
+ * @brief Write a Prometheus gauge for every sensor with a metric name
+ *
+ * The sensor section of /metrics. Sensors without a current value get only
+ * their HELP and TYPE lines.
+ *
+ * @param w Writer for the response
+ * @param hostname Value of the hostname label
  */
-const sensor_data_t* sensors_get_by_index(int index);
+void sensors_write_metrics(http_chunk_writer_t *w, const char *hostname);
 
 #endif // SENSORS_H
@@ -0,0 +1,356 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_http_server.h>
+#include "sensors.h"
+#include "sensors_stream.h"
+#include "http_stats.h"
+#include "buf_pool.h"
+#include "alloc_prof.h"
+
+static const char *TAG = "sensors_stream";
+
+#define MAX_CLIENTS CONFIG_SENSORS_STREAM_MAX_CLIENTS
+#define DIRTY_WORDS ((MAX_SENSORS + 31) / 32)
+#define CLIENT_BUF_SIZE 1024
+#define CHUNK_HDR_LEN 5                 // "%03x\r\n" less the terminator
+#define PING_INTERVAL_S 15
+#define SENSORS_STREAM_STALL_TIMEOUT_S 30
+
+typedef struct {
+    _Atomic int fd;                     // -1 when the slot is free
+    _Atomic uint32_t dirty[DIRTY_WORDS];
+    char *buf;                          // Pending chunk, sent from off to len
+    size_t off;
+    size_t len;
+    int64_t last_progress_us;
+} stream_client_t;
+
+static httpd_handle_t stream_server = NULL;
+static stream_client_t clients[MAX_CLIENTS];
+static _Atomic uint32_t client_count = 0;
+static esp_timer_handle_t flush_timer = NULL;
+static esp_timer_handle_t ping_timer = NULL;
+static atomic_bool flush_scheduled = false;
+static atomic_bool ping_due = false;
+
+static _Atomic uint32_t events_total = 0;
+static _Atomic uint32_t rejected_total = 0;
+static _Atomic uint32_t stalled_total = 0;
+
+static void schedule_flush(void) {
+    if (!atomic_exchange(&flush_scheduled, true)) {
+        esp_timer_start_once(flush_timer, CONFIG_SENSORS_STREAM_INTERVAL_MS * 1000);
+    }
+}
+
+void sensors_stream_mark(int sensor_id) {
+    if (sensor_id < 0 || sensor_id >= MAX_SENSORS || atomic_load(&client_count) == 0) {
+        return;
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (atomic_load_explicit(&clients[i].fd, memory_order_relaxed) >= 0) {
+            atomic_fetch_or_explicit(&clients[i].dirty[sensor_id / 32], 1u << (sensor_id % 32),
+                                     memory_order_relaxed);
+        }
+    }
+    schedule_flush();
+}
+
+// Append one sensor to the event being built. Returns false if it does not fit.
+static bool append_sensor(stream_client_t *c, size_t cap, int id, const sensor_state_t *state, bool first) {
+    const sensor_info_t *info = sensors_get_info(id);
+    if (info == NULL || info->display_name[0] == '\0' || info->unit[0] == '\0') {
+        return true;
+    }
+
+    char *p = c->buf + c->len;
+    size_t room = cap - c->len;
+    int n = snprintf(p, room,
+                     "%s{\"id\":%d,\"name\":\"%s\",\"unit\":\"%s\",\"value\":%.2f,\"last_updated\":%" PRId64 ",\"available\":%s",
+                     first ? "" : ",", id, info->display_name, info->unit, state->value,
+                     (int64_t)state->last_updated,
+                     (state->flags & SENSOR_FLAG_AVAILABLE) ? "true" : "false");
+    sensor_link_t link;
+    if (n > 0 && (size_t)n < room && (state->flags & SENSOR_FLAG_LINK) && sensors_get_link(id, &link)) {
+        n += snprintf(p + n, room - n, ",\"link_url\":\"%s\",\"link_text\":\"%s\"",
+                      link.url, link.text);
+    }
+    if (n > 0 && (size_t)n < room) {
+        n += snprintf(p + n, room - n, "}");
+    }
+    if (n < 0 || (size_t)n >= room) {
+        return false;
+    }
+    c->len += n;
+    return true;
+}
+
+// Wrap buf[CHUNK_HDR_LEN..len) in HTTP chunk framing
+static void finish_chunk(stream_client_t *c) {
+    char hdr[CHUNK_HDR_LEN + 1];
+    snprintf(hdr, sizeof(hdr), "%03x\r\n", (unsigned)(c->len - CHUNK_HDR_LEN));
+    memcpy(c->buf, hdr, CHUNK_HDR_LEN);
+    memcpy(c->buf + c->len, "\r\n", 2);
+    c->len += 2;
+    c->off = 0;
+}
+
+// Build the next event from the client's dirty sensors. Sensors that do not
+// fit stay dirty for the next event. Returns false if nothing was dirty.
+static bool build_event(stream_client_t *c) {
+    static const char prefix[] = "data: {\"sensors\":[";
+    static const char suffix[] = "]}\n\n";
+    const size_t cap = CLIENT_BUF_SIZE - 2 - (sizeof(suffix) - 1);  // Room for the chunk trailer
+
+    c->len = CHUNK_HDR_LEN;
+    memcpy(c->buf + c->len, prefix, sizeof(prefix) - 1);
+    c->len += sizeof(prefix) - 1;
+
+    bool first = true;
+    bool any = false;
+    sensor_state_t states[32];
+    int count = sensors_get_count();
+    for (int w = 0; w < DIRTY_WORDS && w * 32 < count; w++) {
+        uint32_t bits = atomic_exchange_explicit(&c->dirty[w], 0, memory_order_relaxed);
+        if (bits == 0) {
+            continue;
+        }
+        int n = sensors_get_states(w * 32, states, 32);
+        while (bits != 0) {
+            int b = __builtin_ctz(bits);
+            if (b < n) {
+                size_t before = c->len;
+                if (!append_sensor(c, cap, w * 32 + b, &states[b], first)) {
+                    // Full: send what we have and keep the rest for the next event
+                    atomic_fetch_or_explicit(&c->dirty[w], bits, memory_order_relaxed);
+                    goto done;
+                }
+                if (c->len != before) {
+                    first = false;
+                    any = true;
+                }
+            }
+            bits &= bits - 1;
+        }
+    }
+done:
+    if (!any) {
+        c->off = c->len = 0;
+        return false;
+    }
+    memcpy(c->buf + c->len, suffix, sizeof(suffix) - 1);
+    c->len += sizeof(suffix) - 1;
+    finish_chunk(c);
+    atomic_fetch_add(&events_total, 1);
+    return true;
+}
+
+static void build_ping(stream_client_t *c) {
+    static const char ping[] = ": ping\n\n";
+    c->len = CHUNK_HDR_LEN;
+    memcpy(c->buf + c->len, ping, sizeof(ping) - 1);
+    c->len += sizeof(ping) - 1;
+    finish_chunk(c);
+}
+
+static bool client_has_dirty(stream_client_t *c) {
+    for (int w = 0; w < DIRTY_WORDS; w++) {
+        if (atomic_load_explicit(&c->dirty[w], memory_order_relaxed) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Runs in the HTTP server task, like the request handlers and close callback
+static void stream_work(void *arg) {
+    atomic_store(&flush_scheduled, false);
+    bool ping = atomic_exchange(&ping_due, false);
+    bool again = false;
+    int64_t now = esp_timer_get_time();
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        stream_client_t *c = &clients[i];
+        int fd = atomic_load(&c->fd);
+        if (fd < 0) {
+            continue;
+        }
+
+        // The stall clock only runs while output is pending
+        if (c->off == c->len) {
+            c->last_progress_us = now;
+        }
+
+        // Send until the socket would block or nothing is left
+        bool client_ping = ping;
+        while (1) {
+            if (c->off == c->len) {
+                if (!build_event(c)) {
+                    if (!client_ping) {
+                        break;
+                    }
+                    build_ping(c);
+                }
+                client_ping = false;    // Any output keeps the connection alive
+            }
+            int sent = httpd_socket_send(stream_server, fd, c->buf + c->off, c->len - c->off, MSG_DONTWAIT);
+            if (sent > 0) {
+                c->off += sent;
+                c->last_progress_us = now;
+                continue;
+            }
+            if (sent == HTTPD_SOCK_ERR_TIMEOUT) {
+                // Socket buffer full; the client keeps only the latest values
+                if (now - c->last_progress_us > SENSORS_STREAM_STALL_TIMEOUT_S * 1000000LL) {
+                    ESP_LOGW(TAG, "Dropping stream client on socket %d: no progress for %ds",
+                             fd, SENSORS_STREAM_STALL_TIMEOUT_S);
+                    atomic_fetch_add(&stalled_total, 1);
+                    httpd_sess_trigger_close(stream_server, fd);
+                } else {
+                    again = true;
+                }
+                break;
+            }
+            ESP_LOGD(TAG, "Stream send on socket %d failed (%d)", fd, sent);
+            httpd_sess_trigger_close(stream_server, fd);
+            break;
+        }
+        if (c->off != c->len || client_has_dirty(c)) {
+            again = true;
+        }
+    }
+
+    if (again) {
+        schedule_flush();
+    }
+}
+
+static void flush_timer_cb(void *arg) {
+    if (httpd_queue_work(stream_server, stream_work, NULL) != ESP_OK) {
+        atomic_store(&flush_scheduled, false);
+    }
+}
+
+static void ping_timer_cb(void *arg) {
+    if (atomic_load(&client_count) > 0) {
+        atomic_store(&ping_due, true);
+        schedule_flush();
+    }
+}
+
+// Session close callback (sess_ctx free_ctx); runs in the HTTP server task
+static void stream_client_closed(void *ctx) {
+    stream_client_t *c = (stream_client_t *)ctx;
+    ESP_LOGI(TAG, "Stream client on socket %d disconnected", atomic_load(&c->fd));
+    atomic_store(&c->fd, -1);
+    atomic_fetch_sub(&client_count, 1);
+    buf_pool_put(c->buf);
+    c->buf = NULL;
+}
+
+static esp_err_t sensors_stream_handler(httpd_req_t *req) {
+    stream_client_t *c = NULL;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (atomic_load(&clients[i].fd) < 0) {
+            c = &clients[i];
+            break;
+        }
+    }
+    if (c == NULL) {
+        atomic_fetch_add(&rejected_total, 1);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "60");
+        httpd_resp_sendstr(req, "Too many stream clients");
+        return ESP_OK;
+    }
+
+    c->buf = buf_pool_get(CLIENT_BUF_SIZE);
+    if (c->buf == NULL) {
+        return http_resp_send_busy(req);
+    }
+
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    // Sends the headers and opens the chunked body, which is never finished
+    static const char hello[] = "retry: 5000\n\n";
+    if (httpd_resp_send_chunk(req, hello, sizeof(hello) - 1) != ESP_OK) {
+        buf_pool_put(c->buf);
+        c->buf = NULL;
+        return ESP_FAIL;
+    }
+
+    // Start with every sensor
+    int count = sensors_get_count();
+    for (int w = 0; w < DIRTY_WORDS; w++) {
+        int left = count - w * 32;
+        atomic_store(&c->dirty[w], left >= 32 ? UINT32_MAX : left > 0 ? (1u << left) - 1 : 0);
+    }
+    c->off = c->len = 0;
+    c->last_progress_us = esp_timer_get_time();
+    int fd = httpd_req_to_sockfd(req);
+    atomic_store(&c->fd, fd);
+    atomic_fetch_add(&client_count, 1);
+
+    // Closing the session frees the slot
+    req->sess_ctx = c;
+    req->free_ctx = stream_client_closed;
+
+    ESP_LOGI(TAG, "Stream client on socket %d connected (%lu of %d)",
+             fd, (unsigned long)atomic_load(&client_count), MAX_CLIENTS);
+    schedule_flush();
+    return ESP_OK;
+}
+
+static httpd_uri_t sensors_stream_uri = {
+    .uri       = "/sensors/stream",
+    .method    = HTTP_GET,
+    .handler   = sensors_stream_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t sensors_stream_init(httpd_handle_t server) {
+    stream_server = server;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        atomic_store(&clients[i].fd, -1);
+    }
+
+    const esp_timer_create_args_t flush_args = {
+        .callback = flush_timer_cb,
+        .name = "stream_flush",
+    };
+    const esp_timer_create_args_t ping_args = {
+        .callback = ping_timer_cb,
+        .name = "stream_ping",
+    };
+    esp_err_t err = esp_timer_create(&flush_args, &flush_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_create(&ping_args, &ping_timer);
+    }
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(ping_timer, PING_INTERVAL_S * 1000000LL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create stream timers: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = httpd_register_uri_handler_timed(server, &sensors_stream_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) registering sensor stream handler!", esp_err_to_name(err));
+    }
+    return err;
+}
+
+void sensors_stream_get_stats(sensors_stream_stats_t *stats) {
+    stats->clients = atomic_load(&client_count);
+    stats->events = atomic_load(&events_total);
+    stats->rejected = atomic_load(&rejected_total);
+    stats->stalled = atomic_load(&stalled_total);
+}
@@ -0,0 +1,38 @@
+#ifndef SENSORS_STREAM_H
+#define SENSORS_STREAM_H
+
+#include <stdint.h>
+#include <esp_http_server.h>
+
+// Server-Sent Events at GET /sensors/stream. A client first receives every
+// sensor, then only the sensors that changed, batched every
+// CONFIG_SENSORS_STREAM_INTERVAL_MS. Events have the same per-sensor fields
+// as /sensors/data:
+//   data: {"sensors":[{"id":3,"name":...,"value":...},...]}
+//
+// Sends never block the server: a client that cannot keep up receives only
+// the latest value of each changed sensor, and is disconnected when it makes
+// no progress for SENSORS_STREAM_STALL_TIMEOUT_S.
+
+typedef struct {
+    uint32_t clients;           // Connected subscribers
+    uint32_t events;            // Events sent, all clients
+    uint32_t rejected;          // Subscriptions refused (too many clients)
+    uint32_t stalled;           // Clients dropped for not reading
+} sensors_stream_stats_t;
+
+/**
+ * @brief Register GET /sensors/stream
+ */
+esp_err_t sensors_stream_init(httpd_handle_t server);
+
+/**
+ * @brief Queue a sensor for the next event to every client
+ *
+ * Cheap and non-blocking; safe to call with the sensors mutex held.
+ */
+void sensors_stream_mark(int sensor_id);
+
+void sensors_stream_get_stats(sensors_stream_stats_t *stats);
+
+#endif // SENSORS_STREAM_H
@@ -14,12 +14,26 @@ typedef struct {
     bool enabled;            // Whether this filter is active
 } mac_filter_t;
 
+#define BTHOME_BINDKEY_LEN 16
+
+// AES-128 bindkey for an encrypted BTHome device
+typedef struct {
+    esp_bd_addr_t mac_addr;
+    uint8_t key[BTHOME_BINDKEY_LEN];
+} bthome_bindkey_t;
+
 // Structure to hold DS18B20 device name configuration
 typedef struct {
     uint64_t address;        // DS18B20 64-bit address
     char name[32];           // Human-readable name for the device
 } ds18b20_name_t;
 
+typedef enum {
+    SYSLOG_TRANSPORT_UDP = 0,
+    SYSLOG_TRANSPORT_TCP,              // RFC 6587 octet counting
+    SYSLOG_TRANSPORT_TLS,              // RFC 5425, certificate checked against the CA bundle
+} syslog_transport_t;
+
 typedef struct {
     char *update_url;
     char *password;
@@ -35,6 +49,8 @@ typedef struct {
     size_t selected_bthome_object_ids_count;
     mac_filter_t *mac_filters;         // Array of MAC address filters
     size_t mac_filters_count;          // Number of MAC address filters
+    bthome_bindkey_t *bthome_bindkeys; // Array of BTHome encryption keys
+    size_t bthome_bindkeys_count;      // Number of BTHome encryption keys
     ds18b20_name_t *ds18b20_names;     // Array of DS18B20 device names
     size_t ds18b20_names_count;        // Number of DS18B20 device names
     int8_t ds18b20_gpio;               // DS18B20 temperature sensor GPIO pin (-1 = disabled)
@@ -48,6 +64,7 @@ typedef struct {
     bool temp_use_fahrenheit;          // Display temperatures in Fahrenheit (true) or Celsius (false)
     char *syslog_server;               // Syslog server hostname or IP address
     uint16_t syslog_port;              // Syslog server port (default 514)
+    syslog_transport_t syslog_transport;   // Syslog transport (default UDP)
     char *mqtt_broker_url;             // MQTT broker URL (e.g., mqtt://broker.example.com:1883)
     char *mqtt_username;               // MQTT username (optional)
     char *mqtt_password;               // MQTT password (optional)
@@ -55,10 +72,61 @@ typedef struct {
     char *mqtt_status_topic;           // MQTT topic for status updates (default: station/status)
 } settings_t;
 
+// settings_t belongs to the HTTP server task: its handlers are the only
+// writer and may read it directly. Other tasks read immutable snapshots,
+// which are published on every save and stay valid until released:
+//
+//     settings_read_t read;
+//     const settings_t *s = settings_snapshot_acquire(&read);
+//     ...
+//     settings_snapshot_release(read);
+//
+// Acquire and release are lock-free. A save waits for readers that hold an
+// older snapshot before freeing it, so keep the section short and never
+// block in it.
+typedef unsigned settings_read_t;
+
 esp_err_t settings_init(settings_t *settings);
 
 esp_err_t settings_register(settings_t *settings, httpd_handle_t http_server);
 
-const char* settings_get_ds18b20_name(settings_t *settings, uint64_t address);
+const char* settings_get_ds18b20_name(const settings_t *settings, uint64_t address);
+
+/**
+ * @brief Enter a read section and return the current snapshot
+ *
+ * Valid after settings_init(). Nothing in it may be modified.
+ */
+const settings_t *settings_snapshot_acquire(settings_read_t *read);
+
+/**
+ * @brief Leave a read section; the snapshot may be freed afterwards
+ */
+void settings_snapshot_release(settings_read_t read);
+
+/**
+ * @brief Generation of a snapshot, incremented by every publish
+ */
+uint32_t settings_snapshot_generation(const settings_t *snapshot);
+
+// Flash wear from settings saves, per NVS key
+typedef struct {
+    const char *nvs_key;
+    uint32_t writes;                   // Values written
+    uint32_t erases;                   // Lists erased because they became empty
+    uint32_t unchanged;                // Submitted values equal to the stored one, not written
+} settings_nvs_key_stats_t;
+
+typedef void (*settings_nvs_stats_cb_t)(const settings_nvs_key_stats_t *stats, void *ctx);
+
+/**
+ * @brief Call cb with the counters of every settings key
+ */
+void settings_nvs_foreach_key(settings_nvs_stats_cb_t cb, void *ctx);
+
+/**
+ * @brief Number of NVS commits made by settings saves
+ */
+uint32_t settings_nvs_commits(void);
 
 #endif // SETTINGS_H
\ No newline at end of file
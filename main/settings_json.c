@@ -0,0 +1,586 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "settings_json.h"
+
+// Nesting allowed in values that are skipped
+#define JSON_MAX_DEPTH 16
+
+typedef struct {
+    settings_json_sink_fn sink;
+    void *arg;
+    esp_err_t err;
+} json_out_t;
+
+static void out_raw(json_out_t *out, const char *data, size_t len) {
+    if (len > 0 && out->err == ESP_OK) {
+        out->err = out->sink(out->arg, data, len);
+    }
+}
+
+static void out_str(json_out_t *out, const char *s) {
+    out_raw(out, s, strlen(s));
+}
+
+static void out_printf(json_out_t *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void out_printf(json_out_t *out, const char *fmt, ...) {
+    char buf[48];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n > 0) {
+        out_raw(out, buf, n < (int)sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+    }
+}
+
+static void out_string(json_out_t *out, const char *s, size_t len) {
+    out_raw(out, "\"", 1);
+    while (len > 0) {
+        size_t plain = 0;
+        while (plain < len && s[plain] != '"' && s[plain] != '\\' && (unsigned char)s[plain] >= 0x20) {
+            plain++;
+        }
+        out_raw(out, s, plain);
+        s += plain;
+        len -= plain;
+        if (len == 0) {
+            break;
+        }
+        if (*s == '"' || *s == '\\') {
+            char esc[2] = { '\\', *s };
+            out_raw(out, esc, sizeof(esc));
+        } else {
+            out_printf(out, "\\u%04x", (unsigned char)*s);
+        }
+        s++;
+        len--;
+    }
+    out_raw(out, "\"", 1);
+}
+
+static void out_key(json_out_t *out, bool *first, const char *key) {
+    out_str(out, *first ? "\"" : ",\"");
+    out_str(out, key);
+    out_str(out, "\":");
+    *first = false;
+}
+
+static const uint8_t *bindkey_for(const settings_t *settings, const esp_bd_addr_t mac_addr) {
+    for (size_t i = 0; i < settings->bthome_bindkeys_count; i++) {
+        if (memcmp(settings->bthome_bindkeys[i].mac_addr, mac_addr, 6) == 0) {
+            return settings->bthome_bindkeys[i].key;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t settings_json_write(const settings_t *settings, settings_json_sink_fn sink, void *arg) {
+    json_out_t out = { .sink = sink, .arg = arg };
+    bool first = true;
+    char num[24];
+
+    out_raw(&out, "{", 1);
+    for (size_t id = 0; id < SETTING_FIELD_COUNT; id++) {
+        const setting_def_t *def = &settings_schema[id];
+        if (def->flags & SETTING_WRITE_ONLY) {
+            continue;
+        }
+        out_key(&out, &first, def->key);
+        if (def->kind == SETTING_KIND_STR) {
+            const char *s = setting_get_str(settings, def);
+            out_string(&out, s, strlen(s));
+        } else if (def->kind == SETTING_KIND_BOOL) {
+            out_str(&out, setting_get_int(settings, def) ? "true" : "false");
+        } else {
+            out_str(&out, setting_format(settings, def, num, sizeof(num)));
+        }
+    }
+
+    out_key(&out, &first, "bthome_objects");
+    out_raw(&out, "[", 1);
+    for (size_t i = 0; i < settings->selected_bthome_object_ids_count; i++) {
+        out_printf(&out, i == 0 ? "%u" : ",%u", settings->selected_bthome_object_ids[i]);
+    }
+    out_raw(&out, "]", 1);
+
+    out_key(&out, &first, "mac_filters");
+    out_raw(&out, "[", 1);
+    for (size_t i = 0; i < settings->mac_filters_count; i++) {
+        const mac_filter_t *filter = &settings->mac_filters[i];
+        const uint8_t *m = filter->mac_addr;
+        out_printf(&out, "%s{\"mac\":\"%02x:%02x:%02x:%02x:%02x:%02x\",\"name\":",
+                   i == 0 ? "" : ",", m[0], m[1], m[2], m[3], m[4], m[5]);
+        out_string(&out, filter->name, strnlen(filter->name, sizeof(filter->name)));
+        out_str(&out, filter->enabled ? ",\"enabled\":true" : ",\"enabled\":false");
+        const uint8_t *key = bindkey_for(settings, filter->mac_addr);
+        if (key != NULL) {
+            out_str(&out, ",\"key\":\"");
+            for (int j = 0; j < BTHOME_BINDKEY_LEN; j++) {
+                out_printf(&out, "%02x", key[j]);
+            }
+            out_raw(&out, "\"", 1);
+        }
+        out_raw(&out, "}", 1);
+    }
+    out_raw(&out, "]", 1);
+
+    out_key(&out, &first, "ds18b20_names");
+    out_raw(&out, "[", 1);
+    for (size_t i = 0; i < settings->ds18b20_names_count; i++) {
+        const ds18b20_name_t *name = &settings->ds18b20_names[i];
+        out_printf(&out, "%s{\"address\":\"%016" PRIX64 "\",\"name\":", i == 0 ? "" : ",", name->address);
+        out_string(&out, name->name, strnlen(name->name, sizeof(name->name)));
+        out_raw(&out, "}", 1);
+    }
+    out_raw(&out, "]}", 2);
+    return out.err;
+}
+
+// FNV-1a, 64-bit
+static esp_err_t hash_sink(void *arg, const char *data, size_t len) {
+    uint64_t *hash = (uint64_t *)arg;
+    for (size_t i = 0; i < len; i++) {
+        *hash ^= (uint8_t)data[i];
+        *hash *= 1099511628211ULL;
+    }
+    return ESP_OK;
+}
+
+uint64_t settings_json_version(const settings_t *settings) {
+    uint64_t hash = 14695981039346656037ULL;
+    settings_json_write(settings, hash_sink, &hash);
+    return hash;
+}
+
+typedef struct {
+    char *p;
+    char *end;
+    settings_update_t *update;
+} json_in_t;
+
+typedef enum {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_COMPOSITE,                     // Object or array, already skipped
+} json_type_t;
+
+typedef struct {
+    json_type_t type;
+    const char *s;                      // Text of the value, "true"/"false" for booleans
+    char num[32];
+} json_scalar_t;
+
+static void skip_ws(json_in_t *in) {
+    while (in->p < in->end && (*in->p == ' ' || *in->p == '\t' || *in->p == '\n' || *in->p == '\r')) {
+        in->p++;
+    }
+}
+
+static bool consume(json_in_t *in, char c) {
+    skip_ws(in);
+    if (in->p < in->end && *in->p == c) {
+        in->p++;
+        return true;
+    }
+    return false;
+}
+
+static bool peek(json_in_t *in, char c) {
+    skip_ws(in);
+    return in->p < in->end && *in->p == c;
+}
+
+static bool consume_word(json_in_t *in, const char *word) {
+    size_t len = strlen(word);
+    if ((size_t)(in->end - in->p) < len || memcmp(in->p, word, len) != 0) {
+        return false;
+    }
+    in->p += len;
+    return true;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool read_hex4(json_in_t *in, uint32_t *out) {
+    if (in->end - in->p < 4) {
+        return false;
+    }
+    *out = 0;
+    for (int i = 0; i < 4; i++) {
+        int d = hex_digit(*in->p++);
+        if (d < 0) {
+            return false;
+        }
+        *out = *out << 4 | d;
+    }
+    return true;
+}
+
+// Escapes are never shorter than the UTF-8 they decode to, so the string is
+// decoded over itself and NUL terminated no later than its closing quote
+static bool parse_string(json_in_t *in, char **out) {
+    if (!consume(in, '"')) {
+        return false;
+    }
+    char *start = in->p;
+    char *dst = in->p;
+    for (;;) {
+        if (in->p >= in->end) {
+            return false;
+        }
+        char c = *in->p++;
+        if (c == '"') {
+            break;
+        }
+        if ((unsigned char)c < 0x20) {
+            return false;
+        }
+        if (c != '\\') {
+            *dst++ = c;
+            continue;
+        }
+        if (in->p >= in->end) {
+            return false;
+        }
+        uint32_t cp;
+        switch (*in->p++) {
+        case '"':  *dst++ = '"'; continue;
+        case '\\': *dst++ = '\\'; continue;
+        case '/':  *dst++ = '/'; continue;
+        case 'b':  *dst++ = '\b'; continue;
+        case 'f':  *dst++ = '\f'; continue;
+        case 'n':  *dst++ = '\n'; continue;
+        case 'r':  *dst++ = '\r'; continue;
+        case 't':  *dst++ = '\t'; continue;
+        case 'u':
+            if (!read_hex4(in, &cp)) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            uint32_t low;
+            if (!consume_word(in, "\\u") || !read_hex4(in, &low) || low < 0xDC00 || low > 0xDFFF) {
+                return false;
+            }
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        } else if ((cp >= 0xDC00 && cp <= 0xDFFF) || cp == 0) {
+            return false;
+        }
+        if (cp < 0x80) {
+            *dst++ = (char)cp;
+        } else if (cp < 0x800) {
+            *dst++ = (char)(0xC0 | cp >> 6);
+            *dst++ = (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            *dst++ = (char)(0xE0 | cp >> 12);
+            *dst++ = (char)(0x80 | (cp >> 6 & 0x3F));
+            *dst++ = (char)(0x80 | (cp & 0x3F));
+        } else {
+            *dst++ = (char)(0xF0 | cp >> 18);
+            *dst++ = (char)(0x80 | (cp >> 12 & 0x3F));
+            *dst++ = (char)(0x80 | (cp >> 6 & 0x3F));
+            *dst++ = (char)(0x80 | (cp & 0x3F));
+        }
+    }
+    *dst = '\0';
+    *out = start;
+    return true;
+}
+
+static bool skip_value(json_in_t *in, int depth);
+
+static bool parse_scalar(json_in_t *in, json_scalar_t *v, int depth) {
+    skip_ws(in);
+    if (in->p >= in->end) {
+        return false;
+    }
+    char c = *in->p;
+    if (c == '"') {
+        v->type = JSON_STRING;
+        return parse_string(in, (char **)&v->s);
+    }
+    if (c == '{' || c == '[') {
+        v->type = JSON_COMPOSITE;
+        return skip_value(in, depth);
+    }
+    if (consume_word(in, "null")) {
+        v->type = JSON_NULL;
+        return true;
+    }
+    if (consume_word(in, "true")) {
+        v->type = JSON_BOOL;
+        v->s = "true";
+        return true;
+    }
+    if (consume_word(in, "false")) {
+        v->type = JSON_BOOL;
+        v->s = "false";
+        return true;
+    }
+    // Checked by the field parsers; only the extent is found here
+    size_t n = 0;
+    while (in->p < in->end && *in->p != '\0' && strchr("+-.0123456789eE", *in->p) != NULL) {
+        if (n == sizeof(v->num) - 1) {
+            return false;
+        }
+        v->num[n++] = *in->p++;
+    }
+    if (n == 0) {
+        return false;
+    }
+    v->num[n] = '\0';
+    v->type = JSON_NUMBER;
+    v->s = v->num;
+    return true;
+}
+
+static bool skip_value(json_in_t *in, int depth) {
+    if (depth >= JSON_MAX_DEPTH) {
+        return false;
+    }
+    if (consume(in, '{')) {
+        if (consume(in, '}')) {
+            return true;
+        }
+        do {
+            char *key;
+            if (!parse_string(in, &key) || !consume(in, ':') || !skip_value(in, depth + 1)) {
+                return false;
+            }
+        } while (consume(in, ','));
+        return consume(in, '}');
+    }
+    if (consume(in, '[')) {
+        if (consume(in, ']')) {
+            return true;
+        }
+        do {
+            if (!skip_value(in, depth + 1)) {
+                return false;
+            }
+        } while (consume(in, ','));
+        return consume(in, ']');
+    }
+    json_scalar_t v;
+    return parse_scalar(in, &v, depth);
+}
+
+static void json_fail(settings_update_t *update, const char *name) {
+    if (update->error == NULL) {
+        update->error = name;
+    }
+}
+
+// Set a list row through its form key, which only lives on the stack
+static void set_row(settings_update_t *update, const char *key, const char *value, const char *list) {
+    settings_update_set(update, key, value);
+    if (update->error == key) {
+        update->error = list;
+    }
+}
+
+static bool parse_field_value(json_in_t *in, const setting_def_t *def) {
+    json_scalar_t v;
+    if (!parse_scalar(in, &v, 1)) {
+        return false;
+    }
+    json_type_t expected = def->kind == SETTING_KIND_STR  ? JSON_STRING :
+                           def->kind == SETTING_KIND_BOOL ? JSON_BOOL : JSON_NUMBER;
+    if (v.type == JSON_NULL) {
+        return true;
+    }
+    if (v.type != expected) {
+        json_fail(in->update, def->key);
+        return true;
+    }
+    settings_update_set(in->update, def->key, v.s);
+    return true;
+}
+
+static bool parse_object_ids(json_in_t *in) {
+    static const char *name = "bthome_objects";
+    settings_update_t *update = in->update;
+    if (!consume(in, '[')) {
+        json_scalar_t v;
+        if (!parse_scalar(in, &v, 1)) {
+            return false;
+        }
+        if (v.type != JSON_NULL) {
+            json_fail(update, name);
+        }
+        return true;
+    }
+    update->present |= SETTING_LIST_BIT(SETTING_LIST_selected_bthome_object_ids);
+    if (consume(in, ']')) {
+        return true;
+    }
+    size_t row = 0;
+    do {
+        json_scalar_t v;
+        if (!parse_scalar(in, &v, 2)) {
+            return false;
+        }
+        if (v.type != JSON_NUMBER || row >= SETTINGS_MAX_BTHOME_OBJECTS) {
+            json_fail(update, name);
+        } else {
+            char key[32];
+            snprintf(key, sizeof(key), "bthome_objects[%u]", (unsigned)row);
+            set_row(update, key, v.s, name);
+        }
+        row++;
+    } while (consume(in, ','));
+    return consume(in, ']');
+}
+
+typedef struct {
+    const char *name;                   // Of the list in the document
+    const char *form_key;               // Prefix of the row keys in the form
+    size_t max;
+    uint64_t present;                   // SETTING_LIST_BIT() of the lists it replaces
+    uint64_t *rows;                     // Rows with a valid mac or address
+} json_rows_t;
+
+// An array of objects, each member set as <form_key>[row][member]
+static bool parse_rows(json_in_t *in, const json_rows_t *list) {
+    settings_update_t *update = in->update;
+    if (!consume(in, '[')) {
+        json_scalar_t v;
+        if (!parse_scalar(in, &v, 1)) {
+            return false;
+        }
+        if (v.type != JSON_NULL) {
+            json_fail(update, list->name);
+        }
+        return true;
+    }
+    update->present |= list->present;
+    if (consume(in, ']')) {
+        return true;
+    }
+    size_t row = 0;
+    do {
+        if (!peek(in, '{') || row >= list->max) {
+            json_fail(update, list->name);
+            if (!skip_value(in, 2)) {
+                return false;
+            }
+            row++;
+            continue;
+        }
+        consume(in, '{');
+        if (!consume(in, '}')) {
+            do {
+                char *member;
+                json_scalar_t v;
+                if (!parse_string(in, &member) || !consume(in, ':') || !parse_scalar(in, &v, 3)) {
+                    return false;
+                }
+                if (v.type == JSON_NULL) {
+                    continue;
+                }
+                char key[48];
+                snprintf(key, sizeof(key), "%s[%u][%s]", list->form_key, (unsigned)row, member);
+                if (strcmp(member, "enabled") == 0) {
+                    if (v.type != JSON_BOOL) {
+                        json_fail(update, list->name);
+                    } else if (strcmp(v.s, "true") == 0) {
+                        // The form only submits checked boxes
+                        set_row(update, key, v.s, list->name);
+                    }
+                } else if (v.type != JSON_STRING) {
+                    json_fail(update, list->name);
+                } else if (strcmp(member, "name") == 0 &&
+                           strlen(v.s) >= sizeof(((mac_filter_t *)0)->name)) {
+                    // The form truncates, an import should not do so silently
+                    json_fail(update, list->name);
+                } else {
+                    set_row(update, key, v.s, list->name);
+                }
+            } while (consume(in, ','));
+            if (!consume(in, '}')) {
+                return false;
+            }
+        }
+        if (!(*list->rows & (1ULL << row))) {
+            json_fail(update, list->name);
+        }
+        row++;
+    } while (consume(in, ','));
+    return consume(in, ']');
+}
+
+_Static_assert(sizeof(((mac_filter_t *)0)->name) == sizeof(((ds18b20_name_t *)0)->name),
+               "parse_rows() checks both names against one length");
+
+static bool parse_member(json_in_t *in, const char *key) {
+    const setting_def_t *def = settings_schema_find(key);
+    if (def != NULL) {
+        return parse_field_value(in, def);
+    }
+    if (strcmp(key, "bthome_objects") == 0) {
+        return parse_object_ids(in);
+    }
+    if (strcmp(key, "mac_filters") == 0) {
+        json_rows_t list = {
+            .name = "mac_filters",
+            .form_key = "mac_filter",
+            .max = SETTINGS_MAX_MAC_FILTERS,
+            .present = SETTING_LIST_BIT(SETTING_LIST_mac_filters) |
+                       SETTING_LIST_BIT(SETTING_LIST_bthome_bindkeys),
+            .rows = &in->update->mac_rows,
+        };
+        return parse_rows(in, &list);
+    }
+    if (strcmp(key, "ds18b20_names") == 0) {
+        json_rows_t list = {
+            .name = "ds18b20_names",
+            .form_key = "ds18b20_name",
+            .max = SETTINGS_MAX_DS18B20_NAMES,
+            .present = SETTING_LIST_BIT(SETTING_LIST_ds18b20_names),
+            .rows = &in->update->ds18b20_rows,
+        };
+        return parse_rows(in, &list);
+    }
+    return skip_value(in, 1);
+}
+
+bool settings_update_parse_json(settings_update_t *update, char *body, size_t len) {
+    json_in_t in = {
+        .p = body,
+        .end = body + len,
+        .update = update,
+    };
+    if (!consume(&in, '{')) {
+        return false;
+    }
+    if (!consume(&in, '}')) {
+        do {
+            char *key;
+            if (!parse_string(&in, &key) || !consume(&in, ':') || !parse_member(&in, key)) {
+                return false;
+            }
+        } while (consume(&in, ','));
+        if (!consume(&in, '}')) {
+            return false;
+        }
+    }
+    skip_ws(&in);
+    if (in.p != in.end) {
+        return false;
+    }
+    settings_update_finish(update);
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef SETTINGS_JSON_H
+#define SETTINGS_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "settings.h"
+#include "settings_schema.h"
+
+// Receives the document in pieces; a non-ESP_OK return stops the export
+typedef esp_err_t (*settings_json_sink_fn)(void *arg, const char *data, size_t len);
+
+/**
+ * @brief Export settings as one JSON object
+ *
+ * Fields use their form names and form values (weight_gain is the gain
+ * factor). Write-only fields such as the admin password are left out. Lists
+ * are "bthome_objects" (object ids), "mac_filters" ({mac, name, enabled and,
+ * if one is set, key}) and "ds18b20_names" ({address, name}).
+ */
+esp_err_t settings_json_write(const settings_t *settings, settings_json_sink_fn sink, void *arg);
+
+/**
+ * @brief Version of the settings as exported, for ETag/If-Match
+ *
+ * A hash of the settings_json_write() output, so devices with the same
+ * configuration report the same version.
+ */
+uint64_t settings_json_version(const settings_t *settings);
+
+/**
+ * @brief Parse a document in the settings_json_write() format into update
+ *
+ * Parses body in one pass, decoding strings in place, and finishes the
+ * update. Every field is checked as the form would check it. Fields that
+ * are missing or null keep their value. A list that is present replaces
+ * the whole list. Unknown keys are ignored. update->error and the string
+ * values point into body.
+ *
+ * @return false if body is not a JSON object
+ */
+bool settings_update_parse_json(settings_update_t *update, char *body, size_t len);
+
+#endif // SETTINGS_JSON_H
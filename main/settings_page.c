@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "bthome.h"
+#include "settings_page.h"
+#include "settings_schema.h"
+#include "settings_html.h"
+
+static bool str_value(tmpl_value_t *out, const char *s) {
+    out->type = TMPL_STR;
+    out->s = s;
+    return true;
+}
+
+static bool int_value(tmpl_value_t *out, int32_t i) {
+    out->type = TMPL_INT;
+    out->i = i;
+    return true;
+}
+
+static bool uint_value(tmpl_value_t *out, uint32_t u) {
+    out->type = TMPL_UINT;
+    out->u = u;
+    return true;
+}
+
+static bool bool_value(tmpl_value_t *out, bool b) {
+    out->type = TMPL_BOOL;
+    out->b = b;
+    return true;
+}
+
+static const char *ds18b20_name(const settings_t *settings, uint64_t address) {
+    for (size_t i = 0; i < settings->ds18b20_names_count; i++) {
+        if (settings->ds18b20_names[i].address == address) {
+            return settings->ds18b20_names[i].name;
+        }
+    }
+    return "";
+}
+
+static bool ds18b20_detected(const settings_page_t *page, uint64_t address) {
+    for (size_t i = 0; i < page->ds18b20_detected_count; i++) {
+        if (page->ds18b20_detected[i] == address) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Next saved name at or after i whose device is not on the bus
+static size_t ds18b20_saved_next(const settings_page_t *page, size_t i) {
+    const settings_t *s = page->settings;
+    while (i < s->ds18b20_names_count && ds18b20_detected(page, s->ds18b20_names[i].address)) {
+        i++;
+    }
+    return i;
+}
+
+static size_t ds18b20_saved_count(const settings_page_t *page) {
+    size_t count = 0;
+    for (size_t i = ds18b20_saved_next(page, 0); i < page->settings->ds18b20_names_count;
+         i = ds18b20_saved_next(page, i + 1)) {
+        count++;
+    }
+    return count;
+}
+
+// Sections are rendered in order, so remember where the last lookup ended
+static const ds18b20_name_t *ds18b20_saved_at(settings_page_t *page, size_t index) {
+    const settings_t *s = page->settings;
+    if (index < page->saved_index || page->saved_name >= s->ds18b20_names_count) {
+        page->saved_index = 0;
+        page->saved_name = ds18b20_saved_next(page, 0);
+    }
+    while (page->saved_name < s->ds18b20_names_count && page->saved_index < index) {
+        page->saved_name = ds18b20_saved_next(page, page->saved_name + 1);
+        page->saved_index++;
+    }
+    return page->saved_name < s->ds18b20_names_count ? &s->ds18b20_names[page->saved_name] : NULL;
+}
+
+static int bthome_object_next(int id) {
+    for (id++; id < 0xFF; id++) {
+        if (bthome_get_object_name(id) != NULL) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+static size_t bthome_object_count(void) {
+    size_t count = 0;
+    for (int id = bthome_object_next(-1); id >= 0; id = bthome_object_next(id)) {
+        count++;
+    }
+    return count;
+}
+
+static int bthome_object_at(settings_page_t *page, size_t index) {
+    if (page->object_id < 0 || index < page->object_index) {
+        page->object_index = 0;
+        page->object_id = bthome_object_next(-1);
+    }
+    while (page->object_id >= 0 && page->object_index < index) {
+        page->object_id = bthome_object_next(page->object_id);
+        page->object_index++;
+    }
+    return page->object_id;
+}
+
+static bool bthome_object_selected(const settings_t *settings, int id) {
+    for (size_t i = 0; i < settings->selected_bthome_object_ids_count; i++) {
+        if (settings->selected_bthome_object_ids[i] == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *bindkey_hex(settings_page_t *page, const esp_bd_addr_t mac_addr) {
+    const settings_t *s = page->settings;
+    for (size_t i = 0; i < s->bthome_bindkeys_count; i++) {
+        if (memcmp(s->bthome_bindkeys[i].mac_addr, mac_addr, 6) == 0) {
+            static const char hex[] = "0123456789abcdef";
+            for (int j = 0; j < BTHOME_BINDKEY_LEN; j++) {
+                page->scratch[j * 2] = hex[s->bthome_bindkeys[i].key[j] >> 4];
+                page->scratch[j * 2 + 1] = hex[s->bthome_bindkeys[i].key[j] & 0xF];
+            }
+            page->scratch[BTHOME_BINDKEY_LEN * 2] = '\0';
+            return page->scratch;
+        }
+    }
+    return "";
+}
+
+static const setting_def_t *field_at(size_t group, size_t pos) {
+    return &settings_schema[settings_schema_groups[group].first + pos];
+}
+
+static size_t options_count(const setting_def_t *def) {
+    size_t n = 0;
+    while (def->options[n].label != NULL) {
+        n++;
+    }
+    return n;
+}
+
+static const char *field_input_type(const setting_def_t *def) {
+    if (def->kind == SETTING_KIND_BOOL || def->options != NULL) {
+        return NULL;
+    }
+    if (def->flags & SETTING_SECRET) {
+        return "password";
+    }
+    if (def->kind == SETTING_KIND_STR || def->kind == SETTING_KIND_IQ16) {
+        return "text";
+    }
+    return "number";
+}
+
+// Messages shown at the top of a group
+static const char *group_message(const settings_page_t *page, size_t group, const char **title) {
+    switch (group) {
+    case SETTING_GROUP_MQTT:
+        *title = "Last MQTT Error:";
+        return page->mqtt_error;
+    case SETTING_GROUP_PUMP:
+        *title = "Pump Error:";
+        return page->pump_error;
+    default:
+        *title = NULL;
+        return NULL;
+    }
+}
+
+static bool settings_page_value(void *ctx, uint16_t id, const size_t *index, tmpl_value_t *out) {
+    settings_page_t *page = (settings_page_t *)ctx;
+    const settings_t *s = page->settings;
+    const char *title;
+
+    switch (id) {
+    case SETTINGS_HTML_CSS_URL:             return str_value(out, page->css_url);
+    case SETTINGS_HTML_JS_URL:              return str_value(out, page->js_url);
+    case SETTINGS_HTML_OTA_STATUS:          return str_value(out, page->ota_status);
+    case SETTINGS_HTML_OTA_STATUS_CLASS:
+        return str_value(out, strstr(page->ota_status, "successful") != NULL ? "success" : "error");
+    case SETTINGS_HTML_OTA_STATUS_TEXT:     return str_value(out, page->ota_status);
+
+    // Scalar settings come from the schema, one group per heading
+    case SETTINGS_HTML_GROUPS:              return uint_value(out, SETTING_GROUP_COUNT);
+    case SETTINGS_HTML_GROUP_RULE:          return bool_value(out, index[0] > 0);
+    case SETTINGS_HTML_GROUP_TITLE:         return str_value(out, settings_schema_groups[index[0]].title);
+    case SETTINGS_HTML_GROUP_MESSAGE:       return str_value(out, group_message(page, index[0], &title));
+    case SETTINGS_HTML_GROUP_MESSAGE_TITLE:
+        group_message(page, index[0], &title);
+        return str_value(out, title);
+    case SETTINGS_HTML_FIELDS:
+        return uint_value(out, settings_schema_group_end(index[0]) - settings_schema_groups[index[0]].first);
+    case SETTINGS_HTML_FIELD_CHECKBOX:
+        return bool_value(out, field_at(index[1], index[0])->kind == SETTING_KIND_BOOL);
+    case SETTINGS_HTML_FIELD_INPUT:         return str_value(out, field_input_type(field_at(index[1], index[0])));
+    case SETTINGS_HTML_FIELD_SELECT:        return bool_value(out, field_at(index[1], index[0])->options != NULL);
+    case SETTINGS_HTML_FIELD_KEY:           return str_value(out, field_at(index[1], index[0])->key);
+    case SETTINGS_HTML_FIELD_LABEL:         return str_value(out, field_at(index[1], index[0])->label);
+    case SETTINGS_HTML_FIELD_PLACEHOLDER:   return str_value(out, field_at(index[1], index[0])->placeholder);
+    case SETTINGS_HTML_FIELD_CHECKED: {
+        const setting_def_t *def = field_at(index[1], index[0]);
+        return bool_value(out, setting_get_int(s, def) != 0);
+    }
+    case SETTINGS_HTML_FIELD_SHOWN:
+        return bool_value(out, !(field_at(index[1], index[0])->flags & SETTING_WRITE_ONLY));
+    case SETTINGS_HTML_FIELD_VALUE: {
+        const setting_def_t *def = field_at(index[1], index[0]);
+        return str_value(out, setting_format(s, def, page->scratch, sizeof(page->scratch)));
+    }
+    case SETTINGS_HTML_FIELD_RANGE: {
+        const setting_def_t *def = field_at(index[1], index[0]);
+        const char *input = field_input_type(def);
+        return bool_value(out, input != NULL && strcmp(input, "number") == 0 &&
+                               !(def->min == INT32_MIN && def->max == INT32_MAX));
+    }
+    case SETTINGS_HTML_FIELD_MIN:           return int_value(out, field_at(index[1], index[0])->min);
+    case SETTINGS_HTML_FIELD_MAX:           return int_value(out, field_at(index[1], index[0])->max);
+    case SETTINGS_HTML_FIELD_OPTIONS:       return uint_value(out, options_count(field_at(index[1], index[0])));
+    case SETTINGS_HTML_OPTION_VALUE:
+        return int_value(out, field_at(index[2], index[1])->options[index[0]].form);
+    case SETTINGS_HTML_OPTION_SELECTED: {
+        const setting_def_t *def = field_at(index[2], index[1]);
+        return bool_value(out, def->options[index[0]].value == setting_get_int(s, def));
+    }
+    case SETTINGS_HTML_OPTION_LABEL:
+        return str_value(out, field_at(index[2], index[1])->options[index[0]].label);
+
+    // Devices on the bus first, then saved names of devices that are not
+    case SETTINGS_HTML_DS18B20_DETECTED:    return uint_value(out, page->ds18b20_detected_count);
+    case SETTINGS_HTML_DETECTED_INDEX:      return uint_value(out, index[0]);
+    case SETTINGS_HTML_DETECTED_ADDRESS:
+        snprintf(page->scratch, sizeof(page->scratch), "%016" PRIX64, page->ds18b20_detected[index[0]]);
+        return str_value(out, page->scratch);
+    case SETTINGS_HTML_DETECTED_NAME:
+        return str_value(out, ds18b20_name(s, page->ds18b20_detected[index[0]]));
+    case SETTINGS_HTML_DS18B20_SAVED:       return uint_value(out, ds18b20_saved_count(page));
+    case SETTINGS_HTML_SAVED_INDEX:         return uint_value(out, page->ds18b20_detected_count + index[0]);
+    case SETTINGS_HTML_SAVED_ADDRESS:
+    case SETTINGS_HTML_SAVED_NAME: {
+        const ds18b20_name_t *saved = ds18b20_saved_at(page, index[0]);
+        if (saved == NULL) {
+            return false;
+        }
+        if (id == SETTINGS_HTML_SAVED_NAME) {
+            return str_value(out, saved->name);
+        }
+        snprintf(page->scratch, sizeof(page->scratch), "%016" PRIX64, saved->address);
+        return str_value(out, page->scratch);
+    }
+
+    case SETTINGS_HTML_BTHOME_OBJECTS:      return uint_value(out, bthome_object_count());
+    case SETTINGS_HTML_OBJECT_ID:
+    case SETTINGS_HTML_OBJECT_SELECTED:
+    case SETTINGS_HTML_OBJECT_LABEL: {
+        int object_id = bthome_object_at(page, index[0]);
+        if (object_id < 0) {
+            return false;
+        }
+        if (id == SETTINGS_HTML_OBJECT_ID) {
+            return uint_value(out, object_id);
+        }
+        if (id == SETTINGS_HTML_OBJECT_SELECTED) {
+            return bool_value(out, bthome_object_selected(s, object_id));
+        }
+        const char *unit = bthome_get_object_unit(object_id);
+        if (unit != NULL && unit[0] != '\0') {
+            snprintf(page->scratch, sizeof(page->scratch), "0x%02X - %s (%s)",
+                     object_id, bthome_get_object_name(object_id), unit);
+        } else {
+            snprintf(page->scratch, sizeof(page->scratch), "0x%02X - %s",
+                     object_id, bthome_get_object_name(object_id));
+        }
+        return str_value(out, page->scratch);
+    }
+
+    case SETTINGS_HTML_MAC_FILTERS:         return uint_value(out, s->mac_filters_count);
+    case SETTINGS_HTML_MAC_INDEX:           return uint_value(out, index[0]);
+    case SETTINGS_HTML_MAC_ADDR: {
+        const uint8_t *mac = s->mac_filters[index[0]].mac_addr;
+        snprintf(page->scratch, sizeof(page->scratch), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        return str_value(out, page->scratch);
+    }
+    case SETTINGS_HTML_MAC_NAME:            return str_value(out, s->mac_filters[index[0]].name);
+    case SETTINGS_HTML_MAC_KEY:             return str_value(out, bindkey_hex(page, s->mac_filters[index[0]].mac_addr));
+    case SETTINGS_HTML_MAC_ENABLED:         return bool_value(out, s->mac_filters[index[0]].enabled);
+
+    case SETTINGS_HTML_FIRMWARE_VERSION:    return str_value(out, page->firmware_version);
+    case SETTINGS_HTML_FIRMWARE_HASH:       return str_value(out, page->firmware_hash);
+    }
+    return false;
+}
+
+esp_err_t settings_page_render(settings_page_t *page, tmpl_sink_fn sink, void *sink_arg,
+                               char *scratch, size_t scratch_size) {
+    page->saved_index = 0;
+    page->saved_name = SIZE_MAX;
+    page->object_index = 0;
+    page->object_id = -1;
+    return tmpl_render(&settings_html_tmpl, settings_page_value, page, sink, sink_arg,
+                       scratch, scratch_size);
+}
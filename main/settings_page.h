@@ -0,0 +1,40 @@
+#ifndef SETTINGS_PAGE_H
+#define SETTINGS_PAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "settings.h"
+#include "tmpl.h"
+
+// Everything the settings page shows besides settings_t. The handler fills
+// this in; rendering touches nothing else, so the page can be rendered on the
+// host as well.
+typedef struct {
+    const settings_t *settings;
+    const uint64_t *ds18b20_detected;       // Addresses found on the 1-Wire bus
+    size_t ds18b20_detected_count;
+    const char *ota_status;                 // Messages are shown when not NULL or ""
+    const char *mqtt_error;
+    const char *pump_error;
+    const char *firmware_version;
+    const char *firmware_hash;
+    const char *css_url;
+    const char *js_url;
+
+    // Rendering state
+    size_t saved_index;                     // Position of saved_name in the saved section
+    size_t saved_name;                      // Index into settings->ds18b20_names
+    size_t object_index;                    // Position of object_id in the object list
+    int object_id;
+    char scratch[160];                      // Formatted values
+} settings_page_t;
+
+/**
+ * @brief Render the settings form from main/www/settings.html
+ *
+ * @param scratch Output buffer, see tmpl_render()
+ */
+esp_err_t settings_page_render(settings_page_t *page, tmpl_sink_fn sink, void *sink_arg,
+                               char *scratch, size_t scratch_size);
+
+#endif // SETTINGS_PAGE_H
@@ -0,0 +1,551 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sdkconfig.h"
+#include "IQmathLib.h"
+#include "settings_schema.h"
+#include "http_server.h"
+
+_Static_assert(SETTING_FIELD_COUNT + SETTING_LIST_COUNT <= 64, "change masks are 64 bits");
+
+static const setting_option_t syslog_transport_options[] = {
+    { SYSLOG_TRANSPORT_UDP, 0, "UDP" },
+    { SYSLOG_TRANSPORT_TCP, 1, "TCP" },
+    { SYSLOG_TRANSPORT_TLS, 2, "TLS" },
+    { 0 },
+};
+
+// The form shows the gain factor, settings_t holds the hx711 channel setting
+static const setting_option_t weight_gain_options[] = {
+    { HX711_GAIN_A_128, 128, "128" },
+    { HX711_GAIN_A_64,  64,  "64" },
+    { HX711_GAIN_B_32,  32,  "32" },
+    { 0 },
+};
+
+#define SETTING_DEFAULT_STR(d)  .def_str = (d)
+#define SETTING_DEFAULT_BOOL(d) .def_int = (d)
+#define SETTING_DEFAULT_I8(d)   .def_int = (d)
+#define SETTING_DEFAULT_I16(d)  .def_int = (d)
+#define SETTING_DEFAULT_I32(d)  .def_int = (d)
+#define SETTING_DEFAULT_U8(d)   .def_int = (d)
+#define SETTING_DEFAULT_U16(d)  .def_int = (d)
+#define SETTING_DEFAULT_IQ16(d) .def_int = (d)
+
+#define SETTING_DEF(kind_, field, nvs, min_, max_, def, flags_, options_, label_, placeholder_) \
+    [SETTING_##field] = {                                       \
+        .key = #field,                                          \
+        .nvs_key = (nvs),                                       \
+        .offset = offsetof(settings_t, field),                  \
+        .size = sizeof(((settings_t *)0)->field),               \
+        .kind = SETTING_KIND_##kind_,                           \
+        .flags = (flags_),                                      \
+        .min = (min_),                                          \
+        .max = (max_),                                          \
+        SETTING_DEFAULT_##kind_(def),                           \
+        .options = (options_),                                  \
+        .label = (label_),                                      \
+        .placeholder = (placeholder_),                          \
+    },
+
+const setting_def_t settings_schema[SETTING_FIELD_COUNT] = {
+    SETTINGS_FIELDS(SETTING_DEF)
+};
+
+#define SETTING_LIST_DEF(field, count_field, nvs, type, max_)  \
+    [SETTING_LIST_##field] = {                                  \
+        .key = #field,                                          \
+        .nvs_key = (nvs),                                       \
+        .offset = offsetof(settings_t, field),                  \
+        .count_offset = offsetof(settings_t, count_field),      \
+        .elem_size = sizeof(type),                              \
+        .max = (max_),                                          \
+    },
+
+const setting_list_def_t settings_schema_lists[SETTING_LIST_COUNT] = {
+    SETTINGS_LISTS(SETTING_LIST_DEF)
+};
+
+#define SETTING_GROUP_DEF(id, title_, first_) \
+    [SETTING_GROUP_##id] = { .title = (title_), .first = SETTING_##first_ },
+
+const setting_group_def_t settings_schema_groups[SETTING_GROUP_COUNT] = {
+    SETTINGS_GROUPS(SETTING_GROUP_DEF)
+};
+
+const setting_def_t *settings_schema_find(const char *key) {
+    for (size_t i = 0; i < SETTING_FIELD_COUNT; i++) {
+        if (strcmp(settings_schema[i].key, key) == 0) {
+            return &settings_schema[i];
+        }
+    }
+    return NULL;
+}
+
+int32_t setting_get_int(const settings_t *settings, const setting_def_t *def) {
+    const uint8_t *p = (const uint8_t *)settings + def->offset;
+    switch (def->size) {
+    case 1: {
+        uint8_t v;
+        memcpy(&v, p, 1);
+        return def->kind == SETTING_KIND_I8 ? (int8_t)v : v;
+    }
+    case 2: {
+        uint16_t v;
+        memcpy(&v, p, 2);
+        return def->kind == SETTING_KIND_I16 ? (int16_t)v : v;
+    }
+    default: {
+        int32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+    }
+}
+
+void setting_set_int(settings_t *settings, const setting_def_t *def, int32_t value) {
+    uint8_t *p = (uint8_t *)settings + def->offset;
+    switch (def->size) {
+    case 1: {
+        uint8_t v = (uint8_t)value;
+        memcpy(p, &v, 1);
+        break;
+    }
+    case 2: {
+        uint16_t v = (uint16_t)value;
+        memcpy(p, &v, 2);
+        break;
+    }
+    default:
+        memcpy(p, &value, 4);
+        break;
+    }
+}
+
+char **setting_str(settings_t *settings, const setting_def_t *def) {
+    return (char **)((uint8_t *)settings + def->offset);
+}
+
+const char *setting_get_str(const settings_t *settings, const setting_def_t *def) {
+    const char *s = *(char *const *)((const uint8_t *)settings + def->offset);
+    return s != NULL ? s : "";
+}
+
+static const setting_option_t *option_by_form(const setting_def_t *def, int32_t form) {
+    for (const setting_option_t *o = def->options; o->label != NULL; o++) {
+        if (o->form == form) {
+            return o;
+        }
+    }
+    return NULL;
+}
+
+int32_t setting_default_int(const setting_def_t *def) {
+    if (def->options != NULL) {
+        const setting_option_t *o = option_by_form(def, def->def_int);
+        return o != NULL ? o->value : def->options[0].value;
+    }
+    return def->def_int;
+}
+
+bool setting_check_int(const setting_def_t *def, int32_t *value) {
+    if (def->kind == SETTING_KIND_BOOL) {
+        *value = *value != 0;
+        return true;
+    }
+    if (def->options != NULL) {
+        for (const setting_option_t *o = def->options; o->label != NULL; o++) {
+            if (o->value == *value) {
+                return true;
+            }
+        }
+        const setting_option_t *o = option_by_form(def, *value);
+        if (o != NULL) {
+            *value = o->value;
+            return true;
+        }
+        return false;
+    }
+    return *value >= def->min && *value <= def->max;
+}
+
+const char *setting_format(const settings_t *settings, const setting_def_t *def,
+                           char *buf, size_t size) {
+    if (def->kind == SETTING_KIND_STR) {
+        return setting_get_str(settings, def);
+    }
+    int32_t value = setting_get_int(settings, def);
+    if (def->kind == SETTING_KIND_IQ16) {
+        snprintf(buf, size, "%.8f", _IQ16toF(value));
+        return buf;
+    }
+    if (def->options != NULL) {
+        for (const setting_option_t *o = def->options; o->label != NULL; o++) {
+            if (o->value == value) {
+                value = o->form;
+                break;
+            }
+        }
+    }
+    snprintf(buf, size, "%ld", (long)value);
+    return buf;
+}
+
+void settings_update_init(settings_update_t *update) {
+    memset(update, 0, sizeof(*update));
+}
+
+static bool fail(settings_update_t *update, const char *key) {
+    if (update->error == NULL) {
+        update->error = key;
+    }
+    return false;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Exactly len hex digits into bytes, most significant first
+static bool parse_hex(const char *s, uint8_t *out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        int hi = hex_value(s[i * 2]);
+        int lo = hi < 0 ? -1 : hex_value(s[i * 2 + 1]);
+        if (lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return s[len * 2] == '\0';
+}
+
+// "xx:xx:xx:xx:xx:xx"
+static bool parse_mac(const char *s, uint8_t mac[6]) {
+    if (strlen(s) != 17) {
+        return false;
+    }
+    for (int i = 0; i < 6; i++) {
+        int hi = hex_value(s[i * 3]);
+        int lo = hex_value(s[i * 3 + 1]);
+        if (hi < 0 || lo < 0 || (i < 5 && s[i * 3 + 2] != ':')) {
+            return false;
+        }
+        mac[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
+
+static bool parse_long(const char *s, long long *out) {
+    char *end;
+    *out = strtoll(s, &end, 10);
+    return end != s && *end == '\0';
+}
+
+static bool parse_field(settings_update_t *update, const setting_def_t *def, const char *value) {
+    setting_id_t id = (setting_id_t)(def - settings_schema);
+    int32_t v;
+
+    // Only strings can be cleared, and not all of them
+    if (value[0] == '\0' && (def->kind != SETTING_KIND_STR || (def->flags & SETTING_KEEP_IF_EMPTY))) {
+        return true;
+    }
+
+    switch (def->kind) {
+    case SETTING_KIND_STR:
+        if (strlen(value) > (size_t)def->max) {
+            return fail(update, def->key);
+        }
+        update->value[id].s = value;
+        update->present |= SETTING_BIT(id);
+        return true;
+    case SETTING_KIND_BOOL:
+        v = !(strcmp(value, "0") == 0 || strcmp(value, "false") == 0 || strcmp(value, "off") == 0);
+        break;
+    case SETTING_KIND_IQ16: {
+        char *end;
+        double d = strtod(value, &end);
+        if (end == value || *end != '\0' || !isfinite(d) || d <= -32768.0 || d >= 32768.0) {
+            return fail(update, def->key);
+        }
+        v = _IQ16(d);
+        break;
+    }
+    default: {
+        long long n;
+        if (!parse_long(value, &n) || n < INT32_MIN || n > INT32_MAX) {
+            return fail(update, def->key);
+        }
+        v = (int32_t)n;
+        if (def->options != NULL) {
+            const setting_option_t *o = option_by_form(def, v);
+            if (o == NULL) {
+                return fail(update, def->key);
+            }
+            v = o->value;
+        } else if (v < def->min || v > def->max) {
+            return fail(update, def->key);
+        }
+        break;
+    }
+    }
+    update->value[id].i = v;
+    update->present |= SETTING_BIT(id);
+    return true;
+}
+
+// "[N]" at *p with N < max; *p is left after the bracket
+static bool parse_row(const char **p, size_t max, size_t *row) {
+    const char *s = *p;
+    size_t n = 0;
+    if (*s++ != '[' || *s < '0' || *s > '9') {
+        return false;
+    }
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s++ - '0');
+        if (n >= max) {
+            return false;
+        }
+    }
+    if (*s++ != ']') {
+        return false;
+    }
+    *p = s;
+    *row = n;
+    return true;
+}
+
+static bool parse_list_row(settings_update_t *update, const char *key, const char *value) {
+    const char *p;
+    size_t row;
+
+    if (strncmp(key, "bthome_objects[", 15) == 0) {
+        p = key + 14;
+        long long id;
+        if (!parse_row(&p, SETTINGS_MAX_BTHOME_OBJECTS, &row) || *p != '\0' ||
+            !parse_long(value, &id) || id < 0 || id > 0xFF) {
+            return fail(update, key);
+        }
+        update->bthome_object_ids[row] = (uint8_t)id;
+        update->object_rows[row / 8] |= 1 << (row % 8);
+        return true;
+    }
+
+    if (strncmp(key, "mac_filter[", 11) == 0) {
+        p = key + 10;
+        if (!parse_row(&p, SETTINGS_MAX_MAC_FILTERS, &row)) {
+            return fail(update, key);
+        }
+        mac_filter_t *filter = &update->mac_filters[row];
+        if (strcmp(p, "[mac]") == 0) {
+            // The form submits empty rows too
+            if (value[0] == '\0') {
+                return true;
+            }
+            if (!parse_mac(value, filter->mac_addr)) {
+                return fail(update, key);
+            }
+            update->mac_rows |= 1ULL << row;
+        } else if (strcmp(p, "[name]") == 0) {
+            strncpy(filter->name, value, sizeof(filter->name) - 1);
+        } else if (strcmp(p, "[key]") == 0) {
+            if (value[0] == '\0') {
+                return true;
+            }
+            if (!parse_hex(value, update->bindkeys[row].key, BTHOME_BINDKEY_LEN)) {
+                return fail(update, key);
+            }
+            update->key_rows |= 1ULL << row;
+        } else if (strcmp(p, "[enabled]") == 0) {
+            filter->enabled = true;
+        }
+        return true;
+    }
+
+    if (strncmp(key, "ds18b20_name[", 13) == 0) {
+        p = key + 12;
+        if (!parse_row(&p, SETTINGS_MAX_DS18B20_NAMES, &row)) {
+            return fail(update, key);
+        }
+        ds18b20_name_t *name = &update->ds18b20_names[row];
+        if (strcmp(p, "[address]") == 0) {
+            if (value[0] == '\0') {
+                return true;
+            }
+            uint8_t bytes[8];
+            if (!parse_hex(value, bytes, sizeof(bytes))) {
+                return fail(update, key);
+            }
+            name->address = 0;
+            for (int i = 0; i < 8; i++) {
+                name->address = name->address << 8 | bytes[i];
+            }
+            update->ds18b20_rows |= 1ULL << row;
+        } else if (strcmp(p, "[name]") == 0) {
+            strncpy(name->name, value, sizeof(name->name) - 1);
+        }
+        return true;
+    }
+
+    return true;
+}
+
+bool settings_update_set(settings_update_t *update, const char *key, const char *value) {
+    const setting_def_t *def = settings_schema_find(key);
+    if (def != NULL) {
+        return parse_field(update, def, value);
+    }
+
+    // The form always sends the list counts; a list is replaced only when its
+    // count is present, so requests such as the tare link leave lists alone
+    if (strcmp(key, "bthome_objects_count") == 0) {
+        update->present |= SETTING_LIST_BIT(SETTING_LIST_selected_bthome_object_ids);
+        update->full_form = true;
+        return true;
+    }
+    if (strcmp(key, "mac_filter_count") == 0) {
+        update->present |= SETTING_LIST_BIT(SETTING_LIST_mac_filters) |
+                           SETTING_LIST_BIT(SETTING_LIST_bthome_bindkeys);
+        update->full_form = true;
+        return true;
+    }
+    if (strcmp(key, "ds18b20_name_count") == 0) {
+        update->present |= SETTING_LIST_BIT(SETTING_LIST_ds18b20_names);
+        update->full_form = true;
+        return true;
+    }
+    return parse_list_row(update, key, value);
+}
+
+void settings_update_parse_form(settings_update_t *update, char *body) {
+    char *p = body;
+    while (*p) {
+        char *key = p;
+        char *end = key + strcspn(key, "&");
+        p = *end != '\0' ? end + 1 : end;
+        *end = '\0';
+
+        char *value = strchr(key, '=');
+        if (value != NULL) {
+            *value++ = '\0';
+        } else {
+            value = end;
+        }
+        if (key[0] == '\0') {
+            continue;
+        }
+        http_url_decode(key);
+        http_url_decode(value);
+        settings_update_set(update, key, value);
+    }
+    settings_update_finish(update);
+}
+
+void settings_update_finish(settings_update_t *update) {
+    // Rows keep their submitted order; gaps left by removed rows close up
+    size_t n = 0;
+    for (size_t row = 0; row < SETTINGS_MAX_BTHOME_OBJECTS; row++) {
+        if (update->object_rows[row / 8] & (1 << (row % 8))) {
+            update->bthome_object_ids[n++] = update->bthome_object_ids[row];
+        }
+    }
+    update->bthome_object_ids_count = n;
+
+    n = 0;
+    size_t keys = 0;
+    for (size_t row = 0; row < SETTINGS_MAX_MAC_FILTERS; row++) {
+        if (!(update->mac_rows & (1ULL << row))) {
+            continue;
+        }
+        if (update->key_rows & (1ULL << row)) {
+            memmove(update->bindkeys[keys].key, update->bindkeys[row].key, BTHOME_BINDKEY_LEN);
+            memcpy(update->bindkeys[keys].mac_addr, update->mac_filters[row].mac_addr, 6);
+            keys++;
+        }
+        if (n != row) {
+            update->mac_filters[n] = update->mac_filters[row];
+        }
+        n++;
+    }
+    update->mac_filters_count = n;
+    update->bindkeys_count = keys;
+    // Key bytes of dropped rows should not linger
+    memset(&update->bindkeys[keys], 0, (SETTINGS_MAX_MAC_FILTERS - keys) * sizeof(bthome_bindkey_t));
+
+    n = 0;
+    for (size_t row = 0; row < SETTINGS_MAX_DS18B20_NAMES; row++) {
+        if (update->ds18b20_rows & (1ULL << row)) {
+            if (n != row) {
+                update->ds18b20_names[n] = update->ds18b20_names[row];
+            }
+            n++;
+        }
+    }
+    update->ds18b20_names_count = n;
+
+    // Browsers leave unchecked boxes out of the form
+    if (update->full_form) {
+        for (size_t id = 0; id < SETTING_FIELD_COUNT; id++) {
+            if (settings_schema[id].kind == SETTING_KIND_BOOL && !(update->present & SETTING_BIT(id))) {
+                update->value[id].i = 0;
+                update->present |= SETTING_BIT(id);
+            }
+        }
+    }
+}
+
+const void *settings_update_list(const settings_update_t *update, setting_list_id_t list, size_t *count) {
+    switch (list) {
+    case SETTING_LIST_selected_bthome_object_ids:
+        *count = update->bthome_object_ids_count;
+        return update->bthome_object_ids;
+    case SETTING_LIST_mac_filters:
+        *count = update->mac_filters_count;
+        return update->mac_filters;
+    case SETTING_LIST_bthome_bindkeys:
+        *count = update->bindkeys_count;
+        return update->bindkeys;
+    case SETTING_LIST_ds18b20_names:
+        *count = update->ds18b20_names_count;
+        return update->ds18b20_names;
+    default:
+        *count = 0;
+        return NULL;
+    }
+}
+
+uint64_t settings_update_changes(const settings_update_t *update, const settings_t *settings) {
+    uint64_t changes = 0;
+
+    for (size_t id = 0; id < SETTING_FIELD_COUNT; id++) {
+        if (!(update->present & SETTING_BIT(id))) {
+            continue;
+        }
+        const setting_def_t *def = &settings_schema[id];
+        bool differs = def->kind == SETTING_KIND_STR
+            ? strcmp(setting_get_str(settings, def), update->value[id].s) != 0
+            : setting_get_int(settings, def) != update->value[id].i;
+        if (differs) {
+            changes |= SETTING_BIT(id);
+        }
+    }
+
+    for (size_t list = 0; list < SETTING_LIST_COUNT; list++) {
+        if (!(update->present & SETTING_LIST_BIT(list))) {
+            continue;
+        }
+        const setting_list_def_t *def = &settings_schema_lists[list];
+        size_t count;
+        const void *data = settings_update_list(update, (setting_list_id_t)list, &count);
+        const void *current = *(void *const *)((const uint8_t *)settings + def->offset);
+        size_t current_count = *(const size_t *)((const uint8_t *)settings + def->count_offset);
+        if (count != current_count ||
+            (count > 0 && memcmp(data, current, count * def->elem_size) != 0)) {
+            changes |= SETTING_LIST_BIT(list);
+        }
+    }
+    return changes;
+}
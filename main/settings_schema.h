@@ -0,0 +1,308 @@
+#ifndef SETTINGS_SCHEMA_H
+#define SETTINGS_SCHEMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "settings.h"
+
+// Declarative description of settings_t.
+//
+// Each scalar setting is one row of SETTINGS_FIELDS and each list one row of
+// SETTINGS_LISTS. Loading and saving (settings.c), the form parser
+// (settings_schema.c) and the settings page (settings_page.c) all work from
+// these tables, so a new setting is a settings_t member plus one row here.
+//
+// SETTINGS_FIELDS rows:
+//   X(kind, field, nvs_key, min, max, default, flags, options, label, placeholder)
+//
+//   kind         NVS type: STR, BOOL, I8, I16, I32, U8, U16, or IQ16 for an
+//                _iq16 stored as i32 and edited as a decimal
+//   field        settings_t member, also the form field name
+//   min, max     accepted range; for STR, max is the longest accepted value
+//   default      used when NVS has no value; the form value if there are options
+//   options      NULL or a setting_option_t list ending in a NULL label; the
+//                page shows a select and the form submits option.form
+//   label        page label, trusted HTML
+//   placeholder  NULL or the input's placeholder
+//
+// Rows are listed by page section; SETTINGS_GROUPS names the first field of
+// each section.
+
+#define SETTINGS_GROUPS(G) \
+    G(GENERAL, "General Configuration",             password) \
+    G(WIFI,    "Wifi Configuration",                wifi_ssid) \
+    G(SYSLOG,  "Syslog Configuration",              syslog_server) \
+    G(MQTT,    "MQTT Configuration",                mqtt_broker_url) \
+    G(WEIGHT,  "Weight Configuration",              weight_tare) \
+    G(PUMP,    "Pump Configuration",                pump_scl_gpio) \
+    G(DS18B20, "DS18B20 Thermometer Configuration", ds18b20_gpio)
+
+#define SETTINGS_FIELDS(X) \
+    X(STR,  password,                 "password",       0,   255,   CONFIG_HTTPD_BASIC_AUTH_PASSWORD, \
+      SETTING_SECRET | SETTING_WRITE_ONLY | SETTING_KEEP_IF_EMPTY, NULL, \
+      "Password:", "Leave blank to keep current") \
+    X(STR,  hostname,                 "hostname",       0,   63,    CONFIG_ESP_WIFI_HOSTNAME, \
+      SETTING_KEEP_IF_EMPTY | SETTING_RESTART, NULL, "Hostname:", NULL) \
+    X(STR,  update_url,               "update_url",     0,   255,   CONFIG_OTA_FIRMWARE_UPGRADE_URL, \
+      SETTING_KEEP_IF_EMPTY, NULL, "Update URL:", NULL) \
+    X(STR,  timezone,                 "timezone",       0,   63,    "UTC0", \
+      SETTING_KEEP_IF_EMPTY, NULL, "Timezone (e.g., EST5EDT,M3.2.0,M11.1.0):", "UTC0") \
+    X(BOOL, temp_use_fahrenheit,      "temp_use_f",     0,   1,     false, \
+      SETTING_RESTART, NULL, "Display Temperatures in Fahrenheit (&deg;F)", NULL) \
+    X(STR,  wifi_ssid,                "wifi_ssid",      0,   32,    CONFIG_ESP_WIFI_SSID, \
+      SETTING_KEEP_IF_EMPTY | SETTING_RESTART, NULL, "Wifi SSID:", NULL) \
+    X(STR,  wifi_password,            "wifi_password",  0,   64,    CONFIG_ESP_WIFI_PASSWORD, \
+      SETTING_SECRET | SETTING_WRITE_ONLY | SETTING_KEEP_IF_EMPTY | SETTING_RESTART, NULL, \
+      "Wifi Password:", "Leave blank to keep current") \
+    X(BOOL, wifi_ap_fallback_disable, "wifi_ap_fb_dis", 0,   1,     SETTINGS_AP_FALLBACK_DISABLE_DEFAULT, \
+      0, NULL, "Disable WiFi AP Fallback", NULL) \
+    X(STR,  syslog_server,            "syslog_server",  0,   255,   "", \
+      SETTING_RECONFIGURE, NULL, "Syslog Server (hostname or IP):", "syslog.example.com") \
+    X(U16,  syslog_port,              "syslog_port",    1,   65535, 514, \
+      SETTING_RECONFIGURE, NULL, "Syslog Port:", NULL) \
+    X(U8,   syslog_transport,         "syslog_transp",  0,   2,     SYSLOG_TRANSPORT_UDP, \
+      SETTING_RECONFIGURE, syslog_transport_options, "Syslog Transport:", NULL) \
+    X(STR,  mqtt_broker_url,          "mqtt_broker",    0,   255,   "", \
+      SETTING_RECONFIGURE, NULL, "MQTT Broker URL:", "mqtt://broker.example.com") \
+    X(STR,  mqtt_username,            "mqtt_user",      0,   255,   "", \
+      SETTING_RECONFIGURE, NULL, "MQTT Username (optional):", NULL) \
+    X(STR,  mqtt_password,            "mqtt_pass",      0,   255,   "", \
+      SETTING_SECRET | SETTING_RECONFIGURE, NULL, "MQTT Password (optional):", NULL) \
+    X(STR,  mqtt_topic,               "mqtt_topic",     0,   255,   "station/sensor", \
+      SETTING_KEEP_IF_EMPTY | SETTING_RECONFIGURE, NULL, "MQTT Sensor Topic:", "station/sensor") \
+    X(STR,  mqtt_status_topic,        "mqtt_stat_topic", 0,  255,   "station/status", \
+      SETTING_KEEP_IF_EMPTY | SETTING_RECONFIGURE, NULL, "MQTT Status Topic:", "station/status") \
+    X(I32,  weight_tare,              "weight_tare",    INT32_MIN, INT32_MAX, CONFIG_WEIGHT_TARE, \
+      0, NULL, "Weight Tare:", NULL) \
+    X(IQ16, weight_scale,             "weight_scale",   INT32_MIN, INT32_MAX, CONFIG_WEIGHT_SCALE, \
+      0, NULL, "Weight Scale:", NULL) \
+    X(I32,  weight_gain,              "weight_gain",    0,   0,     CONFIG_WEIGHT_GAIN, \
+      0, weight_gain_options, "Weight Gain:", NULL) \
+    X(I8,   weight_dt_gpio,           "weight_dt_gpio", -1,  39,    -1, \
+      SETTING_RECONFIGURE, NULL, "Weight (HX711) DOUT GPIO Pin (-1 = disabled, suggested: 32):", NULL) \
+    X(I8,   weight_sck_gpio,          "weight_sck_gpio", -1, 39,    -1, \
+      SETTING_RECONFIGURE, NULL, "Weight (HX711) SCK GPIO Pin (-1 = disabled, suggested: 26):", NULL) \
+    X(I8,   pump_scl_gpio,            "pump_scl_gpio",  -1,  39,    -1, \
+      SETTING_RECONFIGURE, NULL, "Pump I2C SCL GPIO Pin (-1 = disabled):", NULL) \
+    X(I8,   pump_sda_gpio,            "pump_sda_gpio",  -1,  39,    -1, \
+      SETTING_RECONFIGURE, NULL, "Pump I2C SDA GPIO Pin (-1 = disabled):", NULL) \
+    X(I8,   pump_i2c_addr,            "pump_i2c_addr",  0,   127,   0x37, \
+      SETTING_RECONFIGURE, NULL, "Pump I2C Device Address:", NULL) \
+    X(I16,  pump_dispense_ml,         "pump_disp_ml",   1,   1000,  CONFIG_PUMP_DEFAULT_DISPENSE_ML, \
+      0, NULL, "Pump Dispense Amount (ml, 1-1000):", NULL) \
+    X(I8,   ds18b20_gpio,             "ds18b20_gpio",   -1,  39,    -1, \
+      SETTING_RECONFIGURE, NULL, "DS18B20 Temperature Sensor GPIO Pin (-1 = disabled):", NULL) \
+    X(I8,   ds18b20_pwr_gpio,         "ds18b20_pwr",    -1,  39,    -1, \
+      SETTING_RECONFIGURE, NULL, "DS18B20 Power GPIO Pin (-1 = disabled):", NULL)
+
+// Lists are stored as one blob each, erased when empty.
+//   L(field, count_field, nvs_key, element type, max elements)
+#define SETTINGS_LISTS(L) \
+    L(selected_bthome_object_ids, selected_bthome_object_ids_count, "bthome_obj_ids", uint8_t, 256) \
+    L(mac_filters,                mac_filters_count,                "mac_filters",    mac_filter_t, 64) \
+    L(bthome_bindkeys,            bthome_bindkeys_count,            "bthome_keys",    bthome_bindkey_t, 64) \
+    L(ds18b20_names,              ds18b20_names_count,              "ds18b20_names",  ds18b20_name_t, 64)
+
+#ifdef CONFIG_ESP_WIFI_AP_FALLBACK_DISABLE
+#define SETTINGS_AP_FALLBACK_DISABLE_DEFAULT true
+#else
+#define SETTINGS_AP_FALLBACK_DISABLE_DEFAULT false
+#endif
+
+typedef enum {
+    SETTING_KIND_STR,
+    SETTING_KIND_BOOL,
+    SETTING_KIND_I8,
+    SETTING_KIND_I16,
+    SETTING_KIND_I32,
+    SETTING_KIND_U8,
+    SETTING_KIND_U16,
+    SETTING_KIND_IQ16,
+} setting_kind_t;
+
+enum {
+    SETTING_SECRET        = 1 << 0,     // Password input, never logged
+    SETTING_WRITE_ONLY    = 1 << 1,     // Not shown on the page
+    SETTING_KEEP_IF_EMPTY = 1 << 2,     // An empty form value leaves the setting alone
+    SETTING_RESTART       = 1 << 3,     // Takes effect after a restart
+    SETTING_RECONFIGURE   = 1 << 4,     // Takes effect when its group's subsystem is restarted
+};
+
+typedef struct {
+    int32_t value;                      // As stored in settings_t and NVS
+    int32_t form;                       // As submitted by the form
+    const char *label;
+} setting_option_t;
+
+typedef enum {
+#define SETTING_ID(kind, field, ...) SETTING_##field,
+    SETTINGS_FIELDS(SETTING_ID)
+#undef SETTING_ID
+    SETTING_FIELD_COUNT
+} setting_id_t;
+
+typedef enum {
+#define SETTING_LIST_ID(field, ...) SETTING_LIST_##field,
+    SETTINGS_LISTS(SETTING_LIST_ID)
+#undef SETTING_LIST_ID
+    SETTING_LIST_COUNT
+} setting_list_id_t;
+
+typedef enum {
+#define SETTING_GROUP_ID(id, title, first) SETTING_GROUP_##id,
+    SETTINGS_GROUPS(SETTING_GROUP_ID)
+#undef SETTING_GROUP_ID
+    SETTING_GROUP_COUNT
+} setting_group_t;
+
+// Fields and lists share one change mask
+#define SETTING_BIT(id)         (1ULL << (id))
+#define SETTING_LIST_BIT(id)    (1ULL << (SETTING_FIELD_COUNT + (id)))
+
+typedef struct {
+    const char *key;                    // settings_t member and form field name
+    const char *nvs_key;
+    uint16_t offset;                    // Of the member in settings_t
+    uint8_t size;                       // Of the member
+    uint8_t kind;                       // setting_kind_t
+    uint8_t flags;
+    int32_t min;
+    int32_t max;
+    int32_t def_int;
+    const char *def_str;
+    const setting_option_t *options;
+    const char *label;
+    const char *placeholder;
+} setting_def_t;
+
+typedef struct {
+    const char *key;
+    const char *nvs_key;
+    uint16_t offset;                    // Of the array pointer in settings_t
+    uint16_t count_offset;              // Of its size_t element count
+    uint16_t elem_size;
+    uint16_t max;
+} setting_list_def_t;
+
+typedef struct {
+    const char *title;
+    setting_id_t first;
+} setting_group_def_t;
+
+extern const setting_def_t settings_schema[SETTING_FIELD_COUNT];
+extern const setting_list_def_t settings_schema_lists[SETTING_LIST_COUNT];
+extern const setting_group_def_t settings_schema_groups[SETTING_GROUP_COUNT];
+
+// One past the last field of group
+static inline setting_id_t settings_schema_group_end(setting_group_t group) {
+    return group + 1 < SETTING_GROUP_COUNT ? settings_schema_groups[group + 1].first : SETTING_FIELD_COUNT;
+}
+
+#define SETTINGS_MAX_MAC_FILTERS    64
+#define SETTINGS_MAX_DS18B20_NAMES  64
+#define SETTINGS_MAX_BTHOME_OBJECTS 256
+
+// Values parsed from a request, checked against the schema but not yet applied
+typedef struct {
+    uint64_t present;                   // SETTING_BIT()/SETTING_LIST_BIT() of what was submitted
+    union {
+        int32_t i;
+        const char *s;                  // Points into the parsed request
+    } value[SETTING_FIELD_COUNT];
+    const char *error;                  // Key of the first invalid value, NULL if none
+    bool full_form;                     // The whole settings form was submitted
+
+    uint8_t bthome_object_ids[SETTINGS_MAX_BTHOME_OBJECTS];
+    size_t bthome_object_ids_count;
+    mac_filter_t mac_filters[SETTINGS_MAX_MAC_FILTERS];
+    size_t mac_filters_count;
+    bthome_bindkey_t bindkeys[SETTINGS_MAX_MAC_FILTERS];
+    size_t bindkeys_count;
+    ds18b20_name_t ds18b20_names[SETTINGS_MAX_DS18B20_NAMES];
+    size_t ds18b20_names_count;
+
+    // Form rows by submitted index, compacted by settings_update_finish()
+    uint8_t object_rows[SETTINGS_MAX_BTHOME_OBJECTS / 8];
+    uint64_t mac_rows;                  // Rows with a valid MAC
+    uint64_t key_rows;                  // Rows with a bindkey
+    uint64_t ds18b20_rows;              // Rows with a valid address
+} settings_update_t;
+
+/**
+ * @brief Find a field by form key
+ *
+ * @return NULL if key is not a setting
+ */
+const setting_def_t *settings_schema_find(const char *key);
+
+int32_t setting_get_int(const settings_t *settings, const setting_def_t *def);
+void setting_set_int(settings_t *settings, const setting_def_t *def, int32_t value);
+char **setting_str(settings_t *settings, const setting_def_t *def);
+const char *setting_get_str(const settings_t *settings, const setting_def_t *def);
+
+/**
+ * @brief Default value of an integer field, mapped through its options
+ */
+int32_t setting_default_int(const setting_def_t *def);
+
+/**
+ * @brief Check a stored integer against the field's options or range
+ *
+ * Option fields also accept the option's form value, which older firmware
+ * stored by mistake.
+ *
+ * @return true with *value normalised, false if it is out of range
+ */
+bool setting_check_int(const setting_def_t *def, int32_t *value);
+
+/**
+ * @brief Format a field's current value as the form shows it
+ *
+ * @return The string itself for STR fields, otherwise buf
+ */
+const char *setting_format(const settings_t *settings, const setting_def_t *def,
+                           char *buf, size_t size);
+
+void settings_update_init(settings_update_t *update);
+
+/**
+ * @brief Parse one submitted key/value pair into update
+ *
+ * Scalar keys are the field names; list rows use the form's keys
+ * (bthome_objects[N], mac_filter[N][mac|name|key|enabled],
+ * ds18b20_name[N][address|name]) and the *_count keys mark a full form
+ * submission. Unknown keys are ignored. value must outlive update.
+ *
+ * @return false if the value is invalid; the first such key is kept in
+ *         update->error
+ */
+bool settings_update_set(settings_update_t *update, const char *key, const char *value);
+
+/**
+ * @brief Parse an application/x-www-form-urlencoded body or query string
+ *
+ * Walks body once, URL-decoding it in place, and finishes the update.
+ * update->error and the string values point into body.
+ */
+void settings_update_parse_form(settings_update_t *update, char *body);
+
+/**
+ * @brief Compact the submitted list rows. Checkboxes missing from a full form
+ *        submission are unchecked.
+ */
+void settings_update_finish(settings_update_t *update);
+
+/**
+ * @brief The submitted elements of a list
+ */
+const void *settings_update_list(const settings_update_t *update, setting_list_id_t list, size_t *count);
+
+/**
+ * @brief Compare a finished update with the current settings
+ *
+ * @return SETTING_BIT()/SETTING_LIST_BIT() of every value that differs
+ */
+uint64_t settings_update_changes(const settings_update_t *update, const settings_t *settings);
+
+#endif // SETTINGS_SCHEMA_H
@@ -1,40 +1,76 @@
 #include <string.h>
+#include <sys/time.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "esp_crt_bundle.h"
 #include "syslog.h"
+#include "log_ring.h"
 #include "settings.h"
-#include "metrics.h"
+#include "task_config.h"
+#include "alloc_prof.h"
 
 static const char *TAG = "syslog";
 
-// Syslog message queue
-#define SYSLOG_QUEUE_SIZE 10
-#define SYSLOG_MAX_MSG_LEN 1024
+// Longest line forwarded; longer ones are truncated
+#define SYSLOG_MAX_MSG_LEN 512
+// Room for the RFC 5424 header in front of a line
+#define SYSLOG_HEADER_LEN 192
+// "NNNNN " in front of each message with octet counting
+#define OCTET_PREFIX_MAX 6
 
-typedef struct {
-    char message[SYSLOG_MAX_MSG_LEN];
-    int priority;
-} syslog_msg_t;
+#define BATCH_DELAY_US          ((int64_t)CONFIG_SYSLOG_BATCH_DELAY_MS * 1000)
+#define DNS_TTL_US              ((int64_t)CONFIG_SYSLOG_DNS_TTL_S * 1000000)
+#define DNS_RETRY_US            (30 * 1000000LL)    // Keep a stale address this long after a failed lookup
+#define CONNECT_BACKOFF_MIN_US  (1000000LL)
+#define CONNECT_BACKOFF_MAX_US  (60 * 1000000LL)
 
-static QueueHandle_t syslog_queue = NULL;
+static log_ring_t syslog_ring;
 static TaskHandle_t syslog_task_handle = NULL;
-static settings_t *g_settings = NULL;
+static bool syslog_enabled = false;
+static bool syslog_initialized = false;
+// Set to ask the task to exit; it gives syslog_stopped on the way out
+static volatile bool syslog_stop_requested = false;
+static SemaphoreHandle_t syslog_stopped = NULL;
+
+// Server settings are copied at init, and again by syslog_reconfigure, so the
+// task never reads settings_t while it is being saved
+static syslog_transport_t transport = SYSLOG_TRANSPORT_UDP;
+static char *server_name = NULL;
+static uint16_t server_port = 0;
+static char *syslog_hostname = NULL;
+
+// Transport state, owned by syslog_task
 static int syslog_sock = -1;
+static esp_tls_t *syslog_tls = NULL;
 static struct sockaddr_in syslog_addr;
-static bool syslog_enabled = false;
+static bool connected = false;
+static int64_t next_connect_us = 0;
+static int64_t connect_backoff_us = CONNECT_BACKOFF_MIN_US;
 
-static syslog_msg_t send_msg;
-// These are heap allocated in syslog_task
-static syslog_msg_t *recv_msg = NULL;
-static char *syslog_packet = NULL;
+// Resolved server address
+static struct in_addr dns_addr;
+static bool dns_valid = false;
+static int64_t dns_expires_us = 0;
+
+// Messages waiting to be written, framed for the transport.
+// Heap allocated in syslog_init.
+static char *batch = NULL;
+static size_t batch_len = 0;
+static uint32_t batch_messages = 0;
+static int64_t batch_started_us = 0;
+static uint32_t sequence_id = 0;
+
+static syslog_stats_t tx_stats;
 
 
 // Syslog facility and severity constants
@@ -48,127 +84,408 @@ static char *syslog_packet = NULL;
 #define SYSLOG_SEVERITY_ALERT 1
 #define SYSLOG_SEVERITY_EMERGENCY 0
 
-// Custom log handler for ESP-IDF logging system
-static vprintf_like_t original_vprintf = NULL;
-static SemaphoreHandle_t vprintf_mutex = NULL;
+// Called by log_control from whichever task logs. Lines are formatted
+// straight into the ring; nothing here blocks or takes a lock.
+void syslog_write(const char *fmt, va_list args) {
+    if (!syslog_enabled || !fmt) {
+        return;
+    }
 
-static int custom_vprintf(const char *fmt, va_list args) {
-    // Take mutex with timeout to prevent deadlocks
-    if (vprintf_mutex && xSemaphoreTake(vprintf_mutex, pdMS_TO_TICKS(10)) != pdTRUE) {
-        // If we can't get the mutex, just return to avoid blocking
-        return 0;
+    log_ring_reservation_t res;
+    char *line = log_ring_reserve(&syslog_ring, SYSLOG_MAX_MSG_LEN, &res);
+    if (line == NULL) {
+        return;
     }
-    
-    // First, call the original vprintf to maintain console output
-    int ret = 0;
-    if (original_vprintf) {
-        va_list args_copy;
-        va_copy(args_copy, args);
-        ret = original_vprintf(fmt, args_copy);
-        va_end(args_copy);
-    }
-
-    // If syslog is enabled and we have a valid queue, send to syslog
-    if (syslog_enabled && syslog_queue && fmt) {
-        // Allocate message on heap
-        
-        // Format the message
-        vsnprintf(send_msg.message, SYSLOG_MAX_MSG_LEN, fmt, args);
-        
-        // Parse log level from ESP-IDF log format
-        // ESP-IDF logs typically start with a level indicator like "E (123) TAG: message"
-        int severity = SYSLOG_SEVERITY_INFO;
-        if (send_msg.message[0] == 'E' && send_msg.message[1] == ' ') {
-            severity = SYSLOG_SEVERITY_ERROR;
-        } else if (send_msg.message[0] == 'W' && send_msg.message[1] == ' ') {
-            severity = SYSLOG_SEVERITY_WARNING;
-        } else if (send_msg.message[0] == 'I' && send_msg.message[1] == ' ') {
-            severity = SYSLOG_SEVERITY_INFO;
-        } else if (send_msg.message[0] == 'D' && send_msg.message[1] == ' ') {
-            severity = SYSLOG_SEVERITY_DEBUG;
-        } else if (send_msg.message[0] == 'V' && send_msg.message[1] == ' ') {
-            severity = SYSLOG_SEVERITY_DEBUG;
+    int len = vsnprintf(line, SYSLOG_MAX_MSG_LEN, fmt, args);
+    if (len < 0) {
+        len = 0;
+        line[0] = '\0';
+    } else if (len >= SYSLOG_MAX_MSG_LEN) {
+        len = SYSLOG_MAX_MSG_LEN - 1;
+    }
+    // Keep the terminator so the consumer can use the record as a string
+    log_ring_commit(&syslog_ring, &res, len + 1, 0);
+}
+
+// A log line split into its ESP-IDF parts: "E (123) TAG: message"
+typedef struct {
+    int severity;
+    bool has_uptime;
+    uint32_t uptime_ms;         // Log timestamp, ms since boot
+    const char *tag;            // NULL if the line is not in ESP-IDF format
+    size_t tag_len;
+    const char *msg;
+    size_t msg_len;
+    const char *text;           // The whole line without its newline
+    size_t text_len;
+} log_line_t;
+
+static void parse_line(const char *line, size_t len, log_line_t *out) {
+    // Drop the trailing newline
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        len--;
+    }
+
+    out->severity = SYSLOG_SEVERITY_INFO;
+    out->has_uptime = false;
+    out->uptime_ms = 0;
+    out->tag = NULL;
+    out->tag_len = 0;
+    out->msg = line;
+    out->msg_len = len;
+    out->text = line;
+    out->text_len = len;
+
+    if (len < 2 || line[1] != ' ') {
+        return;
+    }
+    switch (line[0]) {
+        case 'E': out->severity = SYSLOG_SEVERITY_ERROR; break;
+        case 'W': out->severity = SYSLOG_SEVERITY_WARNING; break;
+        case 'I': out->severity = SYSLOG_SEVERITY_INFO; break;
+        case 'D':
+        case 'V': out->severity = SYSLOG_SEVERITY_DEBUG; break;
+        default: return;
+    }
+
+    const char *p = line + 2;
+    const char *end = line + len;
+    if (p < end && *p == '(') {
+        uint32_t ms = 0;
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            ms = ms * 10 + (*p - '0');
+            p++;
+        }
+        if (p + 1 < end && p[0] == ')' && p[1] == ' ') {
+            out->has_uptime = true;
+            out->uptime_ms = ms;
+            p += 2;
         }
-        send_msg.priority = (SYSLOG_FACILITY_USER << 3) | severity;
-        
-        // Try to send to queue (non-blocking to avoid deadlocks)
-        xQueueSend(syslog_queue, &send_msg, 0);
     }
 
-    if (vprintf_mutex) {
-        xSemaphoreGive(vprintf_mutex);
+    const char *colon = memchr(p, ':', end - p);
+    if (colon != NULL && colon > p && colon + 1 < end && colon[1] == ' ') {
+        out->tag = p;
+        out->tag_len = colon - p;
+        p = colon + 2;
     }
-    
-    return ret;
+    out->msg = p;
+    out->msg_len = end - p;
 }
 
-static void syslog_task(void *pvParameters) {
-    while (1) {
-        // Wait for messages from the queue
-        if (xQueueReceive(syslog_queue, recv_msg, portMAX_DELAY) == pdTRUE) {
-            // Check if syslog is still enabled and configured
-            if (!syslog_enabled || !g_settings || !g_settings->syslog_server || 
-                strlen(g_settings->syslog_server) == 0) {
-                continue;
+// Format one message in place. Returns the length it needed, like snprintf.
+static int format_message(char *out, size_t cap, const log_line_t *line, const char *hostname) {
+    int priority = (SYSLOG_FACILITY_USER << 3) | line->severity;
+#if CONFIG_SYSLOG_RFC5424
+    // <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID MSGID [SD] MSG
+    char timestamp[32] = "-";
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    if (now.tv_sec > 1600000000) {     // Clock has been set by SNTP
+        // Date the message from its log timestamp rather than from when it is sent
+        int64_t when_ms = (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+        if (line->has_uptime) {
+            int64_t age_ms = esp_log_timestamp() - line->uptime_ms;
+            if (age_ms > 0) {
+                when_ms -= age_ms;
+            }
+        }
+        time_t when_s = when_ms / 1000;
+        struct tm tm;
+        gmtime_r(&when_s, &tm);
+        snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+                 tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                 tm.tm_hour, tm.tm_min, tm.tm_sec, (int)(when_ms % 1000));
+    }
+
+    // APP-NAME is at most 48 printable characters without spaces
+    char app_name[49] = "-";
+    if (line->tag != NULL) {
+        size_t n = line->tag_len < sizeof(app_name) - 1 ? line->tag_len : sizeof(app_name) - 1;
+        for (size_t i = 0; i < n; i++) {
+            char c = line->tag[i];
+            app_name[i] = (c > ' ' && c < 0x7f) ? c : '_';
+        }
+        app_name[n] = '\0';
+    }
+
+    // sysUpTime is in hundredths of a second
+    if (++sequence_id > 2147483647) {
+        sequence_id = 1;
+    }
+    uint32_t uptime_cs = (line->has_uptime ? line->uptime_ms : esp_log_timestamp()) / 10;
+    return snprintf(out, cap, "<%d>1 %s %s %s - - [meta sequenceId=\"%lu\" sysUpTime=\"%lu\"] %.*s",
+                    priority, timestamp, hostname, app_name,
+                    (unsigned long)sequence_id, (unsigned long)uptime_cs,
+                    (int)line->msg_len, line->msg);
+#else
+    // <priority>hostname line
+    return snprintf(out, cap, "<%d>%s %.*s", priority, hostname, (int)line->text_len, line->text);
+#endif
+}
+
+// Resolve the server, caching the answer for CONFIG_SYSLOG_DNS_TTL_S.
+// lwIP does not report record TTLs, so the cache lifetime is fixed.
+static bool resolve_server(int64_t now_us, struct in_addr *addr) {
+    if (dns_valid && now_us < dns_expires_us) {
+        *addr = dns_addr;
+        return true;
+    }
+
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+    };
+    struct addrinfo *res = NULL;
+    tx_stats.dns_lookups++;
+    if (getaddrinfo(server_name, NULL, &hints, &res) != 0 || res == NULL) {
+        if (!dns_valid) {
+            return false;
+        }
+        // Keep using the last answer for a while
+        dns_expires_us = now_us + DNS_RETRY_US;
+        *addr = dns_addr;
+        return true;
+    }
+    dns_addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+    dns_valid = true;
+    dns_expires_us = now_us + DNS_TTL_US;
+    *addr = dns_addr;
+    return true;
+}
+
+static void transport_close(void) {
+    if (syslog_tls != NULL) {
+        esp_tls_conn_destroy(syslog_tls);
+        syslog_tls = NULL;
+    }
+    if (syslog_sock >= 0) {
+        close(syslog_sock);
+        syslog_sock = -1;
+    }
+    connected = false;
+}
+
+static void transport_failed(int64_t now_us) {
+    transport_close();
+    next_connect_us = now_us + connect_backoff_us;
+    connect_backoff_us *= 2;
+    if (connect_backoff_us > CONNECT_BACKOFF_MAX_US) {
+        connect_backoff_us = CONNECT_BACKOFF_MAX_US;
+    }
+}
+
+static bool transport_connect(int64_t now_us) {
+    if (now_us < next_connect_us) {
+        return false;
+    }
+
+    struct in_addr addr;
+    if (!resolve_server(now_us, &addr)) {
+        transport_failed(now_us);
+        return false;
+    }
+    memset(&syslog_addr, 0, sizeof(syslog_addr));
+    syslog_addr.sin_family = AF_INET;
+    syslog_addr.sin_port = htons(server_port);
+    syslog_addr.sin_addr = addr;
+
+    switch (transport) {
+        case SYSLOG_TRANSPORT_UDP:
+            syslog_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+            if (syslog_sock < 0) {
+                transport_failed(now_us);
+                return false;
             }
-            
-            // Check if we need to create/recreate socket
+            break;
+        case SYSLOG_TRANSPORT_TCP: {
+            syslog_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
             if (syslog_sock < 0) {
-                syslog_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-                if (syslog_sock < 0) {
-                    // ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
-                    vTaskDelay(pdMS_TO_TICKS(1000));
-                    continue;
-                }
-                
-                // Resolve hostname
-                struct hostent *he = gethostbyname(g_settings->syslog_server);
-                if (he == NULL) {
-                    // ESP_LOGE(TAG, "Failed to resolve hostname: %s", g_settings->syslog_server);
-                    close(syslog_sock);
-                    syslog_sock = -1;
-
-                    vTaskDelay(pdMS_TO_TICKS(5000));
-                    continue;
-                }
-                
-                memset(&syslog_addr, 0, sizeof(syslog_addr));
-                syslog_addr.sin_family = AF_INET;
-                syslog_addr.sin_port = htons(g_settings->syslog_port);
-                memcpy(&syslog_addr.sin_addr, he->h_addr_list[0], he->h_length);
+                transport_failed(now_us);
+                return false;
             }
-            
-            // Get hostname for syslog message
-            const char *hostname = g_settings->hostname ? g_settings->hostname : "esp32";
-            
-            // Format syslog message according to RFC 3164
-            // <priority>timestamp hostname tag: message
-            snprintf(syslog_packet, SYSLOG_MAX_MSG_LEN + 100,
-                    "<%d>%s %s",
-                    recv_msg->priority,
-                    hostname,
-                    recv_msg->message);
-            
-            // Send UDP packet
-            int sent = sendto(syslog_sock, syslog_packet, strlen(syslog_packet), 0,
-                            (struct sockaddr *)&syslog_addr, sizeof(syslog_addr));
-            
-            if (sent < 0) {
-                // ESP_LOGE(TAG, "Failed to send syslog message: errno %d", errno);
-                // Close socket to force reconnection on next message
-                close(syslog_sock);
-                syslog_sock = -1;
+            struct timeval timeout = { .tv_sec = 5 };
+            setsockopt(syslog_sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            if (connect(syslog_sock, (struct sockaddr *)&syslog_addr, sizeof(syslog_addr)) != 0) {
+                transport_failed(now_us);
+                return false;
             }
+            break;
+        }
+        case SYSLOG_TRANSPORT_TLS: {
+            // Connect to the cached address; the certificate is still checked
+            // against the configured name
+            char ip[INET_ADDRSTRLEN];
+            inet_ntoa_r(addr, ip, sizeof(ip));
+            esp_tls_cfg_t cfg = {
+                .crt_bundle_attach = esp_crt_bundle_attach,
+                .common_name = server_name,
+                .timeout_ms = 5000,
+            };
+            syslog_tls = esp_tls_init();
+            if (syslog_tls == NULL ||
+                esp_tls_conn_new_sync(ip, strlen(ip), server_port, &cfg, syslog_tls) != 1) {
+                transport_failed(now_us);
+                return false;
+            }
+            break;
         }
     }
+
+    tx_stats.connects++;
+    connected = true;
+    connect_backoff_us = CONNECT_BACKOFF_MIN_US;
+    return true;
+}
+
+static bool transport_write(const char *data, size_t len) {
+    if (transport == SYSLOG_TRANSPORT_UDP) {
+        // A failed datagram says nothing about the next one; keep the socket
+        return sendto(syslog_sock, data, len, 0,
+                      (struct sockaddr *)&syslog_addr, sizeof(syslog_addr)) == (int)len;
+    }
+
+    while (len > 0) {
+        ssize_t sent = (transport == SYSLOG_TRANSPORT_TLS)
+            ? esp_tls_conn_write(syslog_tls, data, len)
+            : send(syslog_sock, data, len, 0);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+static void flush_batch(void) {
+    if (batch_len == 0) {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    if (connected && dns_valid && now_us >= dns_expires_us) {
+        // Follow the server if its address changed
+        struct in_addr addr;
+        if (resolve_server(now_us, &addr) && addr.s_addr != syslog_addr.sin_addr.s_addr) {
+            transport_close();
+        }
+    }
+
+    if (connected || transport_connect(now_us)) {
+        if (transport_write(batch, batch_len)) {
+            tx_stats.writes++;
+            tx_stats.bytes += batch_len;
+            tx_stats.messages += batch_messages;
+        } else {
+            tx_stats.send_errors++;
+            tx_stats.messages_dropped += batch_messages;
+            if (transport != SYSLOG_TRANSPORT_UDP) {
+                transport_failed(now_us);
+            }
+        }
+    } else {
+        tx_stats.messages_dropped += batch_messages;
+    }
+
+    batch_len = 0;
+    batch_messages = 0;
+}
+
+// Frame one log line onto the batch, sending the batch first if it is full
+static void queue_line(const char *text, size_t len) {
+    log_line_t line;
+    parse_line(text, len, &line);
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        // UDP messages in one datagram are separated by newlines; stream
+        // transports prefix each with its length (RFC 6587 octet counting)
+        size_t prefix = (transport == SYSLOG_TRANSPORT_UDP) ? (batch_len > 0) : OCTET_PREFIX_MAX;
+        size_t room = CONFIG_SYSLOG_BATCH_SIZE - batch_len;
+        if (room <= prefix + 1) {
+            flush_batch();
+            continue;
+        }
+        room -= prefix;
+
+        char *dst = batch + batch_len + prefix;
+        int n = format_message(dst, room, &line, syslog_hostname);
+        if (n < 0) {
+            return;
+        }
+        if ((size_t)n >= room) {
+            if (batch_len > 0 && attempt == 0) {
+                flush_batch();
+                continue;
+            }
+            n = room - 1;   // Truncate a message too big for an empty batch
+        }
+
+        if (transport == SYSLOG_TRANSPORT_UDP) {
+            if (prefix) {
+                batch[batch_len] = '\n';
+            }
+            batch_len += prefix + n;
+        } else {
+            char count[OCTET_PREFIX_MAX + 1];
+            int count_len = snprintf(count, sizeof(count), "%d ", n);
+            memmove(batch + batch_len + count_len, dst, n);
+            memcpy(batch + batch_len, count, count_len);
+            batch_len += count_len + n;
+        }
+        if (batch_messages++ == 0) {
+            batch_started_us = esp_timer_get_time();
+        }
+        break;
+    }
+
+#if !CONFIG_SYSLOG_UDP_BATCH
+    if (transport == SYSLOG_TRANSPORT_UDP) {
+        flush_batch();
+    }
+#endif
+}
+
+static void syslog_task(void *pvParameters) {
+    while (!syslog_stop_requested) {
+        // Woken by the first commit after the ring was drained. While a batch
+        // is open, wake in time to send it; otherwise the timeout only
+        // guards against a missed wake.
+        TickType_t wait = pdMS_TO_TICKS(1000);
+        if (batch_len > 0) {
+            int64_t remaining_us = batch_started_us + BATCH_DELAY_US - esp_timer_get_time();
+            wait = remaining_us > 0 ? pdMS_TO_TICKS(remaining_us / 1000) : 0;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        const char *line;
+        size_t len;
+        while ((line = log_ring_peek(&syslog_ring, &len, NULL)) != NULL) {
+            if (len > 1 && syslog_enabled) {
+                queue_line(line, len - 1);  // Without the terminator
+            }
+            log_ring_release(&syslog_ring);
+        }
+
+        if (batch_len > 0 && esp_timer_get_time() - batch_started_us >= BATCH_DELAY_US) {
+            flush_batch();
+        }
+    }
+
+    // Stopping: send what is batched to the server it was meant for
+    if (batch_len > 0) {
+        flush_batch();
+    }
+    xSemaphoreGive(syslog_stopped);
+    vTaskDelete(NULL);
 }
 
 esp_err_t syslog_init(settings_t *settings) {
     if (!settings) {
         return ESP_ERR_INVALID_ARG;
     }
-    
-    g_settings = settings;
+    syslog_initialized = true;
     
     // Check if syslog is enabled and configured
     if (!settings->syslog_server || 
@@ -177,49 +494,56 @@ esp_err_t syslog_init(settings_t *settings) {
         return ESP_OK;
     }
     
-    ESP_LOGI(TAG, "Initializing syslog client (server: %s:%d)", 
-             settings->syslog_server, settings->syslog_port);
+    ESP_LOGI(TAG, "Initializing syslog client (server: %s:%d over %s)", 
+             settings->syslog_server, settings->syslog_port,
+             settings->syslog_transport == SYSLOG_TRANSPORT_TLS ? "TLS" :
+             settings->syslog_transport == SYSLOG_TRANSPORT_TCP ? "TCP" : "UDP");
     
-    // Create mutex for vprintf
-    if (!vprintf_mutex) {
-        vprintf_mutex = xSemaphoreCreateMutex();
-        if (!vprintf_mutex) {
-            ESP_LOGE(TAG, "Failed to create vprintf mutex");
+    if (syslog_ring.buf == NULL) {
+        esp_err_t err = log_ring_init(&syslog_ring, CONFIG_SYSLOG_RING_SIZE);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to allocate syslog ring: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+    if (syslog_stopped == NULL) {
+        syslog_stopped = xSemaphoreCreateBinary();
+        if (syslog_stopped == NULL) {
+            ESP_LOGE(TAG, "Failed to create syslog stop semaphore");
             return ESP_ERR_NO_MEM;
         }
     }
 
-    recv_msg = malloc(sizeof(syslog_msg_t));
-    syslog_packet = malloc(SYSLOG_MAX_MSG_LEN + 100);
-    atomic_fetch_add(&malloc_count_syslog, 2);
-    
-    
-    // Create message queue
-    syslog_queue = xQueueCreate(SYSLOG_QUEUE_SIZE, sizeof(syslog_msg_t));
-    if (!syslog_queue) {
-        ESP_LOGE(TAG, "Failed to create syslog queue");
+    batch = malloc(CONFIG_SYSLOG_BATCH_SIZE);
+    if (!batch) {
+        ESP_LOGE(TAG, "Failed to allocate syslog batch buffer");
         return ESP_ERR_NO_MEM;
     }
-    
-    // Create syslog task
-    BaseType_t result = xTaskCreate(
-        syslog_task,
-        "syslog",
-        4096,
-        NULL,
-        5,
-        &syslog_task_handle
-    );
-    
+    batch_len = 0;
+    batch_messages = 0;
+    transport = settings->syslog_transport;
+    server_port = settings->syslog_port;
+    server_name = strdup(settings->syslog_server);
+    syslog_hostname = strdup(settings->hostname ? settings->hostname : "esp32");
+    if (server_name == NULL || syslog_hostname == NULL) {
+        ESP_LOGE(TAG, "Failed to copy syslog settings");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Create syslog task; the TLS handshake needs the larger stack
+    syslog_stop_requested = false;
+    BaseType_t result = task_config_create(
+        transport == SYSLOG_TRANSPORT_TLS ? TASK_SYSLOG_TLS : TASK_SYSLOG,
+        syslog_task, NULL, &syslog_task_handle);
+
     if (result != pdPASS) {
         ESP_LOGE(TAG, "Failed to create syslog task");
-        vQueueDelete(syslog_queue);
-        syslog_queue = NULL;
+        syslog_task_handle = NULL;
         return ESP_ERR_NO_MEM;
     }
-    
-    // Hook into ESP-IDF logging system
-    original_vprintf = esp_log_set_vprintf(custom_vprintf);
+    atomic_store(&syslog_ring.consumer, syslog_task_handle);
+
+    // log_control starts passing lines to syslog_write
     syslog_enabled = true;
     
     ESP_LOGI(TAG, "Syslog client initialized successfully");
@@ -230,54 +554,60 @@ esp_err_t syslog_init(settings_t *settings) {
 void syslog_deinit(void) {
     syslog_enabled = false;
     
-    // Restore original vprintf
-    if (original_vprintf) {
-        esp_log_set_vprintf(original_vprintf);
-        original_vprintf = NULL;
-    }
-    
-    // Delete mutex
-    if (vprintf_mutex) {
-        vSemaphoreDelete(vprintf_mutex);
-        vprintf_mutex = NULL;
-    }
-    
-    // Close socket
-    if (syslog_sock >= 0) {
-        close(syslog_sock);
-        syslog_sock = -1;
-    }
-    
-    // Delete task
+    // Stop commits from waking the task before it goes away; the ring itself
+    // is kept since a task may still be inside syslog_write
+    atomic_store(&syslog_ring.consumer, NULL);
+
+    // Ask the task to finish; deleting it from here could cut a send short
     if (syslog_task_handle) {
-        vTaskDelete(syslog_task_handle);
+        syslog_stop_requested = true;
+        xTaskNotifyGive(syslog_task_handle);
+        xSemaphoreTake(syslog_stopped, portMAX_DELAY);
         syslog_task_handle = NULL;
     }
+
+    // Close the connection and let the next server be tried at once
+    transport_close();
+    dns_valid = false;
+    next_connect_us = 0;
+    connect_backoff_us = CONNECT_BACKOFF_MIN_US;
     
-    // Delete queue and free any remaining messages
-    if (syslog_queue != NULL) {
-        // Drain the queue and free any remaining messages
-        vQueueDelete(syslog_queue);
-        syslog_queue = NULL;
+    if (server_name != NULL) {
+        free(server_name);
+        server_name = NULL;
     }
-    
-    g_settings = NULL;
-    if (recv_msg != NULL) {
-        free(recv_msg);
-        atomic_fetch_add(&free_count_syslog, 1);
-        recv_msg = NULL;
+    if (syslog_hostname != NULL) {
+        free(syslog_hostname);
+        syslog_hostname = NULL;
     }
-    if (syslog_packet != NULL) {
-        free(syslog_packet);
-        atomic_fetch_add(&free_count_syslog, 1);
-        syslog_packet = NULL;
+    if (batch != NULL) {
+        free(batch);
+        batch = NULL;
     }
+    batch_len = 0;
+    batch_messages = 0;
     
     ESP_LOGI(TAG, "Syslog client deinitialized");
 }
 
+esp_err_t syslog_reconfigure(settings_t *settings) {
+    if (!syslog_initialized) {
+        return ESP_OK;
+    }
+    syslog_deinit();
+    return syslog_init(settings);
+}
+
 esp_err_t syslog_register(settings_t *settings, httpd_handle_t http_server) {
     // This function is a placeholder for potential HTTP configuration interface
     // Settings will be handled through the main settings module
     return ESP_OK;
 }
+
+void syslog_get_stats(syslog_stats_t *stats) {
+    *stats = tx_stats;
+    stats->ring_size = syslog_ring.size;
+    stats->ring_high_water = atomic_load(&syslog_ring.high_water);
+    stats->records = atomic_load(&syslog_ring.records);
+    stats->dropped = atomic_load(&syslog_ring.dropped);
+}
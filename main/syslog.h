@@ -1,12 +1,31 @@
 #ifndef SYSLOG_H
 #define SYSLOG_H
 
+#include <stdarg.h>
+#include <stdint.h>
 #include <esp_err.h>
 #include <esp_http_server.h>
 #include "settings.h"
 
+typedef struct {
+    uint32_t ring_size;         // Bytes in the log ring (0 when syslog is off)
+    uint32_t ring_high_water;   // Most bytes ever queued
+    uint32_t records;           // Lines queued for sending
+    uint32_t dropped;           // Lines lost because the ring was full
+    uint32_t messages;          // Messages delivered to the transport
+    uint32_t messages_dropped;  // Messages lost to send or connect failures
+    uint32_t writes;            // Datagrams (UDP) or writes (TCP/TLS) sent
+    uint64_t bytes;             // Bytes sent, including framing
+    uint32_t send_errors;
+    uint32_t connects;
+    uint32_t dns_lookups;
+} syslog_stats_t;
+
 /**
  * Initialize the syslog client
+ *
+ * Log lines are batched: with UDP several messages share a datagram,
+ * separated by newlines; with TCP and TLS they are octet-counted (RFC 6587).
  * 
  * @param settings Pointer to settings structure
  * @return ESP_OK on success
@@ -24,7 +43,32 @@ esp_err_t syslog_register(settings_t *settings, httpd_handle_t http_server);
 
 /**
  * Shutdown the syslog client
+ *
+ * Waits for the task to send what it has batched and exit.
  */
 void syslog_deinit(void);
 
+/**
+ * Restart the syslog client with new server settings
+ *
+ * Does nothing if syslog_init was never called.
+ *
+ * @param settings Pointer to settings structure
+ * @return ESP_OK on success
+ */
+esp_err_t syslog_reconfigure(settings_t *settings);
+
+/**
+ * Queue a formatted log line for the syslog server
+ *
+ * Called by log_control for every line that passes its filters. Safe from
+ * any task; the line is dropped if the ring is full.
+ */
+void syslog_write(const char *fmt, va_list args);
+
+/**
+ * Get log ring counters
+ */
+void syslog_get_stats(syslog_stats_t *stats);
+
 #endif // SYSLOG_H
@@ -0,0 +1,224 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include "task_config.h"
+#include "alloc_prof.h"
+
+static const char *TAG = "task_config";
+
+#define JITTER_GAIN         (1.0f / 16.0f)   // As in RFC 3550 section 6.4.1
+
+// How long a restart waits for FreeRTOS to release a static task's buffers
+#define BUFFERS_WAIT_MS     1000
+
+typedef struct {
+    const char *name;
+    uint32_t stack_size;    // Bytes
+    UBaseType_t priority;
+    int core;               // -1 for either core
+} task_config_t;
+
+static const task_config_t task_configs[TASK_COUNT] = {
+    [TASK_WEIGHT]         = { "weight", CONFIG_TASK_WEIGHT_STACK,
+                              CONFIG_TASK_WEIGHT_PRIORITY, CONFIG_TASK_WEIGHT_CORE },
+    [TASK_DS18B20]        = { "run_ds18b20", CONFIG_TASK_DS18B20_STACK,
+                              CONFIG_TASK_DS18B20_PRIORITY, CONFIG_TASK_DS18B20_CORE },
+    [TASK_PUMP_MONITOR]   = { "pump_monitor", CONFIG_TASK_PUMP_MONITOR_STACK,
+                              CONFIG_TASK_PUMP_MONITOR_PRIORITY, CONFIG_TASK_PUMP_MONITOR_CORE },
+    [TASK_MQTT_STATUS]    = { "mqtt_status", CONFIG_TASK_MQTT_STATUS_STACK,
+                              CONFIG_TASK_MQTT_STATUS_PRIORITY, CONFIG_TASK_MQTT_STATUS_CORE },
+    [TASK_SENSOR_CLEANUP] = { "sensor_cleanup", CONFIG_TASK_SENSOR_CLEANUP_STACK,
+                              CONFIG_TASK_SENSOR_CLEANUP_PRIORITY, CONFIG_TASK_SENSOR_CLEANUP_CORE },
+    [TASK_SYSLOG]         = { "syslog", CONFIG_TASK_SYSLOG_STACK,
+                              CONFIG_TASK_SYSLOG_PRIORITY, CONFIG_TASK_SYSLOG_CORE },
+    [TASK_SYSLOG_TLS]     = { "syslog", CONFIG_TASK_SYSLOG_TLS_STACK,
+                              CONFIG_TASK_SYSLOG_PRIORITY, CONFIG_TASK_SYSLOG_CORE },
+    [TASK_BTHOME_SCAN]    = { "bthome_scan", CONFIG_TASK_BTHOME_SCAN_STACK,
+                              CONFIG_TASK_BTHOME_SCAN_PRIORITY, CONFIG_TASK_BTHOME_SCAN_CORE },
+    [TASK_DLOG]           = { "dlog", CONFIG_TASK_DLOG_STACK,
+                              CONFIG_TASK_DLOG_PRIORITY, CONFIG_TASK_DLOG_CORE },
+    [TASK_OTA]            = { "ota_task", CONFIG_TASK_OTA_STACK,
+                              CONFIG_TASK_OTA_PRIORITY, CONFIG_TASK_OTA_CORE },
+};
+
+// Tasks whose buffers are kept between starts (TASK_<name>_STATIC)
+static const bool static_tasks[TASK_COUNT] = {
+#if CONFIG_TASK_WEIGHT_STATIC
+    [TASK_WEIGHT] = true,
+#endif
+#if CONFIG_TASK_DS18B20_STATIC
+    [TASK_DS18B20] = true,
+#endif
+#if CONFIG_TASK_PUMP_MONITOR_STATIC
+    [TASK_PUMP_MONITOR] = true,
+#endif
+#if CONFIG_TASK_MQTT_STATUS_STATIC
+    [TASK_MQTT_STATUS] = true,
+#endif
+#if CONFIG_TASK_SENSOR_CLEANUP_STATIC
+    [TASK_SENSOR_CLEANUP] = true,
+#endif
+#if CONFIG_TASK_SYSLOG_STATIC
+    [TASK_SYSLOG] = true,
+    [TASK_SYSLOG_TLS] = true,
+#endif
+#if CONFIG_TASK_BTHOME_SCAN_STATIC
+    [TASK_BTHOME_SCAN] = true,
+#endif
+#if CONFIG_TASK_DLOG_STATIC
+    [TASK_DLOG] = true,
+#endif
+#if CONFIG_TASK_OTA_STATIC
+    [TASK_OTA] = true,
+#endif
+};
+
+typedef struct {
+    StackType_t *stack;
+    StaticTask_t *tcb;
+    atomic_bool in_use;     // Until FreeRTOS has deleted the task
+} task_buffers_t;
+
+static task_buffers_t buffers[TASK_COUNT];
+
+// Written only by the task itself; the metrics read them unlocked
+typedef struct {
+    int64_t last_us;
+    volatile float period_s;
+    volatile float jitter_s;
+} task_loop_t;
+
+static task_loop_t loops[TASK_COUNT];
+static atomic_bool started[TASK_COUNT];
+
+#if CONFIG_FREERTOS_TASK_PRE_DELETION_HOOK
+// Called by FreeRTOS just before it forgets a deleted task: for a task that
+// deleted itself that is in the idle task, some time after vTaskDelete()
+void vTaskPreDeletionHook(void *tcb) {
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (buffers[i].tcb == tcb) {
+            atomic_store(&buffers[i].in_use, false);
+        }
+    }
+}
+#endif
+
+static bool claim_buffers(task_id_t id) {
+    const task_config_t *cfg = &task_configs[id];
+    task_buffers_t *b = &buffers[id];
+
+    for (int waited = 0; atomic_load(&b->in_use); waited += 10) {
+        if (waited >= BUFFERS_WAIT_MS) {
+            ESP_LOGW(TAG, "Buffers of the previous %s task still in use; allocating", cfg->name);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    if (b->stack == NULL) {
+        b->stack = heap_caps_malloc(cfg->stack_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        b->tcb = heap_caps_calloc(1, sizeof(StaticTask_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (b->stack == NULL || b->tcb == NULL) {
+            ESP_LOGE(TAG, "No memory for the %s task's %" PRIu32 " byte stack", cfg->name, cfg->stack_size);
+            heap_caps_free(b->stack);
+            heap_caps_free(b->tcb);
+            b->stack = NULL;
+            b->tcb = NULL;
+            return false;
+        }
+    }
+    atomic_store(&b->in_use, true);
+    return true;
+}
+
+BaseType_t task_config_create(task_id_t id, TaskFunction_t fn, void *arg, TaskHandle_t *handle) {
+    const task_config_t *cfg = &task_configs[id];
+    BaseType_t core = cfg->core >= 0 && cfg->core < portNUM_PROCESSORS ? cfg->core : tskNO_AFFINITY;
+    TaskHandle_t unused;
+    if (handle == NULL) {
+        handle = &unused;
+    }
+
+    loops[id].last_us = 0;
+    loops[id].period_s = 0.0f;
+    loops[id].jitter_s = 0.0f;
+
+    if (static_tasks[id] && claim_buffers(id)) {
+        task_buffers_t *b = &buffers[id];
+        *handle = xTaskCreateStaticPinnedToCore(fn, cfg->name, cfg->stack_size, arg, cfg->priority,
+                                                b->stack, b->tcb, core);
+        if (*handle == NULL) {
+            atomic_store(&b->in_use, false);
+        }
+    } else if (xTaskCreatePinnedToCore(fn, cfg->name, cfg->stack_size, arg, cfg->priority,
+                                       handle, core) != pdPASS) {
+        *handle = NULL;
+    }
+
+    if (*handle == NULL) {
+        ESP_LOGE(TAG, "Failed to start the %s task", cfg->name);
+        return pdFAIL;
+    }
+
+    // Report the variant that ran last for tasks with two (syslog)
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (strcmp(task_configs[i].name, cfg->name) == 0) {
+            atomic_store(&started[i], i == (int)id);
+        }
+    }
+    ESP_LOGD(TAG, "Started %s on core %d at priority %u with %" PRIu32 " bytes of %s stack",
+             cfg->name, cfg->core, (unsigned)cfg->priority, cfg->stack_size,
+             static_tasks[id] ? "static" : "heap");
+    return pdPASS;
+}
+
+void task_loop_mark(task_id_t id) {
+    task_loop_t *loop = &loops[id];
+    int64_t now = esp_timer_get_time();
+    if (loop->last_us != 0) {
+        float period_s = (now - loop->last_us) / 1e6f;
+        if (loop->period_s > 0.0f) {
+            float d = fabsf(period_s - loop->period_s);
+            loop->jitter_s += JITTER_GAIN * (d - loop->jitter_s);
+        }
+        loop->period_s = period_s;
+    }
+    loop->last_us = now;
+}
+
+void task_config_write_metrics(http_chunk_writer_t *w, const char *hostname) {
+    http_chunk_printf(w,
+                      "# HELP task_stack_size_bytes Configured stack size per task\n"
+                      "# TYPE task_stack_size_bytes gauge\n");
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (atomic_load(&started[i])) {
+            http_chunk_printf(w, "task_stack_size_bytes{hostname=\"%s\",task=\"%s\"} %" PRIu32 "\n",
+                              hostname, task_configs[i].name, task_configs[i].stack_size);
+        }
+    }
+
+    http_chunk_printf(w,
+                      "# HELP task_loop_period_seconds Time between the last two iterations of a periodic task\n"
+                      "# TYPE task_loop_period_seconds gauge\n");
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (atomic_load(&started[i]) && loops[i].period_s > 0.0f) {
+            http_chunk_printf(w, "task_loop_period_seconds{hostname=\"%s\",task=\"%s\"} %.6f\n",
+                              hostname, task_configs[i].name, loops[i].period_s);
+        }
+    }
+
+    http_chunk_printf(w,
+                      "# HELP task_loop_jitter_seconds Smoothed variation of the loop period of a periodic task\n"
+                      "# TYPE task_loop_jitter_seconds gauge\n");
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (atomic_load(&started[i]) && loops[i].period_s > 0.0f) {
+            http_chunk_printf(w, "task_loop_jitter_seconds{hostname=\"%s\",task=\"%s\"} %.6f\n",
+                              hostname, task_configs[i].name, loops[i].jitter_s);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef TASK_CONFIG_H
+#define TASK_CONFIG_H
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "sdkconfig.h"
+#include "http_server.h"
+
+// Core, priority and stack of every task the firmware starts, from Kconfig
+// (menu "Task configuration"). The defaults keep core 0 for WiFi, Bluetooth
+// and the network stack, and put the acquisition tasks on core 1 above the
+// other application tasks, so their timing does not depend on radio load.
+//
+// A task with TASK_<name>_STATIC set gets its stack and control block from
+// buffers allocated on its first start and kept for later restarts, so
+// reconfiguring it never fragments the heap or fails for lack of memory.
+//
+// Periodic tasks call task_loop_mark() once per iteration; the period and its
+// jitter are exported as task_loop_period_seconds and
+// task_loop_jitter_seconds.
+
+typedef enum {
+    TASK_WEIGHT,
+    TASK_DS18B20,
+    TASK_PUMP_MONITOR,
+    TASK_MQTT_STATUS,
+    TASK_SENSOR_CLEANUP,
+    TASK_SYSLOG,
+    TASK_SYSLOG_TLS,        // The syslog task when it has a TLS session
+    TASK_BTHOME_SCAN,
+    TASK_DLOG,
+    TASK_OTA,
+    TASK_COUNT
+} task_id_t;
+
+/**
+ * @brief Start a task as configured for id
+ *
+ * @return pdPASS, or pdFAIL with *handle set to NULL
+ */
+BaseType_t task_config_create(task_id_t id, TaskFunction_t fn, void *arg, TaskHandle_t *handle);
+
+/**
+ * @brief Note the start of an iteration of a periodic task's loop
+ *
+ * Only the task itself may call this for its id.
+ */
+void task_loop_mark(task_id_t id);
+
+/**
+ * @brief Write the configured stack sizes and loop timing in Prometheus
+ *        text format
+ */
+void task_config_write_metrics(http_chunk_writer_t *w, const char *hostname);
+
+#endif // TASK_CONFIG_H
@@ -0,0 +1,310 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_attr.h>
+#include <esp_cpu.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "sdkconfig.h"
+#include "task_stats.h"
+#include "task_trace_hook.h"
+
+#if !CONFIG_FREERTOS_USE_TRACE_FACILITY || !CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#error "task_stats needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS"
+#endif
+#if !CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER
+#error "task_stats expects run time in microseconds (CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER)"
+#endif
+
+static const char *TAG = "task_stats";
+
+// uxTaskGetSystemState() fills nothing if there are more tasks than this
+#define TASK_STATS_MAX      40
+
+typedef struct {
+    UBaseType_t number;
+    char name[configMAX_TASK_NAME_LEN];
+    configRUN_TIME_COUNTER_TYPE run_time;   // Microseconds since the task started
+    uint16_t cpu_permille;                  // Of one core, over the last interval
+    uint32_t stack_free_min;                // Bytes
+    eTaskState state;
+    UBaseType_t priority;
+    BaseType_t core;
+} task_sample_t;
+
+// Guards everything below; the timer skips a sample rather than wait for a
+// scrape or trace dump to finish
+static SemaphoreHandle_t stats_mutex;
+static esp_timer_handle_t sample_timer;
+static TaskStatus_t status[TASK_STATS_MAX];
+static task_sample_t samples[TASK_STATS_MAX];
+static UBaseType_t sample_count;
+static configRUN_TIME_COUNTER_TYPE last_total;
+static bool too_many_logged;
+
+static BaseType_t status_core(const TaskStatus_t *s) {
+#if configTASKLIST_INCLUDE_COREID
+    return s->xCoreID;
+#else
+    return tskNO_AFFINITY;
+#endif
+}
+
+static void take_sample(void) {
+    configRUN_TIME_COUNTER_TYPE total;
+    UBaseType_t n = uxTaskGetSystemState(status, TASK_STATS_MAX, &total);
+    if (n == 0) {
+        if (!too_many_logged) {
+            ESP_LOGW(TAG, "%u tasks, more than the %d sampled", (unsigned)uxTaskGetNumberOfTasks(), TASK_STATS_MAX);
+            too_many_logged = true;
+        }
+        return;
+    }
+
+    // Match tasks to the previous sample by number, which unlike the handle
+    // is never reused
+    uint16_t cpu[TASK_STATS_MAX] = {0};
+    configRUN_TIME_COUNTER_TYPE elapsed = total - last_total;
+    for (UBaseType_t i = 0; i < n && last_total != 0 && elapsed > 0; i++) {
+        for (UBaseType_t j = 0; j < sample_count; j++) {
+            if (samples[j].number == status[i].xTaskNumber) {
+                uint64_t ran = (uint64_t)(configRUN_TIME_COUNTER_TYPE)(status[i].ulRunTimeCounter - samples[j].run_time);
+                uint64_t permille = ran * 1000 / elapsed;
+                cpu[i] = permille > 1000 ? 1000 : (uint16_t)permille;
+                break;
+            }
+        }
+    }
+
+    for (UBaseType_t i = 0; i < n; i++) {
+        task_sample_t *s = &samples[i];
+        s->number = status[i].xTaskNumber;
+        strlcpy(s->name, status[i].pcTaskName, sizeof(s->name));
+        s->run_time = status[i].ulRunTimeCounter;
+        s->cpu_permille = cpu[i];
+        s->stack_free_min = status[i].usStackHighWaterMark * sizeof(StackType_t);
+        s->state = status[i].eCurrentState;
+        s->priority = status[i].uxCurrentPriority;
+        s->core = status_core(&status[i]);
+    }
+    sample_count = n;
+    last_total = total;
+}
+
+static void sample_timer_cb(void *arg) {
+    if (xSemaphoreTake(stats_mutex, 0) != pdTRUE) {
+        return;
+    }
+    take_sample();
+    xSemaphoreGive(stats_mutex);
+}
+
+esp_err_t task_stats_init(void) {
+    if (stats_mutex != NULL) {
+        return ESP_OK;
+    }
+    stats_mutex = xSemaphoreCreateMutex();
+    if (stats_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create task stats mutex");
+        return ESP_ERR_NO_MEM;
+    }
+    take_sample();
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = sample_timer_cb,
+        .name = "task_stats",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &sample_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(sample_timer, CONFIG_TASK_STATS_INTERVAL_S * 1000000ULL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start sampling timer: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+static const char *state_names[] = {
+    [eRunning] = "running",
+    [eReady] = "ready",
+    [eBlocked] = "blocked",
+    [eSuspended] = "suspended",     // Also blocked without a timeout
+};
+
+#define STATE_COUNT (sizeof(state_names) / sizeof(state_names[0]))
+
+static void core_label(BaseType_t core, char *buf, size_t size) {
+    if (core == tskNO_AFFINITY) {
+        strlcpy(buf, "any", size);
+    } else {
+        snprintf(buf, size, "%d", (int)core);
+    }
+}
+
+void task_stats_write_metrics(http_chunk_writer_t *w, const char *hostname) {
+    if (stats_mutex == NULL || xSemaphoreTake(stats_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return;
+    }
+
+    http_chunk_printf(w,
+                      "# HELP task_cpu_percent CPU use per task over the last sample interval, percent of one core\n"
+                      "# TYPE task_cpu_percent gauge\n");
+    for (UBaseType_t i = 0; i < sample_count; i++) {
+        http_chunk_printf(w, "task_cpu_percent{hostname=\"%s\",task=\"%s\"} %u.%u\n",
+                          hostname, samples[i].name, samples[i].cpu_permille / 10, samples[i].cpu_permille % 10);
+    }
+    http_chunk_printf(w,
+                      "# HELP task_cpu_seconds_total CPU time per task since it started\n"
+                      "# TYPE task_cpu_seconds_total counter\n");
+    for (UBaseType_t i = 0; i < sample_count; i++) {
+        uint64_t us = samples[i].run_time;
+        http_chunk_printf(w, "task_cpu_seconds_total{hostname=\"%s\",task=\"%s\"} %" PRIu64 ".%06" PRIu64 "\n",
+                          hostname, samples[i].name, us / 1000000, us % 1000000);
+    }
+    http_chunk_printf(w,
+                      "# HELP task_stack_free_min_bytes Smallest free stack per task since it started\n"
+                      "# TYPE task_stack_free_min_bytes gauge\n");
+    for (UBaseType_t i = 0; i < sample_count; i++) {
+        http_chunk_printf(w, "task_stack_free_min_bytes{hostname=\"%s\",task=\"%s\"} %" PRIu32 "\n",
+                          hostname, samples[i].name, samples[i].stack_free_min);
+    }
+    http_chunk_printf(w,
+                      "# HELP task_state Scheduler state per task when sampled\n"
+                      "# TYPE task_state gauge\n");
+    for (UBaseType_t i = 0; i < sample_count; i++) {
+        for (size_t s = 0; s < STATE_COUNT; s++) {
+            http_chunk_printf(w, "task_state{hostname=\"%s\",task=\"%s\",state=\"%s\"} %d\n",
+                              hostname, samples[i].name, state_names[s], samples[i].state == (eTaskState)s);
+        }
+    }
+    http_chunk_printf(w,
+                      "# HELP task_info Core affinity and priority per task\n"
+                      "# TYPE task_info gauge\n");
+    for (UBaseType_t i = 0; i < sample_count; i++) {
+        char core[8];
+        core_label(samples[i].core, core, sizeof(core));
+        http_chunk_printf(w, "task_info{hostname=\"%s\",task=\"%s\",core=\"%s\",priority=\"%u\"} 1\n",
+                          hostname, samples[i].name, core, (unsigned)samples[i].priority);
+    }
+
+    xSemaphoreGive(stats_mutex);
+}
+
+#if CONFIG_TASK_TRACE
+
+_Static_assert((CONFIG_TASK_TRACE_EVENTS & (CONFIG_TASK_TRACE_EVENTS - 1)) == 0,
+               "TASK_TRACE_EVENTS must be a power of two");
+
+typedef struct {
+    uint32_t time_us;       // Low 32 bits of esp_timer_get_time()
+    TaskHandle_t task;      // Switched in
+} trace_event_t;
+
+// One ring per core, each written only by its own core's scheduler
+static DRAM_ATTR trace_event_t trace_ring[portNUM_PROCESSORS][CONFIG_TASK_TRACE_EVENTS];
+static DRAM_ATTR uint32_t trace_head[portNUM_PROCESSORS];
+static DRAM_ATTR volatile bool trace_paused;
+
+// Tasks alive when the ring is read, copied since a task may be deleted
+// while the dump is being sent
+static struct {
+    TaskHandle_t handle;
+    char name[configMAX_TASK_NAME_LEN];
+} trace_names[TASK_STATS_MAX];
+
+// Runs inside the scheduler with interrupts masked: no logging, no locks
+void IRAM_ATTR task_trace_switched_in(void) {
+    if (trace_paused) {
+        return;
+    }
+    int core = esp_cpu_get_core_id();
+    trace_event_t *e = &trace_ring[core][trace_head[core] & (CONFIG_TASK_TRACE_EVENTS - 1)];
+    e->time_us = (uint32_t)esp_timer_get_time();
+    e->task = xTaskGetCurrentTaskHandle();
+    trace_head[core]++;
+}
+
+static const char *trace_task_name(TaskHandle_t task, UBaseType_t n) {
+    for (UBaseType_t i = 0; i < n; i++) {
+        if (trace_names[i].handle == task) {
+            return trace_names[i].name;
+        }
+    }
+    return "(deleted)";
+}
+
+static esp_err_t debug_trace_handler(httpd_req_t *req) {
+    char buf[1024];
+    http_chunk_writer_t w;
+    httpd_resp_set_type(req, "application/json");
+    http_chunk_writer_init(&w, req, buf, sizeof(buf));
+
+    if (xSemaphoreTake(stats_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return http_resp_send_busy(req);
+    }
+    trace_paused = true;
+    vTaskDelay(1);      // Let a hook already running on the other core finish
+    UBaseType_t n = uxTaskGetSystemState(status, TASK_STATS_MAX, NULL);
+    for (UBaseType_t i = 0; i < n; i++) {
+        trace_names[i].handle = status[i].xHandle;
+        strlcpy(trace_names[i].name, status[i].pcTaskName, sizeof(trace_names[i].name));
+    }
+
+    // Timestamps are 32 bits; rebuild them relative to now (good for 71 min)
+    int64_t now = esp_timer_get_time();
+    uint32_t now32 = (uint32_t)now;
+    uint32_t overwritten = 0;
+
+    http_chunk_printf(&w, "{\"traceEvents\":[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                          "\"args\":{\"name\":\"%s\"}}", CONFIG_IDF_TARGET);
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        http_chunk_printf(&w, ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                              "\"args\":{\"name\":\"core %d\"}}", core, core);
+        uint32_t head = trace_head[core];
+        uint32_t first = head > CONFIG_TASK_TRACE_EVENTS ? head - CONFIG_TASK_TRACE_EVENTS : 0;
+        overwritten += first;
+        for (uint32_t i = first; i < head; i++) {
+            const trace_event_t *e = &trace_ring[core][i & (CONFIG_TASK_TRACE_EVENTS - 1)];
+            uint32_t end = i + 1 < head ? trace_ring[core][(i + 1) & (CONFIG_TASK_TRACE_EVENTS - 1)].time_us : now32;
+            http_chunk_printf(&w, ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                                  "\"ts\":%" PRId64 ",\"dur\":%" PRIu32 "}",
+                              trace_task_name(e->task, n), core,
+                              now - (int64_t)(uint32_t)(now32 - e->time_us), end - e->time_us);
+        }
+    }
+    http_chunk_printf(&w, "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"enabled\":true,"
+                          "\"overwritten\":%" PRIu32 "}}\n", overwritten);
+    esp_err_t err = http_chunk_writer_finish(&w);
+
+    trace_paused = false;
+    xSemaphoreGive(stats_mutex);
+    return err;
+}
+
+#else
+
+static esp_err_t debug_trace_handler(httpd_req_t *req) {
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, "{\"traceEvents\":[],\"otherData\":{\"enabled\":false}}\n");
+}
+
+#endif // CONFIG_TASK_TRACE
+
+static httpd_uri_t debug_trace_uri = {
+    .uri       = "/debug/trace",
+    .method    = HTTP_GET,
+    .handler   = debug_trace_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t task_stats_register(void *settings, httpd_handle_t server) {
+    esp_err_t err = httpd_register_uri_handler_with_basic_auth(settings, server, &debug_trace_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register %s: %s", debug_trace_uri.uri, esp_err_to_name(err));
+    }
+    return err;
+}
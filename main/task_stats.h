@@ -0,0 +1,38 @@
+#ifndef TASK_STATS_H
+#define TASK_STATS_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "sdkconfig.h"
+#include "http_server.h"
+
+// Per-task CPU, stack and scheduling metrics.
+//
+// Every TASK_STATS_INTERVAL_S seconds a timer takes a snapshot of all tasks
+// with uxTaskGetSystemState(). CPU use is the task's run time over the last
+// interval as a percentage of one core, so a busy task pinned to a core reads
+// 100 and the per-task values add up to 100 times the number of cores. The
+// snapshot also gives each task's smallest free stack since it started, its
+// state and the core it is pinned to. /metrics reports the last snapshot.
+//
+// With CONFIG_TASK_TRACE the scheduler also records every task switch in a
+// ring per core (see task_trace_hook.h). GET /debug/trace returns the ring as
+// Chrome trace JSON, one track per core, which chrome://tracing and
+// ui.perfetto.dev open directly. Recording pauses while the ring is read.
+
+/**
+ * @brief Take the first snapshot and start the sampling timer
+ */
+esp_err_t task_stats_init(void);
+
+/**
+ * @brief Write the task metrics in Prometheus text format
+ */
+void task_stats_write_metrics(http_chunk_writer_t *w, const char *hostname);
+
+/**
+ * @brief Register GET /debug/trace
+ */
+esp_err_t task_stats_register(void *settings, httpd_handle_t server);
+
+#endif // TASK_STATS_H
@@ -0,0 +1,29 @@
+#ifndef TASK_TRACE_HOOK_H
+#define TASK_TRACE_HOOK_H
+
+// Force-included into every component by the project CMakeLists.txt, so that
+// FreeRTOS (which only defines traceTASK_SWITCHED_IN when nobody else has)
+// calls task_trace_switched_in() from the scheduler after each task switch.
+// Keep it to the hook: it is seen by every C, C++ and assembler file.
+
+#ifndef __ASSEMBLER__
+#include "sdkconfig.h"
+
+#if CONFIG_TASK_TRACE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void task_trace_switched_in(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define traceTASK_SWITCHED_IN() task_trace_switched_in()
+
+#endif // CONFIG_TASK_TRACE
+#endif // __ASSEMBLER__
+
+#endif // TASK_TRACE_HOOK_H
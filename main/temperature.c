@@ -4,15 +4,19 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 
+#include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "onewire_bus.h"
 #include "ds18b20.h"
 #include "settings.h"
 #include "sensors.h"
 #include "temperature.h"
+#include "task_config.h"
 #include "driver/gpio.h"
 
 #define EXAMPLE_ONEWIRE_MAX_DS18B20 5
@@ -31,21 +35,40 @@ typedef struct {
 
 static ds18b20_device_t ds18b20s[EXAMPLE_ONEWIRE_MAX_DS18B20];
 static onewire_bus_handle_t bus = NULL;
-static settings_t *device_settings = NULL;
+
+// Sensor ids by address, kept across reconfiguration so a thermometer found
+// again on a new bus keeps its sensors
+typedef struct {
+    uint64_t address;
+    int sensor_id_c;
+    int sensor_id_f;
+} ds18b20_sensor_ids_t;
+
+static ds18b20_sensor_ids_t known_sensors[EXAMPLE_ONEWIRE_MAX_DS18B20 * 2];
+static int known_sensor_num = 0;
+
+// The polling task is asked to stop rather than deleted, so it never goes
+// away inside a settings snapshot or a bus transaction
+static bool ds18b20_initialized = false;
+static TaskHandle_t ds18b20_task_handle = NULL;
+static SemaphoreHandle_t ds18b20_stopped = NULL;
+static volatile bool ds18b20_stop_requested = false;
 
 void run_ds18b20(void *pvParameters) {
-    // settings_t *settings = (settings_t *) pvParameters;
     float temperature;
-    while (1) {
+    while (!ds18b20_stop_requested) {
+        task_loop_mark(TASK_DS18B20);
         esp_err_t trigger_err = ds18b20_trigger_temperature_conversion_for_all(bus);
         for (int i = 0; i < ds18b20_device_num; i ++) {
             if (trigger_err || ds18b20_get_temperature(ds18b20s[i].dev, &temperature) != ESP_OK) {
-                const char *name = device_settings ? settings_get_ds18b20_name(device_settings, ds18b20s[i].address) : NULL;
+                settings_read_t read;
+                const char *name = settings_get_ds18b20_name(settings_snapshot_acquire(&read), ds18b20s[i].address);
                 if (name && strlen(name) > 0) {
-                    ESP_LOGE(TAG, "Failed to read temperature from DS18B20 '%s' [%016llX]", name, ds18b20s[i].address);
+                    ESP_LOGE(TAG, "Failed to read temperature from DS18B20 '%s' [%016" PRIX64 "]", name, ds18b20s[i].address);
                 } else {
-                    ESP_LOGE(TAG, "Failed to read temperature from DS18B20[%d] [%016llX]", i, ds18b20s[i].address);
+                    ESP_LOGE(TAG, "Failed to read temperature from DS18B20[%d] [%016" PRIX64 "]", i, ds18b20s[i].address);
                 }
+                settings_snapshot_release(read);
                 sensors_update(ds18b20s[i].sensor_id_c, 0.0f, false);
                 if (ds18b20s[i].sensor_id_f >= 0) {
                     sensors_update(ds18b20s[i].sensor_id_f, 0.0f, false);
@@ -67,18 +90,58 @@ void run_ds18b20(void *pvParameters) {
             }
             sensors_update(ds18b20s[i].sensor_id_c, temperature, true);
             
-            const char *name = device_settings ? settings_get_ds18b20_name(device_settings, ds18b20s[i].address) : NULL;
+            settings_read_t read;
+            const char *name = settings_get_ds18b20_name(settings_snapshot_acquire(&read), ds18b20s[i].address);
             if (name && strlen(name) > 0) {
-                ESP_LOGI(TAG, "temperature read from DS18B20 '%s' [%016llX]: %.2f%s", name, ds18b20s[i].address, display_temp, unit);
+                ESP_LOGI(TAG, "temperature read from DS18B20 '%s' [%016" PRIX64 "]: %.2f%s", name, ds18b20s[i].address, display_temp, unit);
             } else {
-                ESP_LOGI(TAG, "temperature read from DS18B20[%d] [%016llX]: %.2f%s", i, ds18b20s[i].address, display_temp, unit);
+                ESP_LOGI(TAG, "temperature read from DS18B20[%d] [%016" PRIX64 "]: %.2f%s", i, ds18b20s[i].address, display_temp, unit);
             }
+            settings_snapshot_release(read);
+        }
+        // Woken early by stop_ds18b20
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    }
+
+    xSemaphoreGive(ds18b20_stopped);
+    vTaskDelete(NULL);
+}
+
+static ds18b20_sensor_ids_t *find_known_sensors(uint64_t address) {
+    for (int i = 0; i < known_sensor_num; i++) {
+        if (known_sensors[i].address == address) {
+            return &known_sensors[i];
         }
-        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+    return NULL;
+}
+
+static void remember_sensors(const ds18b20_device_t *device) {
+    if (known_sensor_num < (int)(sizeof(known_sensors) / sizeof(known_sensors[0]))) {
+        known_sensors[known_sensor_num++] = (ds18b20_sensor_ids_t) {
+            .address = device->address,
+            .sensor_id_c = device->sensor_id_c,
+            .sensor_id_f = device->sensor_id_f,
+        };
+    }
+}
+
+// Release the devices and the bus; the task must not be running
+static void release_ds18b20_bus(void) {
+    int device_num = ds18b20_device_num;
+    ds18b20_device_num = 0;
+    for (int i = 0; i < device_num; i++) {
+        ds18b20_del_device(ds18b20s[i].dev);
+        ds18b20s[i].dev = NULL;
+    }
+    if (bus != NULL) {
+        onewire_bus_del(bus);
+        bus = NULL;
     }
 }
 
 void init_ds18b20(settings_t *settings) {
+    ds18b20_initialized = true;
     if (settings->ds18b20_gpio < 0) {
         ESP_LOGW(TAG, "DS18B20 GPIO not configured, skipping DS18B20 initialization");
         return;
@@ -113,8 +176,6 @@ void init_ds18b20(settings_t *settings) {
     // Wait a moment for the sensors to power up
     vTaskDelay(pdMS_TO_TICKS(100));
 
-    // Store settings pointer for later use
-    device_settings = settings;
     
     // install 1-wire bus
     onewire_bus_config_t bus_config = {
@@ -127,7 +188,12 @@ void init_ds18b20(settings_t *settings) {
         .max_rx_bytes = 10, // 1byte ROM command + 8byte ROM number + 1byte device command
     };
     ESP_LOGI(TAG, "Initializing 1-Wire bus on GPIO%d", settings->ds18b20_gpio);
-    ESP_ERROR_CHECK(onewire_new_bus_rmt(&bus_config, &rmt_config, &bus));
+    esp_err_t err = onewire_new_bus_rmt(&bus_config, &rmt_config, &bus);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) installing 1-Wire bus on GPIO%d", esp_err_to_name(err), settings->ds18b20_gpio);
+        bus = NULL;
+        return;
+    }
     ESP_LOGI(TAG, "1-Wire bus installed on GPIO%d", settings->ds18b20_gpio);
 
     onewire_device_iter_handle_t iter = NULL;
@@ -135,12 +201,17 @@ void init_ds18b20(settings_t *settings) {
     esp_err_t search_result = ESP_OK;
 
     // create 1-wire device iterator, which is used for device search
-    ESP_ERROR_CHECK(onewire_new_device_iter(bus, &iter));
+    err = onewire_new_device_iter(bus, &iter);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) creating 1-Wire device iterator", esp_err_to_name(err));
+        release_ds18b20_bus();
+        return;
+    }
     ESP_LOGI(TAG, "Device iterator created, start searching...");
     do {
         search_result = onewire_device_iter_get_next(iter, &next_onewire_device);
         if (search_result == ESP_OK) { // found a new device, let's check if we can upgrade it to a DS18B20
-            ESP_LOGI(TAG, "Found a device, address: %016llX", next_onewire_device.address);
+            ESP_LOGI(TAG, "Found a device, address: %016" PRIX64, next_onewire_device.address);
             ds18b20_config_t ds_cfg = {};
             onewire_device_address_t address;
             // check if the device is a DS18B20, if so, return the ds18b20 handle
@@ -154,21 +225,27 @@ void init_ds18b20(settings_t *settings) {
                          (uint8_t)(address >> 40), (uint8_t)(address >> 32), (uint8_t)(address >> 24),
                          (uint8_t)(address >> 16), (uint8_t)(address >> 8), (uint8_t)(address >> 0));
                 
-                if (settings->temp_use_fahrenheit) {
+                const ds18b20_sensor_ids_t *known = find_known_sensors(address);
+                if (known != NULL) {
+                    ds18b20s[ds18b20_device_num].sensor_id_c = known->sensor_id_c;
+                    ds18b20s[ds18b20_device_num].sensor_id_f = known->sensor_id_f;
+                } else if (settings->temp_use_fahrenheit) {
                     ds18b20s[ds18b20_device_num].sensor_id_f = sensors_register(
                         "Temperature", unit, NULL, NULL, NULL);
                     ds18b20s[ds18b20_device_num].sensor_id_c = sensors_register(
                         NULL, NULL, "temperature", device_name ? device_name : addr_str, addr_str);
+                    remember_sensors(&ds18b20s[ds18b20_device_num]);
                 } else {
                     ds18b20s[ds18b20_device_num].sensor_id_c = sensors_register(
                         "Temperature", unit, "temperature", device_name ? device_name : addr_str, addr_str);
                     ds18b20s[ds18b20_device_num].sensor_id_f = -1;
+                    remember_sensors(&ds18b20s[ds18b20_device_num]);
                 }
                 
                 if (device_name && strlen(device_name) > 0) {
-                    ESP_LOGI(TAG, "Found a DS18B20[%d] '%s', address: %016llX", ds18b20_device_num, device_name, address);
+                    ESP_LOGI(TAG, "Found a DS18B20[%d] '%s', address: %016" PRIX64, ds18b20_device_num, device_name, address);
                 } else {
-                    ESP_LOGI(TAG, "Found a DS18B20[%d], address: %016llX", ds18b20_device_num, address);
+                    ESP_LOGI(TAG, "Found a DS18B20[%d], address: %016" PRIX64, ds18b20_device_num, address);
                 }
                 
                 ds18b20_device_num++;
@@ -177,19 +254,60 @@ void init_ds18b20(settings_t *settings) {
                     break;
                 }
             } else {
-                ESP_LOGI(TAG, "Found an unknown device, address: %016llX", next_onewire_device.address);
+                ESP_LOGI(TAG, "Found an unknown device, address: %016" PRIX64, next_onewire_device.address);
             }
         }
     } while (search_result == ESP_OK);
-    ESP_ERROR_CHECK(onewire_del_device_iter(iter));
+    onewire_del_device_iter(iter);
     if (ds18b20_device_num == 0) {
         ESP_LOGW(TAG, "No DS18B20 device found on the bus");
+        release_ds18b20_bus();
         return;
     }
     ESP_LOGI(TAG, "Searching done, %d DS18B20 device(s) found", ds18b20_device_num);
+
+    if (ds18b20_stopped == NULL) {
+        ds18b20_stopped = xSemaphoreCreateBinary();
+        if (ds18b20_stopped == NULL) {
+            ESP_LOGE(TAG, "Failed to create DS18B20 stop semaphore");
+            release_ds18b20_bus();
+            return;
+        }
+    }
     
-    // Start the weight reading task
-    xTaskCreate(run_ds18b20, "run_ds18b20", configMINIMAL_STACK_SIZE * 5, settings, 5, NULL);
+    // Start the temperature reading task
+    ds18b20_stop_requested = false;
+    if (task_config_create(TASK_DS18B20, run_ds18b20, NULL, &ds18b20_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create DS18B20 task");
+        ds18b20_task_handle = NULL;
+        release_ds18b20_bus();
+    }
+}
+
+void stop_ds18b20(void) {
+    if (ds18b20_task_handle != NULL) {
+        ds18b20_stop_requested = true;
+        xTaskNotifyGive(ds18b20_task_handle);
+        xSemaphoreTake(ds18b20_stopped, portMAX_DELAY);
+        ds18b20_task_handle = NULL;
+        ESP_LOGI(TAG, "DS18B20 task stopped");
+    }
+    for (int i = 0; i < ds18b20_device_num; i++) {
+        sensors_update(ds18b20s[i].sensor_id_c, 0.0f, false);
+        if (ds18b20s[i].sensor_id_f >= 0) {
+            sensors_update(ds18b20s[i].sensor_id_f, 0.0f, false);
+        }
+    }
+    release_ds18b20_bus();
+}
+
+esp_err_t reconfigure_ds18b20(settings_t *settings) {
+    if (!ds18b20_initialized) {
+        return ESP_OK;
+    }
+    stop_ds18b20();
+    init_ds18b20(settings);
+    return ESP_OK;
 }
 
 int get_ds18b20_devices(ds18b20_info_t *devices, int max_devices) {
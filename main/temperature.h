@@ -4,6 +4,7 @@
 #include "settings.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <esp_err.h>
 
 #define EXAMPLE_ONEWIRE_MAX_DS18B20 5
 
@@ -14,6 +15,11 @@ typedef struct {
 } ds18b20_info_t;
 
 void init_ds18b20(settings_t *settings);
+// Stop polling and release the bus; sensors stay registered as unavailable
+void stop_ds18b20(void);
+// Search the bus again with new GPIOs, unless init_ds18b20 was never called.
+// Thermometers found again keep their sensor ids.
+esp_err_t reconfigure_ds18b20(settings_t *settings);
 int get_ds18b20_devices(ds18b20_info_t *devices, int max_devices);
 
 #endif // TEMPERATURE_H
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <esp_log.h>
+#include "tmpl.h"
+
+static const char *TAG = "tmpl";
+
+typedef struct {
+    tmpl_sink_fn sink;
+    void *sink_arg;
+    char *buf;
+    size_t size;
+    size_t len;
+    esp_err_t err;
+} tmpl_out_t;
+
+static void out_flush(tmpl_out_t *out) {
+    if (out->len > 0 && out->err == ESP_OK) {
+        out->err = out->sink(out->sink_arg, out->buf, out->len);
+    }
+    out->len = 0;
+}
+
+static void out_write(tmpl_out_t *out, const char *data, size_t len) {
+    if (len > out->size - out->len) {
+        out_flush(out);
+        // Long literals go to the sink directly instead of through the buffer
+        if (len >= out->size / 2) {
+            if (out->err == ESP_OK) {
+                out->err = out->sink(out->sink_arg, data, len);
+            }
+            return;
+        }
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+static void out_escaped(tmpl_out_t *out, const char *s) {
+    while (*s) {
+        size_t plain = strcspn(s, "&<>\"'");
+        out_write(out, s, plain);
+        s += plain;
+        const char *rep;
+        switch (*s) {
+        case '&':  rep = "&amp;"; break;
+        case '<':  rep = "&lt;"; break;
+        case '>':  rep = "&gt;"; break;
+        case '"':  rep = "&quot;"; break;
+        case '\'': rep = "&#39;"; break;
+        default:   return;
+        }
+        out_write(out, rep, strlen(rep));
+        s++;
+    }
+}
+
+static bool value_true(const tmpl_value_t *v) {
+    switch (v->type) {
+    case TMPL_STR:   return v->s != NULL && v->s[0] != '\0';
+    case TMPL_INT:   return v->i != 0;
+    case TMPL_UINT:  return v->u != 0;
+    case TMPL_FLOAT: return v->f != 0;
+    case TMPL_BOOL:  return v->b;
+    }
+    return false;
+}
+
+static bool value_equals(const tmpl_value_t *v, int32_t n) {
+    switch (v->type) {
+    case TMPL_INT:   return v->i == n;
+    case TMPL_UINT:  return n >= 0 && v->u == (uint32_t)n;
+    case TMPL_BOOL:  return v->b == (n != 0);
+    default:         return false;
+    }
+}
+
+static void out_value(tmpl_out_t *out, const tmpl_op_t *op, const tmpl_value_t *v) {
+    char num[32];
+    int n = 0;
+
+    switch (op->filter) {
+    case TMPL_FILTER_CHECKED:
+        if (value_true(v)) out_write(out, " checked", 8);
+        return;
+    case TMPL_FILTER_SELECTED:
+        if (value_true(v)) out_write(out, " selected", 9);
+        return;
+    case TMPL_FILTER_SELECTED_EQ:
+        if (value_equals(v, (int16_t)op->off)) out_write(out, " selected", 9);
+        return;
+    default:
+        break;
+    }
+
+    switch (v->type) {
+    case TMPL_STR:
+        if (v->s == NULL) {
+            return;
+        }
+        if (op->filter == TMPL_FILTER_RAW) {
+            out_write(out, v->s, strlen(v->s));
+        } else {
+            out_escaped(out, v->s);
+        }
+        return;
+    case TMPL_INT:
+        n = snprintf(num, sizeof(num), "%" PRId32, v->i);
+        break;
+    case TMPL_UINT:
+        n = snprintf(num, sizeof(num), "%" PRIu32, v->u);
+        break;
+    case TMPL_FLOAT:
+        n = snprintf(num, sizeof(num), "%.*f", v->precision, v->f);
+        break;
+    case TMPL_BOOL:
+        n = snprintf(num, sizeof(num), "%d", v->b ? 1 : 0);
+        break;
+    }
+    if (n > 0) {
+        out_write(out, num, n < (int)sizeof(num) ? (size_t)n : sizeof(num) - 1);
+    }
+}
+
+// Numbers repeat a section, anything else makes it conditional
+static bool section_repeats(const tmpl_value_t *v) {
+    return v->type == TMPL_INT || v->type == TMPL_UINT;
+}
+
+static size_t section_count(const tmpl_value_t *v) {
+    switch (v->type) {
+    case TMPL_INT:   return v->i > 0 ? (size_t)v->i : 0;
+    case TMPL_UINT:  return v->u;
+    default:         return value_true(v) ? 1 : 0;
+    }
+}
+
+esp_err_t tmpl_render(const tmpl_t *tmpl, tmpl_value_fn value, void *ctx,
+                      tmpl_sink_fn sink, void *sink_arg,
+                      char *scratch, size_t scratch_size) {
+    tmpl_out_t out = {
+        .sink = sink,
+        .sink_arg = sink_arg,
+        .buf = scratch,
+        .size = scratch_size,
+    };
+    struct {
+        size_t count;
+        bool repeats;
+    } stack[TMPL_MAX_DEPTH];
+    int depth = 0;
+    // Iteration of each enclosing repeated section, innermost first
+    size_t index[TMPL_MAX_DEPTH + 1] = { 0 };
+
+    for (size_t pc = 0; pc < tmpl->op_count && out.err == ESP_OK; pc++) {
+        const tmpl_op_t *op = &tmpl->ops[pc];
+        tmpl_value_t v;
+
+        switch (op->op) {
+        case TMPL_OP_TEXT:
+            out_write(&out, tmpl->text + op->off, op->len);
+            break;
+        case TMPL_OP_VALUE:
+            if (value(ctx, op->id, index, &v)) {
+                out_value(&out, op, &v);
+            }
+            break;
+        case TMPL_OP_SECTION: {
+            size_t count = value(ctx, op->id, index, &v) ? section_count(&v) : 0;
+            if (count == 0) {
+                pc += op->len;
+                break;
+            }
+            if (depth == TMPL_MAX_DEPTH) {
+                ESP_LOGE(TAG, "%s: sections nested too deep", tmpl->name);
+                out.err = ESP_ERR_INVALID_STATE;
+                break;
+            }
+            stack[depth].count = count;
+            stack[depth].repeats = section_repeats(&v);
+            if (stack[depth].repeats) {
+                memmove(&index[1], &index[0], TMPL_MAX_DEPTH * sizeof(index[0]));
+                index[0] = 0;
+            }
+            depth++;
+            break;
+        }
+        case TMPL_OP_END:
+            if (depth == 0) {
+                break;
+            }
+            if (!stack[depth - 1].repeats) {
+                depth--;
+            } else if (++index[0] < stack[depth - 1].count) {
+                pc = op->off;
+            } else {
+                memmove(&index[0], &index[1], TMPL_MAX_DEPTH * sizeof(index[0]));
+                index[TMPL_MAX_DEPTH] = 0;
+                depth--;
+            }
+            break;
+        }
+    }
+
+    out_flush(&out);
+    return out.err;
+}
@@ -0,0 +1,112 @@
+#ifndef TMPL_H
+#define TMPL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// Streaming HTML templates.
+//
+// tools/tmpl_compile.py turns a template such as main/www/settings.html into
+// an op list at build time: literal spans of a single string constant, typed
+// placeholders and repeated sections. tmpl_render() walks the ops and writes
+// through a sink using a scratch buffer supplied by the caller, so rendering
+// allocates nothing.
+//
+// Template syntax:
+//   {{name}}              value, HTML-escaped (safe in text and quoted attributes)
+//   {{name|raw}}          value as is, for trusted markup and URLs only
+//   {{name|checked}}      " checked" if the value is non-zero
+//   {{name|selected}}     " selected" if the value is non-zero
+//   {{name|selected=N}}   " selected" if the value equals N
+//   {{#name}} ... {{/name}}
+//                         a numeric value repeats the body that many times (0
+//                         skips it) and placeholders inside are resolved with
+//                         the iteration index; any other value renders the
+//                         body once if it is true or non-empty, leaving the
+//                         indexes of enclosing sections as they are
+//
+// The compiler also writes a header with one <TEMPLATE>_<NAME> id per
+// placeholder for the resolver to switch on.
+
+typedef enum {
+    TMPL_OP_TEXT,           // off/len: span of tmpl_t.text
+    TMPL_OP_VALUE,          // id, filter; off: the N of "selected=N"
+    TMPL_OP_SECTION,        // id; len: number of ops up to the matching END
+    TMPL_OP_END,            // id; off: index of the matching SECTION
+} tmpl_opcode_t;
+
+typedef enum {
+    TMPL_FILTER_HTML,
+    TMPL_FILTER_RAW,
+    TMPL_FILTER_CHECKED,
+    TMPL_FILTER_SELECTED,
+    TMPL_FILTER_SELECTED_EQ,
+} tmpl_filter_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t filter;
+    uint16_t id;
+    uint16_t off;
+    uint16_t len;
+} tmpl_op_t;
+
+typedef struct {
+    const char *name;
+    const char *text;
+    const tmpl_op_t *ops;
+    uint16_t op_count;
+} tmpl_t;
+
+typedef enum {
+    TMPL_STR,
+    TMPL_INT,
+    TMPL_UINT,
+    TMPL_FLOAT,
+    TMPL_BOOL,
+} tmpl_type_t;
+
+typedef struct {
+    tmpl_type_t type;
+    uint8_t precision;      // Digits after the point for TMPL_FLOAT
+    union {
+        const char *s;      // NULL renders as ""
+        int32_t i;
+        uint32_t u;
+        double f;
+        bool b;
+    };
+} tmpl_value_t;
+
+#define TMPL_MAX_DEPTH 4
+
+/**
+ * @brief Looks up placeholder id. index[0] is the iteration of the innermost
+ *        repeated section, index[1] that of the one around it and so on, 0
+ *        where there is none. Sections are asked for their value the same
+ *        way. A TMPL_STR only has to stay valid until the next call.
+ *
+ * @return false if id is unknown; the placeholder renders as nothing
+ */
+typedef bool (*tmpl_value_fn)(void *ctx, uint16_t id, const size_t *index, tmpl_value_t *out);
+
+/**
+ * @brief Receives rendered output in pieces of at most the scratch size, or
+ *        whole literal spans that are too long to be worth copying.
+ */
+typedef esp_err_t (*tmpl_sink_fn)(void *arg, const char *data, size_t len);
+
+/**
+ * @brief Render a compiled template
+ *
+ * @param scratch Output is batched here before it goes to the sink
+ * @return ESP_OK, the first sink error, or ESP_ERR_INVALID_STATE if sections
+ *         nest deeper than TMPL_MAX_DEPTH
+ */
+esp_err_t tmpl_render(const tmpl_t *tmpl, tmpl_value_fn value, void *ctx,
+                      tmpl_sink_fn sink, void *sink_arg,
+                      char *scratch, size_t scratch_size);
+
+#endif // TMPL_H
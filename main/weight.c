@@ -3,6 +3,7 @@
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 #include <hx711.h>
 #include <string.h>
 #include <esp_ota_ops.h>
@@ -10,8 +11,10 @@
 #include "IQmathLib.h"
 
 #include "weight.h"
+#include "weight_filter.h"
 #include "sensors.h"
 #include "settings.h"
+#include "task_config.h"
 
 static const char *TAG = "hx711";
 
@@ -20,26 +23,27 @@ static int32_t g_latest_weight_raw = 0;
 static float g_latest_weight_grams = 0;
 static bool g_weight_available = false;
 
-// Sensor IDs for registered weight sensors
+// Sensor IDs for registered weight sensors; kept when the task is
+// restarted with new GPIOs
 static int sensor_id_grams = -1;
 static int sensor_id_lbs = -1;
 
+// The reading task is asked to stop rather than deleted, so it never goes
+// away inside a settings snapshot or halfway through a read
+static bool weight_initialized = false;
+static hx711_t weight_dev;
+static TaskHandle_t weight_task_handle = NULL;
+static SemaphoreHandle_t weight_stopped = NULL;
+static volatile bool weight_stop_requested = false;
+
 static void weight(void *pvParameters)
 {
-    settings_t *settings = (settings_t *)pvParameters;
-    hx711_t dev =
-    {
-        .dout = settings->weight_dt_gpio,
-        .pd_sck = settings->weight_sck_gpio,
-        .gain = HX711_GAIN_A_64
-    };
-
-    // initialize device
-    ESP_ERROR_CHECK(hx711_init(&dev));
+    hx711_t dev = weight_dev;
 
     // read from device
-    while (1)
+    while (!weight_stop_requested)
     {
+        task_loop_mark(TASK_WEIGHT);
         esp_err_t r = hx711_wait(&dev, 500);
         if (r != ESP_OK)
         {
@@ -74,40 +78,18 @@ static void weight(void *pvParameters)
             continue;
         }
         
-        // Sort readings to find median
-        for (int i = 0; i < CONFIG_WEIGHT_SAMPLE_TIMES - 1; i++)
-        {
-            for (int j = 0; j < CONFIG_WEIGHT_SAMPLE_TIMES - i - 1; j++)
-            {
-                if (readings[j] > readings[j + 1])
-                {
-                    int32_t temp = readings[j];
-                    readings[j] = readings[j + 1];
-                    readings[j + 1] = temp;
-                }
-            }
-        }
-        
-        // Get median value
-        int32_t data;
-        if (CONFIG_WEIGHT_SAMPLE_TIMES % 2 == 0)
-        {
-            // Even number of samples - average the two middle values
-            data = (readings[CONFIG_WEIGHT_SAMPLE_TIMES / 2 - 1] + readings[CONFIG_WEIGHT_SAMPLE_TIMES / 2]) / 2;
-        }
-        else
-        {
-            // Odd number of samples - take the middle value
-            data = readings[CONFIG_WEIGHT_SAMPLE_TIMES / 2];
-        }
+        int32_t data = weight_filter_median(readings, CONFIG_WEIGHT_SAMPLE_TIMES);
 
         ESP_LOGI(TAG, "Raw data: %" PRIi32, data);
 
         // Store the latest weight reading
         g_latest_weight_raw = data;
-        // Convert raw int32_t to float, multiply by scale (float), subtract tare
-        float data_float = (float)(g_latest_weight_raw - settings->weight_tare);
-        g_latest_weight_grams = data_float * _IQ16toF(settings->weight_scale);
+        // Tare and scale from one snapshot, so a calibration save is seen whole
+        settings_read_t read;
+        const settings_t *calibration = settings_snapshot_acquire(&read);
+        g_latest_weight_grams = weight_filter_grams(g_latest_weight_raw, calibration->weight_tare,
+                                                    calibration->weight_scale);
+        settings_snapshot_release(read);
         g_weight_available = true;
         
         // Update sensor values if registered
@@ -122,8 +104,12 @@ static void weight(void *pvParameters)
             sensors_update(sensor_id_lbs, lbs, true);
         }
 
-        vTaskDelay(pdMS_TO_TICKS(500));
+        // Woken early by weight_stop
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(500));
     }
+
+    xSemaphoreGive(weight_stopped);
+    vTaskDelete(NULL);
 }
 
 float weight_get_latest(bool *available) {
@@ -142,14 +128,74 @@ uint32_t weight_get_latest_raw(bool *available) {
 
 void weight_init(settings_t *settings)
 {
+    weight_initialized = true;
     if (settings->weight_dt_gpio < 0 || settings->weight_sck_gpio < 0) {
         ESP_LOGW(TAG, "Weight HX711 GPIOs not configured, skipping weight initialization");
         return;
     }
+
+    weight_dev = (hx711_t) {
+        .dout = settings->weight_dt_gpio,
+        .pd_sck = settings->weight_sck_gpio,
+        .gain = HX711_GAIN_A_64
+    };
+    esp_err_t err = hx711_init(&weight_dev);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) initializing HX711 on DOUT GPIO %d, SCK GPIO %d", esp_err_to_name(err),
+                 settings->weight_dt_gpio, settings->weight_sck_gpio);
+        return;
+    }
+
+    if (weight_stopped == NULL) {
+        weight_stopped = xSemaphoreCreateBinary();
+        if (weight_stopped == NULL) {
+            ESP_LOGE(TAG, "Failed to create weight stop semaphore");
+            return;
+        }
+    }
+
     // Register weight sensors
-    sensor_id_grams = sensors_register("Weight", "g", "weight_grams", NULL, NULL);
-    sensor_id_lbs = sensors_register("Weight", "lbs", NULL, NULL, NULL);
+    if (sensor_id_grams < 0) {
+        sensor_id_grams = sensors_register("Weight", "g", "weight_grams", NULL, NULL);
+    }
+    if (sensor_id_lbs < 0) {
+        sensor_id_lbs = sensors_register("Weight", "lbs", NULL, NULL, NULL);
+    }
     
     // Start the weight reading task
-    xTaskCreate(weight, "weight", configMINIMAL_STACK_SIZE * 5, settings, 5, NULL);
-}
\ No newline at end of file
+    weight_stop_requested = false;
+    if (task_config_create(TASK_WEIGHT, weight, NULL, &weight_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create weight task");
+        weight_task_handle = NULL;
+    }
+}
+
+void weight_stop(void)
+{
+    if (weight_task_handle == NULL) {
+        return;
+    }
+    weight_stop_requested = true;
+    xTaskNotifyGive(weight_task_handle);
+    xSemaphoreTake(weight_stopped, portMAX_DELAY);
+    weight_task_handle = NULL;
+
+    g_weight_available = false;
+    if (sensor_id_grams >= 0) {
+        sensors_update(sensor_id_grams, 0.0f, false);
+    }
+    if (sensor_id_lbs >= 0) {
+        sensors_update(sensor_id_lbs, 0.0f, false);
+    }
+    ESP_LOGI(TAG, "Weight task stopped");
+}
+
+esp_err_t weight_reconfigure(settings_t *settings)
+{
+    if (!weight_initialized) {
+        return ESP_OK;
+    }
+    weight_stop();
+    weight_init(settings);
+    return ESP_OK;
+}
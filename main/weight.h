@@ -2,11 +2,16 @@
 #define WEIGHT_H
 
 #include "settings.h"
+#include <esp_err.h>
 #include <esp_http_server.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 void weight_init(settings_t *settings);
+// Stop reading; the sensors stay registered and show as unavailable
+void weight_stop(void);
+// Restart reading with new GPIOs, unless weight_init was never called
+esp_err_t weight_reconfigure(settings_t *settings);
 float weight_get_latest(bool *available);
 uint32_t weight_get_latest_raw(bool *available);
 
@@ -0,0 +1,32 @@
+#include "weight_filter.h"
+
+int32_t weight_filter_median(int32_t *samples, size_t count)
+{
+    // Insertion sort; there are only a handful of samples
+    for (size_t i = 1; i < count; i++)
+    {
+        int32_t v = samples[i];
+        size_t j = i;
+        while (j > 0 && samples[j - 1] > v)
+        {
+            samples[j] = samples[j - 1];
+            j--;
+        }
+        samples[j] = v;
+    }
+
+    if (count % 2 == 0)
+    {
+        // Even number of samples - average the two middle values
+        return (int32_t)(((int64_t)samples[count / 2 - 1] + samples[count / 2]) / 2);
+    }
+    // Odd number of samples - take the middle value
+    return samples[count / 2];
+}
+
+float weight_filter_grams(int32_t raw, int32_t tare, _iq16 scale)
+{
+    // Convert raw int32_t to float, multiply by scale (float), subtract tare
+    float data_float = (float)(raw - tare);
+    return data_float * _IQ16toF(scale);
+}
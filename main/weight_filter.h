@@ -0,0 +1,24 @@
+#ifndef WEIGHT_FILTER_H
+#define WEIGHT_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "IQmathLib.h"
+
+// Turns raw HX711 samples into a weight. No hardware access, so it builds
+// on the host as well.
+
+/**
+ * @brief Median of count samples; the two middle values are averaged when
+ *        count is even
+ *
+ * Sorts samples in place.
+ */
+int32_t weight_filter_median(int32_t *samples, size_t count);
+
+/**
+ * @brief Convert a raw reading to grams with the calibration from settings
+ */
+float weight_filter_grams(int32_t raw, int32_t tare, _iq16 scale);
+
+#endif // WEIGHT_FILTER_H
@@ -164,7 +164,6 @@ static EventGroupHandle_t s_wifi_event_group;
 static void event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
 {
-    settings_t *settings = (settings_t *)arg;
     if (event_base == WIFI_EVENT) {
         if (event_id == WIFI_EVENT_AP_STACONNECTED) {
             wifi_event_ap_staconnected_t *event = (wifi_event_ap_staconnected_t *) event_data;
@@ -183,7 +182,10 @@ static void event_handler(void* arg, esp_event_base_t event_base,
                 ESP_LOGI(TAG, "retry to connect to the AP");
             } else {
                 xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-                if (!ap_active && !settings->wifi_ap_fallback_disable) {
+                settings_read_t read;
+                bool fallback_disable = settings_snapshot_acquire(&read)->wifi_ap_fallback_disable;
+                settings_snapshot_release(read);
+                if (!ap_active && !fallback_disable) {
                     esp_err_t err = esp_wifi_set_mode(WIFI_MODE_APSTA);
                     if (err != ESP_OK) {
                         ESP_LOGE(TAG, "Failed to set WiFi mode to APSTA: %s", esp_err_to_name(err));
@@ -290,12 +292,12 @@ void wifi_init(settings_t *settings)
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
                                                         ESP_EVENT_ANY_ID,
                                                         &event_handler,
-                                                        settings,
+                                                        NULL,
                                                         &instance_any_id));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
                                                         IP_EVENT_STA_GOT_IP,
                                                         &event_handler,
-                                                        settings,
+                                                        NULL,
                                                         &instance_got_ip));
 
 
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "www.h"
+#include "http_stats.h"
+
+static const char *TAG = "www";
+
+// Symbols generated by target_add_binary_data() in main/CMakeLists.txt
+#define WWW_EMBED(name)                                                     \
+    extern const uint8_t name##_gz_start[] asm("_binary_" #name "_gz_start"); \
+    extern const uint8_t name##_gz_end[] asm("_binary_" #name "_gz_end");
+
+WWW_EMBED(index_html)
+WWW_EMBED(settings_css)
+WWW_EMBED(settings_js)
+WWW_EMBED(bthome_css)
+
+#define CACHE_REVALIDATE "no-cache"
+#define CACHE_IMMUTABLE  "public, max-age=31536000, immutable"
+
+typedef struct {
+    const char *path;
+    const char *type;
+    const char *cache_control;
+    const uint8_t *start;
+    const uint8_t *end;
+    char etag[19];                  // Quoted 64-bit hex hash of the gzipped bytes
+    char url[64];                   // path?v=<hash>
+    httpd_uri_t uri;
+} www_asset_t;
+
+static www_asset_t assets[] = {
+    { "/", "text/html", CACHE_REVALIDATE, index_html_gz_start, index_html_gz_end },
+    { "/static/settings.css", "text/css", CACHE_IMMUTABLE, settings_css_gz_start, settings_css_gz_end },
+    { "/static/settings.js", "application/javascript", CACHE_IMMUTABLE, settings_js_gz_start, settings_js_gz_end },
+    { "/static/bthome.css", "text/css", CACHE_IMMUTABLE, bthome_css_gz_start, bthome_css_gz_end },
+};
+
+#define ASSET_COUNT (sizeof(assets) / sizeof(assets[0]))
+
+// FNV-1a, 64-bit
+static uint64_t asset_hash(const uint8_t *data, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static esp_err_t www_asset_handler(httpd_req_t *req) {
+    const www_asset_t *asset = (const www_asset_t *)req->user_ctx;
+
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", asset->cache_control);
+
+    char if_none_match[sizeof(asset->etag) + 8];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, asset->etag) != NULL) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    // Sent directly from the flash mapping; nothing is copied to RAM
+    return httpd_resp_send(req, (const char *)asset->start, asset->end - asset->start);
+}
+
+const char *www_asset_url(const char *path) {
+    for (size_t i = 0; i < ASSET_COUNT; i++) {
+        if (strcmp(assets[i].path, path) == 0) {
+            return assets[i].url[0] != '\0' ? assets[i].url : path;
+        }
+    }
+    return path;
+}
+
+esp_err_t www_init(httpd_handle_t server) {
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < ASSET_COUNT; i++) {
+        www_asset_t *asset = &assets[i];
+        uint64_t hash = asset_hash(asset->start, asset->end - asset->start);
+        snprintf(asset->etag, sizeof(asset->etag), "\"%016" PRIx64 "\"", hash);
+        snprintf(asset->url, sizeof(asset->url), "%s?v=%016" PRIx64, asset->path, hash);
+
+        asset->uri.uri = asset->path;
+        asset->uri.method = HTTP_GET;
+        asset->uri.handler = www_asset_handler;
+        asset->uri.user_ctx = asset;
+        esp_err_t err = httpd_register_uri_handler_timed(server, &asset->uri);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error (%s) registering %s!", esp_err_to_name(err), asset->path);
+            ret = err;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,29 @@
+#ifndef WWW_H
+#define WWW_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+// Static web assets from main/www, gzipped at build time and embedded in the
+// firmware. They are sent straight from flash with Content-Encoding: gzip and
+// a strong ETag; a matching If-None-Match gets 304 Not Modified.
+//
+// "/" is revalidated on every load. Files under /static/ are cached for a
+// year, so pages must reference them through www_asset_url(), which adds the
+// ETag as a version query.
+
+/**
+ * @brief Register the asset handlers
+ */
+esp_err_t www_init(httpd_handle_t server);
+
+/**
+ * @brief URL of a static asset including its version, e.g.
+ *        "/static/settings.css?v=0123456789abcdef"
+ *
+ * @param path Asset path as registered, e.g. "/static/settings.css"
+ * @return The versioned URL, or path itself if it is not an asset
+ */
+const char *www_asset_url(const char *path);
+
+#endif // WWW_H
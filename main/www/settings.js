@@ -0,0 +1,106 @@
+// Settings page behaviour. Loaded at the end of the page.
+// Row indexes continue after the rows rendered by the server.
+var ds18b20NameIndex = null;
+function addDS18B20Name() {
+  if (ds18b20NameIndex === null) ds18b20NameIndex = document.querySelectorAll('.ds18b20_name_row').length;
+  var container = document.getElementById('ds18b20_names_container');
+  var div = document.createElement('div');
+  div.className = 'ds18b20_name_row';
+  div.style = 'margin: 10px 0; padding: 10px; background: #fff; border: 1px solid #ddd; border-radius: 4px;';
+  div.innerHTML = `
+    <input type='text' name='ds18b20_name[${ds18b20NameIndex}][address]' placeholder='Device Address (hex)' style='width: 180px;' pattern='[0-9a-fA-F]{16}' title='16-character hex address'>
+    <input type='text' name='ds18b20_name[${ds18b20NameIndex}][name]' placeholder='Device Name' style='width: 250px;'>
+    <button type='button' onclick='this.parentElement.remove()' style='width: auto; padding: 5px 10px; background: #dc3545; margin-left: 10px;'>Remove</button>
+  `;
+  container.appendChild(div);
+  ds18b20NameIndex++;
+}
+var macFilterIndex = null;
+function addMacFilter() {
+  if (macFilterIndex === null) macFilterIndex = document.querySelectorAll('.mac_filter_row').length;
+  var container = document.getElementById('mac_filters_container');
+  var div = document.createElement('div');
+  div.className = 'mac_filter_row';
+  div.style = 'margin: 10px 0; padding: 10px; background: #fff; border: 1px solid #ddd; border-radius: 4px;';
+  div.innerHTML = `
+    <input type='text' name='mac_filter[${macFilterIndex}][mac]' placeholder='xx:xx:xx:xx:xx:xx' style='width: 180px;' pattern='[0-9a-fA-F]{2}:[0-9a-fA-F]{2}:[0-9a-fA-F]{2}:[0-9a-fA-F]{2}:[0-9a-fA-F]{2}:[0-9a-fA-F]{2}' title='MAC address format: xx:xx:xx:xx:xx:xx'>
+    <input type='text' name='mac_filter[${macFilterIndex}][name]' placeholder='Device Name' style='width: 200px;'>
+    <input type='password' name='mac_filter[${macFilterIndex}][key]' placeholder='Bindkey (encrypted devices)' style='width: 260px;' pattern='[0-9a-fA-F]{32}' title='32 hex characters'>
+    <label style='display: inline;'><input type='checkbox' name='mac_filter[${macFilterIndex}][enabled]' value='1' checked> Enabled</label>
+    <button type='button' onclick='this.parentElement.remove()' style='width: auto; padding: 5px 10px; background: #dc3545; margin-left: 10px;'>Remove</button>
+  `;
+  container.appendChild(div);
+  macFilterIndex++;
+}
+document.getElementById('settingsForm').addEventListener('submit', function(e) {
+  e.preventDefault();
+  window.scrollTo(0, 0);
+  var formData = new FormData(this);
+  var params = new URLSearchParams();
+  // Handle BTHome objects multi-select
+  var select = document.getElementById('bthome_objects');
+  var selectedOptions = Array.from(select.selectedOptions);
+  params.append('bthome_objects_count', selectedOptions.length);
+  for (var i = 0; i < selectedOptions.length; i++) {
+    params.append('bthome_objects[' + i + ']', selectedOptions[i].value);
+  }
+  // Count MAC filters
+  var macFilterCount = 0;
+  var macInputs = document.querySelectorAll('input[name^="mac_filter["][name$="[mac]"]');
+  macInputs.forEach(function(input) {
+    if (input.value) macFilterCount++;
+  });
+  params.append('mac_filter_count', macFilterCount);
+  // Count DS18B20 names
+  var ds18b20NameCount = 0;
+  var ds18b20Inputs = document.querySelectorAll('input[name^="ds18b20_name["][name$="[address]"]');
+  ds18b20Inputs.forEach(function(input) {
+    if (input.value) ds18b20NameCount++;
+  });
+  params.append('ds18b20_name_count', ds18b20NameCount);
+  // Fields that should be sent even when empty (to allow clearing)
+  var allowEmptyFields = ['syslog_server', 'mqtt_broker_url', 'mqtt_username', 'mqtt_password'];
+  // Process all other form fields
+  for (var pair of formData.entries()) {
+    if (pair[1]) {
+      // Skip bthome_objects (already handled above)
+      if (pair[0] === 'bthome_objects') {
+        continue;
+      }
+      params.append(pair[0], pair[1]);
+    } else if (pair[0].startsWith('mac_filter[') && pair[0].includes('[mac]')) {
+      // Include MAC filter fields even if empty for proper indexing
+      params.append(pair[0], pair[1]);
+    } else if (allowEmptyFields.includes(pair[0])) {
+      // Include these fields even if empty to allow clearing them
+      params.append(pair[0], pair[1]);
+    }
+  }
+  fetch('/settings', {
+    method: 'POST',
+    headers: {
+      'Content-Type': 'application/x-www-form-urlencoded'
+    },
+    body: params.toString()
+  })
+    .then(response => {
+      var msg = document.getElementById('message');
+      if (response.ok) {
+        msg.className = 'message success';
+        msg.textContent = 'Settings updated successfully!';
+        msg.style.display = 'block';
+      } else {
+        return response.text().then(text => {
+          msg.className = 'message error';
+          msg.textContent = 'Error: ' + text;
+          msg.style.display = 'block';
+        });
+      }
+    })
+    .catch(error => {
+      var msg = document.getElementById('message');
+      msg.className = 'message error';
+      msg.textContent = 'Network error: ' + error;
+      msg.style.display = 'block';
+    });
+});
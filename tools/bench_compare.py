@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""Compare two runs of host/bench and flag regressions.
+
+usage: bench_compare.py [--threshold PCT] <baseline.json> <current.json>
+
+A case regresses when its time per operation grows by more than PCT percent
+(default 10) or it makes more allocations per operation than before. Exits
+with 1 if any case regressed, so it can gate a commit.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        doc = json.load(f)
+    return doc.get("label", ""), {r["name"]: r for r in doc["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed slowdown in percent")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    args = parser.parse_args()
+
+    base_label, base = load(args.baseline)
+    cur_label, cur = load(args.current)
+    print(f"{base_label or args.baseline} -> {cur_label or args.current}")
+    print(f"{'case':<24} {'base us/op':>12} {'us/op':>12} {'change':>8} {'base allocs':>11} {'allocs':>10}")
+
+    regressed = []
+    for name, c in cur.items():
+        b = base.get(name)
+        if b is None:
+            print(f"{name:<24} {'':>12} {c['us_per_op']:>12.3f} {'new':>8}")
+            continue
+        change = (c["us_per_op"] / b["us_per_op"] - 1) * 100 if b["us_per_op"] > 0 else 0.0
+        flags = []
+        if change > args.threshold:
+            flags.append("slower")
+        if c["allocs_per_op"] > b["allocs_per_op"] + 0.005:
+            flags.append("more allocs")
+        if flags:
+            regressed.append(name)
+        print(f"{name:<24} {b['us_per_op']:>12.3f} {c['us_per_op']:>12.3f} {change:>+7.1f}% "
+              f"{b['allocs_per_op']:>11.2f} {c['allocs_per_op']:>10.2f}  {', '.join(flags)}")
+    for name in base.keys() - cur.keys():
+        print(f"{name:<24} {base[name]['us_per_op']:>12.3f} {'':>12} {'gone':>8}")
+
+    if regressed:
+        print(f"{len(regressed)} regression(s): {', '.join(regressed)}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
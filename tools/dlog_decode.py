@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Decode a deferred log dump from GET /debug/dlog.
+
+Records hold the addresses of their tag and format strings; this resolves
+them from the firmware ELF that produced the dump.
+
+    curl -u user:pass http://device/debug/dlog -o dlog.bin
+    tools/dlog_decode.py build/bthome-weight-station.elf dlog.bin
+
+Requires pyelftools (pip install pyelftools).
+"""
+
+import argparse
+import hashlib
+import re
+import struct
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+HEADER = struct.Struct("<IIIBBBB")  # dlog_header_t
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D", 5: "V"}
+SPEC = re.compile(r"%([-+ #0]*)(\d*)(?:\.(\d+))?(?:hh|h|ll|l|L|q|j|z|t)?([diuxXocfFeEgGaAsp%])")
+
+
+class Strings:
+    """Reads NUL-terminated strings from the ELF's allocated sections."""
+
+    def __init__(self, elf):
+        self.sections = []
+        for section in elf.iter_sections():
+            if section["sh_addr"] and section["sh_type"] == "SHT_PROGBITS":
+                self.sections.append((section["sh_addr"], section.data()))
+
+    def get(self, addr):
+        for base, data in self.sections:
+            if base <= addr < base + len(data):
+                end = data.find(b"\0", addr - base)
+                return data[addr - base:end].decode("utf-8", "replace")
+        return "<0x%08x?>" % addr
+
+
+def parse_args(data, nargs):
+    args, pos = [], 0
+    for _ in range(nargs):
+        kind = chr(data[pos])
+        pos += 1
+        if kind in "iufp":
+            fmt = {"i": "<i", "u": "<I", "f": "<f", "p": "<I"}[kind]
+            args.append((kind, struct.unpack_from(fmt, data, pos)[0]))
+            pos += 4
+        elif kind in "lLd":
+            fmt = {"l": "<q", "L": "<Q", "d": "<d"}[kind]
+            args.append((kind, struct.unpack_from(fmt, data, pos)[0]))
+            pos += 8
+        elif kind == "s":
+            length = data[pos]
+            args.append((kind, data[pos + 1:pos + 1 + length].decode("utf-8", "replace")))
+            pos += 1 + length
+        elif kind == "m":
+            args.append((kind, ":".join("%02X" % b for b in data[pos:pos + 6])))
+            pos += 6
+        else:
+            break
+    return args
+
+
+def format_message(fmt, args, truncated):
+    args = iter(args)
+
+    def convert(match):
+        flags, width, precision, conv = match.groups()
+        if conv == "%":
+            return "%"
+        arg = next(args, None)
+        if arg is None:
+            return "<truncated>" if truncated else "<?>"
+        kind, value = arg
+        if conv == "p":
+            return "0x%08x" % value
+        if conv == "s" and kind not in "sm":
+            return "<%s>" % kind
+        if conv in "diuxXoc" and kind in "fd":
+            value = int(value)
+        if conv in "diu":
+            conv = "d"
+        spec = "%" + flags + width + ("." + precision if precision else "") + conv
+        return spec % value
+
+    return SPEC.sub(convert, fmt)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf", help="firmware ELF matching the device")
+    parser.add_argument("dump", help="output of GET /debug/dlog")
+    opts = parser.parse_args()
+
+    with open(opts.dump, "rb") as f:
+        dump = f.read()
+    text_end = dump.index(b"\n\n") + 2
+    meta = dict(line.split(" ", 1) for line in dump[:text_end].decode().split("\n") if " " in line)
+    if meta.get("DLOG") != "1":
+        sys.exit("not a dlog dump")
+
+    with open(opts.elf, "rb") as f:
+        elf_sha256 = hashlib.sha256(f.read()).hexdigest()
+        f.seek(0)
+        strings = Strings(ELFFile(f))
+    if not elf_sha256.startswith(meta.get("elf_sha256", "")):
+        print("warning: ELF does not match the firmware that wrote the dump", file=sys.stderr)
+
+    pos = text_end
+    while pos + 2 <= len(dump):
+        length = struct.unpack_from("<H", dump, pos)[0]
+        record = dump[pos + 2:pos + 2 + length]
+        pos += 2 + length
+        if len(record) < HEADER.size:
+            break
+        timestamp, tag, fmt, level, nargs, truncated, _ = HEADER.unpack_from(record)
+        args = parse_args(record[HEADER.size:], nargs)
+        message = format_message(strings.get(fmt), args, truncated)
+        print("%s (%d) %s: %s" % (LEVELS.get(level, "?"), timestamp, strings.get(tag), message))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,23 @@
+#!/usr/bin/env python3
+"""Gzip a web asset for embedding in the firmware (see main/CMakeLists.txt).
+
+The output does not depend on the input's name or mtime, so an unchanged
+asset gives the same bytes and the same ETag in every build.
+"""
+
+import gzip
+import sys
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: gzip_asset.py <input> <output.gz>")
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    with open(sys.argv[2], "wb") as out:
+        with gzip.GzipFile(filename="", mode="wb", fileobj=out, compresslevel=9, mtime=0) as gz:
+            gz.write(data)
+
+
+if __name__ == "__main__":
+    main()
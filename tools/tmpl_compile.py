@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Compile an HTML template into the op list rendered by main/tmpl.c.
+
+usage: tmpl_compile.py <template> <output.c> <output.h>
+
+For main/www/settings.html this writes settings_html.c, defining
+settings_html_tmpl, and settings_html.h with one SETTINGS_HTML_<NAME> id per
+placeholder. See main/tmpl.h for the template syntax.
+"""
+
+import os
+import re
+import sys
+
+TAG = re.compile(r"\{\{\s*([#/]?)([a-z0-9_]+)(?:\|([a-z]+)(?:=(-?\d+))?)?\s*\}\}")
+
+FILTERS = {
+    None: "TMPL_FILTER_HTML",
+    "raw": "TMPL_FILTER_RAW",
+    "checked": "TMPL_FILTER_CHECKED",
+    "selected": "TMPL_FILTER_SELECTED",
+}
+
+
+class TemplateError(Exception):
+    pass
+
+
+def line_of(src, pos):
+    return src.count("\n", 0, pos) + 1
+
+
+def compile_template(src):
+    """Return (text, ops, names); ops are (op, filter, name, off, len)."""
+    text = []
+    text_len = 0
+    ops = []
+    names = []
+    open_sections = []
+    pos = 0
+
+    def literal(s):
+        nonlocal text_len
+        if s:
+            n = len(s.encode())
+            text.append(s)
+            ops.append(["TMPL_OP_TEXT", "TMPL_FILTER_HTML", None, text_len, n])
+            text_len += n
+
+    def name_id(name):
+        if name not in names:
+            names.append(name)
+        return name
+
+    for m in TAG.finditer(src):
+        literal(src[pos:m.start()])
+        pos = m.end()
+        kind, name, filt, arg = m.groups()
+        where = "line %d" % line_of(src, m.start())
+        if kind == "#":
+            if filt:
+                raise TemplateError("%s: filter on section '%s'" % (where, name))
+            open_sections.append((name, len(ops), where))
+            ops.append(["TMPL_OP_SECTION", "TMPL_FILTER_HTML", name_id(name), 0, 0])
+        elif kind == "/":
+            if not open_sections or open_sections[-1][0] != name:
+                raise TemplateError("%s: unexpected {{/%s}}" % (where, name))
+            _, start, _ = open_sections.pop()
+            ops[start][4] = len(ops) - start
+            ops.append(["TMPL_OP_END", "TMPL_FILTER_HTML", name, start, 0])
+        else:
+            if filt not in FILTERS:
+                raise TemplateError("%s: unknown filter '%s'" % (where, filt))
+            if arg is not None and filt != "selected":
+                raise TemplateError("%s: '%s' takes no argument" % (where, filt))
+            off = 0
+            flt = FILTERS[filt]
+            if arg is not None:
+                n = int(arg)
+                if not -32768 <= n <= 32767:
+                    raise TemplateError("%s: argument %d out of range" % (where, n))
+                flt = "TMPL_FILTER_SELECTED_EQ"
+                off = n & 0xFFFF
+            ops.append(["TMPL_OP_VALUE", flt, name_id(name), off, 0])
+    literal(src[pos:])
+
+    if open_sections:
+        name, _, where = open_sections[-1]
+        raise TemplateError("%s: {{#%s}} is never closed" % (where, name))
+    if "{{" in "".join(text):
+        raise TemplateError("malformed placeholder near '%s'"
+                            % "".join(text).split("{{", 1)[1][:20])
+    text = "".join(text)
+    if len(text.encode()) > 0xFFFF or len(ops) > 0xFFFF:
+        raise TemplateError("template too large")
+    return text, ops, names
+
+
+def c_string(s, indent="    "):
+    out = []
+    for line in s.encode().splitlines(keepends=True):
+        esc = ""
+        for b in line:
+            c = chr(b)
+            if c == "\\":
+                esc += "\\\\"
+            elif c == '"':
+                esc += '\\"'
+            elif c == "\n":
+                esc += "\\n"
+            elif c == "\t":
+                esc += "\\t"
+            elif 32 <= b < 127:
+                esc += c
+            else:
+                # Octal keeps a following hex digit from joining the escape
+                esc += "\\%03o" % b
+        out.append('%s"%s"' % (indent, esc))
+    return "\n".join(out) if out else indent + '""'
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit("usage: tmpl_compile.py <template> <output.c> <output.h>")
+    src_path, c_path, h_path = sys.argv[1:]
+    with open(src_path, encoding="utf-8") as f:
+        src = f.read()
+    try:
+        text, ops, names = compile_template(src)
+    except TemplateError as e:
+        sys.exit("%s: %s" % (src_path, e))
+
+    base = re.sub(r"[^a-z0-9]+", "_", os.path.basename(src_path).lower())
+    prefix = base.upper()
+    guard = prefix + "_H"
+    ident = {name: "%s_%s" % (prefix, name.upper()) for name in names}
+    generated = "// Generated by tools/tmpl_compile.py from %s; do not edit.\n" % os.path.basename(src_path)
+
+    with open(h_path, "w") as h:
+        h.write(generated + "\n")
+        h.write("#ifndef %s\n#define %s\n\n#include \"tmpl.h\"\n\n" % (guard, guard))
+        h.write("enum {\n")
+        for name in names:
+            h.write("    %s,\n" % ident[name])
+        h.write("};\n\n")
+        h.write("extern const tmpl_t %s_tmpl;\n\n#endif // %s\n" % (base, guard))
+
+    with open(c_path, "w") as c:
+        c.write(generated + "\n")
+        c.write('#include "%s"\n\n' % os.path.basename(h_path))
+        c.write("static const char text[] =\n%s;\n\n" % c_string(text))
+        c.write("static const tmpl_op_t ops[] = {\n")
+        for op, flt, name, off, length in ops:
+            c.write("    { %s, %s, %s, %d, %d },\n"
+                    % (op, flt, ident[name] if name else "0", off, length))
+        c.write("};\n\n")
+        c.write("const tmpl_t %s_tmpl = {\n" % base)
+        c.write('    .name = "%s",\n' % os.path.basename(src_path))
+        c.write("    .text = text,\n")
+        c.write("    .ops = ops,\n")
+        c.write("    .op_count = sizeof(ops) / sizeof(ops[0]),\n")
+        c.write("};\n")
+
+
+if __name__ == "__main__":
+    main()